@@ -0,0 +1,38 @@
+// main_host.c - process entry point for the Linux host build
+//
+// On the device the IDF startup code calls app_main() from the main task and
+// the scheduler keeps running after it returns. Here the process calls it
+// once and then parks the main thread until SIGINT/SIGTERM.
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+void app_main(void);
+
+static const char *TAG = "HOST";
+
+static void handle_exit_signal(int signo)
+{
+    (void)signo;
+    _exit(0);
+}
+
+int main(void)
+{
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_exit_signal);
+    signal(SIGTERM, handle_exit_signal);
+
+    ESP_LOGI(TAG, "Starting gateway host build");
+    shim_task_adopt("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE, 1);
+    app_main();
+
+    while (1) {
+        pause();
+    }
+    return 0;
+}
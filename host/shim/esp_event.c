@@ -0,0 +1,252 @@
+// esp_event.c - default event loop with its own dispatch thread
+
+#include <pthread.h>
+#include "esp_event.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define EVENT_QUEUE_LEN 32
+
+typedef struct handler_node {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+    bool removed;
+    struct handler_node *next;
+} handler_node_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} posted_event_t;
+
+static const char *TAG = "event";
+
+// s_handler_lock guards the handler list and is held (recursively) while
+// handlers run; s_queue_lock only guards the queue so other threads can keep
+// posting while a handler blocks.
+static pthread_mutex_t s_handler_lock;
+static pthread_mutex_t s_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_not_empty;
+static pthread_cond_t s_not_full;
+static bool s_created;
+static handler_node_t *s_handlers;
+static posted_event_t s_queue[EVENT_QUEUE_LEN];
+static unsigned s_head;
+static unsigned s_count;
+static unsigned s_dispatch_depth;
+static pthread_t s_event_thread;
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+
+static void event_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_handler_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&s_not_empty, NULL);
+    pthread_cond_init(&s_not_full, NULL);
+}
+
+static bool handler_matches(const handler_node_t *node, esp_event_base_t base, int32_t id)
+{
+    if (node->removed) {
+        return false;
+    }
+    if (node->base != ESP_EVENT_ANY_BASE && node->base != base) {
+        return false;
+    }
+    return node->id == ESP_EVENT_ANY_ID || node->id == id;
+}
+
+// Unlinks handlers removed while a dispatch was walking the list.
+static void purge_removed(void)
+{
+    handler_node_t **it = &s_handlers;
+    while (*it) {
+        if ((*it)->removed) {
+            handler_node_t *dead = *it;
+            *it = dead->next;
+            free(dead);
+        } else {
+            it = &(*it)->next;
+        }
+    }
+}
+
+static void *event_task(void *arg)
+{
+    (void)arg;
+    shim_task_adopt("sys_evt", CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE, 20);
+    while (1) {
+        pthread_mutex_lock(&s_queue_lock);
+        while (s_count == 0) {
+            pthread_cond_wait(&s_not_empty, &s_queue_lock);
+        }
+        posted_event_t event = s_queue[s_head];
+        s_head = (s_head + 1) % EVENT_QUEUE_LEN;
+        s_count--;
+        pthread_cond_signal(&s_not_full);
+        pthread_mutex_unlock(&s_queue_lock);
+
+        // Handlers may register or unregister handlers; removal is deferred
+        // until the walk completes.
+        pthread_mutex_lock(&s_handler_lock);
+        s_dispatch_depth++;
+        for (handler_node_t *node = s_handlers; node; node = node->next) {
+            if (handler_matches(node, event.base, event.id)) {
+                node->handler(node->arg, event.base, event.id, event.data);
+            }
+        }
+        s_dispatch_depth--;
+        if (s_dispatch_depth == 0) {
+            purge_removed();
+        }
+        pthread_mutex_unlock(&s_handler_lock);
+        free(event.data);
+    }
+    return NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    pthread_once(&s_once, event_init);
+    pthread_mutex_lock(&s_queue_lock);
+    if (s_created) {
+        pthread_mutex_unlock(&s_queue_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_created = true;
+    pthread_mutex_unlock(&s_queue_lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_create(&s_event_thread, &attr, event_task, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(s_event_thread, "sys_evt");
+    pthread_detach(s_event_thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete_default(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    pthread_once(&s_once, event_init);
+    if (event_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handler_node_t *node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    node->base = event_base;
+    node->id = event_id;
+    node->handler = event_handler;
+    node->arg = event_handler_arg;
+
+    pthread_mutex_lock(&s_handler_lock);
+    handler_node_t **it = &s_handlers;
+    while (*it) {
+        it = &(*it)->next;
+    }
+    *it = node;
+    pthread_mutex_unlock(&s_handler_lock);
+
+    if (instance) {
+        *instance = node;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return esp_event_handler_instance_register(event_base, event_id, event_handler,
+                                               event_handler_arg, NULL);
+}
+
+static esp_err_t unregister_matching(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, handler_node_t *instance)
+{
+    pthread_once(&s_once, event_init);
+    pthread_mutex_lock(&s_handler_lock);
+    for (handler_node_t *node = s_handlers; node; node = node->next) {
+        if (node->removed || node->base != event_base || node->id != event_id) {
+            continue;
+        }
+        if ((instance && node == instance) || (!instance && node->handler == event_handler)) {
+            node->removed = true;
+            break;
+        }
+    }
+    if (s_dispatch_depth == 0) {
+        purge_removed();
+    }
+    pthread_mutex_unlock(&s_handler_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler)
+{
+    return unregister_matching(event_base, event_id, event_handler, NULL);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance)
+{
+    return unregister_matching(event_base, event_id, NULL, instance);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    pthread_once(&s_once, event_init);
+    void *copy = NULL;
+    if (event_data && event_data_size) {
+        copy = malloc(event_data_size);
+        if (copy == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(copy, event_data, event_data_size);
+    }
+
+    pthread_mutex_lock(&s_queue_lock);
+    if (!s_created) {
+        pthread_mutex_unlock(&s_queue_lock);
+        free(copy);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_count == EVENT_QUEUE_LEN && pthread_equal(pthread_self(), s_event_thread)) {
+        // Posting from a handler into a full queue would deadlock the loop.
+        pthread_mutex_unlock(&s_queue_lock);
+        free(copy);
+        ESP_LOGW(TAG, "Event queue full, dropping %s:%" PRIi32, event_base, event_id);
+        return ESP_ERR_TIMEOUT;
+    }
+    while (s_count == EVENT_QUEUE_LEN) {
+        pthread_cond_wait(&s_not_full, &s_queue_lock);
+    }
+    s_queue[(s_head + s_count) % EVENT_QUEUE_LEN] = (posted_event_t){
+        .base = event_base,
+        .id = event_id,
+        .data = copy,
+    };
+    s_count++;
+    pthread_cond_signal(&s_not_empty);
+    pthread_mutex_unlock(&s_queue_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,1235 @@
+// esp_http_server.c - HTTP/1.1 server with the esp_http_server session model
+//
+// One server thread owns the listening socket and every session, and runs
+// URI handlers inline, the same as the httpd task on the device. Requests on
+// a session are processed one at a time; pipelined bytes stay buffered in the
+// session until the next request is parsed. A handler may pass its request
+// to another task with httpd_req_async_handler_begin(); the session is then
+// left out of the poll set until that task completes the request.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SESS_RX_BUF_LEN (CONFIG_HTTPD_MAX_REQ_HDR_LEN + HTTPD_MAX_URI_LEN + 64)
+#define RESP_HDR_BUF_LEN 512
+
+static const char *TAG = "httpd";
+
+ESP_EVENT_DEFINE_BASE(ESP_HTTP_SERVER_EVENT);
+
+struct sock_db {
+    int fd;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    void *transport_ctx;
+    httpd_free_ctx_fn_t free_transport_ctx;
+    httpd_send_func_t send_fn;
+    httpd_recv_func_t recv_fn;
+    httpd_pending_func_t pending_fn;
+    uint64_t lru_counter;
+    bool close_pending;
+    volatile bool for_async_req;   // Owned by an async handler task
+    char rx[SESS_RX_BUF_LEN];
+    size_t rx_len;
+};
+
+typedef struct {
+    const char *field;
+    const char *value;
+} resp_hdr_t;
+
+struct httpd_req_aux {
+    struct sock_db *sd;
+    char *hdr_start;
+    size_t hdr_len;
+    size_t remaining_len;
+    const char *status;
+    const char *content_type;
+    resp_hdr_t *resp_hdrs;
+    unsigned resp_hdrs_count;
+    bool first_chunk_sent;
+    bool resp_sent;
+    bool close_after;
+    bool async;          // Handed to another task by the handler
+};
+
+// Copy of a request that outlives its handler; req comes first so the
+// httpd_req_t pointer handed out is also the allocation.
+struct httpd_req_async {
+    httpd_req_t req;
+    struct httpd_req_aux aux;
+    char hdrs[SESS_RX_BUF_LEN];
+    resp_hdr_t resp_hdrs[];
+};
+
+typedef struct work_item {
+    httpd_work_fn_t fn;
+    void *arg;
+    struct work_item *next;
+} work_item_t;
+
+struct httpd_data {
+    httpd_config_t config;
+    int listen_fd;
+    int ctrl_fd[2];
+    pthread_t thread;
+    volatile bool running;
+    struct sock_db *sd;
+    httpd_uri_t *handlers;
+    uint64_t lru_tick;
+    pthread_mutex_t work_lock;
+    work_item_t *work_head;
+    work_item_t *work_tail;
+    httpd_req_t req;
+    struct httpd_req_aux req_aux;
+};
+
+static struct sock_db *sess_get(struct httpd_data *hd, int fd)
+{
+    if (hd == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd[i].fd == fd) {
+            return &hd->sd[i];
+        }
+    }
+    return NULL;
+}
+
+static int sess_count(struct httpd_data *hd)
+{
+    int count = 0;
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd[i].fd >= 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int default_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    (void)hd;
+    ssize_t ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static int default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    (void)hd;
+    ssize_t ret = recv(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static void dispatch_event(int32_t event_id, const void *event_data, size_t event_data_size)
+{
+    esp_err_t err = esp_event_post(ESP_HTTP_SERVER_EVENT, event_id, event_data, event_data_size, portMAX_DELAY);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to post http_server event: %s", esp_err_to_name(err));
+    }
+}
+
+static void dispatch_data_event(int32_t event_id, int fd, int len)
+{
+    esp_http_server_event_data evt_data = { .fd = fd, .data_len = len };
+    dispatch_event(event_id, &evt_data, sizeof(evt_data));
+}
+
+static void sess_reset(struct sock_db *sd)
+{
+    memset(sd, 0, offsetof(struct sock_db, rx));
+    sd->fd = -1;
+    sd->rx_len = 0;
+}
+
+static void sess_delete(struct httpd_data *hd, struct sock_db *sd)
+{
+    if (sd->fd < 0) {
+        return;
+    }
+    ESP_LOGD(TAG, "closing session fd %d", sd->fd);
+    if (sd->ctx) {
+        if (sd->free_ctx) {
+            sd->free_ctx(sd->ctx);
+        } else {
+            free(sd->ctx);
+        }
+    }
+    // The transport is torn down first so a TLS close_notify can still go
+    // out on the socket.
+    if (sd->transport_ctx) {
+        if (sd->free_transport_ctx) {
+            sd->free_transport_ctx(sd->transport_ctx);
+        } else {
+            free(sd->transport_ctx);
+        }
+    }
+    int fd = sd->fd;
+    if (hd->config.close_fn) {
+        hd->config.close_fn(hd, fd);
+    } else {
+        close(fd);
+    }
+    sess_reset(sd);
+    dispatch_event(HTTP_SERVER_EVENT_DISCONNECTED, &fd, sizeof(fd));
+}
+
+static struct sock_db *sess_lru(struct httpd_data *hd)
+{
+    struct sock_db *lru = NULL;
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        struct sock_db *sd = &hd->sd[i];
+        if (sd->fd >= 0 && !sd->for_async_req && (lru == NULL || sd->lru_counter < lru->lru_counter)) {
+            lru = sd;
+        }
+    }
+    return lru;
+}
+
+static void configure_socket(struct httpd_data *hd, int fd)
+{
+    struct timeval tv = { .tv_sec = hd->config.recv_wait_timeout };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = hd->config.send_wait_timeout;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (hd->config.keep_alive_enable) {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        int idle = hd->config.keep_alive_idle ? hd->config.keep_alive_idle : 5;
+        int interval = hd->config.keep_alive_interval ? hd->config.keep_alive_interval : 5;
+        int count = hd->config.keep_alive_count ? hd->config.keep_alive_count : 3;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    }
+    if (hd->config.enable_so_linger) {
+        struct linger linger = { .l_onoff = 1, .l_linger = hd->config.linger_timeout };
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+}
+
+static void accept_conn(struct httpd_data *hd)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = accept(hd->listen_fd, (struct sockaddr *)&addr, &addr_len);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "accept failed: %s", strerror(errno));
+        return;
+    }
+    if (sess_count(hd) >= hd->config.max_open_sockets) {
+        if (!hd->config.lru_purge_enable) {
+            close(fd);
+            return;
+        }
+        struct sock_db *lru = sess_lru(hd);
+        if (lru == NULL) {
+            close(fd);
+            return;
+        }
+        ESP_LOGD(TAG, "purging LRU session fd %d", lru->fd);
+        sess_delete(hd, lru);
+    }
+    struct sock_db *sd = sess_get(hd, -1);
+    if (sd == NULL) {
+        close(fd);
+        return;
+    }
+    sess_reset(sd);
+    sd->fd = fd;
+    sd->send_fn = default_send;
+    sd->recv_fn = default_recv;
+    sd->lru_counter = ++hd->lru_tick;
+    configure_socket(hd, fd);
+
+    if (hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK) {
+        ESP_LOGD(TAG, "open_fn rejected fd %d", fd);
+        sess_delete(hd, sd);
+        return;
+    }
+    ESP_LOGD(TAG, "new session fd %d", fd);
+    dispatch_event(HTTP_SERVER_EVENT_ON_CONNECTED, &fd, sizeof(fd));
+}
+
+static int sess_pending(struct httpd_data *hd, struct sock_db *sd)
+{
+    if (sd->rx_len > 0) {
+        return (int)sd->rx_len;
+    }
+    if (sd->pending_fn) {
+        return sd->pending_fn(hd, sd->fd);
+    }
+    return 0;
+}
+
+// Reads from the session's transport into rx until the header terminator is
+// buffered. Returns the offset just past "\r\n\r\n", 0 if the peer closed or
+// the buffer overflowed, or -1 on a transport error.
+static int read_headers(struct httpd_data *hd, struct sock_db *sd, bool *overflow)
+{
+    *overflow = false;
+    while (1) {
+        if (sd->rx_len >= 4) {
+            char *end = memmem(sd->rx, sd->rx_len, "\r\n\r\n", 4);
+            if (end) {
+                return (int)(end - sd->rx) + 4;
+            }
+        }
+        if (sd->rx_len >= sizeof(sd->rx) - 1) {
+            *overflow = true;
+            return 0;
+        }
+        int n = sd->recv_fn(hd, sd->fd, sd->rx + sd->rx_len, sizeof(sd->rx) - 1 - sd->rx_len, 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        sd->rx_len += n;
+    }
+}
+
+static int parse_method(const char *method, size_t len)
+{
+    static const struct {
+        const char *name;
+        int method;
+    } methods[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+        { "DELETE", HTTP_DELETE }, { "HEAD", HTTP_HEAD }, { "OPTIONS", HTTP_OPTIONS },
+        { "PATCH", HTTP_PATCH },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strlen(methods[i].name) == len && strncmp(methods[i].name, method, len) == 0) {
+            return methods[i].method;
+        }
+    }
+    return -1;
+}
+
+static const char *find_header(struct httpd_req_aux *ra, const char *field, size_t *value_len)
+{
+    size_t field_len = strlen(field);
+    const char *p = ra->hdr_start;
+    const char *end = ra->hdr_start + ra->hdr_len;
+    while (p < end) {
+        const char *eol = memmem(p, end - p, "\r\n", 2);
+        if (eol == NULL) {
+            eol = end;
+        }
+        if ((size_t)(eol - p) > field_len && p[field_len] == ':' &&
+            strncasecmp(p, field, field_len) == 0) {
+            const char *value = p + field_len + 1;
+            while (value < eol && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            const char *value_end = eol;
+            while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+                value_end--;
+            }
+            *value_len = value_end - value;
+            return value;
+        }
+        p = eol + 2;
+    }
+    return NULL;
+}
+
+static esp_err_t send_all(httpd_req_t *r, const char *buf, size_t len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    struct httpd_data *hd = r->handle;
+    while (len > 0) {
+        int n = ra->sd->send_fn(hd, ra->sd->fd, buf, len, 0);
+        if (n <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t send_resp_headers(httpd_req_t *r, const char *length_hdr)
+{
+    struct httpd_req_aux *ra = r->aux;
+    char hdr[RESP_HDR_BUF_LEN];
+    int len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s",
+                       ra->status, ra->content_type, length_hdr);
+    if (len < 0 || len >= (int)sizeof(hdr)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    esp_err_t err = send_all(r, hdr, len);
+    for (unsigned i = 0; err == ESP_OK && i < ra->resp_hdrs_count; i++) {
+        len = snprintf(hdr, sizeof(hdr), "%s: %s\r\n", ra->resp_hdrs[i].field, ra->resp_hdrs[i].value);
+        if (len < 0 || len >= (int)sizeof(hdr)) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+        err = send_all(r, hdr, len);
+    }
+    if (err == ESP_OK) {
+        err = send_all(r, "\r\n", 2);
+    }
+    return err;
+}
+
+static bool req_valid(httpd_req_t *r)
+{
+    return r && r->handle && r->aux && ((struct httpd_req_aux *)r->aux)->sd;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if (!req_valid(r) || status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((struct httpd_req_aux *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if (!req_valid(r) || type == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((struct httpd_req_aux *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (!req_valid(r) || field == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_req_aux *ra = r->aux;
+    struct httpd_data *hd = r->handle;
+    if (ra->resp_hdrs_count >= hd->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    ra->resp_hdrs[ra->resp_hdrs_count].field = field;
+    ra->resp_hdrs[ra->resp_hdrs_count].value = value;
+    ra->resp_hdrs_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!req_valid(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+    struct httpd_req_aux *ra = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    }
+    char length_hdr[48];
+    snprintf(length_hdr, sizeof(length_hdr), "Content-Length: %zd\r\n", buf_len);
+    esp_err_t err = send_resp_headers(r, length_hdr);
+    if (err == ESP_OK && buf_len > 0) {
+        err = send_all(r, buf, buf_len);
+    }
+    ra->resp_sent = true;
+    if (err == ESP_OK) {
+        dispatch_data_event(HTTP_SERVER_EVENT_SENT_DATA, ra->sd->fd, (int)buf_len);
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!req_valid(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+    struct httpd_req_aux *ra = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    }
+    esp_err_t err = ESP_OK;
+    if (!ra->first_chunk_sent) {
+        err = send_resp_headers(r, "Transfer-Encoding: chunked\r\n");
+        ra->first_chunk_sent = true;
+    }
+    char size_line[16];
+    int len = snprintf(size_line, sizeof(size_line), "%zx\r\n", buf_len);
+    if (err == ESP_OK) {
+        err = send_all(r, size_line, len);
+    }
+    if (err == ESP_OK && buf_len > 0) {
+        err = send_all(r, buf, buf_len);
+    }
+    if (err == ESP_OK) {
+        err = send_all(r, "\r\n", 2);
+    }
+    if (err == ESP_OK) {
+        dispatch_data_event(HTTP_SERVER_EVENT_SENT_DATA, ra->sd->fd, (int)buf_len);
+    }
+    if (buf_len == 0) {
+        ra->resp_sent = true;
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
+{
+    static const struct {
+        const char *status;
+        const char *msg;
+    } errors[HTTPD_ERR_CODE_MAX] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = { "501 Method Not Implemented", "Request method is not supported by server" },
+        [HTTPD_505_VERSION_NOT_SUPPORTED] = { "505 Version Not Supported", "HTTP version not supported by server" },
+        [HTTPD_400_BAD_REQUEST] = { "400 Bad Request", "Bad request syntax" },
+        [HTTPD_401_UNAUTHORIZED] = { "401 Unauthorized", "No permission -- see authorization schemes" },
+        [HTTPD_403_FORBIDDEN] = { "403 Forbidden", "Request forbidden -- authorization will not help" },
+        [HTTPD_404_NOT_FOUND] = { "404 Not Found", "Nothing matches the given URI" },
+        [HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed", "Specified method is invalid for this resource" },
+        [HTTPD_408_REQ_TIMEOUT] = { "408 Request Timeout", "Server closed this connection" },
+        [HTTPD_411_LENGTH_REQUIRED] = { "411 Length Required", "Client must specify Content-Length" },
+        [HTTPD_413_CONTENT_TOO_LARGE] = { "413 Content Too Large", "Content is too large" },
+        [HTTPD_414_URI_TOO_LONG] = { "414 URI Too Long", "URI is too long" },
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = { "431 Request Header Fields Too Large", "Header fields are too long" },
+    };
+    if (error < 0 || error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_resp_set_status(req, errors[error].status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, usr_msg ? usr_msg : errors[error].msg, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (!req_valid(r)) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+    if (buf_len > ra->remaining_len) {
+        buf_len = ra->remaining_len;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+    int n;
+    if (sd->rx_len > 0) {
+        n = (int)(buf_len < sd->rx_len ? buf_len : sd->rx_len);
+        memcpy(buf, sd->rx, n);
+        memmove(sd->rx, sd->rx + n, sd->rx_len - n);
+        sd->rx_len -= n;
+    } else {
+        n = sd->recv_fn(r->handle, sd->fd, buf, buf_len, 0);
+        if (n < 0) {
+            return n;
+        }
+        if (n == 0) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+    }
+    ra->remaining_len -= n;
+    dispatch_data_event(HTTP_SERVER_EVENT_ON_DATA, sd->fd, n);
+    return n;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    if (!req_valid(r) || field == NULL) {
+        return 0;
+    }
+    size_t len = 0;
+    return find_header(r->aux, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (!req_valid(r) || field == NULL || val == NULL || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len = 0;
+    const char *value = find_header(r->aux, field, &len);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t copy = len < val_size - 1 ? len : val_size - 1;
+    memcpy(val, value, copy);
+    val[copy] = '\0';
+    return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    if (!req_valid(r)) {
+        return 0;
+    }
+    const char *q = strchr(r->uri, '?');
+    return q ? strlen(q + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (!req_valid(r) || buf == NULL || buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *q = strchr(r->uri, '?');
+    if (q == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t len = strlen(q + 1);
+    size_t copy = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, q + 1, copy);
+    buf[copy] = '\0';
+    return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    if (qry == NULL || key == NULL || val == NULL || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (p && *p) {
+        const char *end = strchr(p, '&');
+        size_t pair_len = end ? (size_t)(end - p) : strlen(p);
+        if (pair_len > key_len && strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            size_t len = pair_len - key_len - 1;
+            size_t copy = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, p + key_len + 1, copy);
+            val[copy] = '\0';
+            return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    if (!req_valid(r)) {
+        return -1;
+    }
+    return ((struct httpd_req_aux *)r->aux)->sd->fd;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto)
+{
+    size_t tpl_len = strlen(uri_template);
+    size_t exact_len = tpl_len;
+    bool wildcard = false;
+    if (tpl_len > 0 && uri_template[tpl_len - 1] == '*') {
+        wildcard = true;
+        exact_len = tpl_len - 1;
+    }
+    if (!wildcard) {
+        return match_upto == tpl_len && strncmp(uri_template, uri_to_match, match_upto) == 0;
+    }
+    if (match_upto < exact_len) {
+        // "/path/*" also matches "/path"
+        return match_upto + 1 == exact_len && uri_template[exact_len - 1] == '/' &&
+               strncmp(uri_template, uri_to_match, match_upto) == 0;
+    }
+    return strncmp(uri_template, uri_to_match, exact_len) == 0;
+}
+
+static const httpd_uri_t *find_handler(struct httpd_data *hd, const char *uri, size_t uri_len,
+                                       int method, bool *uri_exists)
+{
+    *uri_exists = false;
+    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+        const httpd_uri_t *h = &hd->handlers[i];
+        if (h->uri == NULL) {
+            continue;
+        }
+        bool match = hd->config.uri_match_fn
+                     ? hd->config.uri_match_fn(h->uri, uri, uri_len)
+                     : (strlen(h->uri) == uri_len && strncmp(h->uri, uri, uri_len) == 0);
+        if (!match) {
+            continue;
+        }
+        if ((int)h->method == method || h->method == HTTP_ANY) {
+            return h;
+        }
+        *uri_exists = true;
+    }
+    return NULL;
+}
+
+// Discards whatever part of the request body the handler did not read so
+// the next request on the session starts at a header boundary.
+static bool drain_body(struct httpd_data *hd, httpd_req_t *r)
+{
+    struct httpd_req_aux *ra = r->aux;
+    char scratch[256];
+    while (ra->remaining_len > 0) {
+        int n = httpd_req_recv(r, scratch, sizeof(scratch));
+        if (n <= 0) {
+            return false;
+        }
+    }
+    (void)hd;
+    return true;
+}
+
+// Handles one request on a session. Returns false if the session must close.
+static bool process_request(struct httpd_data *hd, struct sock_db *sd)
+{
+    bool overflow;
+    int hdr_end = read_headers(hd, sd, &overflow);
+    httpd_req_t *r = &hd->req;
+    struct httpd_req_aux *ra = &hd->req_aux;
+    resp_hdr_t resp_hdrs[hd->config.max_resp_headers ? hd->config.max_resp_headers : 1];
+
+    memset(r, 0, sizeof(*r));
+    memset(ra, 0, sizeof(*ra));
+    r->handle = hd;
+    r->aux = ra;
+    ra->sd = sd;
+    ra->status = HTTPD_200;
+    ra->content_type = HTTPD_TYPE_TEXT;
+    ra->resp_hdrs = resp_hdrs;
+
+    if (hdr_end <= 0) {
+        if (overflow) {
+            httpd_resp_send_err(r, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, NULL);
+        }
+        return false;
+    }
+
+    // Request line
+    char *line_end = memmem(sd->rx, hdr_end, "\r\n", 2);
+    char *sp1 = memchr(sd->rx, ' ', line_end - sd->rx);
+    char *sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (sp1 == NULL || sp2 == NULL) {
+        httpd_resp_send_err(r, HTTPD_400_BAD_REQUEST, NULL);
+        return false;
+    }
+    r->method = parse_method(sd->rx, sp1 - sd->rx);
+    size_t uri_len = sp2 - sp1 - 1;
+    if (uri_len > HTTPD_MAX_URI_LEN) {
+        httpd_resp_send_err(r, HTTPD_414_URI_TOO_LONG, NULL);
+        return false;
+    }
+    memcpy((char *)r->uri, sp1 + 1, uri_len);
+    ((char *)r->uri)[uri_len] = '\0';
+    if (r->method < 0) {
+        httpd_resp_send_err(r, HTTPD_501_METHOD_NOT_IMPLEMENTED, NULL);
+        return false;
+    }
+
+    // Headers stay in the rx buffer; copy them out so the body can be
+    // consumed from the front of rx.
+    size_t hdr_len = hdr_end - (line_end + 2 - sd->rx);
+    char hdr_copy[SESS_RX_BUF_LEN];
+    memcpy(hdr_copy, line_end + 2, hdr_len);
+    ra->hdr_start = hdr_copy;
+    ra->hdr_len = hdr_len;
+    memmove(sd->rx, sd->rx + hdr_end, sd->rx_len - hdr_end);
+    sd->rx_len -= hdr_end;
+
+    size_t value_len;
+    const char *value = find_header(ra, "Content-Length", &value_len);
+    if (value) {
+        r->content_len = strtoul(value, NULL, 10);
+    }
+    ra->remaining_len = r->content_len;
+    value = find_header(ra, "Connection", &value_len);
+    if (value && value_len == 5 && strncasecmp(value, "close", 5) == 0) {
+        ra->close_after = true;
+    }
+
+    sd->lru_counter = ++hd->lru_tick;
+    r->sess_ctx = sd->ctx;
+    r->free_ctx = sd->free_ctx;
+
+    const char *q = strchr(r->uri, '?');
+    size_t match_len = q ? (size_t)(q - r->uri) : uri_len;
+    bool uri_exists;
+    const httpd_uri_t *handler = find_handler(hd, r->uri, match_len, r->method, &uri_exists);
+    esp_err_t ret;
+    if (handler == NULL) {
+        ESP_LOGW(TAG, "URI '%s' not found", r->uri);
+        httpd_resp_send_err(r, uri_exists ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+        ret = ESP_FAIL;
+    } else {
+        r->user_ctx = handler->user_ctx;
+        ret = handler->handler(r);
+    }
+
+    // Pick up a session context the handler installed or replaced.
+    if (!r->ignore_sess_ctx_changes && r->sess_ctx != sd->ctx) {
+        if (sd->ctx && sd->ctx != r->sess_ctx) {
+            if (sd->free_ctx) {
+                sd->free_ctx(sd->ctx);
+            } else {
+                free(sd->ctx);
+            }
+        }
+        sd->ctx = r->sess_ctx;
+        sd->free_ctx = r->free_ctx;
+    }
+
+    if (ra->async) {
+        // The rest of the body and the session now belong to the async task,
+        // which may even have finished with them already
+        ra->sd = NULL;
+        return true;
+    }
+    bool keep = (ret == ESP_OK) && !ra->close_after && drain_body(hd, r);
+    ra->sd = NULL;
+    return keep;
+}
+
+static void run_work_queue(struct httpd_data *hd)
+{
+    while (1) {
+        pthread_mutex_lock(&hd->work_lock);
+        work_item_t *item = hd->work_head;
+        if (item) {
+            hd->work_head = item->next;
+            if (hd->work_head == NULL) {
+                hd->work_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&hd->work_lock);
+        if (item == NULL) {
+            return;
+        }
+        item->fn(item->arg);
+        free(item);
+    }
+}
+
+static void *httpd_thread(void *arg)
+{
+    struct httpd_data *hd = arg;
+    int max = hd->config.max_open_sockets;
+    struct pollfd pfds[max + 2];
+
+    shim_task_adopt("httpd", hd->config.stack_size, hd->config.task_priority);
+    while (hd->running) {
+        // Sessions that already hold decoded data (pipelined requests, TLS
+        // records) are served before blocking in poll().
+        bool served = false;
+        for (int i = 0; i < max; i++) {
+            struct sock_db *sd = &hd->sd[i];
+            if (sd->fd >= 0 && !sd->close_pending && !sd->for_async_req && sess_pending(hd, sd) > 0) {
+                if (!process_request(hd, sd)) {
+                    sess_delete(hd, sd);
+                }
+                served = true;
+            }
+        }
+        if (served) {
+            continue;
+        }
+
+        int nfds = 0;
+        pfds[nfds++] = (struct pollfd){ .fd = hd->ctrl_fd[0], .events = POLLIN };
+        bool can_accept = hd->config.lru_purge_enable || sess_count(hd) < max;
+        pfds[nfds++] = (struct pollfd){ .fd = can_accept ? hd->listen_fd : -1, .events = POLLIN };
+        for (int i = 0; i < max; i++) {
+            int fd = hd->sd[i].for_async_req ? -1 : hd->sd[i].fd;
+            pfds[nfds++] = (struct pollfd){ .fd = fd, .events = POLLIN };
+        }
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "poll failed: %s", strerror(errno));
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            ssize_t ignored = read(hd->ctrl_fd[0], drain, sizeof(drain));
+            (void)ignored;
+            run_work_queue(hd);
+            for (int i = 0; i < max; i++) {
+                if (hd->sd[i].fd >= 0 && hd->sd[i].close_pending && !hd->sd[i].for_async_req) {
+                    sess_delete(hd, &hd->sd[i]);
+                }
+            }
+        }
+        for (int i = 0; i < max; i++) {
+            struct sock_db *sd = &hd->sd[i];
+            short revents = pfds[2 + i].revents;
+            if (sd->fd < 0 || sd->fd != pfds[2 + i].fd || revents == 0) {
+                continue;
+            }
+            if (!process_request(hd, sd)) {
+                sess_delete(hd, sd);
+            }
+        }
+        if (pfds[1].revents & POLLIN) {
+            accept_conn(hd);
+        }
+    }
+
+    for (int i = 0; i < max; i++) {
+        sess_delete(hd, &hd->sd[i]);
+    }
+    shim_task_release();
+    return NULL;
+}
+
+static void wake_server(struct httpd_data *hd)
+{
+    char byte = 1;
+    ssize_t ignored = write(hd->ctrl_fd[1], &byte, 1);
+    (void)ignored;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (handle == NULL || config == NULL || config->max_open_sockets == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_data *hd = calloc(1, sizeof(*hd));
+    if (hd == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    hd->config = *config;
+    hd->sd = calloc(config->max_open_sockets, sizeof(struct sock_db));
+    hd->handlers = calloc(config->max_uri_handlers ? config->max_uri_handlers : 1, sizeof(httpd_uri_t));
+    if (hd->sd == NULL || hd->handlers == NULL || pipe(hd->ctrl_fd) != 0) {
+        free(hd->sd);
+        free(hd->handlers);
+        free(hd);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    for (int i = 0; i < config->max_open_sockets; i++) {
+        sess_reset(&hd->sd[i]);
+    }
+    pthread_mutex_init(&hd->work_lock, NULL);
+
+    const char *addr_env = getenv("GW_HOST_ADDR");
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->server_port),
+    };
+    inet_pton(AF_INET, (addr_env && *addr_env) ? addr_env : "127.0.0.1", &addr.sin_addr);
+
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (hd->listen_fd < 0 ||
+        bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(hd->listen_fd, config->backlog_conn) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %u: %s", config->server_port, strerror(errno));
+        if (hd->listen_fd >= 0) {
+            close(hd->listen_fd);
+        }
+        close(hd->ctrl_fd[0]);
+        close(hd->ctrl_fd[1]);
+        free(hd->sd);
+        free(hd->handlers);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    hd->running = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 512 * 1024);
+    if (pthread_create(&hd->thread, &attr, httpd_thread, hd) != 0) {
+        pthread_attr_destroy(&attr);
+        close(hd->listen_fd);
+        close(hd->ctrl_fd[0]);
+        close(hd->ctrl_fd[1]);
+        free(hd->sd);
+        free(hd->handlers);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(hd->thread, "httpd");
+    ESP_LOGI(TAG, "Started server on port: '%u'", config->server_port);
+    *handle = hd;
+    dispatch_event(HTTP_SERVER_EVENT_START, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    struct httpd_data *hd = handle;
+    if (hd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hd->running = false;
+    wake_server(hd);
+    if (!pthread_equal(pthread_self(), hd->thread)) {
+        pthread_join(hd->thread, NULL);
+    }
+    close(hd->listen_fd);
+    close(hd->ctrl_fd[0]);
+    close(hd->ctrl_fd[1]);
+    while (hd->work_head) {
+        work_item_t *next = hd->work_head->next;
+        free(hd->work_head);
+        hd->work_head = next;
+    }
+    if (hd->config.global_user_ctx) {
+        if (hd->config.global_user_ctx_free_fn) {
+            hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+        } else {
+            free(hd->config.global_user_ctx);
+        }
+    }
+    if (hd->config.global_transport_ctx) {
+        if (hd->config.global_transport_ctx_free_fn) {
+            hd->config.global_transport_ctx_free_fn(hd->config.global_transport_ctx);
+        } else {
+            free(hd->config.global_transport_ctx);
+        }
+    }
+    pthread_mutex_destroy(&hd->work_lock);
+    free(hd->sd);
+    free(hd->handlers);
+    free(hd);
+    dispatch_event(HTTP_SERVER_EVENT_STOP, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    struct httpd_data *hd = handle;
+    if (hd == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+        const httpd_uri_t *h = &hd->handlers[i];
+        if (h->uri && h->method == uri_handler->method && strcmp(h->uri, uri_handler->uri) == 0) {
+            ESP_LOGW(TAG, "handler %s already registered", uri_handler->uri);
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+        if (hd->handlers[i].uri == NULL) {
+            hd->handlers[i] = *uri_handler;
+            return ESP_OK;
+        }
+    }
+    ESP_LOGW(TAG, "no slots left for registering handler %s", uri_handler->uri);
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char *uri, httpd_method_t method)
+{
+    struct httpd_data *hd = handle;
+    if (hd == NULL || uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+        httpd_uri_t *h = &hd->handlers[i];
+        if (h->uri && h->method == method && strcmp(h->uri, uri) == 0) {
+            memset(h, 0, sizeof(*h));
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd)
+{
+    struct sock_db *sd = sess_get(handle, sockfd);
+    return sd ? sd->ctx : NULL;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    struct sock_db *sd = sess_get(handle, sockfd);
+    if (sd) {
+        sd->ctx = ctx;
+        sd->free_ctx = free_fn;
+    }
+}
+
+void *httpd_sess_get_transport_ctx(httpd_handle_t handle, int sockfd)
+{
+    struct sock_db *sd = sess_get(handle, sockfd);
+    return sd ? sd->transport_ctx : NULL;
+}
+
+void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    struct sock_db *sd = sess_get(handle, sockfd);
+    if (sd) {
+        sd->transport_ctx = ctx;
+        sd->free_transport_ctx = free_fn;
+    }
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle)
+{
+    return handle ? ((struct httpd_data *)handle)->config.global_user_ctx : NULL;
+}
+
+void *httpd_get_global_transport_ctx(httpd_handle_t handle)
+{
+    return handle ? ((struct httpd_data *)handle)->config.global_transport_ctx : NULL;
+}
+
+esp_err_t httpd_sess_set_recv_override(httpd_handle_t hd, int sockfd, httpd_recv_func_t recv_func)
+{
+    struct sock_db *sd = sess_get(hd, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sd->recv_fn = recv_func;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
+{
+    struct sock_db *sd = sess_get(hd, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sd->send_fn = send_func;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_pending_override(httpd_handle_t hd, int sockfd, httpd_pending_func_t pending_func)
+{
+    struct sock_db *sd = sess_get(hd, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sd->pending_fn = pending_func;
+    return ESP_OK;
+}
+
+static void trigger_close_work(void *arg)
+{
+    (void)arg;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    struct sock_db *sd = sess_get(handle, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    sd->close_pending = true;
+    // The close itself happens on the server thread after it wakes up.
+    return httpd_queue_work(handle, trigger_close_work, NULL);
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    if (!req_valid(r) || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_data *hd = r->handle;
+    struct httpd_req_aux *ra = r->aux;
+    size_t max_hdrs = hd->config.max_resp_headers ? hd->config.max_resp_headers : 1;
+    struct httpd_req_async *async = malloc(sizeof(*async) + max_hdrs * sizeof(resp_hdr_t));
+    if (async == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(&async->req, r, sizeof(*r));
+    async->aux = *ra;
+    memcpy(async->hdrs, ra->hdr_start, ra->hdr_len);
+    async->aux.hdr_start = async->hdrs;
+    memcpy(async->resp_hdrs, ra->resp_hdrs, ra->resp_hdrs_count * sizeof(resp_hdr_t));
+    async->aux.resp_hdrs = async->resp_hdrs;
+    async->req.aux = &async->aux;
+    async->aux.async = false;
+    ra->async = true;
+    ra->sd->for_async_req = true;
+    *out = &async->req;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    if (!req_valid(r)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_data *hd = r->handle;
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+    // A session already on its way out is not worth draining
+    if (!sd->close_pending && (ra->close_after || !drain_body(hd, r))) {
+        sd->close_pending = true;
+    }
+    // Hand the session back; the server thread picks it up, or closes it,
+    // once woken.
+    __atomic_store_n(&sd->for_async_req, false, __ATOMIC_RELEASE);
+    free(r);
+    wake_server(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd)
+{
+    struct httpd_data *hd = handle;
+    struct sock_db *sd = sess_get(hd, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    sd->lru_counter = ++hd->lru_tick;
+    return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds)
+{
+    struct httpd_data *hd = handle;
+    if (hd == NULL || fds == NULL || client_fds == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t max = *fds;
+    size_t count = 0;
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd[i].fd >= 0) {
+            if (count >= max) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            client_fds[count++] = hd->sd[i].fd;
+        }
+    }
+    *fds = count;
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    struct httpd_data *hd = handle;
+    if (hd == NULL || work == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    work_item_t *item = calloc(1, sizeof(*item));
+    if (item == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    item->fn = work;
+    item->arg = arg;
+    pthread_mutex_lock(&hd->work_lock);
+    if (hd->work_tail) {
+        hd->work_tail->next = item;
+    } else {
+        hd->work_head = item;
+    }
+    hd->work_tail = item;
+    pthread_mutex_unlock(&hd->work_lock);
+    wake_server(hd);
+    return ESP_OK;
+}
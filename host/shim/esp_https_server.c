@@ -0,0 +1,256 @@
+// esp_https_server.c - HTTPS server layered on the httpd and esp-tls shims
+//
+// Mirrors components/esp_https_server: the handshake runs in open_fn, the
+// esp_tls handle becomes the session's transport context, and I/O is routed
+// through send/recv/pending overrides that also emit the server events.
+
+#include <unistd.h>
+#include "esp_https_server.h"
+#include "esp_log.h"
+
+ESP_EVENT_DEFINE_BASE(ESP_HTTPS_SERVER_EVENT);
+
+static const char *TAG = "esp_https_server";
+
+typedef struct httpd_ssl_ctx {
+    esp_tls_cfg_server_t *tls_cfg;
+    httpd_open_func_t open_fn;
+    esp_https_server_user_cb *user_cb;
+    void *user_ctx;
+} httpd_ssl_ctx_t;
+
+typedef struct {
+    esp_tls_t *tls;
+    httpd_ssl_ctx_t *ssl_ctx;
+} transport_ctx_t;
+
+static void http_dispatch_event_to_event_loop(int32_t event_id, const void *event_data, size_t event_data_size)
+{
+    esp_err_t err = esp_event_post(ESP_HTTPS_SERVER_EVENT, event_id, event_data, event_data_size, portMAX_DELAY);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to post esp_https_server event: %s", esp_err_to_name(err));
+    }
+}
+
+static void post_tls_error(esp_tls_t *tls)
+{
+    esp_https_server_last_error_t last_error = {0};
+    last_error.last_error = esp_tls_get_and_clear_last_error(tls, &last_error.esp_tls_error_code,
+                                                             &last_error.esp_tls_flags);
+    http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_ERROR, &last_error, sizeof(last_error));
+}
+
+static int httpd_ssl_recv(httpd_handle_t server, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    (void)flags;
+    transport_ctx_t *ctx = httpd_sess_get_transport_ctx(server, sockfd);
+    if (ctx == NULL || buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t ret = esp_tls_conn_read(ctx->tls, buf, buf_len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_TIMEOUT) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (ret < 0) {
+        post_tls_error(ctx->tls);
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if (ret > 0) {
+        int len = (int)ret;
+        http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_ON_DATA, &len, sizeof(len));
+    }
+    return (int)ret;
+}
+
+static int httpd_ssl_send(httpd_handle_t server, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    (void)flags;
+    transport_ctx_t *ctx = httpd_sess_get_transport_ctx(server, sockfd);
+    if (ctx == NULL || buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t ret = esp_tls_conn_write(ctx->tls, buf, buf_len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (ret < 0) {
+        post_tls_error(ctx->tls);
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_SENT_DATA, NULL, 0);
+    return (int)ret;
+}
+
+static int httpd_ssl_pending(httpd_handle_t server, int sockfd)
+{
+    transport_ctx_t *ctx = httpd_sess_get_transport_ctx(server, sockfd);
+    if (ctx == NULL) {
+        return 0;
+    }
+    ssize_t avail = esp_tls_get_bytes_avail(ctx->tls);
+    return avail > 0 ? (int)avail : 0;
+}
+
+static void httpd_ssl_close(void *ctx)
+{
+    transport_ctx_t *transport_ctx = ctx;
+    httpd_ssl_ctx_t *ssl_ctx = transport_ctx->ssl_ctx;
+    if (ssl_ctx->user_cb) {
+        esp_https_server_user_cb_arg_t user_cb_data = {
+            .user_cb_state = HTTPD_SSL_USER_CB_SESS_CLOSE,
+            .user_data = ssl_ctx->user_ctx,
+            .tls = transport_ctx->tls,
+        };
+        ssl_ctx->user_cb(&user_cb_data);
+    }
+    esp_tls_server_session_delete(transport_ctx->tls);
+    free(transport_ctx);
+    ESP_LOGD(TAG, "Secure socket closed");
+    http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_DISCONNECTED, NULL, 0);
+}
+
+static esp_err_t httpd_ssl_open(httpd_handle_t server, int sockfd)
+{
+    httpd_ssl_ctx_t *ssl_ctx = httpd_get_global_transport_ctx(server);
+    esp_tls_t *tls = esp_tls_init();
+    if (tls == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "performing session handshake");
+    if (esp_tls_server_session_create(ssl_ctx->tls_cfg, sockfd, tls) != 1) {
+        ESP_LOGE(TAG, "esp_tls_create_server_session failed");
+        post_tls_error(tls);
+        esp_tls_server_session_delete(tls);
+        return ESP_FAIL;
+    }
+
+    transport_ctx_t *transport_ctx = calloc(1, sizeof(*transport_ctx));
+    if (transport_ctx == NULL) {
+        esp_tls_server_session_delete(tls);
+        return ESP_ERR_NO_MEM;
+    }
+    transport_ctx->tls = tls;
+    transport_ctx->ssl_ctx = ssl_ctx;
+
+    httpd_sess_set_transport_ctx(server, sockfd, transport_ctx, httpd_ssl_close);
+    httpd_sess_set_send_override(server, sockfd, httpd_ssl_send);
+    httpd_sess_set_recv_override(server, sockfd, httpd_ssl_recv);
+    httpd_sess_set_pending_override(server, sockfd, httpd_ssl_pending);
+
+    ESP_LOGD(TAG, "Secure socket open");
+    if (ssl_ctx->user_cb) {
+        esp_https_server_user_cb_arg_t user_cb_data = {
+            .user_cb_state = HTTPD_SSL_USER_CB_SESS_CREATE,
+            .user_data = ssl_ctx->user_ctx,
+            .tls = tls,
+        };
+        ssl_ctx->user_cb(&user_cb_data);
+    }
+    http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_ON_CONNECTED, NULL, 0);
+
+    if (ssl_ctx->open_fn) {
+        return ssl_ctx->open_fn(server, sockfd);
+    }
+    return ESP_OK;
+}
+
+static void free_secure_context(void *ctx)
+{
+    httpd_ssl_ctx_t *ssl_ctx = ctx;
+    esp_tls_cfg_server_t *cfg = ssl_ctx->tls_cfg;
+    ESP_LOGI(TAG, "Server shuts down, releasing SSL context");
+    esp_tls_cfg_server_session_tickets_free(cfg);
+    free((void *)cfg->servercert_buf);
+    free((void *)cfg->serverkey_buf);
+    free(cfg);
+    free(ssl_ctx);
+}
+
+static void *dup_pem(const uint8_t *buf, size_t len)
+{
+    void *copy = malloc(len);
+    if (copy) {
+        memcpy(copy, buf, len);
+    }
+    return copy;
+}
+
+static httpd_ssl_ctx_t *create_secure_context(const httpd_ssl_config_t *config)
+{
+    httpd_ssl_ctx_t *ssl_ctx = calloc(1, sizeof(*ssl_ctx));
+    esp_tls_cfg_server_t *cfg = calloc(1, sizeof(*cfg));
+    if (ssl_ctx == NULL || cfg == NULL) {
+        free(ssl_ctx);
+        free(cfg);
+        return NULL;
+    }
+    if (config->session_tickets && esp_tls_cfg_server_session_tickets_init(cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init session ticket support");
+        free(ssl_ctx);
+        free(cfg);
+        return NULL;
+    }
+    ssl_ctx->tls_cfg = cfg;
+    ssl_ctx->user_cb = config->user_cb;
+    ssl_ctx->user_ctx = config->ssl_userdata;
+    cfg->userdata = config->ssl_userdata;
+    cfg->alpn_protos = config->alpn_protos;
+    cfg->cert_select_cb = config->cert_select_cb;
+    cfg->servercert_buf = dup_pem(config->servercert, config->servercert_len);
+    cfg->servercert_bytes = config->servercert_len;
+    cfg->serverkey_buf = dup_pem(config->prvtkey_pem, config->prvtkey_len);
+    cfg->serverkey_bytes = config->prvtkey_len;
+    if (cfg->servercert_buf == NULL || cfg->serverkey_buf == NULL) {
+        free_secure_context(ssl_ctx);
+        return NULL;
+    }
+    return ssl_ctx;
+}
+
+esp_err_t httpd_ssl_start(httpd_handle_t *pHandle, httpd_ssl_config_t *config)
+{
+    if (pHandle == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "Starting server");
+
+    if (config->transport_mode == HTTPD_SSL_TRANSPORT_SECURE) {
+        httpd_ssl_ctx_t *ssl_ctx = create_secure_context(config);
+        if (ssl_ctx == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        ssl_ctx->open_fn = config->httpd.open_fn;
+        config->httpd.global_transport_ctx = ssl_ctx;
+        config->httpd.global_transport_ctx_free_fn = free_secure_context;
+        config->httpd.open_fn = httpd_ssl_open;
+        // Port 443 needs privileges on a workstation; the host build serves
+        // on GW_HOST_PORT, 8443 by default, whatever port_secure says.
+        const char *port_env = getenv("GW_HOST_PORT");
+        config->httpd.server_port = (port_env && *port_env) ? (uint16_t)atoi(port_env) : 8443;
+    } else {
+        ESP_LOGD(TAG, "SSL disabled, using plain HTTP");
+        config->httpd.server_port = config->port_insecure;
+    }
+
+    httpd_handle_t handle = NULL;
+    esp_err_t ret = httpd_start(&handle, &config->httpd);
+    if (ret != ESP_OK) {
+        if (config->httpd.global_transport_ctx) {
+            free_secure_context(config->httpd.global_transport_ctx);
+            config->httpd.global_transport_ctx = NULL;
+        }
+        return ret;
+    }
+    *pHandle = handle;
+    http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_START, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ssl_stop(httpd_handle_t handle)
+{
+    esp_err_t ret = httpd_stop(handle);
+    if (ret == ESP_OK) {
+        http_dispatch_event_to_event_loop(HTTPS_SERVER_EVENT_STOP, NULL, 0);
+    }
+    return ret;
+}
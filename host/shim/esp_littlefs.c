@@ -0,0 +1,36 @@
+// esp_littlefs.c - LittleFS mounts backed by host directories
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_littlefs.h"
+#include "esp_log.h"
+
+static const char *TAG = "esp_littlefs";
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf)
+{
+    if (conf == NULL || conf->base_path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mkdir(conf->base_path, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Failed to create %s: %s", conf->base_path, strerror(errno));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Mounted %s as a host directory", conf->base_path);
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_littlefs_unregister(const char *partition_label)
+{
+    (void)partition_label;
+    return ESP_OK;
+}
+
+esp_err_t esp_littlefs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    (void)partition_label;
+    *total_bytes = 0;
+    *used_bytes = 0;
+    return ESP_OK;
+}
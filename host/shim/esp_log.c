@@ -0,0 +1,177 @@
+// esp_log.c - console logging and error names
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_http_server.h"
+#include "esp_ota_ops.h"
+#include "esp_tls.h"
+#include "nvs.h"
+
+#define MAX_TAG_LEVELS 32
+
+typedef struct {
+    char tag[32];
+    esp_log_level_t level;
+} tag_level_t;
+
+static pthread_mutex_t s_level_lock = PTHREAD_MUTEX_INITIALIZER;
+static tag_level_t s_tag_levels[MAX_TAG_LEVELS];
+static int s_tag_level_count;
+static esp_log_level_t s_default_level = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+static pthread_once_t s_level_once = PTHREAD_ONCE_INIT;
+
+static void level_init(void)
+{
+    const char *env = getenv("GW_LOG_LEVEL");
+    if (env && *env) {
+        int level = atoi(env);
+        if (level >= ESP_LOG_NONE && level <= ESP_LOG_VERBOSE) {
+            s_default_level = (esp_log_level_t)level;
+        }
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    pthread_once(&s_level_once, level_init);
+    pthread_mutex_lock(&s_level_lock);
+    if (strcmp(tag, "*") == 0) {
+        s_default_level = level;
+        s_tag_level_count = 0;
+    } else {
+        int i;
+        for (i = 0; i < s_tag_level_count; i++) {
+            if (strcmp(s_tag_levels[i].tag, tag) == 0) {
+                break;
+            }
+        }
+        if (i < MAX_TAG_LEVELS) {
+            strncpy(s_tag_levels[i].tag, tag, sizeof(s_tag_levels[i].tag) - 1);
+            s_tag_levels[i].level = level;
+            if (i == s_tag_level_count) {
+                s_tag_level_count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_level_lock);
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    pthread_once(&s_level_once, level_init);
+    esp_log_level_t level = s_default_level;
+    if (s_tag_level_count == 0) {
+        return level;
+    }
+    pthread_mutex_lock(&s_level_lock);
+    for (int i = 0; i < s_tag_level_count; i++) {
+        if (strcmp(s_tag_levels[i].tag, tag) == 0) {
+            level = s_tag_levels[i].level;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_level_lock);
+    return level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+    static const char *colors[] = { "", "\033[0;31m", "\033[0;33m", "\033[0;32m", "", "" };
+    char line[1024];
+    bool color = isatty(STDERR_FILENO);
+    int len = snprintf(line, sizeof(line), "%s%c (%" PRIu32 ") %s: ",
+                       color ? colors[level] : "", letters[level], esp_log_timestamp(), tag);
+    va_list args;
+    va_start(args, format);
+    if (len >= 0 && len < (int)sizeof(line)) {
+        int n = vsnprintf(line + len, sizeof(line) - len, format, args);
+        len = (n < 0) ? len : len + n;
+    }
+    va_end(args);
+    if (len > (int)sizeof(line) - 8) {
+        len = sizeof(line) - 8;
+    }
+    if (color && colors[level][0]) {
+        memcpy(line + len, "\033[0m", 4);
+        len += 4;
+    }
+    line[len++] = '\n';
+    // One write() per line keeps concurrent tasks from interleaving output.
+    ssize_t ignored = write(STDERR_FILENO, line, len);
+    (void)ignored;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+    case ESP_ERR_NOT_ALLOWED: return "ESP_ERR_NOT_ALLOWED";
+    case ESP_ERR_WIFI_NOT_INIT: return "ESP_ERR_WIFI_NOT_INIT";
+    case ESP_ERR_WIFI_NOT_STARTED: return "ESP_ERR_WIFI_NOT_STARTED";
+    case ESP_ERR_WIFI_CONN: return "ESP_ERR_WIFI_CONN";
+    case ESP_ERR_WIFI_NOT_CONNECT: return "ESP_ERR_WIFI_NOT_CONNECT";
+    case ESP_ERR_HTTPD_HANDLERS_FULL: return "ESP_ERR_HTTPD_HANDLERS_FULL";
+    case ESP_ERR_HTTPD_HANDLER_EXISTS: return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+    case ESP_ERR_HTTPD_INVALID_REQ: return "ESP_ERR_HTTPD_INVALID_REQ";
+    case ESP_ERR_HTTPD_RESULT_TRUNC: return "ESP_ERR_HTTPD_RESULT_TRUNC";
+    case ESP_ERR_HTTPD_RESP_HDR: return "ESP_ERR_HTTPD_RESP_HDR";
+    case ESP_ERR_HTTPD_RESP_SEND: return "ESP_ERR_HTTPD_RESP_SEND";
+    case ESP_ERR_HTTPD_ALLOC_MEM: return "ESP_ERR_HTTPD_ALLOC_MEM";
+    case ESP_ERR_HTTPD_TASK: return "ESP_ERR_HTTPD_TASK";
+    case ESP_ERR_MBEDTLS_SSL_SETUP_FAILED: return "ESP_ERR_MBEDTLS_SSL_SETUP_FAILED";
+    case ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED: return "ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED";
+    case ESP_ERR_ESP_TLS_TCP_CLOSED_FIN: return "ESP_ERR_ESP_TLS_TCP_CLOSED_FIN";
+    case ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED: return "ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED";
+    case ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED: return "ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED";
+    case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE: return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME: return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    case ESP_ERR_OTA_PARTITION_CONFLICT: return "ESP_ERR_OTA_PARTITION_CONFLICT";
+    case ESP_ERR_OTA_SELECT_INFO_INVALID: return "ESP_ERR_OTA_SELECT_INFO_INVALID";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    case ESP_ERR_OTA_ROLLBACK_FAILED: return "ESP_ERR_OTA_ROLLBACK_FAILED";
+    case ESP_ERR_OTA_ROLLBACK_INVALID_STATE: return "ESP_ERR_OTA_ROLLBACK_INVALID_STATE";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line,
+                             const char *function, const char *expression)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\n"
+            "file: \"%s\" line %d\nfunc: %s\nexpression: %s\n",
+            rc, esp_err_to_name(rc), file, line, file, line, function, expression);
+    abort();
+}
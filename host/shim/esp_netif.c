@@ -0,0 +1,157 @@
+// esp_netif.c - single mock station interface
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <string.h>
+#include "esp_netif.h"
+
+struct esp_netif_obj {
+    bool created;
+    bool up;
+    bool dhcpc_running;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_FALLBACK + 1];
+};
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_netif_obj s_sta = { .dhcpc_running = true };
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_sta.created = true;
+    pthread_mutex_unlock(&s_lock);
+    return &s_sta;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    if (if_key && strcmp(if_key, "WIFI_STA_DEF") == 0 && s_sta.created) {
+        return &s_sta;
+    }
+    return NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
+{
+    if (esp_netif == NULL || ip_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (esp_netif->up) {
+        *ip_info = esp_netif->ip_info;
+    } else {
+        memset(ip_info, 0, sizeof(*ip_info));
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info)
+{
+    if (esp_netif == NULL || ip_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (esp_netif->dhcpc_running) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_netif->ip_info = *ip_info;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (esp_netif == NULL || dns == NULL || type > ESP_NETIF_DNS_FALLBACK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_netif->dns[type] = *dns;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (esp_netif == NULL || dns == NULL || type > ESP_NETIF_DNS_FALLBACK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    *dns = esp_netif->dns[type];
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif)
+{
+    pthread_mutex_lock(&s_lock);
+    bool changed = esp_netif->dhcpc_running != true;
+    esp_netif->dhcpc_running = true;
+    bool up = esp_netif->up;
+    pthread_mutex_unlock(&s_lock);
+    if (changed && up) {
+        shim_wifi_dhcpc_started();
+    }
+    return changed ? ESP_OK : ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif)
+{
+    pthread_mutex_lock(&s_lock);
+    bool changed = esp_netif->dhcpc_running != false;
+    esp_netif->dhcpc_running = false;
+    pthread_mutex_unlock(&s_lock);
+    return changed ? ESP_OK : ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+}
+
+esp_err_t esp_netif_get_hostname(esp_netif_t *esp_netif, const char **hostname)
+{
+    (void)esp_netif;
+    *hostname = "espressif";
+    return ESP_OK;
+}
+
+char *esp_ip4addr_ntoa(const esp_ip4_addr_t *addr, char *buf, int buflen)
+{
+    struct in_addr in = { .s_addr = addr->addr };
+    return (char *)inet_ntop(AF_INET, &in, buf, buflen);
+}
+
+uint32_t esp_ip4addr_aton(const char *addr)
+{
+    struct in_addr in;
+    return inet_pton(AF_INET, addr, &in) == 1 ? in.s_addr : 0;
+}
+
+// Called by the mock Wi-Fi driver when the link comes up or goes down. With
+// DHCP running the interface gets the loopback address; with a static
+// configuration it keeps whatever esp_netif_set_ip_info() stored.
+void shim_netif_set_sta_up(bool up)
+{
+    pthread_mutex_lock(&s_lock);
+    s_sta.up = up;
+    if (up && s_sta.dhcpc_running) {
+        s_sta.ip_info.ip.addr = ESP_IP4TOADDR(127, 0, 0, 1);
+        s_sta.ip_info.netmask.addr = ESP_IP4TOADDR(255, 0, 0, 0);
+        s_sta.ip_info.gw.addr = ESP_IP4TOADDR(127, 0, 0, 1);
+        s_sta.dns[ESP_NETIF_DNS_MAIN].ip.u_addr.ip4.addr = ESP_IP4TOADDR(127, 0, 0, 53);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool shim_netif_dhcp_enabled(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool running = s_sta.dhcpc_running;
+    pthread_mutex_unlock(&s_lock);
+    return running;
+}
@@ -0,0 +1,287 @@
+// esp_ota_ops.c - OTA slots over the partition shim
+//
+// Boot selection follows the bootloader: the slot picked by the otadata
+// record at startup is the running one, a freshly selected image starts out
+// pending verification, and one still pending at the next start is rolled
+// back.
+
+#include <pthread.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+static const char *TAG = "esp_ota";
+
+#define OTADATA_MAGIC 0x4441544f // "OTAD"
+#define MAX_HANDLES 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;     // Slot (seq - 1) % 2 boots; 0 means none chosen
+    uint32_t state;   // esp_ota_img_states_t of that slot
+} otadata_t;
+
+typedef struct {
+    bool used;
+    const esp_partition_t *part;
+    size_t written;
+    size_t erased;    // Bytes erased from the start of the slot
+} ota_handle_t;
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static const esp_partition_t *s_slots[2];
+static const esp_partition_t *s_otadata;
+static const esp_partition_t *s_running;
+static otadata_t s_record;
+static ota_handle_t s_handles[MAX_HANDLES];
+
+static int slot_index(const esp_partition_t *part)
+{
+    for (int i = 0; i < 2; i++) {
+        if (s_slots[i] && s_slots[i] == part) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const esp_partition_t *record_slot(void)
+{
+    if (s_record.magic != OTADATA_MAGIC || s_record.seq == 0) {
+        return s_slots[0];
+    }
+    return s_slots[(s_record.seq - 1) % 2];
+}
+
+static esp_err_t store_record(void)
+{
+    if (s_otadata == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t err = esp_partition_erase_range(s_otadata, 0, SPI_FLASH_SEC_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_otadata, 0, &s_record, sizeof(s_record));
+    }
+    return err;
+}
+
+static void boot(void)
+{
+    s_slots[0] = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    s_slots[1] = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+    s_otadata = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, NULL);
+    if (s_otadata == NULL || esp_partition_read(s_otadata, 0, &s_record, sizeof(s_record)) != ESP_OK) {
+        memset(&s_record, 0xff, sizeof(s_record));
+    }
+    if (s_record.magic == OTADATA_MAGIC && s_record.state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGW(TAG, "Image in %s was never confirmed, rolling back", record_slot()->label);
+        s_record.seq++;
+        s_record.state = ESP_OTA_IMG_VALID;
+        store_record();
+    } else if (s_record.magic == OTADATA_MAGIC && s_record.state == ESP_OTA_IMG_NEW) {
+        s_record.state = ESP_OTA_IMG_PENDING_VERIFY;
+        store_record();
+    }
+    s_running = record_slot();
+}
+
+static ota_handle_t *get_handle(esp_ota_handle_t handle)
+{
+    if (handle == 0 || handle > MAX_HANDLES || !s_handles[handle - 1].used) {
+        return NULL;
+    }
+    return &s_handles[handle - 1];
+}
+
+// Erases whole sectors until the first end bytes of the slot are covered
+static esp_err_t erase_to(ota_handle_t *h, size_t end)
+{
+    while (h->erased < end) {
+        esp_err_t err = esp_partition_erase_range(h->part, h->erased, SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        h->erased += SPI_FLASH_SEC_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    pthread_once(&s_once, boot);
+    if (partition == NULL || out_handle == NULL || slot_index(partition) < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition == s_running) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if (image_size != OTA_SIZE_UNKNOWN && image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&s_lock);
+    int idx = -1;
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (s_handles[i].used && s_handles[i].part == partition) {
+            pthread_mutex_unlock(&s_lock);
+            return ESP_ERR_OTA_PARTITION_CONFLICT;
+        }
+        if (!s_handles[i].used && idx < 0) {
+            idx = i;
+        }
+    }
+    if (idx < 0) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    ota_handle_t *h = &s_handles[idx];
+    *h = (ota_handle_t){.used = true, .part = partition};
+    pthread_mutex_unlock(&s_lock);
+
+    esp_err_t err = ESP_OK;
+    if (image_size == OTA_SIZE_UNKNOWN) {
+        err = erase_to(h, partition->size);
+    } else if (image_size != OTA_WITH_SEQUENTIAL_WRITES) {
+        err = erase_to(h, image_size);
+    }
+    if (err != ESP_OK) {
+        h->used = false;
+        return err;
+    }
+    *out_handle = idx + 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    ota_handle_t *h = get_handle(handle);
+    if (h == NULL || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (size == 0) {
+        return ESP_OK;
+    }
+    if (h->written == 0 && ((const uint8_t *)data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x)", ((const uint8_t *)data)[0]);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (size > h->part->size - h->written) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = erase_to(h, h->written + size);
+    if (err == ESP_OK) {
+        err = esp_partition_write(h->part, h->written, data, size);
+    }
+    if (err == ESP_OK) {
+        h->written += size;
+    }
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    ota_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t written = h->written;
+    h->used = false;
+    return written > 0 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    ota_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    h->used = false;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    pthread_once(&s_once, boot);
+    return s_running;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    pthread_once(&s_once, boot);
+    pthread_mutex_lock(&s_lock);
+    const esp_partition_t *part = record_slot();
+    pthread_mutex_unlock(&s_lock);
+    return part;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    pthread_once(&s_once, boot);
+    int idx = slot_index(start_from ? start_from : s_running);
+    return idx < 0 ? s_slots[0] : s_slots[(idx + 1) % 2];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    pthread_once(&s_once, boot);
+    int idx = slot_index(partition);
+    if (idx < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t magic;
+    if (esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    pthread_mutex_lock(&s_lock);
+    uint32_t seq = s_record.magic == OTADATA_MAGIC ? s_record.seq : 0;
+    while (seq == 0 || (int)((seq - 1) % 2) != idx) {
+        seq++;
+    }
+    s_record = (otadata_t){.magic = OTADATA_MAGIC, .seq = seq, .state = ESP_OTA_IMG_NEW};
+    esp_err_t err = store_record();
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    pthread_once(&s_once, boot);
+    if (partition == NULL || ota_state == NULL || slot_index(partition) < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (s_record.magic == OTADATA_MAGIC && partition == record_slot()) {
+        *ota_state = s_record.state;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    pthread_once(&s_once, boot);
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_OK;
+    if (s_record.magic == OTADATA_MAGIC && record_slot() == s_running &&
+        s_record.state == ESP_OTA_IMG_PENDING_VERIFY) {
+        s_record.state = ESP_OTA_IMG_VALID;
+        err = store_record();
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {
+        .magic_word = 0xABCD5432,
+        .version = "host",
+        .project_name = "esp32_c6_gateway",
+        .time = __TIME__,
+        .date = __DATE__,
+        .idf_ver = "host-shim",
+    };
+    return &desc;
+}
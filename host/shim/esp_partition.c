@@ -0,0 +1,352 @@
+// esp_partition.c - partition table from partitions.csv, backed by files
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static const char *TAG = "esp_partition";
+
+#ifndef GW_PARTITION_TABLE
+#define GW_PARTITION_TABLE "partitions.csv"
+#endif
+
+#define MAX_PARTITIONS 16
+#define MAX_MAPPINGS 8
+#define TABLE_END_OFFSET 0x9000 // Table itself lives at 0x8000
+
+typedef struct {
+    esp_partition_t part;
+    int fd;
+} host_partition_t;
+
+typedef struct {
+    void *addr;
+    size_t len;
+} host_mapping_t;
+
+static host_partition_t s_parts[MAX_PARTITIONS];
+static int s_part_count;
+static host_mapping_t s_maps[MAX_MAPPINGS];
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_table_once = PTHREAD_ONCE_INIT;
+
+static char *trim(char *s)
+{
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+static uint32_t parse_size(const char *s)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        v *= 1024;
+    } else if (*end == 'M' || *end == 'm') {
+        v *= 1024 * 1024;
+    }
+    return (uint32_t)v;
+}
+
+static int parse_type(const char *s)
+{
+    if (strcmp(s, "app") == 0) {
+        return ESP_PARTITION_TYPE_APP;
+    }
+    if (strcmp(s, "data") == 0) {
+        return ESP_PARTITION_TYPE_DATA;
+    }
+    return (int)strtol(s, NULL, 0);
+}
+
+static int parse_subtype(const char *s)
+{
+    static const struct {
+        const char *name;
+        int value;
+    } names[] = {
+        {"factory", ESP_PARTITION_SUBTYPE_APP_FACTORY},
+        {"ota_0", ESP_PARTITION_SUBTYPE_APP_OTA_0},
+        {"ota_1", ESP_PARTITION_SUBTYPE_APP_OTA_1},
+        {"ota", ESP_PARTITION_SUBTYPE_DATA_OTA},
+        {"phy", ESP_PARTITION_SUBTYPE_DATA_PHY},
+        {"nvs", ESP_PARTITION_SUBTYPE_DATA_NVS},
+        {"fat", ESP_PARTITION_SUBTYPE_DATA_FAT},
+        {"spiffs", ESP_PARTITION_SUBTYPE_DATA_SPIFFS},
+        {"littlefs", ESP_PARTITION_SUBTYPE_DATA_LITTLEFS},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(s, names[i].name) == 0) {
+            return names[i].value;
+        }
+    }
+    return (int)strtol(s, NULL, 0);
+}
+
+// Lays the table out the way gen_esp32part.py does: blank offsets follow
+// the previous entry, apps aligned to 64 KB and data to 4 KB.
+static void load_table(void)
+{
+    FILE *f = fopen(GW_PARTITION_TABLE, "r");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", GW_PARTITION_TABLE, strerror(errno));
+        return;
+    }
+    uint32_t next = TABLE_END_OFFSET;
+    char line[256];
+    while (fgets(line, sizeof(line), f) && s_part_count < MAX_PARTITIONS) {
+        char *p = trim(line);
+        if (*p == '#' || *p == '\0') {
+            continue;
+        }
+        char *fields[6] = {0};
+        for (int i = 0; i < 6 && p; i++) {
+            char *comma = strchr(p, ',');
+            if (comma) {
+                *comma = '\0';
+            }
+            fields[i] = trim(p);
+            p = comma ? comma + 1 : NULL;
+        }
+        if (fields[4] == NULL) {
+            continue;
+        }
+        esp_partition_t *part = &s_parts[s_part_count].part;
+        strncpy(part->label, fields[0], sizeof(part->label) - 1);
+        part->type = parse_type(fields[1]);
+        part->subtype = parse_subtype(fields[2]);
+        uint32_t align = part->type == ESP_PARTITION_TYPE_APP ? 0x10000 : 0x1000;
+        part->address = *fields[3] ? parse_size(fields[3]) : (next + align - 1) & ~(align - 1);
+        part->size = parse_size(fields[4]);
+        part->erase_size = SPI_FLASH_SEC_SIZE;
+        s_parts[s_part_count].fd = -1;
+        next = part->address + part->size;
+        s_part_count++;
+    }
+    fclose(f);
+}
+
+// Opens the backing file, growing it with erased bytes as needed.
+static int backing_fd(host_partition_t *hp)
+{
+    if (hp->fd >= 0) {
+        return hp->fd;
+    }
+    const char *dir = getenv("GW_HOST_FLASH_DIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.part", dir ? dir : ".", hp->part.label);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+#ifdef GW_PARTITION_IMAGES
+    // A fresh partition starts out with its build image, as `idf.py flash`
+    // would write it
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        char image[256];
+        snprintf(image, sizeof(image), "%s/%s.bin", GW_PARTITION_IMAGES, hp->part.label);
+        FILE *f = fopen(image, "rb");
+        if (f) {
+            char buf[SPI_FLASH_SEC_SIZE];
+            size_t n;
+            off_t off = 0;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0 && off + n <= hp->part.size) {
+                if (pwrite(fd, buf, n, off) != (ssize_t)n) {
+                    break;
+                }
+                off += n;
+            }
+            fclose(f);
+        }
+    }
+#endif
+    if (fstat(fd, &st) == 0 && (uint32_t)st.st_size < hp->part.size) {
+        static const uint8_t erased[SPI_FLASH_SEC_SIZE] = {[0 ... SPI_FLASH_SEC_SIZE - 1] = 0xff};
+        for (size_t off = st.st_size; off < hp->part.size;) {
+            size_t n = hp->part.size - off < sizeof(erased) ? hp->part.size - off : sizeof(erased);
+            if (pwrite(fd, erased, n, off) != (ssize_t)n) {
+                close(fd);
+                return -1;
+            }
+            off += n;
+        }
+    }
+    hp->fd = fd;
+    return fd;
+}
+
+static host_partition_t *lookup(const esp_partition_t *partition)
+{
+    for (int i = 0; i < s_part_count; i++) {
+        if (&s_parts[i].part == partition) {
+            return &s_parts[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t check_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (partition == NULL || lookup(partition) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    pthread_once(&s_table_once, load_table);
+    for (int i = 0; i < s_part_count; i++) {
+        const esp_partition_t *part = &s_parts[i].part;
+        if (type != ESP_PARTITION_TYPE_ANY && part->type != type) {
+            continue;
+        }
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && part->subtype != subtype) {
+            continue;
+        }
+        if (label != NULL && strcmp(part->label, label) != 0) {
+            continue;
+        }
+        return part;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    esp_err_t err = check_range(partition, src_offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&s_lock);
+    int fd = backing_fd(lookup(partition));
+    ssize_t n = fd < 0 ? -1 : pread(fd, dst, size, src_offset);
+    pthread_mutex_unlock(&s_lock);
+    return n == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    esp_err_t err = check_range(partition, dst_offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (partition->readonly) {
+        return ESP_ERR_NOT_ALLOWED;
+    }
+    pthread_mutex_lock(&s_lock);
+    int fd = backing_fd(lookup(partition));
+    err = fd < 0 ? ESP_FAIL : ESP_OK;
+    uint8_t chunk[256];
+    for (size_t done = 0; err == ESP_OK && done < size;) {
+        size_t n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+        if (pread(fd, chunk, n, dst_offset + done) != (ssize_t)n) {
+            err = ESP_FAIL;
+            break;
+        }
+        // NOR flash can only clear bits
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] &= ((const uint8_t *)src)[done + i];
+        }
+        if (pwrite(fd, chunk, n, dst_offset + done) != (ssize_t)n) {
+            err = ESP_FAIL;
+        }
+        done += n;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    esp_err_t err = check_range(partition, offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition->readonly) {
+        return ESP_ERR_NOT_ALLOWED;
+    }
+    static const uint8_t erased[SPI_FLASH_SEC_SIZE] = {[0 ... SPI_FLASH_SEC_SIZE - 1] = 0xff};
+    pthread_mutex_lock(&s_lock);
+    int fd = backing_fd(lookup(partition));
+    err = fd < 0 ? ESP_FAIL : ESP_OK;
+    for (size_t off = 0; err == ESP_OK && off < size; off += SPI_FLASH_SEC_SIZE) {
+        if (pwrite(fd, erased, SPI_FLASH_SEC_SIZE, offset + off) != SPI_FLASH_SEC_SIZE) {
+            err = ESP_FAIL;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+// Maps the backing file read-only; MAP_SHARED so later writes show through
+// the way they do through the flash cache.
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    esp_err_t err = check_range(partition, offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&s_lock);
+    int fd = backing_fd(lookup(partition));
+    int slot = -1;
+    for (int i = 0; i < MAX_MAPPINGS; i++) {
+        if (s_maps[i].addr == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    if (fd < 0 || slot < 0) {
+        pthread_mutex_unlock(&s_lock);
+        return fd < 0 ? ESP_FAIL : ESP_ERR_NO_MEM;
+    }
+    // mmap wants a page-aligned file offset
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t lead = offset % page;
+    void *addr = mmap(NULL, size + lead, PROT_READ, MAP_SHARED, fd, offset - lead);
+    if (addr == MAP_FAILED) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_maps[slot].addr = addr;
+    s_maps[slot].len = size + lead;
+    pthread_mutex_unlock(&s_lock);
+    *out_ptr = (const uint8_t *)addr + lead;
+    *out_handle = (esp_partition_mmap_handle_t)slot;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    if (handle < MAX_MAPPINGS && s_maps[handle].addr != NULL) {
+        munmap(s_maps[handle].addr, s_maps[handle].len);
+        s_maps[handle].addr = NULL;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,28 @@
+// esp_rom_crc.c - software CRC-32 standing in for the ROM implementation
+
+#include <pthread.h>
+#include "esp_rom_crc.h"
+
+static uint32_t s_table[256];
+static pthread_once_t s_table_once = PTHREAD_ONCE_INIT;
+
+static void build_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        s_table[i] = c;
+    }
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    pthread_once(&s_table_once, build_table);
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc = s_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,102 @@
+// esp_system.c - chip, flash, heap and random number shims
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "esp_system.h"
+#include "esp_random.h"
+#include "esp_chip_info.h"
+#include "esp_flash.h"
+
+static pthread_mutex_t s_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_heap_size;
+static uint32_t s_min_free_heap = UINT32_MAX;
+
+esp_flash_t *esp_flash_default_chip = NULL;
+
+static uint32_t heap_size(void)
+{
+    if (s_heap_size == 0) {
+        const char *env = getenv("GW_HOST_HEAP_KB");
+        uint32_t kb = (env && *env) ? (uint32_t)strtoul(env, NULL, 10) : 0;
+        s_heap_size = kb ? kb * 1024 : SHIM_HEAP_SIZE;
+    }
+    return s_heap_size;
+}
+
+// The host heap is effectively unbounded, so report what the process has
+// allocated against a fixed budget instead. This keeps the heap figures in
+// logs and APIs moving the same way they do on the device.
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    uint32_t size = heap_size();
+    uint32_t used = info.uordblks > size ? size : (uint32_t)info.uordblks;
+    uint32_t free_size = size - used;
+    pthread_mutex_lock(&s_heap_lock);
+    if (free_size < s_min_free_heap) {
+        s_min_free_heap = free_size;
+    }
+    pthread_mutex_unlock(&s_heap_lock);
+    return free_size;
+}
+
+uint32_t esp_get_free_internal_heap_size(void)
+{
+    return esp_get_free_heap_size();
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    esp_get_free_heap_size();
+    pthread_mutex_lock(&s_heap_lock);
+    uint32_t min_free = s_min_free_heap;
+    pthread_mutex_unlock(&s_heap_lock);
+    return min_free;
+}
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() called, exiting\n");
+    exit(0);
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value;
+    if (getrandom(&value, sizeof(value), 0) != sizeof(value)) {
+        value = (uint32_t)rand();
+    }
+    return value;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n <= 0) {
+            break;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+void esp_chip_info(esp_chip_info_t *out_info)
+{
+    out_info->model = CHIP_ESP32C6;
+    out_info->features = CHIP_FEATURE_WIFI_BGN | CHIP_FEATURE_BLE | CHIP_FEATURE_IEEE802154;
+    out_info->revision = 0;
+    out_info->cores = 1;
+}
+
+esp_err_t esp_flash_get_size(esp_flash_t *chip, uint32_t *out_size)
+{
+    (void)chip;
+    if (out_size == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_size = SHIM_FLASH_SIZE;
+    return ESP_OK;
+}
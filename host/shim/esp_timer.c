@@ -0,0 +1,229 @@
+// esp_timer.c - high resolution timer service on a dedicated thread
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    uint64_t period_us;
+    int64_t alarm_us;
+    bool active;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *s_active;
+static struct esp_timer *s_running;
+static int64_t s_epoch_us = -1;
+static pthread_t s_timer_thread;
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Time since "boot", i.e. since the first use of any timer API.
+int64_t esp_timer_get_time(void)
+{
+    int64_t now = monotonic_us();
+    if (__atomic_load_n(&s_epoch_us, __ATOMIC_ACQUIRE) < 0) {
+        int64_t expected = -1;
+        __atomic_compare_exchange_n(&s_epoch_us, &expected, now, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+    return now - __atomic_load_n(&s_epoch_us, __ATOMIC_ACQUIRE);
+}
+
+static void list_remove(struct esp_timer *timer)
+{
+    for (struct esp_timer **it = &s_active; *it; it = &(*it)->next) {
+        if (*it == timer) {
+            *it = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->active = false;
+}
+
+static void list_insert(struct esp_timer *timer)
+{
+    struct esp_timer **it = &s_active;
+    while (*it && (*it)->alarm_us <= timer->alarm_us) {
+        it = &(*it)->next;
+    }
+    timer->next = *it;
+    *it = timer;
+    timer->active = true;
+}
+
+static void *timer_task(void *arg)
+{
+    (void)arg;
+    shim_task_adopt("esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE, 22);
+    pthread_mutex_lock(&s_lock);
+    while (1) {
+        if (s_active == NULL) {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        struct esp_timer *timer = s_active;
+        if (timer->alarm_us > now) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            int64_t wait_us = timer->alarm_us - now;
+            deadline.tv_sec += wait_us / 1000000;
+            deadline.tv_nsec += (wait_us % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue;
+        }
+        list_remove(timer);
+        if (timer->period_us) {
+            timer->alarm_us += timer->period_us;
+            if (timer->alarm_us < now) {
+                timer->alarm_us = now + timer->period_us;
+            }
+            list_insert(timer);
+        }
+        s_running = timer;
+        pthread_mutex_unlock(&s_lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&s_lock);
+        s_running = NULL;
+        pthread_cond_broadcast(&s_cond);
+    }
+    return NULL;
+}
+
+static void timer_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_create(&s_timer_thread, NULL, timer_task, NULL);
+    pthread_setname_np(s_timer_thread, "esp_timer");
+    pthread_detach(s_timer_thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&s_once, timer_init);
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us, bool restart)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (timer->active) {
+        if (!restart) {
+            pthread_mutex_unlock(&s_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        list_remove(timer);
+    }
+    timer->period_us = period_us;
+    timer->alarm_us = esp_timer_get_time() + (int64_t)timeout_us;
+    list_insert(timer);
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return timer_start(timer, period, period, false);
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    bool active = timer->active;
+    uint64_t period = timer->period_us;
+    pthread_mutex_unlock(&s_lock);
+    if (!active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return timer_start(timer, timeout_us, period ? timeout_us : 0, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (!timer->active) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    list_remove(timer);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (timer->active) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Let a callback that is currently running finish before freeing it.
+    while (s_running == timer && !pthread_equal(pthread_self(), s_timer_thread)) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    bool active = timer && timer->active;
+    pthread_mutex_unlock(&s_lock);
+    return active;
+}
@@ -0,0 +1,403 @@
+// esp_tls.c - esp-tls server sessions on OpenSSL
+//
+// One SSL_CTX is built per server configuration and reused for every session,
+// as mbedTLS shares its ssl_config on the device. Sessions are limited to
+// TLS 1.2 to match the gateway's mbedTLS build; resumption uses tickets only,
+// and only after esp_tls_cfg_server_session_tickets_init().
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include "esp_log.h"
+#include "esp_mem.h"
+#include "esp_tls.h"
+#include "mbedtls/net_sockets.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "esp-tls";
+
+struct esp_tls_server_session_ticket_ctx {
+    int enabled;
+};
+
+struct esp_tls {
+    SSL *ssl;
+    int sockfd;
+    mbedtls_net_context server_fd;
+    mbedtls_ssl_context mbedtls;
+    int last_error;
+    int last_flags;
+};
+
+typedef struct ctx_cache_entry {
+    const esp_tls_cfg_server_t *cfg;
+    const unsigned char *cert;
+    const unsigned char *key;
+    bool tickets;
+    SSL_CTX *ctx;
+    struct ctx_cache_entry *next;
+} ctx_cache_entry_t;
+
+static pthread_mutex_t s_ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+static ctx_cache_entry_t *s_ctx_cache;
+
+#ifdef CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+// Defaults for builds that link esp-tls without providing the hooks
+__attribute__((weak)) void *esp_mbedtls_mem_calloc(size_t n, size_t size)
+{
+    return calloc(n, size);
+}
+
+__attribute__((weak)) void esp_mbedtls_mem_free(void *ptr)
+{
+    free(ptr);
+}
+
+static void *crypto_malloc(size_t size, const char *file, int line)
+{
+    return esp_mbedtls_mem_calloc(1, size);
+}
+
+static void *crypto_realloc(void *ptr, size_t size, const char *file, int line)
+{
+    if (ptr == NULL) {
+        return esp_mbedtls_mem_calloc(1, size);
+    }
+    if (size == 0) {
+        esp_mbedtls_mem_free(ptr);
+        return NULL;
+    }
+    // mbedTLS has no realloc, so neither do the hooks
+    void *grown = esp_mbedtls_mem_calloc(1, size);
+    if (grown != NULL) {
+        size_t old = malloc_usable_size(ptr);
+        memcpy(grown, ptr, old < size ? old : size);
+        esp_mbedtls_mem_free(ptr);
+    }
+    return grown;
+}
+
+static void crypto_free(void *ptr, const char *file, int line)
+{
+    esp_mbedtls_mem_free(ptr);
+}
+
+// Must run before OpenSSL allocates anything
+__attribute__((constructor)) static void install_mem_hooks(void)
+{
+    CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free);
+}
+#endif
+
+static void log_openssl_errors(const char *what)
+{
+    unsigned long err;
+    char buf[256];
+    while ((err = ERR_get_error()) != 0) {
+        ERR_error_string_n(err, buf, sizeof(buf));
+        ESP_LOGD(TAG, "%s: %s", what, buf);
+    }
+}
+
+// mbedTLS calls the certificate selection hook right after parsing the
+// ClientHello; OpenSSL's ClientHello callback runs at the same point.
+static int client_hello_cb(SSL *ssl, int *alert, void *arg)
+{
+    const esp_tls_cfg_server_t *cfg = arg;
+    esp_tls_t *tls = SSL_get_app_data(ssl);
+    if (cfg->cert_select_cb(&tls->mbedtls) != 0) {
+        *alert = SSL_AD_HANDSHAKE_FAILURE;
+        return SSL_CLIENT_HELLO_ERROR;
+    }
+    return SSL_CLIENT_HELLO_SUCCESS;
+}
+
+static SSL_CTX *build_ctx(const esp_tls_cfg_server_t *cfg)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == NULL) {
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    if (cfg->ticket_ctx == NULL) {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+    if (cfg->cert_select_cb) {
+        SSL_CTX_set_client_hello_cb(ctx, client_hello_cb, (void *)cfg);
+    }
+
+    BIO *bio = BIO_new_mem_buf(cfg->servercert_buf, (int)cfg->servercert_bytes);
+    X509 *cert = bio ? PEM_read_bio_X509(bio, NULL, NULL, NULL) : NULL;
+    BIO_free(bio);
+    bio = BIO_new_mem_buf(cfg->serverkey_buf, (int)cfg->serverkey_bytes);
+    EVP_PKEY *key = bio ? PEM_read_bio_PrivateKey(bio, NULL, NULL, (void *)cfg->serverkey_password) : NULL;
+    BIO_free(bio);
+
+    bool ok = cert && key && SSL_CTX_use_certificate(ctx, cert) == 1 &&
+              SSL_CTX_use_PrivateKey(ctx, key) == 1 && SSL_CTX_check_private_key(ctx) == 1;
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    if (!ok) {
+        log_openssl_errors("certificate setup");
+        ESP_LOGE(TAG, "Failed to load server certificate or key");
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static SSL_CTX *get_ctx(const esp_tls_cfg_server_t *cfg)
+{
+    bool tickets = cfg->ticket_ctx != NULL;
+    pthread_mutex_lock(&s_ctx_lock);
+    ctx_cache_entry_t *entry;
+    for (entry = s_ctx_cache; entry; entry = entry->next) {
+        if (entry->cfg == cfg && entry->cert == cfg->servercert_buf &&
+            entry->key == cfg->serverkey_buf && entry->tickets == tickets) {
+            break;
+        }
+    }
+    if (entry == NULL) {
+        SSL_CTX *ctx = build_ctx(cfg);
+        entry = ctx ? calloc(1, sizeof(*entry)) : NULL;
+        if (entry) {
+            entry->cfg = cfg;
+            entry->cert = cfg->servercert_buf;
+            entry->key = cfg->serverkey_buf;
+            entry->tickets = tickets;
+            entry->ctx = ctx;
+            entry->next = s_ctx_cache;
+            s_ctx_cache = entry;
+        } else {
+            SSL_CTX_free(ctx);
+        }
+    }
+    pthread_mutex_unlock(&s_ctx_lock);
+    return entry ? entry->ctx : NULL;
+}
+
+static void drop_ctx(const esp_tls_cfg_server_t *cfg)
+{
+    pthread_mutex_lock(&s_ctx_lock);
+    ctx_cache_entry_t **link = &s_ctx_cache;
+    while (*link) {
+        ctx_cache_entry_t *entry = *link;
+        if (entry->cfg == cfg) {
+            *link = entry->next;
+            SSL_CTX_free(entry->ctx);
+            free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&s_ctx_lock);
+}
+
+esp_tls_t *esp_tls_init(void)
+{
+    esp_tls_t *tls = calloc(1, sizeof(*tls));
+    if (tls) {
+        tls->sockfd = -1;
+    }
+    return tls;
+}
+
+int esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls)
+{
+    if (cfg == NULL || tls == NULL) {
+        return -1;
+    }
+    SSL_CTX *ctx = get_ctx(cfg);
+    if (ctx == NULL) {
+        tls->last_error = ESP_ERR_MBEDTLS_SSL_SETUP_FAILED;
+        return -1;
+    }
+    tls->ssl = SSL_new(ctx);
+    if (tls->ssl == NULL || SSL_set_fd(tls->ssl, sockfd) != 1) {
+        tls->last_error = ESP_ERR_MBEDTLS_SSL_SETUP_FAILED;
+        return -1;
+    }
+    tls->sockfd = sockfd;
+    tls->server_fd.fd = sockfd;
+    tls->mbedtls.p_bio = &tls->server_fd;
+    SSL_set_app_data(tls->ssl, tls);
+    int ret = SSL_accept(tls->ssl);
+    if (ret != 1) {
+        int ssl_err = SSL_get_error(tls->ssl, ret);
+        tls->last_error = ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED;
+        tls->last_flags = ssl_err;
+        log_openssl_errors("handshake");
+        ESP_LOGD(TAG, "SSL_accept failed on fd %d (ssl error %d)", sockfd, ssl_err);
+        return -1;
+    }
+
+    tls->mbedtls.ssl = tls->ssl;
+    const char *cipher = SSL_CIPHER_standard_name(SSL_get_current_cipher(tls->ssl));
+    snprintf(tls->mbedtls.ciphersuite, sizeof(tls->mbedtls.ciphersuite), "%s", cipher ? cipher : "unknown");
+    // mbedTLS spells suite names with dashes
+    for (char *p = tls->mbedtls.ciphersuite; *p; p++) {
+        if (*p == '_') {
+            *p = '-';
+        }
+    }
+    tls->mbedtls.peer_cert.x509 = SSL_get0_peer_certificate(tls->ssl);
+    return 1;
+}
+
+void esp_tls_server_session_delete(esp_tls_t *tls)
+{
+    if (tls == NULL) {
+        return;
+    }
+    if (tls->ssl) {
+        SSL_shutdown(tls->ssl);
+        SSL_free(tls->ssl);
+    }
+    free(tls);
+}
+
+esp_err_t esp_tls_cfg_server_session_tickets_init(esp_tls_cfg_server_t *cfg)
+{
+    if (cfg == NULL || cfg->ticket_ctx != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cfg->ticket_ctx = calloc(1, sizeof(*cfg->ticket_ctx));
+    if (cfg->ticket_ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    cfg->ticket_ctx->enabled = 1;
+    return ESP_OK;
+}
+
+void esp_tls_cfg_server_session_tickets_free(esp_tls_cfg_server_t *cfg)
+{
+    if (cfg == NULL) {
+        return;
+    }
+    drop_ctx(cfg);
+    free(cfg->ticket_ctx);
+    cfg->ticket_ctx = NULL;
+}
+
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen)
+{
+    int ret = SSL_read(tls->ssl, data, (int)datalen);
+    if (ret > 0) {
+        return ret;
+    }
+    int ssl_err = SSL_get_error(tls->ssl, ret);
+    switch (ssl_err) {
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_WANT_READ:
+        return ESP_TLS_ERR_SSL_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return ESP_TLS_ERR_SSL_WANT_WRITE;
+    case SSL_ERROR_SYSCALL:
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return ESP_TLS_ERR_SSL_TIMEOUT;
+        }
+        // Peer closed without close_notify
+        if (errno == 0 || errno == ECONNRESET) {
+            return 0;
+        }
+        /* fall through */
+    default:
+        tls->last_error = ESP_ERR_ESP_TLS_TCP_CLOSED_FIN;
+        tls->last_flags = ssl_err;
+        return -1;
+    }
+}
+
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen)
+{
+    int ret = SSL_write(tls->ssl, data, (int)datalen);
+    if (ret > 0) {
+        return ret;
+    }
+    int ssl_err = SSL_get_error(tls->ssl, ret);
+    if (ssl_err == SSL_ERROR_WANT_WRITE || ssl_err == SSL_ERROR_WANT_READ) {
+        return ESP_TLS_ERR_SSL_WANT_WRITE;
+    }
+    tls->last_error = ESP_ERR_MBEDTLS_SSL_WRITE_FAILED;
+    tls->last_flags = ssl_err;
+    return -1;
+}
+
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls)
+{
+    if (tls == NULL || tls->ssl == NULL) {
+        return -1;
+    }
+    return SSL_pending(tls->ssl);
+}
+
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd)
+{
+    if (tls == NULL || sockfd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *sockfd = tls->sockfd;
+    return ESP_OK;
+}
+
+void *esp_tls_get_ssl_context(esp_tls_t *tls)
+{
+    return tls ? &tls->mbedtls : NULL;
+}
+
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_t *tls, int *esp_tls_code, int *esp_tls_flags)
+{
+    if (tls == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = tls->last_error;
+    if (esp_tls_code) {
+        *esp_tls_code = tls->last_flags;
+    }
+    if (esp_tls_flags) {
+        *esp_tls_flags = 0;
+    }
+    tls->last_error = 0;
+    tls->last_flags = 0;
+    return err;
+}
+
+const mbedtls_x509_crt *mbedtls_ssl_get_peer_cert(const mbedtls_ssl_context *ssl)
+{
+    return (ssl && ssl->peer_cert.x509) ? &ssl->peer_cert : NULL;
+}
+
+const char *mbedtls_ssl_get_ciphersuite(const mbedtls_ssl_context *ssl)
+{
+    return ssl ? ssl->ciphersuite : NULL;
+}
+
+const char *mbedtls_ssl_get_version(const mbedtls_ssl_context *ssl)
+{
+    return (ssl && ssl->ssl) ? SSL_get_version(ssl->ssl) : "unknown";
+}
+
+int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix, const mbedtls_x509_crt *crt)
+{
+    if (buf == NULL || size == 0 || crt == NULL || crt->x509 == NULL) {
+        return -1;
+    }
+    X509 *x509 = crt->x509;
+    char subject[256];
+    char issuer[256];
+    X509_NAME_oneline(X509_get_subject_name(x509), subject, sizeof(subject));
+    X509_NAME_oneline(X509_get_issuer_name(x509), issuer, sizeof(issuer));
+    int len = snprintf(buf, size, "%sissuer name       : %s\n%ssubject name      : %s\n",
+                       prefix, issuer, prefix, subject);
+    return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
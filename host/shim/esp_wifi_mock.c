@@ -0,0 +1,311 @@
+// esp_wifi_mock.c - mock station driver
+//
+// Simulates scan, association and DHCP with timers so the event sequence and
+// its timing look like a real connection. See esp_wifi.h for the knobs.
+
+#include <pthread.h>
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_log.h"
+
+#define MOCK_AP_CHANNEL 6
+#define MOCK_CHANNEL_COUNT 13
+
+static const char *TAG = "wifi_mock";
+static const uint8_t s_ap_bssid[6] = { 0x02, 0x47, 0x57, 0x00, 0x00, 0x01 };
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+typedef enum {
+    MOCK_IDLE,
+    MOCK_STARTED,
+    MOCK_CONNECTING,
+    MOCK_ASSOCIATED,
+    MOCK_GOT_IP,
+} mock_state_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_inited;
+static mock_state_t s_state;
+static wifi_mode_t s_mode;
+static wifi_config_t s_config;
+static esp_timer_handle_t s_assoc_timer;
+static esp_timer_handle_t s_dhcp_timer;
+static int s_fails_left = -1;
+
+static int env_int(const char *name, int def)
+{
+    const char *value = getenv(name);
+    return (value && *value) ? atoi(value) : def;
+}
+
+static void post_disconnected(uint8_t reason)
+{
+    wifi_event_sta_disconnected_t event = { .reason = reason, .rssi = -90 };
+    memcpy(event.ssid, s_config.sta.ssid, sizeof(event.ssid));
+    event.ssid_len = strnlen((const char *)s_config.sta.ssid, sizeof(s_config.sta.ssid));
+    memcpy(event.bssid, s_ap_bssid, sizeof(event.bssid));
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), portMAX_DELAY);
+}
+
+static void post_got_ip(void)
+{
+    ip_event_got_ip_t event = { 0 };
+    event.esp_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    esp_netif_get_ip_info(event.esp_netif, &event.ip_info);
+    event.ip_changed = true;
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), portMAX_DELAY);
+}
+
+static void dhcp_timer_cb(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    if (s_state != MOCK_ASSOCIATED) {
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+    s_state = MOCK_GOT_IP;
+    pthread_mutex_unlock(&s_lock);
+    shim_netif_set_sta_up(true);
+    post_got_ip();
+}
+
+static void assoc_timer_cb(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    if (s_state != MOCK_CONNECTING) {
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+    bool fail = false;
+    if (s_fails_left > 0) {
+        s_fails_left--;
+        fail = true;
+    }
+    // A directed connect to a BSSID or channel the AP is not on fails just
+    // like a stale cached entry would on the device.
+    if (s_config.sta.bssid_set && memcmp(s_config.sta.bssid, s_ap_bssid, 6) != 0) {
+        fail = true;
+    }
+    if (s_config.sta.channel && s_config.sta.channel != MOCK_AP_CHANNEL) {
+        fail = true;
+    }
+    if (fail) {
+        s_state = MOCK_STARTED;
+        pthread_mutex_unlock(&s_lock);
+        post_disconnected(WIFI_REASON_NO_AP_FOUND);
+        return;
+    }
+    s_state = MOCK_ASSOCIATED;
+    wifi_event_sta_connected_t event = {
+        .channel = MOCK_AP_CHANNEL,
+        .authmode = WIFI_AUTH_WPA2_PSK,
+        .aid = 1,
+    };
+    memcpy(event.ssid, s_config.sta.ssid, sizeof(event.ssid));
+    event.ssid_len = strnlen((const char *)s_config.sta.ssid, sizeof(s_config.sta.ssid));
+    memcpy(event.bssid, s_ap_bssid, sizeof(event.bssid));
+    pthread_mutex_unlock(&s_lock);
+
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &event, sizeof(event), portMAX_DELAY);
+    if (shim_netif_dhcp_enabled()) {
+        esp_timer_start_once(s_dhcp_timer, (uint64_t)env_int("GW_MOCK_WIFI_DHCP_MS", 200) * 1000);
+    } else {
+        dhcp_timer_cb(NULL);
+    }
+}
+
+// The lease exchange runs as after association. Like every GOT_IP the mock
+// posts, its event has ip_changed set, so the lease reads as replaced.
+void shim_wifi_dhcpc_started(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool got_ip = s_state == MOCK_GOT_IP;
+    if (got_ip) {
+        s_state = MOCK_ASSOCIATED;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (got_ip) {
+        esp_timer_start_once(s_dhcp_timer, (uint64_t)env_int("GW_MOCK_WIFI_DHCP_MS", 200) * 1000);
+    }
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    pthread_mutex_lock(&s_lock);
+    if (!s_inited) {
+        esp_timer_create_args_t assoc_args = { .callback = assoc_timer_cb, .name = "wifi_assoc" };
+        esp_timer_create_args_t dhcp_args = { .callback = dhcp_timer_cb, .name = "wifi_dhcp" };
+        esp_timer_create(&assoc_args, &s_assoc_timer);
+        esp_timer_create(&dhcp_args, &s_dhcp_timer);
+        s_fails_left = env_int("GW_MOCK_WIFI_FAILS", 0);
+        s_inited = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    s_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode)
+{
+    *mode = s_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface != WIFI_IF_STA || conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_config = *conf;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (interface != WIFI_IF_STA || conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    *conf = s_config;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (s_state != MOCK_IDLE) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_OK;
+    }
+    s_state = MOCK_STARTED;
+    pthread_mutex_unlock(&s_lock);
+    ESP_LOGI(TAG, "mock station started (AP on channel %d)", MOCK_AP_CHANNEL);
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    esp_wifi_disconnect();
+    pthread_mutex_lock(&s_lock);
+    s_state = MOCK_IDLE;
+    pthread_mutex_unlock(&s_lock);
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    pthread_mutex_lock(&s_lock);
+    if (s_state == MOCK_IDLE) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (s_state != MOCK_STARTED) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_WIFI_CONN;
+    }
+    s_state = MOCK_CONNECTING;
+    // A known channel costs one channel dwell, otherwise all channels are
+    // scanned before association.
+    int channels = s_config.sta.channel ? 1 : MOCK_CHANNEL_COUNT;
+    uint64_t delay_us = (uint64_t)channels * env_int("GW_MOCK_WIFI_SCAN_MS", 120) * 1000;
+    pthread_mutex_unlock(&s_lock);
+    esp_timer_stop(s_assoc_timer);
+    return esp_timer_start_once(s_assoc_timer, delay_us);
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    pthread_mutex_lock(&s_lock);
+    mock_state_t state = s_state;
+    if (state == MOCK_CONNECTING || state == MOCK_ASSOCIATED || state == MOCK_GOT_IP) {
+        s_state = MOCK_STARTED;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (state == MOCK_ASSOCIATED || state == MOCK_GOT_IP || state == MOCK_CONNECTING) {
+        esp_timer_stop(s_assoc_timer);
+        esp_timer_stop(s_dhcp_timer);
+        shim_netif_set_sta_up(false);
+        post_disconnected(WIFI_REASON_ASSOC_LEAVE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (ap_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    bool connected = s_state == MOCK_ASSOCIATED || s_state == MOCK_GOT_IP;
+    if (connected) {
+        memset(ap_info, 0, sizeof(*ap_info));
+        memcpy(ap_info->bssid, s_ap_bssid, sizeof(ap_info->bssid));
+        memcpy(ap_info->ssid, s_config.sta.ssid, sizeof(s_config.sta.ssid));
+        ap_info->primary = MOCK_AP_CHANNEL;
+        ap_info->rssi = (int8_t)(-55 - (int)(esp_random() % 9) + 4);
+        ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+        ap_info->phy_11b = 1;
+        ap_info->phy_11g = 1;
+        ap_info->phy_11n = 1;
+        ap_info->phy_11ax = 1;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return connected ? ESP_OK : ESP_ERR_WIFI_NOT_CONNECT;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi)
+{
+    wifi_ap_record_t ap_info;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&ap_info);
+    if (err == ESP_OK) {
+        *rssi = ap_info.rssi;
+    }
+    return err;
+}
+
+esp_err_t esp_wifi_sta_get_negotiated_phymode(wifi_phy_mode_t *phymode)
+{
+    *phymode = WIFI_PHY_MODE_HE20;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    static const uint8_t sta_mac[6] = { 0x02, 0x47, 0x57, 0x00, 0x00, 0x10 };
+    memcpy(mac, sta_mac, 6);
+    mac[5] += (uint8_t)ifx;
+    return ESP_OK;
+}
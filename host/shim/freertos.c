@@ -0,0 +1,819 @@
+// freertos.c - FreeRTOS primitives on top of pthreads
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+
+// Host threads need far more stack than the device tasks request (glibc
+// stdio alone uses several KB), so requested sizes are only a lower bound.
+#define SHIM_MIN_STACK (256 * 1024)
+
+struct shim_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t stack_depth;
+    UBaseType_t priority;
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notify_cond;
+    uint32_t notify_value;
+    bool notify_pending;
+    // Registry for uxTaskGetSystemState(), linked while the thread runs
+    struct shim_task *next;
+    bool registered;
+    UBaseType_t number;
+    pid_t tid;
+    const uint8_t *paint_lo;   // Painted stack range, see paint_stack()
+    const uint8_t *paint_hi;
+};
+
+static __thread struct shim_task *s_current_task;
+static pthread_mutex_t s_task_count_lock = PTHREAD_MUTEX_INITIALIZER;
+static UBaseType_t s_task_count = 1;
+static struct shim_task *s_tasks;   // Guarded by s_task_count_lock
+static UBaseType_t s_next_task_number = 1;
+static pthread_mutex_t s_critical_lock;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void monotonic_deadline(struct timespec *ts, TickType_t ticks)
+{
+    uint64_t ms = pdTICKS_TO_MS(ticks);
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void init_monotonic_cond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void unlock_on_cancel(void *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+// Waits on cond until pred() holds or the tick timeout expires. A task deleted
+// with vTaskDelete() while blocked here releases the lock on its way out.
+#define WAIT_UNTIL(lock, cond, pred, ticks, timed_out) do {                     \
+        struct timespec deadline_;                                              \
+        (timed_out) = false;                                                    \
+        pthread_cleanup_push(unlock_on_cancel, (lock));                         \
+        if ((ticks) != portMAX_DELAY) {                                         \
+            monotonic_deadline(&deadline_, (ticks));                            \
+        }                                                                       \
+        while (!(pred)) {                                                       \
+            if ((ticks) == 0) {                                                 \
+                (timed_out) = true;                                             \
+                break;                                                          \
+            }                                                                   \
+            if ((ticks) == portMAX_DELAY) {                                     \
+                pthread_cond_wait((cond), (lock));                              \
+            } else if (pthread_cond_timedwait((cond), (lock), &deadline_) == ETIMEDOUT) { \
+                if (!(pred)) {                                                  \
+                    (timed_out) = true;                                         \
+                }                                                               \
+                break;                                                          \
+            }                                                                   \
+        }                                                                       \
+        pthread_cleanup_pop(0);                                                 \
+    } while (0)
+
+static struct shim_task *task_alloc(const char *name, uint32_t stack_depth, UBaseType_t priority)
+{
+    struct shim_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    task->stack_depth = stack_depth;
+    task->priority = priority;
+    pthread_mutex_init(&task->notify_lock, NULL);
+    init_monotonic_cond(&task->notify_cond);
+    return task;
+}
+
+#define STACK_PAINT 0xA5
+// Room left between the painted range and the painting frame
+#define STACK_PAINT_GAP 1024
+
+// Fills the unused part of the calling thread's stack with a known byte so
+// the deepest use can be found later, as FreeRTOS does with
+// tskSTACK_FILL_BYTE. The first page is skipped in case it is the guard.
+static void __attribute__((noinline)) paint_stack(struct shim_task *task)
+{
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return;
+    }
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+    uint8_t *lo = (uint8_t *)addr + 4096;
+    uint8_t *hi = (uint8_t *)((uintptr_t)__builtin_frame_address(0) - STACK_PAINT_GAP);
+    if (hi <= lo) {
+        return;
+    }
+    for (volatile uint8_t *p = lo; p < hi; p++) {
+        *p = STACK_PAINT;
+    }
+    task->paint_lo = lo;
+    task->paint_hi = hi;
+}
+
+static void task_register(struct shim_task *task)
+{
+    task->tid = (pid_t)syscall(SYS_gettid);
+    pthread_mutex_lock(&s_task_count_lock);
+    task->number = s_next_task_number++;
+    task->next = s_tasks;
+    s_tasks = task;
+    task->registered = true;
+    pthread_mutex_unlock(&s_task_count_lock);
+}
+
+static void task_unregister(struct shim_task *task)
+{
+    pthread_mutex_lock(&s_task_count_lock);
+    for (struct shim_task **p = &s_tasks; *p; p = &(*p)->next) {
+        if (*p == task) {
+            *p = task->next;
+            break;
+        }
+    }
+    task->registered = false;
+    pthread_mutex_unlock(&s_task_count_lock);
+}
+
+static void task_free(void *arg)
+{
+    struct shim_task *task = arg;
+    task_unregister(task);
+    pthread_mutex_lock(&s_task_count_lock);
+    s_task_count--;
+    pthread_mutex_unlock(&s_task_count_lock);
+    pthread_mutex_destroy(&task->notify_lock);
+    pthread_cond_destroy(&task->notify_cond);
+    free(task);
+}
+
+static void *task_trampoline(void *arg)
+{
+    struct shim_task *task = arg;
+    s_current_task = task;
+    paint_stack(task);
+    task_register(task);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+    pthread_cleanup_push(task_free, task);
+    task->fn(task->arg);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName,
+                                   const uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    (void)xCoreID;
+    struct shim_task *task = task_alloc(pcName, usStackDepth, uxPriority);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = pxTaskCode;
+    task->arg = pvParameters;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    size_t stack = usStackDepth < SHIM_MIN_STACK ? SHIM_MIN_STACK : usStackDepth;
+    pthread_attr_setstacksize(&attr, stack);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_mutex_lock(&s_task_count_lock);
+    s_task_count++;
+    pthread_mutex_unlock(&s_task_count_lock);
+
+    // Publish the handle before the task runs, as FreeRTOS does.
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    if (pthread_create(&task->thread, &attr, task_trampoline, task) != 0) {
+        pthread_attr_destroy(&attr);
+        if (pxCreatedTask) {
+            *pxCreatedTask = NULL;
+        }
+        task_free(task);
+        return pdFAIL;
+    }
+    pthread_setname_np(task->thread, task->name);
+    pthread_attr_destroy(&attr);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (s_current_task == NULL) {
+        // Threads not created through xTaskCreate (main, shim workers) get a
+        // handle on first use so notifications work for them too.
+        s_current_task = task_alloc("main", 0, 1);
+        if (s_current_task) {
+            s_current_task->thread = pthread_self();
+        }
+    }
+    return s_current_task;
+}
+
+void shim_task_adopt(const char *name, uint32_t stack_depth, UBaseType_t priority)
+{
+    struct shim_task *task = s_current_task;
+    if (task == NULL) {
+        task = task_alloc(name, stack_depth, priority);
+        if (task == NULL) {
+            return;
+        }
+        task->thread = pthread_self();
+        s_current_task = task;
+    } else {
+        strncpy(task->name, name, sizeof(task->name) - 1);
+        task->stack_depth = stack_depth;
+        task->priority = priority;
+    }
+    if (!task->registered) {
+        // The main thread's stack grows on demand; painting it would commit
+        // the whole rlimit, so it is left unmeasured.
+        if (getpid() != (pid_t)syscall(SYS_gettid)) {
+            paint_stack(task);
+        }
+        task_register(task);
+    }
+}
+
+void shim_task_release(void)
+{
+    if (s_current_task && s_current_task->registered) {
+        task_unregister(s_current_task);
+    }
+}
+
+// Deepest use of the painted range, or 0 if the stack was not painted
+static uint32_t stack_used(const struct shim_task *task)
+{
+    if (task->paint_lo == NULL) {
+        return 0;
+    }
+    const uint8_t *p = task->paint_lo;
+    while (p < task->paint_hi && *p == STACK_PAINT) {
+        p++;
+    }
+    return (uint32_t)(task->paint_hi - p) + STACK_PAINT_GAP;
+}
+
+static uint32_t stack_high_water(const struct shim_task *task)
+{
+    uint32_t used = stack_used(task);
+    if (task->paint_lo == NULL) {
+        return task->stack_depth;
+    }
+    return used < task->stack_depth ? task->stack_depth - used : 0;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    struct shim_task *task = xTask ? xTask : xTaskGetCurrentTaskHandle();
+    return task ? stack_high_water(task) : 0;
+}
+
+// Thread CPU time in microseconds, the unit of IDF's esp_timer based
+// run-time counter; wraps like the device's 32-bit counter
+static uint32_t thread_run_time(const struct shim_task *task)
+{
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(task->thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL);
+}
+
+static eTaskState thread_state(const struct shim_task *task)
+{
+    if (task == s_current_task) {
+        return eRunning;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)task->tid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return eInvalid;
+    }
+    // The state follows the parenthesised name, which may contain spaces
+    char buf[256];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    const char *close_paren = strrchr(buf, ')');
+    char state = close_paren && close_paren[1] ? close_paren[2] : '?';
+    switch (state) {
+    case 'R':
+        return eReady;
+    case 'S':
+    case 'D':
+        return eBlocked;
+    case 'T':
+    case 't':
+        return eSuspended;
+    default:
+        return eInvalid;
+    }
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize,
+                                 uint32_t *const pulTotalRunTime)
+{
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&s_task_count_lock);
+    for (struct shim_task *t = s_tasks; t; t = t->next) {
+        count++;
+    }
+    if (count > uxArraySize) {
+        pthread_mutex_unlock(&s_task_count_lock);
+        return 0;
+    }
+    UBaseType_t i = 0;
+    for (struct shim_task *t = s_tasks; t; t = t->next, i++) {
+        pxTaskStatusArray[i] = (TaskStatus_t){
+            .xHandle = t,
+            .pcTaskName = t->name,
+            .xTaskNumber = t->number,
+            .eCurrentState = thread_state(t),
+            .uxCurrentPriority = t->priority,
+            .uxBasePriority = t->priority,
+            .ulRunTimeCounter = thread_run_time(t),
+            .usStackHighWaterMark = stack_high_water(t),
+            .xCoreID = tskNO_AFFINITY,
+        };
+    }
+    pthread_mutex_unlock(&s_task_count_lock);
+    if (pulTotalRunTime) {
+        // Elapsed wall time, so a task's share is its CPU time over elapsed
+        // time. Host threads run on several cores, so shares can sum past
+        // 100%.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        *pulTotalRunTime = (uint32_t)((uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL);
+    }
+    return count;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete == NULL || xTaskToDelete == s_current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(xTaskToDelete->thread);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    uint64_t ms = pdTICKS_TO_MS(xTicksToDelay);
+    struct timespec ts = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long)(ms % 1000) * 1000000L,
+    };
+    if (xTicksToDelay == 0) {
+        sched_yield();
+        return;
+    }
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ms = (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+    return (TickType_t)pdMS_TO_TICKS(ms);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0) {
+        vTaskDelay(wake - now);
+    }
+    *pxPreviousWakeTime = wake;
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    struct shim_task *task = xTaskToQuery ? xTaskToQuery : xTaskGetCurrentTaskHandle();
+    return task ? task->name : "";
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    struct shim_task *task = xTask ? xTask : xTaskGetCurrentTaskHandle();
+    return task ? task->priority : 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    pthread_mutex_lock(&s_task_count_lock);
+    UBaseType_t count = s_task_count;
+    pthread_mutex_unlock(&s_task_count_lock);
+    return count;
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue,
+                              eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&xTaskToNotify->notify_lock);
+    if (pulPreviousNotificationValue) {
+        *pulPreviousNotificationValue = xTaskToNotify->notify_value;
+    }
+    switch (eAction) {
+    case eSetBits:
+        xTaskToNotify->notify_value |= ulValue;
+        break;
+    case eIncrement:
+        xTaskToNotify->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        xTaskToNotify->notify_value = ulValue;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (xTaskToNotify->notify_pending) {
+            ret = pdFAIL;
+        } else {
+            xTaskToNotify->notify_value = ulValue;
+        }
+        break;
+    case eNoAction:
+    default:
+        break;
+    }
+    xTaskToNotify->notify_pending = true;
+    pthread_cond_signal(&xTaskToNotify->notify_cond);
+    pthread_mutex_unlock(&xTaskToNotify->notify_lock);
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct shim_task *task = xTaskGetCurrentTaskHandle();
+    bool timed_out;
+    pthread_mutex_lock(&task->notify_lock);
+    WAIT_UNTIL(&task->notify_lock, &task->notify_cond, task->notify_value != 0,
+               xTicksToWait, timed_out);
+    (void)timed_out;
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->notify_lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+                           uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    struct shim_task *task = xTaskGetCurrentTaskHandle();
+    bool timed_out;
+    pthread_mutex_lock(&task->notify_lock);
+    if (!task->notify_pending) {
+        task->notify_value &= ~ulBitsToClearOnEntry;
+    }
+    WAIT_UNTIL(&task->notify_lock, &task->notify_cond, task->notify_pending,
+               xTicksToWait, timed_out);
+    if (pulNotificationValue) {
+        *pulNotificationValue = task->notify_value;
+    }
+    if (!timed_out) {
+        task->notify_value &= ~ulBitsToClearOnExit;
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->notify_lock);
+    return timed_out ? pdFALSE : pdTRUE;
+}
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void shim_enter_critical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical_lock);
+}
+
+void shim_exit_critical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&s_critical_lock);
+}
+
+// ---- Semaphores and mutexes ----
+
+struct shim_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max_count;
+    bool recursive;
+    pthread_t owner;
+    UBaseType_t depth;
+};
+
+SemaphoreHandle_t shim_sem_create(UBaseType_t max_count, UBaseType_t initial, bool recursive)
+{
+    struct shim_sem *sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    init_monotonic_cond(&sem->cond);
+    sem->count = initial;
+    sem->max_count = max_count;
+    sem->recursive = recursive;
+    return sem;
+}
+
+BaseType_t shim_sem_take(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    bool timed_out;
+    pthread_mutex_lock(&sem->lock);
+    if (sem->recursive && sem->depth > 0 && pthread_equal(sem->owner, pthread_self())) {
+        sem->depth++;
+        pthread_mutex_unlock(&sem->lock);
+        return pdTRUE;
+    }
+    WAIT_UNTIL(&sem->lock, &sem->cond, sem->count > 0, ticks, timed_out);
+    if (!timed_out) {
+        sem->count--;
+        if (sem->recursive) {
+            sem->owner = pthread_self();
+            sem->depth = 1;
+        }
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return timed_out ? pdFALSE : pdTRUE;
+}
+
+BaseType_t shim_sem_give(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdTRUE;
+    pthread_mutex_lock(&sem->lock);
+    if (sem->recursive && sem->depth > 1) {
+        sem->depth--;
+    } else if (sem->count < sem->max_count) {
+        sem->depth = 0;
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    } else {
+        ret = pdFALSE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+UBaseType_t shim_sem_count(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    UBaseType_t count = sem->count;
+    pthread_mutex_unlock(&sem->lock);
+    return count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (sem == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+// ---- Event groups ----
+
+struct shim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct shim_event_group *group = calloc(1, sizeof(*group));
+    if (group == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    init_monotonic_cond(&group->cond);
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    if (xEventGroup == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&xEventGroup->lock);
+    pthread_cond_destroy(&xEventGroup->cond);
+    free(xEventGroup);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    xEventGroup->bits |= uxBitsToSet;
+    EventBits_t bits = xEventGroup->bits;
+    pthread_cond_broadcast(&xEventGroup->cond);
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits,
+                                TickType_t xTicksToWait)
+{
+    bool timed_out;
+    pthread_mutex_lock(&xEventGroup->lock);
+#define BITS_SATISFIED() (xWaitForAllBits                                          \
+        ? (xEventGroup->bits & uxBitsToWaitFor) == uxBitsToWaitFor                  \
+        : (xEventGroup->bits & uxBitsToWaitFor) != 0)
+    WAIT_UNTIL(&xEventGroup->lock, &xEventGroup->cond, BITS_SATISFIED(), xTicksToWait, timed_out);
+#undef BITS_SATISFIED
+    EventBits_t bits = xEventGroup->bits;
+    if (!timed_out && xClearOnExit) {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+// ---- Queues ----
+
+struct shim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *storage;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct shim_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->storage = calloc(uxQueueLength, uxItemSize ? uxItemSize : 1);
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    init_monotonic_cond(&queue->not_empty);
+    init_monotonic_cond(&queue->not_full);
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    if (xQueue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->not_empty);
+    pthread_cond_destroy(&xQueue->not_full);
+    free(xQueue->storage);
+    free(xQueue);
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t ticks, bool front)
+{
+    bool timed_out;
+    pthread_mutex_lock(&q->lock);
+    WAIT_UNTIL(&q->lock, &q->not_full, q->count < q->length, ticks, timed_out);
+    if (timed_out) {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_FULL;
+    }
+    UBaseType_t slot;
+    if (front) {
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    } else {
+        slot = (q->head + q->count) % q->length;
+    }
+    memcpy(q->storage + (size_t)slot * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    bool timed_out;
+    pthread_mutex_lock(&xQueue->lock);
+    WAIT_UNTIL(&xQueue->lock, &xQueue->not_empty, xQueue->count > 0, xTicksToWait, timed_out);
+    if (timed_out) {
+        pthread_mutex_unlock(&xQueue->lock);
+        return errQUEUE_EMPTY;
+    }
+    memcpy(pvBuffer, xQueue->storage + (size_t)xQueue->head * xQueue->item_size, xQueue->item_size);
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    pthread_cond_signal(&xQueue->not_full);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t spaces = xQueue->length - xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return spaces;
+}
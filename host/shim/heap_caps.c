@@ -0,0 +1,86 @@
+// heap_caps.c - capability-aware heap API on top of glibc malloc
+
+#include <malloc.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+
+static esp_alloc_failed_hook_t s_failed_hook;
+
+static void *check_alloc(void *ptr, size_t size, uint32_t caps, const char *function_name)
+{
+    if (ptr == NULL && size > 0 && s_failed_hook) {
+        s_failed_hook(size, caps, function_name);
+    }
+    return ptr;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return check_alloc(malloc(size), size, caps, __func__);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return check_alloc(calloc(n, size), n * size, caps, __func__);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    return check_alloc(realloc(ptr, size), size, caps, __func__);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+size_t heap_caps_get_allocated_size(void *ptr)
+{
+    return malloc_usable_size(ptr);
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    (void)caps;
+    struct mallinfo2 mi = mallinfo2();
+    size_t free_size = esp_get_free_heap_size();
+    size_t budget = free_size + mi.uordblks;
+    size_t claimed = mi.arena + mi.hblkhd;
+    size_t untouched = budget > claimed ? budget - claimed : 0;
+    info->total_free_bytes = free_size;
+    info->total_allocated_bytes = mi.uordblks;
+    info->largest_free_block = untouched < free_size ? untouched : free_size;
+    info->minimum_free_bytes = esp_get_minimum_free_heap_size();
+    info->allocated_blocks = mi.hblks;
+    info->free_blocks = mi.ordblks;
+    info->total_blocks = mi.hblks + mi.ordblks;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return esp_get_free_heap_size();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, caps);
+    return info.largest_free_block;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void)caps;
+    return esp_get_minimum_free_heap_size();
+}
+
+esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callback)
+{
+    if (callback == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_failed_hook = callback;
+    return ESP_OK;
+}
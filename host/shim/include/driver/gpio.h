@@ -0,0 +1,7 @@
+// gpio.h - host shim (the gateway only needs the type definitions)
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
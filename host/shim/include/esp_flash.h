@@ -0,0 +1,22 @@
+// esp_flash.h - host shim
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of the simulated flash chip.
+#define SHIM_FLASH_SIZE (4 * 1024 * 1024)
+
+typedef struct esp_flash_t esp_flash_t;
+
+extern esp_flash_t *esp_flash_default_chip;
+
+esp_err_t esp_flash_get_size(esp_flash_t *chip, uint32_t *out_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,133 @@
+// esp_https_server.h - host shim of the ESP-IDF HTTPS server
+//
+// Built on the esp_http_server and esp_tls shims exactly like the device
+// component: the TLS handshake runs in the server's open_fn and all session
+// I/O goes through transport overrides. The secure port is taken from the
+// GW_HOST_PORT environment variable (default 8443) instead of port_secure,
+// since binding port 443 needs privileges on a workstation.
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+#include "esp_tls.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ESP_EVENT_DECLARE_BASE(ESP_HTTPS_SERVER_EVENT);
+
+typedef enum {
+    HTTPS_SERVER_EVENT_ERROR = 0,
+    HTTPS_SERVER_EVENT_START,
+    HTTPS_SERVER_EVENT_ON_CONNECTED,
+    HTTPS_SERVER_EVENT_ON_DATA,
+    HTTPS_SERVER_EVENT_SENT_DATA,
+    HTTPS_SERVER_EVENT_DISCONNECTED,
+    HTTPS_SERVER_EVENT_STOP,
+} esp_https_server_event_id_t;
+
+typedef enum {
+    HTTPD_SSL_TRANSPORT_SECURE,
+    HTTPD_SSL_TRANSPORT_INSECURE
+} httpd_ssl_transport_mode_t;
+
+typedef enum {
+    HTTPD_SSL_USER_CB_SESS_CREATE,
+    HTTPD_SSL_USER_CB_SESS_CLOSE
+} httpd_ssl_user_cb_state_t;
+
+typedef struct esp_https_server_user_cb_arg {
+    httpd_ssl_user_cb_state_t user_cb_state;
+    void *user_data;
+    const esp_tls_t *tls;
+} esp_https_server_user_cb_arg_t;
+
+typedef void esp_https_server_user_cb(esp_https_server_user_cb_arg_t *user_cb);
+
+typedef esp_tls_server_cert_select_cb esp_https_server_cert_select_cb;
+
+typedef struct esp_https_server_last_error {
+    esp_err_t last_error;
+    int esp_tls_error_code;
+    int esp_tls_flags;
+} esp_https_server_last_error_t;
+
+struct httpd_ssl_config {
+    httpd_config_t httpd;
+    const uint8_t *servercert;
+    size_t servercert_len;
+    const uint8_t *cacert_pem;
+    size_t cacert_len;
+    const uint8_t *prvtkey_pem;
+    size_t prvtkey_len;
+    bool use_ecdsa_peripheral;
+    uint8_t ecdsa_key_efuse_blk;
+    httpd_ssl_transport_mode_t transport_mode;
+    uint16_t port_secure;
+    uint16_t port_insecure;
+    bool session_tickets;
+    bool use_secure_element;
+    esp_https_server_user_cb *user_cb;
+    void *ssl_userdata;
+    const char **alpn_protos;
+    esp_https_server_cert_select_cb cert_select_cb;
+};
+
+typedef struct httpd_ssl_config httpd_ssl_config_t;
+
+#define HTTPD_SSL_CONFIG_DEFAULT() {                        \
+    .httpd = {                                              \
+        .task_priority      = 5,                            \
+        .stack_size         = 10240,                        \
+        .core_id            = tskNO_AFFINITY,               \
+        .server_port        = 0,                            \
+        .ctrl_port          = 32768,                        \
+        .max_open_sockets   = 4,                            \
+        .max_uri_handlers   = 8,                            \
+        .max_resp_headers   = 8,                            \
+        .backlog_conn       = 5,                            \
+        .lru_purge_enable   = true,                         \
+        .recv_wait_timeout  = 5,                            \
+        .send_wait_timeout  = 5,                            \
+        .global_user_ctx = NULL,                            \
+        .global_user_ctx_free_fn = NULL,                    \
+        .global_transport_ctx = NULL,                       \
+        .global_transport_ctx_free_fn = NULL,               \
+        .enable_so_linger = false,                          \
+        .linger_timeout = 0,                                \
+        .keep_alive_enable = false,                         \
+        .keep_alive_idle = 0,                               \
+        .keep_alive_interval = 0,                           \
+        .keep_alive_count = 0,                              \
+        .open_fn = NULL,                                    \
+        .close_fn = NULL,                                   \
+        .uri_match_fn = NULL                                \
+    },                                                      \
+    .servercert = NULL,                                     \
+    .servercert_len = 0,                                    \
+    .cacert_pem = NULL,                                     \
+    .cacert_len = 0,                                        \
+    .prvtkey_pem = NULL,                                    \
+    .prvtkey_len = 0,                                       \
+    .use_ecdsa_peripheral = false,                          \
+    .ecdsa_key_efuse_blk = 0,                               \
+    .transport_mode = HTTPD_SSL_TRANSPORT_SECURE,           \
+    .port_secure = 443,                                     \
+    .port_insecure = 80,                                    \
+    .session_tickets = false,                               \
+    .use_secure_element = false,                            \
+    .user_cb = NULL,                                        \
+    .ssl_userdata = NULL,                                   \
+    .alpn_protos = NULL,                                    \
+    .cert_select_cb = NULL,                                 \
+}
+
+esp_err_t httpd_ssl_start(httpd_handle_t *handle, httpd_ssl_config_t *config);
+esp_err_t httpd_ssl_stop(httpd_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+// esp_littlefs.h - host shim for the joltwallet/littlefs component
+//
+// Registering a LittleFS partition creates base_path as a plain directory,
+// so the storage code reads and writes ordinary files on the host.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *base_path;
+    const char *partition_label;
+    uint8_t format_if_mount_failed : 1;
+    uint8_t read_only : 1;
+    uint8_t dont_mount : 1;
+    uint8_t grow_on_mount : 1;
+} esp_vfs_littlefs_conf_t;
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf);
+esp_err_t esp_vfs_littlefs_unregister(const char *partition_label);
+esp_err_t esp_littlefs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+// esp_mem.h - host shim
+//
+// mbedTLS allocator hooks. With CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC the
+// application defines these; the host build routes OpenSSL's allocations
+// through them so they are accounted the same way as on the device.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *esp_mbedtls_mem_calloc(size_t n, size_t size);
+void esp_mbedtls_mem_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,16 @@
+// esp_rom_crc.h - host shim for the ROM CRC routines
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same result as zlib's crc32(): pass 0 to start, or a previous result to
+// continue over more data.
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+// esp_system.h - host shim
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default size of the simulated heap reported by esp_get_free_heap_size().
+// OpenSSL and glibc use several times what mbedTLS does on the device, so
+// the default is well above the C6's ~400 KB; GW_HOST_HEAP_KB overrides it.
+#define SHIM_HEAP_SIZE (8 * 1024 * 1024)
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_free_internal_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+void esp_restart(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
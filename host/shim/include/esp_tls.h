@@ -0,0 +1,69 @@
+// esp_tls.h - host shim of the esp-tls server API on top of OpenSSL
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_MBEDTLS_SSL_SETUP_FAILED        (ESP_ERR_ESP_TLS_BASE + 0x16)
+#define ESP_ERR_MBEDTLS_SSL_WRITE_FAILED        (ESP_ERR_ESP_TLS_BASE + 0x17)
+#define ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED    (ESP_ERR_ESP_TLS_BASE + 0x1A)
+#define ESP_ERR_ESP_TLS_TCP_CLOSED_FIN          (ESP_ERR_ESP_TLS_BASE + 0x1C)
+
+#define ESP_TLS_ERR_SSL_WANT_READ   -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE  -0x6880
+#define ESP_TLS_ERR_SSL_TIMEOUT     -0x6800
+
+typedef enum {
+    ESP_TLS_VER_ANY = 0,
+    ESP_TLS_VER_TLS_1_2 = 0x1,
+    ESP_TLS_VER_TLS_1_3 = 0x2,
+    ESP_TLS_VER_TLS_MAX,
+} esp_tls_proto_ver_t;
+
+typedef struct esp_tls esp_tls_t;
+
+typedef struct esp_tls_server_session_ticket_ctx esp_tls_server_session_ticket_ctx_t;
+
+// Runs once the ClientHello is parsed, before any key exchange; a non-zero
+// return aborts the handshake (CONFIG_ESP_TLS_SERVER_CERT_SELECT_HOOK).
+typedef int (*esp_tls_server_cert_select_cb)(mbedtls_ssl_context *ssl);
+
+typedef struct esp_tls_cfg_server {
+    const char **alpn_protos;
+    const unsigned char *cacert_buf;
+    unsigned int cacert_bytes;
+    const unsigned char *servercert_buf;
+    unsigned int servercert_bytes;
+    const unsigned char *serverkey_buf;
+    unsigned int serverkey_bytes;
+    const unsigned char *serverkey_password;
+    unsigned int serverkey_password_len;
+    bool use_secure_element;
+    esp_tls_server_session_ticket_ctx_t *ticket_ctx;
+    void *userdata;
+    esp_tls_server_cert_select_cb cert_select_cb;
+} esp_tls_cfg_server_t;
+
+esp_tls_t *esp_tls_init(void);
+int esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls);
+void esp_tls_server_session_delete(esp_tls_t *tls);
+esp_err_t esp_tls_cfg_server_session_tickets_init(esp_tls_cfg_server_t *cfg);
+void esp_tls_cfg_server_session_tickets_free(esp_tls_cfg_server_t *cfg);
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen);
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen);
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls);
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd);
+void *esp_tls_get_ssl_context(esp_tls_t *tls);
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_t *tls, int *esp_tls_code, int *esp_tls_flags);
+
+#ifdef __cplusplus
+}
+#endif
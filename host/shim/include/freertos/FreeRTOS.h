@@ -0,0 +1,69 @@
+// FreeRTOS.h - host shim
+//
+// Tasks map onto pthreads and ticks onto CLOCK_MONOTONIC, which is enough for
+// the gateway's use of FreeRTOS (tasks, delays, mutexes, event groups).
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ  CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS  ((TickType_t)1000 / configTICK_RATE_HZ)
+#define configMAX_PRIORITIES 25
+#define configMAX_TASK_NAME_LEN 16
+#define portNUM_PROCESSORS  1
+
+#define pdMS_TO_TICKS(xTimeInMs) \
+    ((TickType_t)(((uint64_t)(xTimeInMs) * (uint64_t)configTICK_RATE_HZ) / (uint64_t)1000U))
+#define pdTICKS_TO_MS(xTicks) \
+    ((TickType_t)(((uint64_t)(xTicks) * (uint64_t)1000U) / (uint64_t)configTICK_RATE_HZ))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdPASS  (pdTRUE)
+#define pdFAIL  (pdFALSE)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL  ((BaseType_t)0)
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+// Critical sections and spinlocks collapse onto one process-wide recursive
+// mutex; there is no ISR context on the host.
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+void shim_enter_critical(portMUX_TYPE *mux);
+void shim_exit_critical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)         shim_enter_critical(mux)
+#define portEXIT_CRITICAL(mux)          shim_exit_critical(mux)
+#define portENTER_CRITICAL_ISR(mux)     shim_enter_critical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      shim_exit_critical(mux)
+#define portENTER_CRITICAL_SAFE(mux)    shim_enter_critical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     shim_exit_critical(mux)
+#define taskENTER_CRITICAL(mux)         shim_enter_critical(mux)
+#define taskEXIT_CRITICAL(mux)          shim_exit_critical(mux)
+#define portYIELD_FROM_ISR(x)           ((void)(x))
+#define xPortInIsrContext()             (pdFALSE)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+// semphr.h - host shim
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct shim_sem *SemaphoreHandle_t;
+
+SemaphoreHandle_t shim_sem_create(UBaseType_t max_count, UBaseType_t initial, bool recursive);
+BaseType_t shim_sem_take(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t shim_sem_give(SemaphoreHandle_t sem);
+UBaseType_t shim_sem_count(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#define xSemaphoreCreateMutex()                 shim_sem_create(1, 1, false)
+#define xSemaphoreCreateRecursiveMutex()        shim_sem_create(1, 1, true)
+#define xSemaphoreCreateBinary()                shim_sem_create(1, 0, false)
+#define xSemaphoreCreateCounting(max, init)     shim_sem_create((max), (init), false)
+#define xSemaphoreTake(sem, ticks)              shim_sem_take((sem), (ticks))
+#define xSemaphoreGive(sem)                     shim_sem_give(sem)
+#define xSemaphoreTakeRecursive(sem, ticks)     shim_sem_take((sem), (ticks))
+#define xSemaphoreGiveRecursive(sem)            shim_sem_give(sem)
+#define xSemaphoreGiveFromISR(sem, woken)       ((void)(woken), shim_sem_give(sem))
+#define xSemaphoreTakeFromISR(sem, woken)       ((void)(woken), shim_sem_take((sem), 0))
+#define uxSemaphoreGetCount(sem)                shim_sem_count(sem)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,4 @@
+// err.h - host shim
+#pragma once
+
+typedef signed char err_t;
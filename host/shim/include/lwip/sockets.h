@@ -0,0 +1,44 @@
+// sockets.h - host shim mapping lwIP sockets onto BSD sockets
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+// Fixed listener ports clash when several host processes run at once, as
+// under ctest -j. A UDP bind to a port from sdkconfig.h goes to the port in
+// its environment variable instead when that is set:
+//   GW_HOST_INGEST_UDP_PORT   CONFIG_INGEST_UDP_PORT
+//   GW_HOST_COAP_PORT         CONFIG_INGEST_COAP_PORT
+static inline int gw_host_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    int type = 0;
+    socklen_t type_len = sizeof(type);
+    struct sockaddr_in moved;
+    if (addr->sa_family != AF_INET || len < sizeof(moved) ||
+        getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len) != 0 || type != SOCK_DGRAM) {
+        return bind(fd, addr, len);
+    }
+    memcpy(&moved, addr, sizeof(moved));
+    const char *env = NULL;
+    if (ntohs(moved.sin_port) == CONFIG_INGEST_UDP_PORT) {
+        env = getenv("GW_HOST_INGEST_UDP_PORT");
+    } else if (ntohs(moved.sin_port) == CONFIG_INGEST_COAP_PORT) {
+        env = getenv("GW_HOST_COAP_PORT");
+    }
+    if (env == NULL || *env == '\0') {
+        return bind(fd, addr, len);
+    }
+    moved.sin_port = htons((uint16_t)atoi(env));
+    return bind(fd, (const struct sockaddr *)&moved, sizeof(moved));
+}
+#define bind gw_host_bind
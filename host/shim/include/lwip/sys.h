@@ -0,0 +1,4 @@
+// sys.h - host shim
+#pragma once
+
+#include <stdint.h>
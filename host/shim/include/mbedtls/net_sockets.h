@@ -0,0 +1,19 @@
+// net_sockets.h - host shim of the mbedTLS socket context
+//
+// esp-tls hands mbedTLS one of these as the BIO, so callbacks that only see
+// the mbedtls_ssl_context can still find the socket.
+#pragma once
+
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_net_context {
+    int MBEDTLS_PRIVATE(fd);
+} mbedtls_net_context;
+
+#ifdef __cplusplus
+}
+#endif
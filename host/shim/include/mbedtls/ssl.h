@@ -0,0 +1,38 @@
+// ssl.h - host shim exposing the mbedTLS session queries used by the gateway
+//
+// The host TLS backend is OpenSSL; these wrappers present its session state
+// through the mbedTLS names so CONFIG_ESP_TLS_USING_MBEDTLS code compiles.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// mbedTLS 3 hides struct members behind this unless private access is allowed
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+#define MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE -0x6E00
+
+typedef struct mbedtls_x509_crt {
+    void *x509;
+} mbedtls_x509_crt;
+
+typedef struct mbedtls_ssl_context {
+    void *ssl;
+    mbedtls_x509_crt peer_cert;
+    char ciphersuite[96];
+    void *MBEDTLS_PRIVATE(p_bio);   // The session's mbedtls_net_context
+} mbedtls_ssl_context;
+
+const mbedtls_x509_crt *mbedtls_ssl_get_peer_cert(const mbedtls_ssl_context *ssl);
+const char *mbedtls_ssl_get_ciphersuite(const mbedtls_ssl_context *ssl);
+const char *mbedtls_ssl_get_version(const mbedtls_ssl_context *ssl);
+int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix, const mbedtls_x509_crt *crt);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,115 @@
+// sdkconfig.h - host build configuration
+//
+// Mirrors the defaults from main/Kconfig and the ESP-IDF options the gateway
+// relies on, so the firmware sources compile unchanged on Linux.
+#pragma once
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+
+// Wi-Fi Configuration
+#define CONFIG_ESP_WIFI_SSID "mirzaGhalib"
+#define CONFIG_ESP_WIFI_PASSWORD "mypassword"
+#define CONFIG_ESP_MAXIMUM_RETRY 5
+#define CONFIG_ESP_WIFI_BACKOFF_BASE_MS 500
+#define CONFIG_ESP_WIFI_BACKOFF_MAX_MS 60000
+#define CONFIG_ESP_WIFI_AUTH_MODE_WPA_WPA2_PSK 1
+#define CONFIG_ESP_WIFI_FAST_RECONNECT 1
+#define CONFIG_LINK_MONITOR_INTERVAL_MS 5000
+#define CONFIG_LINK_MONITOR_HISTORY_LEN 120
+
+// LED Configuration
+#define CONFIG_BLINK_LED_STRIP 1
+#define CONFIG_BLINK_LED_STRIP_BACKEND_RMT 1
+#define CONFIG_ENV_GPIO_RANGE_MIN 0
+#define CONFIG_ENV_GPIO_OUT_RANGE_MAX 30
+#define CONFIG_BLINK_GPIO 8
+#define CONFIG_BLINK_PERIOD 1000
+
+// ESP-IDF component options
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_FREERTOS_IDLE_TASK_STACKSIZE 1536
+#define CONFIG_ESP_MAIN_TASK_STACK_SIZE 3584
+#define CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE 2304
+#define CONFIG_ESP_TIMER_TASK_STACK_SIZE 3584
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_ESP_TLS_USING_MBEDTLS 1
+#define CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC 1
+#define CONFIG_ESP_HTTPS_SERVER_ENABLE 1
+#define CONFIG_ESP_TLS_SERVER_CERT_SELECT_HOOK 1
+#define CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK 1
+#define CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE 1
+
+// HTTPS Server
+#define CONFIG_HTTPS_IDLE_TIMEOUT_S 30
+#define CONFIG_HTTPS_EVICT_MIN_IDLE_MS 1000
+// The load and ingest tests drive one loopback client far past a browser's
+// rate, so the host build allows many more handshakes per client and does
+// not limit requests; test_rate_limit covers the buckets themselves
+#define CONFIG_HTTPS_CONN_BURST 1000
+#define CONFIG_HTTPS_CONN_PER_MIN 60000
+#define CONFIG_HTTPS_REQ_BURST 0
+#define CONFIG_HTTPS_REQ_PER_MIN 1200
+#define CONFIG_HTTPS_ADMIT_MIN_FREE 32768
+#define CONFIG_HTTPS_ADMIT_MIN_BLOCK 18432
+
+// Firmware Update
+#define CONFIG_OTA_CHUNK_SIZE 4096
+#define CONFIG_OTA_REBOOT_DELAY_MS 2000
+
+// Storage
+#define CONFIG_LOG_STORE_BUFFER_SIZE 4096
+#define CONFIG_LOG_STORE_FLUSH_MS 5000
+#define CONFIG_LOG_STORE_SEGMENT_SIZE 65536
+#define CONFIG_LOG_STORE_MAX_SEGMENTS 6
+#define CONFIG_TSDB_MAX_SERIES 8
+
+// Heap Monitor
+#define CONFIG_HEAP_MONITOR_INTERVAL_MS 5000
+#define CONFIG_HEAP_MONITOR_MIN_FREE 40960
+#define CONFIG_HEAP_MONITOR_MIN_BLOCK 20480
+#define CONFIG_HEAP_MONITOR_MAX_FRAG_PCT 70
+#define CONFIG_HEAP_MONITOR_JSON_POOL_BLOCKS 256
+#define CONFIG_HEAP_MONITOR_SCRATCH_BLOCKS 2
+#define CONFIG_REQ_ARENA_SIZE 12288
+
+// Task Profiler
+#define CONFIG_TASK_PROFILER_INTERVAL_MS 5000
+#define CONFIG_TASK_PROFILER_WINDOW 12
+#define CONFIG_TASK_PROFILER_MAX_TASKS 24
+#define CONFIG_TASK_PROFILER_STACK_MARGIN_PCT 25
+#define CONFIG_TASK_PROFILER_REPORT_INTERVAL_S 600
+
+// Binary Log
+#define CONFIG_BINLOG_RECORDS_LOG2 8
+#define CONFIG_BINLOG_LEVEL 3
+#define CONFIG_BINLOG_CONSOLE 1
+#define CONFIG_BINLOG_DRAIN_MS 200
+
+// Sensor Ingest
+#define CONFIG_INGEST_QUEUE_LEN 256
+#define CONFIG_INGEST_ARCHIVE 1
+#define CONFIG_INGEST_SIM_RATE 0
+#define CONFIG_INGEST_SIM_SENSORS 2
+#define CONFIG_INGEST_UDP_PORT 5690
+#define CONFIG_INGEST_COAP_PORT 5683
+
+// MQTT Uplink; no broker by default, shorter batch and reconnect times so
+// test_uplink runs quickly
+#define CONFIG_UPLINK_BROKER_URI ""
+#define CONFIG_UPLINK_USERNAME ""
+#define CONFIG_UPLINK_PASSWORD ""
+#define CONFIG_UPLINK_TOPIC_PREFIX "gateway"
+#define CONFIG_UPLINK_BATCH_MAX_BYTES 1024
+#define CONFIG_UPLINK_BATCH_MAX_MS 500
+#define CONFIG_UPLINK_MAX_INFLIGHT 4
+#define CONFIG_UPLINK_ACK_TIMEOUT_MS 30000
+#define CONFIG_UPLINK_DRAIN_PER_S 20
+#define CONFIG_UPLINK_RECONNECT_MS 500
+#define CONFIG_UPLINK_STATUS_INTERVAL_S 60
+#define CONFIG_UPLINK_SPOOL_SEGMENT_SIZE 16384
+#define CONFIG_UPLINK_SPOOL_MAX_SEGMENTS 8
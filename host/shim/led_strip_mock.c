@@ -0,0 +1,92 @@
+// led_strip_mock.c - in-memory LED strip
+
+#include "led_strip.h"
+#include "esp_log.h"
+
+struct led_strip_t {
+    uint32_t max_leds;
+    uint32_t *pixels;
+    uint32_t *shown;
+};
+
+static const char *TAG = "led_mock";
+
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config,
+                                   const led_strip_rmt_config_t *rmt_config,
+                                   led_strip_handle_t *ret_strip)
+{
+    (void)rmt_config;
+    if (led_config == NULL || ret_strip == NULL || led_config->max_leds == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct led_strip_t *strip = calloc(1, sizeof(*strip));
+    if (strip == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    strip->max_leds = led_config->max_leds;
+    strip->pixels = calloc(strip->max_leds, sizeof(uint32_t));
+    strip->shown = calloc(strip->max_leds, sizeof(uint32_t));
+    if (strip->pixels == NULL || strip->shown == NULL) {
+        led_strip_del(strip);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "mock strip with %" PRIu32 " LED(s) on GPIO %d", strip->max_leds,
+             led_config->strip_gpio_num);
+    *ret_strip = strip;
+    return ESP_OK;
+}
+
+esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index,
+                              uint32_t red, uint32_t green, uint32_t blue)
+{
+    if (strip == NULL || index >= strip->max_leds) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t rgb = ((red & 0xff) << 16) | ((green & 0xff) << 8) | (blue & 0xff);
+    __atomic_store_n(&strip->pixels[index], rgb, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_refresh(led_strip_handle_t strip)
+{
+    if (strip == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < strip->max_leds; i++) {
+        uint32_t rgb = __atomic_load_n(&strip->pixels[i], __ATOMIC_RELAXED);
+        __atomic_store_n(&strip->shown[i], rgb, __ATOMIC_RELAXED);
+    }
+    ESP_LOGD(TAG, "refresh: pixel 0 = #%06" PRIx32, __atomic_load_n(&strip->shown[0], __ATOMIC_RELAXED));
+    return ESP_OK;
+}
+
+esp_err_t led_strip_clear(led_strip_handle_t strip)
+{
+    if (strip == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < strip->max_leds; i++) {
+        __atomic_store_n(&strip->pixels[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&strip->shown[i], 0, __ATOMIC_RELAXED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_strip_del(led_strip_handle_t strip)
+{
+    if (strip == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    free(strip->pixels);
+    free(strip->shown);
+    free(strip);
+    return ESP_OK;
+}
+
+uint32_t shim_led_strip_get_pixel(led_strip_handle_t strip, uint32_t index)
+{
+    if (strip == NULL || index >= strip->max_leds) {
+        return 0;
+    }
+    return __atomic_load_n(&strip->shown[index], __ATOMIC_RELAXED);
+}
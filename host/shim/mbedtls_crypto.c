@@ -0,0 +1,69 @@
+// mbedtls_crypto.c - SHA-256 and signature checks in mbedTLS terms, over
+// OpenSSL
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    ctx->md = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    EVP_MD_CTX_free(ctx->md);
+    ctx->md = NULL;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    const EVP_MD *md = is224 ? EVP_sha224() : EVP_sha256();
+    return ctx->md && EVP_DigestInit_ex(ctx->md, md, NULL) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    return EVP_DigestUpdate(ctx->md, input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output)
+{
+    return EVP_DigestFinal_ex(ctx->md, output, NULL) == 1 ? 0 : -1;
+}
+
+void mbedtls_pk_init(mbedtls_pk_context *ctx)
+{
+    ctx->key = NULL;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context *ctx)
+{
+    EVP_PKEY_free(ctx->key);
+    ctx->key = NULL;
+}
+
+int mbedtls_pk_parse_public_key(mbedtls_pk_context *ctx, const unsigned char *key, size_t keylen)
+{
+    BIO *bio = BIO_new_mem_buf(key, (int)keylen);
+    if (bio == NULL) {
+        return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+    }
+    ctx->key = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    return ctx->key ? 0 : MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context *ctx, mbedtls_md_type_t md_alg, const unsigned char *hash, size_t hash_len,
+                      const unsigned char *sig, size_t sig_len)
+{
+    if (ctx->key == NULL || md_alg != MBEDTLS_MD_SHA256) {
+        return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+    }
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new(ctx->key, NULL);
+    int ok = pctx && EVP_PKEY_verify_init(pctx) == 1 && EVP_PKEY_CTX_set_signature_md(pctx, EVP_sha256()) == 1 &&
+             EVP_PKEY_verify(pctx, sig, sig_len, hash, hash_len) == 1;
+    EVP_PKEY_CTX_free(pctx);
+    return ok ? 0 : MBEDTLS_ERR_ECP_VERIFY_FAILED;
+}
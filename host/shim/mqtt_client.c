@@ -0,0 +1,550 @@
+// mqtt_client.c - minimal esp-mqtt client on BSD sockets and OpenSSL
+//
+// The client thread owns the connection: it connects, reads packets and
+// sends keepalive pings. Publishers write from their own threads; a mutex
+// serializes every read and write on the connection since an OpenSSL
+// session cannot be used from two threads at once.
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+
+static const char *TAG = "mqtt_client";
+
+ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
+
+#define MQTT_TASK_STACK 6144
+#define MQTT_TASK_PRIORITY 5
+#define POLL_MS 100
+#define MAX_PACKET 4096
+
+#define PKT_CONNECT 0x10
+#define PKT_CONNACK 0x20
+#define PKT_PUBLISH 0x30
+#define PKT_PUBACK 0x40
+#define PKT_PINGREQ 0xc0
+#define PKT_PINGRESP 0xd0
+#define PKT_DISCONNECT 0xe0
+
+struct esp_mqtt_client {
+    char host[128];
+    int port;
+    bool tls;
+    char *client_id;
+    char *username;
+    char *password;
+    int keepalive_s;
+    int reconnect_ms;
+    int timeout_ms;
+    bool clean_session;
+
+    esp_event_handler_t handler;
+    void *handler_arg;
+    esp_mqtt_event_id_t handler_event;
+
+    pthread_t thread;
+    volatile bool running;
+    pthread_mutex_t io_lock;
+    int sock;
+    SSL_CTX *ssl_ctx;
+    SSL *ssl;
+    volatile bool connected;
+    uint16_t next_msg_id;
+    int64_t last_tx_us;
+    int64_t ping_sent_us;     // 0 when no ping is outstanding
+};
+
+static char *dup_or_null(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+static bool parse_uri(esp_mqtt_client_handle_t c, const char *uri)
+{
+    const char *rest;
+    if (strncmp(uri, "mqtts://", 8) == 0) {
+        c->tls = true;
+        c->port = 8883;
+        rest = uri + 8;
+    } else if (strncmp(uri, "mqtt://", 7) == 0) {
+        c->tls = false;
+        c->port = 1883;
+        rest = uri + 7;
+    } else {
+        return false;
+    }
+    size_t len = strcspn(rest, ":/");
+    if (len == 0 || len >= sizeof(c->host)) {
+        return false;
+    }
+    memcpy(c->host, rest, len);
+    c->host[len] = '\0';
+    if (rest[len] == ':') {
+        c->port = atoi(rest + len + 1);
+    }
+    return c->port > 0 && c->port < 65536;
+}
+
+static void dispatch(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t id, int msg_id)
+{
+    if (c->handler == NULL || (c->handler_event != MQTT_EVENT_ANY && c->handler_event != id)) {
+        return;
+    }
+    esp_mqtt_event_t event = {.event_id = id, .client = c, .msg_id = msg_id};
+    c->handler(c->handler_arg, MQTT_EVENTS, id, &event);
+}
+
+// Writes everything or fails. Caller holds io_lock.
+static bool write_all(esp_mqtt_client_handle_t c, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        int n;
+        if (c->ssl) {
+            n = SSL_write(c->ssl, buf, (int)len);
+        } else {
+            n = (int)send(c->sock, buf, len, MSG_NOSIGNAL);
+        }
+        if (n <= 0) {
+            if (!c->ssl && n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    c->last_tx_us = esp_timer_get_time();
+    return true;
+}
+
+// Reads up to len bytes. Returns the count, 0 if nothing arrived within the
+// socket's short receive timeout, -1 on error or close. Caller holds io_lock.
+static int read_some(esp_mqtt_client_handle_t c, uint8_t *buf, size_t len)
+{
+    if (c->ssl) {
+        int n = SSL_read(c->ssl, buf, (int)len);
+        if (n > 0) {
+            return n;
+        }
+        int err = SSL_get_error(c->ssl, n);
+        if (err == SSL_ERROR_WANT_READ ||
+            (err == SSL_ERROR_SYSCALL && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+            return 0;
+        }
+        return -1;
+    }
+    ssize_t n = recv(c->sock, buf, len, 0);
+    if (n > 0) {
+        return (int)n;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    return -1;
+}
+
+static bool read_exact(esp_mqtt_client_handle_t c, uint8_t *buf, size_t len)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)c->timeout_ms * 1000;
+    while (len > 0) {
+        int n = read_some(c, buf, len);
+        if (n < 0 || (n == 0 && esp_timer_get_time() > deadline) || !c->running) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Reads one packet. Returns 1 with the packet, 0 if none was waiting, -1 on
+// a broken connection. Caller holds io_lock.
+static int read_packet(esp_mqtt_client_handle_t c, uint8_t *type, uint8_t *body, size_t *body_len)
+{
+    uint8_t first;
+    int n = read_some(c, &first, 1);
+    if (n <= 0) {
+        return n;
+    }
+    size_t remaining = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        uint8_t b;
+        if (!read_exact(c, &b, 1)) {
+            return -1;
+        }
+        remaining |= (size_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    if (remaining > MAX_PACKET || !read_exact(c, body, remaining)) {
+        return -1;
+    }
+    *type = first;
+    *body_len = remaining;
+    return 1;
+}
+
+static size_t put_remaining_length(uint8_t *p, size_t len)
+{
+    size_t n = 0;
+    do {
+        uint8_t b = len & 0x7f;
+        len >>= 7;
+        p[n++] = b | (len ? 0x80 : 0);
+    } while (len);
+    return n;
+}
+
+static size_t put_string(uint8_t *p, const char *s, size_t len)
+{
+    p[0] = (uint8_t)(len >> 8);
+    p[1] = (uint8_t)len;
+    memcpy(p + 2, s, len);
+    return 2 + len;
+}
+
+static void close_connection(esp_mqtt_client_handle_t c)
+{
+    pthread_mutex_lock(&c->io_lock);
+    c->connected = false;
+    if (c->ssl) {
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+    if (c->sock >= 0) {
+        close(c->sock);
+        c->sock = -1;
+    }
+    pthread_mutex_unlock(&c->io_lock);
+}
+
+static bool open_socket(esp_mqtt_client_handle_t c)
+{
+    char port[8];
+    snprintf(port, sizeof(port), "%d", c->port);
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res;
+    if (getaddrinfo(c->host, port, &hints, &res) != 0) {
+        return false;
+    }
+    int sock = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock < 0) {
+            continue;
+        }
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    if (sock < 0) {
+        return false;
+    }
+    struct timeval tv = {.tv_sec = 0, .tv_usec = POLL_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    c->sock = sock;
+    return true;
+}
+
+static bool start_tls(esp_mqtt_client_handle_t c)
+{
+    if (c->ssl_ctx == NULL) {
+        c->ssl_ctx = SSL_CTX_new(TLS_client_method());
+        if (c->ssl_ctx == NULL) {
+            return false;
+        }
+        SSL_CTX_set_verify(c->ssl_ctx, SSL_VERIFY_NONE, NULL);
+    }
+    c->ssl = SSL_new(c->ssl_ctx);
+    if (c->ssl == NULL) {
+        return false;
+    }
+    SSL_set_fd(c->ssl, c->sock);
+    SSL_set_tlsext_host_name(c->ssl, c->host);
+    int64_t deadline = esp_timer_get_time() + (int64_t)c->timeout_ms * 1000;
+    while (SSL_connect(c->ssl) != 1) {
+        int err = SSL_get_error(c->ssl, -1);
+        bool retry = err == SSL_ERROR_WANT_READ ||
+                     (err == SSL_ERROR_SYSCALL && (errno == EAGAIN || errno == EWOULDBLOCK));
+        if (!retry || esp_timer_get_time() > deadline || !c->running) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool connect_broker(esp_mqtt_client_handle_t c)
+{
+    if (!open_socket(c)) {
+        return false;
+    }
+    pthread_mutex_lock(&c->io_lock);
+    bool ok = !c->tls || start_tls(c);
+    if (ok) {
+        uint8_t pkt[512];
+        uint8_t body[500];
+        size_t len = put_string(body, "MQTT", 4);
+        uint8_t flags = c->clean_session ? 0x02 : 0;
+        flags |= c->username ? 0x80 : 0;
+        flags |= c->password ? 0x40 : 0;
+        body[len++] = 4;   // Protocol level 3.1.1
+        body[len++] = flags;
+        body[len++] = (uint8_t)(c->keepalive_s >> 8);
+        body[len++] = (uint8_t)c->keepalive_s;
+        const char *fields[] = {c->client_id, c->username, c->password};
+        for (int i = 0; i < 3; i++) {
+            if (fields[i] == NULL) {
+                continue;
+            }
+            size_t field_len = strlen(fields[i]);
+            if (len + 2 + field_len > sizeof(body)) {
+                ok = false;
+                break;
+            }
+            len += put_string(body + len, fields[i], field_len);
+        }
+        size_t pos = 0;
+        pkt[pos++] = PKT_CONNECT;
+        pos += put_remaining_length(pkt + pos, len);
+        memcpy(pkt + pos, body, len);
+        ok = ok && write_all(c, pkt, pos + len);
+    }
+    if (ok) {
+        uint8_t type = 0;
+        uint8_t ack[MAX_PACKET];
+        size_t ack_len = 0;
+        int64_t deadline = esp_timer_get_time() + (int64_t)c->timeout_ms * 1000;
+        int n;
+        while ((n = read_packet(c, &type, ack, &ack_len)) == 0 && esp_timer_get_time() < deadline && c->running) {
+        }
+        ok = n == 1 && (type & 0xf0) == PKT_CONNACK && ack_len == 2 && ack[1] == 0;
+        if (n == 1 && !ok) {
+            ESP_LOGW(TAG, "Broker refused the connection (return code %d)", ack_len == 2 ? ack[1] : -1);
+        }
+    }
+    if (ok) {
+        c->connected = true;
+        c->ping_sent_us = 0;
+    }
+    pthread_mutex_unlock(&c->io_lock);
+    if (!ok) {
+        close_connection(c);
+    }
+    return ok;
+}
+
+static void sleep_while_running(esp_mqtt_client_handle_t c, int ms)
+{
+    for (int waited = 0; waited < ms && c->running; waited += POLL_MS) {
+        usleep(POLL_MS * 1000);
+    }
+}
+
+// Polls for packets and keeps the connection alive until it breaks
+static void serve_connection(esp_mqtt_client_handle_t c)
+{
+    static const uint8_t ping[] = {PKT_PINGREQ, 0};
+    uint8_t body[MAX_PACKET];
+
+    while (c->running) {
+        struct pollfd pfd = {.fd = c->sock, .events = POLLIN};
+        bool pending = c->ssl && SSL_pending(c->ssl) > 0;
+        if (!pending && poll(&pfd, 1, POLL_MS) < 0 && errno != EINTR) {
+            return;
+        }
+        int64_t now = esp_timer_get_time();
+        pthread_mutex_lock(&c->io_lock);
+        int n = 0;
+        uint8_t type = 0;
+        size_t len = 0;
+        if (pending || (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            n = read_packet(c, &type, body, &len);
+        }
+        bool ok = n >= 0;
+        if (ok && c->ping_sent_us && now - c->ping_sent_us > (int64_t)c->timeout_ms * 1000) {
+            ESP_LOGW(TAG, "No ping response from the broker");
+            ok = false;
+        } else if (ok && c->keepalive_s && !c->ping_sent_us &&
+                   now - c->last_tx_us >= (int64_t)c->keepalive_s * 500000) {
+            ok = write_all(c, ping, sizeof(ping));
+            c->ping_sent_us = now;
+        }
+        pthread_mutex_unlock(&c->io_lock);
+        if (!ok) {
+            return;
+        }
+        if (n == 1 && (type & 0xf0) == PKT_PUBACK && len >= 2) {
+            dispatch(c, MQTT_EVENT_PUBLISHED, body[0] << 8 | body[1]);
+        } else if (n == 1 && (type & 0xf0) == PKT_PINGRESP) {
+            c->ping_sent_us = 0;
+        }
+    }
+}
+
+static void *client_thread(void *arg)
+{
+    esp_mqtt_client_handle_t c = arg;
+    shim_task_adopt("mqtt_task", MQTT_TASK_STACK, MQTT_TASK_PRIORITY);
+    while (c->running) {
+        dispatch(c, MQTT_EVENT_BEFORE_CONNECT, 0);
+        if (!connect_broker(c)) {
+            dispatch(c, MQTT_EVENT_ERROR, 0);
+            sleep_while_running(c, c->reconnect_ms);
+            continue;
+        }
+        ESP_LOGI(TAG, "Connected to %s:%d", c->host, c->port);
+        dispatch(c, MQTT_EVENT_CONNECTED, 0);
+        serve_connection(c);
+        if (c->running) {
+            ESP_LOGW(TAG, "Connection to %s:%d lost", c->host, c->port);
+        } else {
+            static const uint8_t bye[] = {PKT_DISCONNECT, 0};
+            pthread_mutex_lock(&c->io_lock);
+            write_all(c, bye, sizeof(bye));
+            pthread_mutex_unlock(&c->io_lock);
+        }
+        close_connection(c);
+        dispatch(c, MQTT_EVENT_DISCONNECTED, 0);
+        sleep_while_running(c, c->reconnect_ms);
+    }
+    shim_task_release();
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    if (config->broker.address.uri == NULL || !parse_uri(c, config->broker.address.uri)) {
+        ESP_LOGE(TAG, "Unsupported broker URI %s",
+                 config->broker.address.uri ? config->broker.address.uri : "(null)");
+        free(c);
+        return NULL;
+    }
+    c->client_id = strdup(config->credentials.client_id ? config->credentials.client_id : "esp32");
+    c->username = dup_or_null(config->credentials.username);
+    c->password = dup_or_null(config->credentials.authentication.password);
+    c->keepalive_s = config->session.keepalive ? config->session.keepalive : 120;
+    c->clean_session = !config->session.disable_clean_session;
+    c->reconnect_ms = config->network.reconnect_timeout_ms ? config->network.reconnect_timeout_ms : 10000;
+    c->timeout_ms = config->network.timeout_ms ? config->network.timeout_ms : 10000;
+    c->sock = -1;
+    c->next_msg_id = 1;
+    pthread_mutex_init(&c->io_lock, NULL);
+    return c;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    client->handler_event = event;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL || client->running) {
+        return ESP_FAIL;
+    }
+    client->running = true;
+    if (pthread_create(&client->thread, NULL, client_thread, client) != 0) {
+        client->running = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL || !client->running) {
+        return ESP_FAIL;
+    }
+    client->running = false;
+    pthread_join(client->thread, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->running) {
+        esp_mqtt_client_stop(client);
+    }
+    if (client->ssl_ctx) {
+        SSL_CTX_free(client->ssl_ctx);
+    }
+    pthread_mutex_destroy(&client->io_lock);
+    free(client->client_id);
+    free(client->username);
+    free(client->password);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    if (client == NULL || topic == NULL || qos < 0 || qos > 1) {
+        return -1;
+    }
+    if (len == 0 && data) {
+        len = (int)strlen(data);
+    }
+    size_t topic_len = strlen(topic);
+    size_t body_len = 2 + topic_len + (qos ? 2 : 0) + (size_t)len;
+    uint8_t *pkt = malloc(5 + body_len);
+    if (pkt == NULL) {
+        return -1;
+    }
+    size_t pos = 0;
+    pkt[pos++] = PKT_PUBLISH | (uint8_t)(qos << 1) | (retain ? 1 : 0);
+    pos += put_remaining_length(pkt + pos, body_len);
+    pos += put_string(pkt + pos, topic, topic_len);
+
+    int msg_id = 0;
+    pthread_mutex_lock(&client->io_lock);
+    if (qos) {
+        msg_id = client->next_msg_id++;
+        if (client->next_msg_id == 0) {
+            client->next_msg_id = 1;
+        }
+        pkt[pos++] = (uint8_t)(msg_id >> 8);
+        pkt[pos++] = (uint8_t)msg_id;
+    }
+    if (len > 0) {
+        memcpy(pkt + pos, data, (size_t)len);
+        pos += (size_t)len;
+    }
+    if (!client->connected || !write_all(client, pkt, pos)) {
+        msg_id = -1;
+    }
+    pthread_mutex_unlock(&client->io_lock);
+    free(pkt);
+    return msg_id;
+}
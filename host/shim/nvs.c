@@ -0,0 +1,382 @@
+// nvs.c - file-backed NVS
+//
+// Entries are kept in a linked list and written out in full on every commit,
+// which is plenty for the handful of keys the gateway stores.
+
+#include <pthread.h>
+#include <string.h>
+#include "nvs_flash.h"
+#include "esp_log.h"
+
+#define NVS_MAX_HANDLES 16
+#define NVS_FILE_MAGIC 0x3153564eU  // "NVS1"
+
+typedef enum {
+    NVS_TYPE_U8 = 0x01,
+    NVS_TYPE_I8 = 0x11,
+    NVS_TYPE_U16 = 0x02,
+    NVS_TYPE_I16 = 0x12,
+    NVS_TYPE_U32 = 0x04,
+    NVS_TYPE_I32 = 0x14,
+    NVS_TYPE_U64 = 0x08,
+    NVS_TYPE_I64 = 0x18,
+    NVS_TYPE_STR = 0x21,
+    NVS_TYPE_BLOB = 0x42,
+} nvs_type_t;
+
+typedef struct nvs_entry {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    uint32_t len;
+    uint8_t *data;
+    struct nvs_entry *next;
+} nvs_entry_t;
+
+typedef struct {
+    bool used;
+    bool read_only;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+} nvs_open_handle_t;
+
+static const char *TAG = "nvs";
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_initialized;
+static nvs_entry_t *s_entries;
+static nvs_open_handle_t s_handles[NVS_MAX_HANDLES];
+
+static const char *nvs_path(void)
+{
+    const char *path = getenv("GW_HOST_NVS");
+    return (path && *path) ? path : "gw_nvs.bin";
+}
+
+static void free_entries(void)
+{
+    while (s_entries) {
+        nvs_entry_t *next = s_entries->next;
+        free(s_entries->data);
+        free(s_entries);
+        s_entries = next;
+    }
+}
+
+static esp_err_t save_locked(void)
+{
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", nvs_path());
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    uint32_t magic = NVS_FILE_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, f);
+    for (nvs_entry_t *e = s_entries; e; e = e->next) {
+        fwrite(e->ns, sizeof(e->ns), 1, f);
+        fwrite(e->key, sizeof(e->key), 1, f);
+        fwrite(&e->type, sizeof(e->type), 1, f);
+        fwrite(&e->len, sizeof(e->len), 1, f);
+        fwrite(e->data, 1, e->len, f);
+    }
+    bool ok = fflush(f) == 0;
+    fclose(f);
+    // Rename so a crash mid-write never leaves a torn file behind.
+    if (!ok || rename(tmp, nvs_path()) != 0) {
+        remove(tmp);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t load_locked(void)
+{
+    FILE *f = fopen(nvs_path(), "rb");
+    if (f == NULL) {
+        return ESP_OK;
+    }
+    uint32_t magic = 0;
+    if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != NVS_FILE_MAGIC) {
+        fclose(f);
+        return ESP_ERR_NVS_NEW_VERSION_FOUND;
+    }
+    nvs_entry_t **tail = &s_entries;
+    while (1) {
+        nvs_entry_t *e = calloc(1, sizeof(*e));
+        if (e == NULL) {
+            break;
+        }
+        if (fread(e->ns, sizeof(e->ns), 1, f) != 1 ||
+            fread(e->key, sizeof(e->key), 1, f) != 1 ||
+            fread(&e->type, sizeof(e->type), 1, f) != 1 ||
+            fread(&e->len, sizeof(e->len), 1, f) != 1) {
+            free(e);
+            break;
+        }
+        e->data = malloc(e->len ? e->len : 1);
+        if (e->data == NULL || fread(e->data, 1, e->len, f) != e->len) {
+            free(e->data);
+            free(e);
+            break;
+        }
+        *tail = e;
+        tail = &e->next;
+    }
+    fclose(f);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_OK;
+    if (!s_initialized) {
+        err = load_locked();
+        s_initialized = (err == ESP_OK);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_flash_deinit(void)
+{
+    pthread_mutex_lock(&s_lock);
+    free_entries();
+    s_initialized = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&s_lock);
+    free_entries();
+    s_initialized = false;
+    remove(nvs_path());
+    pthread_mutex_unlock(&s_lock);
+    ESP_LOGW(TAG, "Erased %s", nvs_path());
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (name == NULL || strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (!s_initialized) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    for (int i = 0; i < NVS_MAX_HANDLES; i++) {
+        if (!s_handles[i].used) {
+            s_handles[i].used = true;
+            s_handles[i].read_only = (open_mode == NVS_READONLY);
+            strcpy(s_handles[i].ns, name);
+            *out_handle = (nvs_handle_t)(i + 1);
+            pthread_mutex_unlock(&s_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES) {
+        s_handles[handle - 1].used = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+static nvs_open_handle_t *get_handle(nvs_handle_t handle)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !s_handles[handle - 1].used) {
+        return NULL;
+    }
+    return &s_handles[handle - 1];
+}
+
+static nvs_entry_t *find_entry(const char *ns, const char *key, nvs_entry_t ***link)
+{
+    for (nvs_entry_t **it = &s_entries; *it; it = &(*it)->next) {
+        if (strcmp((*it)->ns, ns) == 0 && strcmp((*it)->key, key) == 0) {
+            if (link) {
+                *link = it;
+            }
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, uint8_t type,
+                           const void *data, size_t len)
+{
+    if (key == NULL || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (h->read_only) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    uint8_t *copy = malloc(len ? len : 1);
+    if (copy == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, data, len);
+    nvs_entry_t *e = find_entry(h->ns, key, NULL);
+    if (e == NULL) {
+        e = calloc(1, sizeof(*e));
+        if (e == NULL) {
+            free(copy);
+            pthread_mutex_unlock(&s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy(e->ns, h->ns);
+        strcpy(e->key, key);
+        e->next = s_entries;
+        s_entries = e;
+    }
+    free(e->data);
+    e->type = type;
+    e->data = copy;
+    e->len = (uint32_t)len;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char *key, uint8_t type,
+                           void *out, size_t *len, bool variable)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t *e = find_entry(h->ns, key, NULL);
+    if (e == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (e->type != type) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    esp_err_t err = ESP_OK;
+    if (variable) {
+        if (out == NULL) {
+            *len = e->len;
+        } else if (*len < e->len) {
+            *len = e->len;
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(out, e->data, e->len);
+            *len = e->len;
+        }
+    } else {
+        memcpy(out, e->data, e->len);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+#define NVS_SCALAR(suffix, ctype, tag)                                              \
+    esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key, ctype value)   \
+    {                                                                               \
+        return set_value(handle, key, tag, &value, sizeof(value));                  \
+    }                                                                               \
+    esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key, ctype *out)    \
+    {                                                                               \
+        return get_value(handle, key, tag, out, NULL, false);                       \
+    }
+
+NVS_SCALAR(u8, uint8_t, NVS_TYPE_U8)
+NVS_SCALAR(i8, int8_t, NVS_TYPE_I8)
+NVS_SCALAR(u16, uint16_t, NVS_TYPE_U16)
+NVS_SCALAR(i16, int16_t, NVS_TYPE_I16)
+NVS_SCALAR(u32, uint32_t, NVS_TYPE_U32)
+NVS_SCALAR(i32, int32_t, NVS_TYPE_I32)
+NVS_SCALAR(u64, uint64_t, NVS_TYPE_U64)
+NVS_SCALAR(i64, int64_t, NVS_TYPE_I64)
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set_value(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return get_value(handle, key, NVS_TYPE_STR, out_value, length, true);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return get_value(handle, key, NVS_TYPE_BLOB, out_value, length, true);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t **link = NULL;
+    nvs_entry_t *e = find_entry(h->ns, key, &link);
+    if (e == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *link = e->next;
+    free(e->data);
+    free(e);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t **it = &s_entries;
+    while (*it) {
+        if (strcmp((*it)->ns, h->ns) == 0) {
+            nvs_entry_t *dead = *it;
+            *it = dead->next;
+            free(dead->data);
+            free(dead);
+        } else {
+            it = &(*it)->next;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = get_handle(handle) ? save_locked() : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
@@ -0,0 +1,18 @@
+// check.h - assertion shared by the host tests
+//
+// Unlike assert() it is not compiled out by NDEBUG, and it reports the
+// failing expression with its file and line before exiting non-zero, which
+// is all ctest needs.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,120 @@
+// test_boot.c - phase ordering, skipped dependents and optional phases in
+// the boot orchestrator
+//
+// The table mirrors the shape of the one in main.c: settings fails, and the
+// LED and Wi-Fi phases, which only wait for it, still run on the Kconfig
+// defaults while a phase that requires it is skipped.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boot.h"
+#include "settings.h"
+#include "sdkconfig.h"
+#include "check.h"
+
+enum { PHASE_NVS, PHASE_SETTINGS, PHASE_LED, PHASE_NEEDS_SETTINGS, PHASE_WIFI, PHASE_BROKEN, PHASE_AFTER_BROKEN };
+
+static atomic_int s_order;
+static int s_ran[PHASE_AFTER_BROKEN + 1];
+static int32_t s_led_gpio;
+static char s_ssid[SETTINGS_STR_MAX + 1];
+
+static void ran(int phase)
+{
+    s_ran[phase] = atomic_fetch_add(&s_order, 1) + 1;
+}
+
+static esp_err_t nvs_phase(void)
+{
+    ran(PHASE_NVS);
+    return ESP_OK;
+}
+
+// As if the settings mutex could not be allocated
+static esp_err_t settings_phase(void)
+{
+    ran(PHASE_SETTINGS);
+    return ESP_ERR_NO_MEM;
+}
+
+static esp_err_t led_phase(void)
+{
+    ran(PHASE_LED);
+    s_led_gpio = settings_get_int(SETTING_LED_GPIO);
+    return ESP_OK;
+}
+
+static esp_err_t needs_settings_phase(void)
+{
+    ran(PHASE_NEEDS_SETTINGS);
+    return ESP_OK;
+}
+
+static esp_err_t wifi_phase(void)
+{
+    ran(PHASE_WIFI);
+    settings_get_str(SETTING_WIFI_SSID, s_ssid, sizeof(s_ssid));
+    return ESP_OK;
+}
+
+static esp_err_t broken_phase(void)
+{
+    ran(PHASE_BROKEN);
+    return ESP_FAIL;
+}
+
+static esp_err_t after_broken_phase(void)
+{
+    ran(PHASE_AFTER_BROKEN);
+    return ESP_OK;
+}
+
+static const boot_phase_t s_phases[] = {
+    [PHASE_NVS] = {.name = "nvs", .fn = nvs_phase},
+    [PHASE_SETTINGS] = {.name = "settings", .fn = settings_phase, .deps = BOOT_DEP(PHASE_NVS)},
+    [PHASE_LED] = {.name = "led", .fn = led_phase, .after = BOOT_DEP(PHASE_SETTINGS)},
+    [PHASE_NEEDS_SETTINGS] = {.name = "needs_set", .fn = needs_settings_phase, .deps = BOOT_DEP(PHASE_SETTINGS)},
+    [PHASE_WIFI] = {.name = "wifi", .fn = wifi_phase, .deps = BOOT_DEP(PHASE_LED) | BOOT_DEP(PHASE_NVS),
+                    .after = BOOT_DEP(PHASE_SETTINGS)},
+    [PHASE_BROKEN] = {.name = "broken", .fn = broken_phase},
+    [PHASE_AFTER_BROKEN] = {.name = "after_brk", .fn = after_broken_phase,
+                            .deps = BOOT_DEP(PHASE_WIFI), .after = BOOT_DEP(PHASE_BROKEN)},
+};
+
+#define PHASE_COUNT (sizeof(s_phases) / sizeof(s_phases[0]))
+
+int main(void)
+{
+    // A phase may only wait for earlier ones
+    static const boot_phase_t backwards[] = {
+        {.name = "first", .fn = nvs_phase, .after = BOOT_DEP(1)},
+        {.name = "second", .fn = nvs_phase},
+    };
+    CHECK(boot_run(backwards, 2) == ESP_ERR_INVALID_ARG);
+    CHECK(s_ran[PHASE_NVS] == 0);
+
+    // The first failure is reported, in table order
+    CHECK(boot_run(s_phases, PHASE_COUNT) == ESP_ERR_NO_MEM);
+    boot_phase_record_t records[BOOT_MAX_PHASES];
+    CHECK(boot_get_phases(records, BOOT_MAX_PHASES) == PHASE_COUNT);
+
+    CHECK(records[PHASE_SETTINGS].err == ESP_ERR_NO_MEM);
+    CHECK(records[PHASE_NEEDS_SETTINGS].err == ESP_ERR_INVALID_STATE && records[PHASE_NEEDS_SETTINGS].start_us < 0);
+    CHECK(s_ran[PHASE_NEEDS_SETTINGS] == 0);
+
+    // Waited for settings, then ran on the defaults
+    CHECK(records[PHASE_LED].err == ESP_OK && records[PHASE_WIFI].err == ESP_OK);
+    CHECK(s_ran[PHASE_LED] > s_ran[PHASE_SETTINGS] && s_ran[PHASE_WIFI] > s_ran[PHASE_LED]);
+    CHECK(records[PHASE_LED].start_us >= records[PHASE_SETTINGS].end_us);
+    CHECK(s_led_gpio == CONFIG_BLINK_GPIO);
+    CHECK(strcmp(s_ssid, CONFIG_ESP_WIFI_SSID) == 0);
+
+    CHECK(records[PHASE_BROKEN].err == ESP_FAIL);
+    CHECK(records[PHASE_AFTER_BROKEN].err == ESP_OK);
+    CHECK(s_ran[PHASE_AFTER_BROKEN] > s_ran[PHASE_BROKEN]);
+
+    printf("test_boot: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,334 @@
+// test_cbor.c - CBOR codec vectors, streaming output and the cJSON bridge
+//
+// Also prints payload sizes and encode/decode times next to cJSON's text
+// JSON for trees shaped like the /api replies, so the trade-off shows up in
+// the test log.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cbor.h"
+#include "check.h"
+
+#define BENCH_ROUNDS 5000
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Hex string to bytes; returns the length
+static size_t unhex(const char *hex, uint8_t *out)
+{
+    size_t n = 0;
+    for (; hex[0] && hex[1]; hex += 2) {
+        unsigned byte;
+        sscanf(hex, "%2x", &byte);
+        out[n++] = (uint8_t)byte;
+    }
+    return n;
+}
+
+static void expect_bytes(const cbor_writer_t *w, const char *hex)
+{
+    uint8_t want[64];
+    size_t n = unhex(hex, want);
+    if (w->err != ESP_OK || w->len != n || memcmp(w->buf, want, n) != 0) {
+        fprintf(stderr, "encoded ");
+        for (size_t i = 0; i < w->len; i++) {
+            fprintf(stderr, "%02x", w->buf[i]);
+        }
+        fprintf(stderr, ", want %s\n", hex);
+        exit(1);
+    }
+}
+
+// Encodes one number and compares with RFC 8949 Appendix A
+static void expect_number(double value, const char *hex)
+{
+    uint8_t buf[16];
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    cbor_put_number(&w, value);
+    expect_bytes(&w, hex);
+}
+
+static void check_encoder(void)
+{
+    expect_number(0, "00");
+    expect_number(23, "17");
+    expect_number(24, "1818");
+    expect_number(100, "1864");
+    expect_number(1000, "1903e8");
+    expect_number(1000000, "1a000f4240");
+    expect_number(1000000000000.0, "1b000000e8d4a51000");
+    expect_number(-1, "20");
+    expect_number(-100, "3863");
+    expect_number(-1000, "3903e7");
+    expect_number(1.1, "fb3ff199999999999a");
+    expect_number(100000.0, "1a000186a0");
+    expect_number(3.4028234663852886e+38, "fa7f7fffff");
+    expect_number(1.0e+300, "fb7e37e43c8800759c");
+    expect_number(-4.1, "fbc010666666666666");
+    expect_number(INFINITY, "fa7f800000");
+
+    uint8_t buf[64];
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    cbor_put_int(&w, INT64_MIN);
+    cbor_put_uint(&w, UINT64_MAX);
+    expect_bytes(&w, "3b7fffffffffffffff1bffffffffffffffff");
+
+    cbor_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    cbor_open_map(&w, 2);
+    cbor_put_text(&w, "a", 1);
+    cbor_put_number(&w, 1);
+    cbor_put_text(&w, "b", 1);
+    cbor_open_array(&w, 2);
+    cbor_put_bool(&w, true);
+    cbor_put_null(&w);
+    cbor_put_bytes(&w, "\x01\x02", 2);
+    expect_bytes(&w, "a2616101616282f5f6420102");
+    CHECK(cbor_writer_finish(&w) == ESP_OK);
+
+    // Without a flush callback the encoding has to fit
+    cbor_writer_init(&w, buf, 4, NULL, NULL);
+    cbor_put_text(&w, "IETF", 4);
+    CHECK(cbor_writer_finish(&w) == ESP_ERR_NO_MEM);
+    CHECK(w.total == 5);
+}
+
+typedef struct {
+    uint8_t data[4096];
+    size_t len;
+    int flushes;
+} sink_t;
+
+static esp_err_t collect(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *sink = ctx;
+    CHECK(sink->len + len <= sizeof(sink->data));
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    sink->flushes++;
+    return ESP_OK;
+}
+
+static esp_err_t refuse(void *ctx, const uint8_t *data, size_t len)
+{
+    return ESP_FAIL;
+}
+
+static cJSON *sample_tree(int tasks)
+{
+    static const char *states[] = {"running", "ready", "blocked", "suspended"};
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "count", tasks);
+    cJSON_AddNumberToObject(root, "window_ms", 5000);
+    cJSON *arr = cJSON_AddArrayToObject(root, "tasks");
+    for (int i = 0; i < tasks; i++) {
+        cJSON *item = cJSON_CreateObject();
+        char name[16];
+        snprintf(name, sizeof(name), "task_%d", i);
+        cJSON_AddStringToObject(item, "name", name);
+        cJSON_AddNumberToObject(item, "number", i + 1);
+        cJSON_AddNumberToObject(item, "priority", i % 24);
+        cJSON_AddStringToObject(item, "state", states[i % 4]);
+        cJSON_AddNumberToObject(item, "cpu_pct", (i * 37 % 1000) / 10.0);
+        cJSON_AddNumberToObject(item, "cpu_pct_window", i % 3 ? 0.5 : -1);
+        cJSON_AddNumberToObject(item, "stack_size", 3072 + 1024 * (i % 4));
+        cJSON_AddNumberToObject(item, "stack_free", 1200 + 13 * i);
+        cJSON_AddNumberToObject(item, "stack_free_min", 900 + 11 * i);
+        cJSON_AddBoolToObject(item, "self", i == 3);
+        cJSON_AddItemToArray(arr, item);
+    }
+    cJSON_AddNullToObject(root, "last_error");
+    return root;
+}
+
+// Streaming through a tiny buffer gives the same bytes as one big one, and
+// the tree survives a round trip
+static void check_stream_and_round_trip(void)
+{
+    cJSON *tree = sample_tree(12);
+    static uint8_t whole[4096];
+    cbor_writer_t w;
+    cbor_writer_init(&w, whole, sizeof(whole), NULL, NULL);
+    CHECK(cbor_encode_cjson(&w, tree) == ESP_OK);
+    CHECK(cbor_writer_finish(&w) == ESP_OK);
+
+    static sink_t sink;
+    uint8_t small[7];
+    cbor_writer_t sw;
+    cbor_writer_init(&sw, small, sizeof(small), collect, &sink);
+    CHECK(cbor_encode_cjson(&sw, tree) == ESP_OK);
+    CHECK(cbor_writer_finish(&sw) == ESP_OK);
+    CHECK(sink.len == w.len && memcmp(sink.data, whole, w.len) == 0);
+    CHECK(sw.total == w.len && sink.flushes > 10);
+
+    // A failing sink stops the writer
+    cbor_writer_init(&sw, small, sizeof(small), refuse, NULL);
+    CHECK(cbor_encode_cjson(&sw, tree) == ESP_FAIL);
+
+    cJSON *back;
+    CHECK(cbor_decode_cjson(whole, w.len, &back) == ESP_OK);
+    CHECK(cJSON_Compare(tree, back, true));
+    cJSON_Delete(back);
+    cJSON_Delete(tree);
+}
+
+static void expect_decode(const char *hex, const char *json)
+{
+    uint8_t buf[64];
+    size_t n = unhex(hex, buf);
+    cJSON *got;
+    CHECK(cbor_decode_cjson(buf, n, &got) == ESP_OK);
+    cJSON *want = cJSON_Parse(json);
+    if (!cJSON_Compare(got, want, true)) {
+        char *text = cJSON_PrintUnformatted(got);
+        fprintf(stderr, "decoded %s as %s, want %s\n", hex, text, json);
+        exit(1);
+    }
+    cJSON_Delete(got);
+    cJSON_Delete(want);
+}
+
+static void expect_reject(const char *hex, esp_err_t want)
+{
+    uint8_t buf[64];
+    size_t n = unhex(hex, buf);
+    cJSON *got = (cJSON *)1;
+    esp_err_t err = cbor_decode_cjson(buf, n, &got);
+    if (err != want || got != NULL) {
+        fprintf(stderr, "decoding %s gave %s, want %s\n", hex, esp_err_to_name(err), esp_err_to_name(want));
+        exit(1);
+    }
+}
+
+static void check_decoder(void)
+{
+    expect_decode("f93c00", "1.0");
+    expect_decode("f97bff", "65504.0");
+    expect_decode("f9c400", "-4.0");
+    expect_decode("fa47c35000", "100000.0");
+    expect_decode("3bfffffffffffffffe", "-18446744073709551615");
+    expect_decode("6449455446", "\"IETF\"");
+    expect_decode("62c3bc", "\"\xc3\xbc\"");
+    expect_decode("83010203", "[1,2,3]");
+    expect_decode("9f018202039f0405ffff", "[1,[2,3],[4,5]]");
+    expect_decode("bf61610161629f0203ffff", "{\"a\":1,\"b\":[2,3]}");
+    expect_decode("a26161016162820203", "{\"a\":1,\"b\":[2,3]}");
+    expect_decode("c074323031332d30332d32315432303a30343a30305a", "\"2013-03-21T20:04:00Z\"");
+    expect_decode("d9d9f7a0", "{}");
+    expect_decode("83f4f5f6", "[false,true,null]");
+
+    expect_reject("", ESP_ERR_INVALID_SIZE);
+    expect_reject("1903", ESP_ERR_INVALID_SIZE);          // Truncated argument
+    expect_reject("6261", ESP_ERR_INVALID_SIZE);          // Truncated string
+    expect_reject("830102", ESP_ERR_INVALID_SIZE);        // Missing array item
+    expect_reject("9f01", ESP_ERR_INVALID_SIZE);          // Missing break
+    expect_reject("0101", ESP_ERR_INVALID_SIZE);          // Trailing item
+    expect_reject("1c", ESP_ERR_INVALID_SIZE);            // Reserved additional info
+    expect_reject("f818", ESP_ERR_INVALID_SIZE);          // Badly encoded simple value
+    expect_reject("ff", ESP_ERR_INVALID_SIZE);            // Stray break
+    expect_reject("7f657374726561ff", ESP_ERR_NOT_SUPPORTED);
+    expect_reject("a10102", ESP_ERR_NOT_SUPPORTED);       // Integer key
+    expect_reject("4101", ESP_ERR_NOT_SUPPORTED);         // Byte string
+    expect_reject("f7", ESP_ERR_NOT_SUPPORTED);           // Undefined
+    expect_reject("818181818181818181818181818181818101", ESP_ERR_INVALID_SIZE);   // Too deep
+
+    // The reader on its own: headers, string slices and the end
+    uint8_t buf[16];
+    size_t n = unhex("a1636b6579f93e00", buf);
+    cbor_reader_t r;
+    cbor_item_t item;
+    cbor_reader_init(&r, buf, n);
+    CHECK(cbor_next(&r, &item) == ESP_OK && item.type == CBOR_MAP && item.uint == 1);
+    CHECK(cbor_next(&r, &item) == ESP_OK && item.type == CBOR_TEXT && item.uint == 3);
+    CHECK(memcmp(item.data, "key", 3) == 0);
+    CHECK(cbor_next(&r, &item) == ESP_OK && item.type == CBOR_FLOAT && item.number == 1.5);
+    CHECK(cbor_at_end(&r) && cbor_next(&r, &item) == ESP_ERR_NOT_FOUND);
+}
+
+// Walks every item without building anything, as a streaming consumer would
+static size_t walk(const uint8_t *buf, size_t len)
+{
+    cbor_reader_t r;
+    cbor_item_t item;
+    size_t items = 0;
+    cbor_reader_init(&r, buf, len);
+    while (cbor_next(&r, &item) == ESP_OK) {
+        items++;
+    }
+    return items;
+}
+
+static void report_sizes_and_times(int tasks)
+{
+    cJSON *tree = sample_tree(tasks);
+    static uint8_t buf[16384];
+    cbor_writer_t w;
+
+    double start = now_s();
+    size_t json_len = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        char *text = cJSON_PrintUnformatted(tree);
+        json_len = strlen(text);
+        cJSON_free(text);
+    }
+    double json_enc_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        cbor_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+        CHECK(cbor_encode_cjson(&w, tree) == ESP_OK);
+    }
+    double cbor_enc_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+    size_t cbor_len = w.len;
+
+    char *text = cJSON_PrintUnformatted(tree);
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        cJSON_Delete(cJSON_Parse(text));
+    }
+    double json_dec_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+    cJSON_free(text);
+
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        cJSON *back;
+        CHECK(cbor_decode_cjson(buf, cbor_len, &back) == ESP_OK);
+        cJSON_Delete(back);
+    }
+    double cbor_dec_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+
+    start = now_s();
+    size_t items = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        items = walk(buf, cbor_len);
+    }
+    double walk_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+
+    printf("%2d tasks: JSON %5zu B, CBOR %5zu B (%.0f%%) | encode %.2f vs %.2f us | "
+           "decode to tree %.2f vs %.2f us, streaming walk of %zu items %.2f us\n",
+           tasks, json_len, cbor_len, 100.0 * cbor_len / json_len, json_enc_us, cbor_enc_us, json_dec_us,
+           cbor_dec_us, items, walk_us);
+    CHECK(cbor_len < json_len);
+    cJSON_Delete(tree);
+}
+
+int main(void)
+{
+    check_encoder();
+    check_stream_and_round_trip();
+    check_decoder();
+    report_sizes_and_times(4);
+    report_sizes_and_times(24);
+    printf("test_cbor: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,299 @@
+// test_ingest.c - report and 802.15.4 parsing, dispatch, the UDP and CoAP
+// listeners and simulated-source throughput of the ingest pipeline
+//
+// tsdb, the record log and NVS use scratch files under the working
+// directory. Prints the sustained simulated rate so regressions show up in
+// the test log.
+
+#include <arpa/inet.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "coap.h"
+#include "ingest.h"
+#include "log_store.h"
+#include "nvs_flash.h"
+#include "tsdb.h"
+#include "sdkconfig.h"
+#include "check.h"
+
+#define FLASH_DIR "ingest_test_data"
+// Off the default ports, which the gateway_host tests may hold meanwhile
+#define UDP_PORT "18690"
+#define COAP_PORT "18680"
+#define KEEP 64
+
+static ingest_record_t s_seen[KEEP];
+static atomic_uint s_seen_count;
+
+// Keeps the first KEEP records for inspection and counts the rest
+static size_t keep_consume(const ingest_record_t *records, size_t count, void *ctx)
+{
+    for (size_t i = 0; i < count; i++) {
+        unsigned n = atomic_load(&s_seen_count);
+        if (n < KEEP) {
+            s_seen[n] = records[i];
+        }
+        atomic_store(&s_seen_count, n + 1);
+    }
+    return count;
+}
+
+static void wait_for(unsigned count)
+{
+    for (int i = 0; i < 200 && atomic_load(&s_seen_count) < count; i++) {
+        usleep(10000);
+    }
+    CHECK(atomic_load(&s_seen_count) == count);
+}
+
+static size_t put_reading(uint8_t *p, uint8_t kind, float value)
+{
+    p[0] = kind;
+    memcpy(p + 1, &value, sizeof(value));   // The host is little-endian
+    return 5;
+}
+
+static size_t report(uint8_t *p, uint8_t count, uint16_t seq, uint32_t sensor_id)
+{
+    p[0] = INGEST_REPORT_VERSION;
+    p[1] = count;
+    memcpy(p + 2, &seq, 2);
+    memcpy(p + 4, &sensor_id, 4);
+    size_t len = INGEST_REPORT_HDR_SIZE;
+    for (uint8_t i = 0; i < count; i++) {
+        len += put_reading(p + len, INGEST_KIND_TEMPERATURE + i % 4, 20.0f + i);
+    }
+    return len;
+}
+
+static const uint8_t s_token[] = {0xab, 0xcd};
+
+// CoAP request with a two-byte token, one Uri-Path option per segment and
+// an optional payload
+static size_t coap_request(uint8_t *p, coap_type_t type, uint8_t code, uint16_t mid, const char *path,
+                           const uint8_t *payload, size_t payload_len)
+{
+    size_t len = coap_build(p, 256, type, code, mid, s_token, sizeof(s_token), COAP_FORMAT_NONE, NULL, 0);
+    uint16_t last = 0;
+    while (*path == '/') {
+        const char *seg = ++path;
+        size_t seg_len = strcspn(seg, "/");
+        p[len++] = (uint8_t)((COAP_OPT_URI_PATH - last) << 4 | seg_len);
+        memcpy(p + len, seg, seg_len);
+        len += seg_len;
+        last = COAP_OPT_URI_PATH;
+        path = seg + seg_len;
+    }
+    if (payload_len) {
+        p[len++] = COAP_PAYLOAD_MARKER;
+        memcpy(p + len, payload, payload_len);
+        len += payload_len;
+    }
+    return len;
+}
+
+// Sends a datagram to the CoAP listener and parses the answer into msg.
+// Returns the answer's length, 0 if none came within 200 ms.
+static size_t coap_exchange(int sock, const uint8_t *req, size_t len, uint8_t *resp, coap_msg_t *msg)
+{
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons(atoi(COAP_PORT))};
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(sendto(sock, req, len, 0, (struct sockaddr *)&to, sizeof(to)) == (ssize_t)len);
+    ssize_t n = recv(sock, resp, 256, 0);
+    if (n <= 0) {
+        return 0;
+    }
+    CHECK(coap_parse(resp, (size_t)n, msg) == ESP_OK);
+    return (size_t)n;
+}
+
+int main(void)
+{
+    CHECK(system("rm -rf " FLASH_DIR " && mkdir " FLASH_DIR) == 0);
+    setenv("GW_HOST_FLASH_DIR", FLASH_DIR, 1);
+    setenv("GW_HOST_NVS", FLASH_DIR "/nvs.bin", 1);
+    setenv("GW_HOST_INGEST_UDP_PORT", UDP_PORT, 1);
+    setenv("GW_HOST_COAP_PORT", COAP_PORT, 1);
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(tsdb_init() == ESP_OK);
+    CHECK(log_store_init() == ESP_OK);
+
+    // An earlier boot stored samples ahead of the clock, as after a reset
+    // of a device whose clock was never set; stamps must carry on after them
+    int64_t stored_ms = (int64_t)time(NULL) * 1000 + 86400000;
+    CHECK(tsdb_append(CONFIG_TSDB_MAX_SERIES - 1, stored_ms, 1.0f) == ESP_OK);
+    CHECK(tsdb_flush() == ESP_OK);
+    CHECK(tsdb_init() == ESP_OK);
+    CHECK(tsdb_last_ts() == stored_ms);
+
+    uint8_t buf[128];
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, report(buf, 1, 1, 0), 1) == ESP_ERR_INVALID_STATE);
+    CHECK(ingest_init() == ESP_OK);
+    CHECK(ingest_add_consumer("keep", keep_consume, NULL) == ESP_OK);
+
+    // A bare report takes the sender's id when it does not carry one
+    size_t len = report(buf, 3, 7, 0);
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, len, 0x0a000001) == ESP_OK);
+    wait_for(3);
+    CHECK(s_seen[0].sensor_id == 0x0a000001 && s_seen[0].seq == 7 && s_seen[0].source == INGEST_SRC_UDP);
+    CHECK(s_seen[0].kind == INGEST_KIND_TEMPERATURE && s_seen[0].value == 20.0f);
+    CHECK(s_seen[2].kind == INGEST_KIND_PRESSURE && s_seen[2].value == 22.0f);
+    CHECK(s_seen[0].ts_ms > stored_ms && s_seen[0].ts_ms == s_seen[2].ts_ms);
+
+    // 802.15.4 data frame: 2006, no PAN ID compression, short destination,
+    // extended source whose low 32 bits name the sensor
+    uint8_t frame[128] = {0x01, 0xd8, 0x42, 0x62, 0x1a, 0x00, 0x00, 0x62, 0x1a,
+                          0x44, 0x33, 0x22, 0x11, 0xff, 0xee, 0xdd, 0xcc};
+    len = 17 + report(frame + 17, 2, 9, 0);
+    CHECK(ingest_submit_802154(INGEST_SRC_802154, frame, len + 2) == ESP_OK);
+    wait_for(5);
+    CHECK(s_seen[3].sensor_id == 0x11223344 && s_seen[3].seq == 9 && s_seen[4].value == 21.0f);
+
+    // Same frame with compression and the sequence number suppressed (2015)
+    uint8_t compact[128] = {0x41, 0xa9, 0x62, 0x1a, 0x00, 0x00, 0x34, 0x12};
+    len = 8 + report(compact + 8, 1, 10, 0);
+    CHECK(ingest_submit_802154(INGEST_SRC_802154, compact, len + 2) == ESP_OK);
+    wait_for(6);
+    CHECK(s_seen[5].sensor_id == 0x1234 && s_seen[5].seq == 10);
+
+    // Malformed frames are rejected and counted, nothing is queued
+    len = report(buf, 2, 1, 42);
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, len - 1, 0) == ESP_ERR_INVALID_SIZE);
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, 4, 0) == ESP_ERR_INVALID_SIZE);
+    buf[0] = 2;
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, len, 0) == ESP_ERR_INVALID_VERSION);
+    buf[0] = INGEST_REPORT_VERSION;
+    buf[1] = INGEST_MAX_READINGS + 1;
+    CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, sizeof(buf), 0) == ESP_ERR_INVALID_SIZE);
+    frame[0] |= 0x08;   // Security enabled
+    CHECK(ingest_submit_802154(INGEST_SRC_802154, frame, 40) == ESP_ERR_NOT_SUPPORTED);
+    frame[0] = 0x02;    // Acknowledgement
+    CHECK(ingest_submit_802154(INGEST_SRC_802154, frame, 5) == ESP_ERR_NOT_SUPPORTED);
+    CHECK(ingest_submit_802154(INGEST_SRC_802154, compact, 9) == ESP_ERR_INVALID_SIZE);
+
+    ingest_stats_t st;
+    ingest_get_stats(&st);
+    CHECK(st.sources[INGEST_SRC_UDP].parse_errors == 4 && st.sources[INGEST_SRC_UDP].records == 3);
+    CHECK(st.sources[INGEST_SRC_802154].parse_errors == 3 && st.sources[INGEST_SRC_802154].frames == 5);
+    CHECK(st.consumer_count == 2 && strcmp(st.consumers[0].name, "storage") == 0);
+    usleep(50000);
+    CHECK(atomic_load(&s_seen_count) == 6);
+
+    // The UDP listener sees the same reports over a socket
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons(atoi(UDP_PORT))};
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = report(buf, 1, 11, 0);
+    CHECK(sendto(sock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) == (ssize_t)len);
+    close(sock);
+    wait_for(7);
+    CHECK(s_seen[6].sensor_id == INADDR_LOOPBACK && s_seen[6].seq == 11);
+
+    // Codec: format errors are caught before anything is routed
+    coap_msg_t msg;
+    static const uint8_t bad_version[] = {0x80, 0x01, 0, 1};
+    static const uint8_t long_token[] = {0x49, 0x01, 0, 1, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    static const uint8_t lone_marker[] = {0x40, 0x02, 0, 1, 0xff};
+    static const uint8_t reserved_delta[] = {0x40, 0x02, 0, 1, 0xf1, 0};
+    static const uint8_t short_option[] = {0x40, 0x02, 0, 1, 0xb6, 'i', 'n'};
+    static const uint8_t ext_option[] = {0x40, 0x02, 0, 1, 0xd1, 0x02, 0x2a, 0xff, 1};
+    CHECK(coap_parse(bad_version, sizeof(bad_version), &msg) == ESP_ERR_INVALID_VERSION);
+    CHECK(coap_parse(long_token, sizeof(long_token), &msg) == ESP_ERR_INVALID_SIZE);
+    CHECK(coap_parse(lone_marker, sizeof(lone_marker), &msg) == ESP_ERR_INVALID_SIZE);
+    CHECK(coap_parse(reserved_delta, sizeof(reserved_delta), &msg) == ESP_ERR_INVALID_SIZE);
+    CHECK(coap_parse(short_option, sizeof(short_option), &msg) == ESP_ERR_INVALID_SIZE);
+    CHECK(coap_parse(ext_option, sizeof(ext_option), &msg) == ESP_OK && msg.payload_len == 1);
+    coap_option_iter_t it;
+    coap_option_t opt;
+    coap_option_iter_init(&msg, &it);
+    CHECK(coap_option_next(&it, &opt) && opt.num == 15 && coap_option_uint(&opt) == 0x2a);
+    CHECK(!coap_option_next(&it, &opt));
+
+    // CoAP listener: a confirmable report is acknowledged with 2.04 in a
+    // piggybacked ACK, and a retransmission is answered again but not
+    // ingested twice
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval tv = {.tv_usec = 200000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint8_t req[256];
+    uint8_t resp[256];
+    len = report(buf, 2, 12, 77);
+    size_t req_len = coap_request(req, COAP_TYPE_CON, COAP_CODE_POST, 0x1234, "/ingest", buf, len);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0);
+    CHECK(msg.type == COAP_TYPE_ACK && msg.code == COAP_CODE_CHANGED && msg.mid == 0x1234);
+    CHECK(msg.token_len == sizeof(s_token) && memcmp(msg.token, s_token, sizeof(s_token)) == 0);
+    wait_for(9);
+    CHECK(s_seen[7].sensor_id == 77 && s_seen[7].seq == 12 && s_seen[7].source == INGEST_SRC_COAP);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0 && msg.code == COAP_CODE_CHANGED);
+
+    // Non-confirmable reports get no answer unless they are rejected
+    len = report(buf, 1, 13, 0);
+    req_len = coap_request(req, COAP_TYPE_NON, COAP_CODE_POST, 0x1235, "/ingest", buf, len);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) == 0);
+    wait_for(10);
+    CHECK(s_seen[9].sensor_id == INADDR_LOOPBACK && s_seen[9].seq == 13);
+    req_len = coap_request(req, COAP_TYPE_NON, COAP_CODE_POST, 0x1236, "/ingest", buf, 3);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0);
+    CHECK(msg.type == COAP_TYPE_NON && msg.code == COAP_CODE_BAD_REQUEST);
+
+    // Routing, options and pings
+    req_len = coap_request(req, COAP_TYPE_CON, COAP_CODE_GET, 0x1237, "/ingest", NULL, 0);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0 && msg.code == COAP_CODE_METHOD_NOT_ALLOWED);
+    req_len = coap_request(req, COAP_TYPE_CON, COAP_CODE_POST, 0x1238, "/nothing/here", buf, len);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0 && msg.code == COAP_CODE_NOT_FOUND);
+    req_len = coap_request(req, COAP_TYPE_CON, COAP_CODE_GET, 0x1239, "/.well-known/core", NULL, 0);
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0 && msg.code == COAP_CODE_CONTENT);
+    coap_option_iter_init(&msg, &it);
+    CHECK(coap_option_next(&it, &opt) && opt.num == COAP_OPT_CONTENT_FORMAT &&
+          coap_option_uint(&opt) == COAP_FORMAT_LINK);
+    CHECK(msg.payload_len > 9 && memcmp(msg.payload, "</ingest>", 9) == 0);
+    req_len = coap_request(req, COAP_TYPE_CON, COAP_CODE_POST, 0x123a, "/ingest", NULL, 0);
+    req[req_len++] = 0x21;   // Option 13, unknown and critical, one byte
+    req[req_len++] = 0;
+    CHECK(coap_exchange(sock, req, req_len, resp, &msg) > 0 && msg.code == COAP_CODE_BAD_OPTION);
+    static const uint8_t ping[] = {0x40, 0x00, 0x12, 0x3b};
+    CHECK(coap_exchange(sock, ping, sizeof(ping), resp, &msg) > 0);
+    CHECK(msg.type == COAP_TYPE_RST && msg.code == COAP_CODE_EMPTY && msg.mid == 0x123b);
+    close(sock);
+    usleep(20000);   // The last response is counted after it is sent
+
+    ingest_coap_stats_t coap_st;
+    ingest_coap_get_stats(&coap_st);
+    CHECK(coap_st.requests == 9 && coap_st.confirmable == 6 && coap_st.duplicates == 1);
+    CHECK(coap_st.pings == 1 && coap_st.rejected == 4 && coap_st.responses == 8);
+    ingest_get_stats(&st);
+    CHECK(st.sources[INGEST_SRC_COAP].records == 3 && st.sources[INGEST_SRC_COAP].parse_errors == 1);
+
+    // Sustained simulated load through the whole pipeline, storage included
+    ingest_get_stats(&st);
+    uint32_t start = st.dispatched;
+    CHECK(ingest_sim_set_rate(INGEST_SIM_RATE_MAX + 1, 2) == ESP_ERR_INVALID_ARG);
+    CHECK(ingest_sim_set_rate(20000, INGEST_SIM_SENSORS_MAX + 1) == ESP_ERR_INVALID_ARG);
+    CHECK(ingest_sim_set_rate(20000, 2) == ESP_OK);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sleep(2);
+    CHECK(ingest_sim_set_rate(0, 2) == ESP_OK);
+    usleep(100000);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ingest_get_stats(&st);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    const ingest_source_stats_t *sim = &st.sources[INGEST_SRC_SIM];
+    printf("sim: %u frames, %u records dispatched in %.2f s (%.0f records/s), %u queue drops, "
+           "queue peak %u/%u\n", (unsigned)sim->frames, (unsigned)(st.dispatched - start), secs,
+           (st.dispatched - start) / secs, (unsigned)sim->queue_drops, (unsigned)st.queue_peak,
+           (unsigned)st.queue_len);
+    CHECK(sim->parse_errors == 0);
+    CHECK(st.dispatched - start == sim->records);
+    CHECK(sim->records > 10000);
+    CHECK(st.consumers[0].records + st.consumers[0].drops == st.dispatched);
+    CHECK(st.sim_rate == 0);
+
+    printf("ingest: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+// test_mem_pool.c - block reuse, exhaustion counters and contention of mem_pool
+//
+// Also prints the cost of an allocate/free pair next to malloc/free so a
+// regression on the fast path shows up in the test log. On the host most of
+// the pool's cost is the shim's process-wide critical section.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mem_pool.h"
+#include "check.h"
+
+#define THREADS 4
+#define ROUNDS 20000
+#define HELD 8
+#define BENCH_ROUNDS 1000000
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check_basics(void)
+{
+    mem_pool_t *pool;
+    CHECK(mem_pool_create("zero", 0, 4, 0, &pool) == ESP_ERR_INVALID_ARG);
+    CHECK(mem_pool_create("small", 13, 3, 0, &pool) == ESP_OK);
+    CHECK(mem_pool_block_size(pool) % sizeof(void *) == 0 && mem_pool_block_size(pool) >= 13);
+
+    void *a = mem_pool_alloc(pool);
+    void *b = mem_pool_alloc(pool);
+    void *c = mem_pool_alloc(pool);
+    CHECK(a && b && c && a != b && b != c && a != c);
+    CHECK(((uintptr_t)a | (uintptr_t)b | (uintptr_t)c) % sizeof(void *) == 0);
+    CHECK(mem_pool_owns(pool, a) && mem_pool_owns(pool, c));
+    CHECK(!mem_pool_owns(pool, &pool) && !mem_pool_owns(NULL, a));
+
+    // Exhaustion is counted and recovers once a block comes back
+    CHECK(mem_pool_alloc(pool) == NULL);
+    CHECK(mem_pool_alloc(pool) == NULL);
+    mem_pool_free(pool, b);
+    CHECK(mem_pool_alloc(pool) == b);   // Most recently freed first, still warm
+
+    // Pointers that are not blocks are refused without corrupting the list
+    mem_pool_free(pool, (uint8_t *)a + 1);
+    int outside;
+    mem_pool_free(pool, &outside);
+    mem_pool_free(pool, NULL);
+
+    // Not created ISR-safe, so the ISR path refuses it
+    mem_pool_free(pool, a);
+    CHECK(mem_pool_alloc_from_isr(pool) == NULL);
+
+    mem_pool_stats_t s;
+    mem_pool_get_stats(pool, &s);
+    CHECK(strcmp(s.name, "small") == 0);
+    CHECK(s.blocks == 3 && s.in_use == 2 && s.peak_in_use == 3);
+    CHECK(s.allocs == 4 && s.frees == 2 && s.exhausted == 2);
+
+    mem_pool_t *isr;
+    CHECK(mem_pool_create("isr", 32, 1, MEM_POOL_ISR_SAFE, &isr) == ESP_OK);
+    void *d = mem_pool_alloc_from_isr(isr);
+    CHECK(d && mem_pool_alloc_from_isr(isr) == NULL);
+    mem_pool_free(isr, d);
+    CHECK(mem_pool_alloc(isr) == d);
+
+    CHECK(mem_pool_count() == 2 && mem_pool_at(0) == pool && mem_pool_at(1) == isr);
+    CHECK(mem_pool_at(2) == NULL);
+}
+
+static mem_pool_t *s_shared;
+
+// Holds a few blocks at a time stamped with the thread's id; a block handed
+// to two threads at once would show another thread's stamp
+static void *churn(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    uint32_t *held[HELD] = {0};
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        uint32_t slot = round % HELD;
+        if (held[slot]) {
+            CHECK(held[slot][0] == id && held[slot][1] == round - HELD);
+            mem_pool_free(s_shared, held[slot]);
+        }
+        held[slot] = mem_pool_alloc(s_shared);
+        CHECK(held[slot] != NULL);
+        held[slot][0] = id;
+        held[slot][1] = round;
+    }
+    for (uint32_t i = 0; i < HELD; i++) {
+        mem_pool_free(s_shared, held[i]);
+    }
+    return NULL;
+}
+
+static void check_contention(void)
+{
+    CHECK(mem_pool_create("shared", 16, THREADS * HELD, 0, &s_shared) == ESP_OK);
+    pthread_t threads[THREADS];
+    for (uintptr_t i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, churn, (void *)(i + 1));
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    mem_pool_stats_t s;
+    mem_pool_get_stats(s_shared, &s);
+    CHECK(s.in_use == 0 && s.exhausted == 0);
+    CHECK(s.allocs == THREADS * ROUNDS && s.frees == THREADS * ROUNDS);
+    CHECK(s.peak_in_use >= HELD && s.peak_in_use <= THREADS * HELD);
+}
+
+static void report_cost(void)
+{
+    mem_pool_t *pool;
+    CHECK(mem_pool_create("bench", 64, 1, 0, &pool) == ESP_OK);
+    double start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        void *volatile p = mem_pool_alloc(pool);
+        mem_pool_free(pool, p);
+    }
+    double pool_ns = (now_s() - start) * 1e9 / BENCH_ROUNDS;
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        void *volatile p = malloc(64);
+        free(p);
+    }
+    double heap_ns = (now_s() - start) * 1e9 / BENCH_ROUNDS;
+    printf("64-byte alloc/free: pool %.1f ns, malloc %.1f ns\n", pool_ns, heap_ns);
+}
+
+int main(void)
+{
+    check_basics();
+    check_contention();
+    report_cost();
+    printf("test_mem_pool: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,187 @@
+// test_ota.c - streamed firmware updates: signature and image checks, the
+// boot slot switch, and rollback of an image that never confirms itself
+//
+// App slots and otadata are files in a scratch directory. The shim reads
+// otadata once per process, like the bootloader once per reset, so each
+// "reboot" runs this program again with the name of the next phase.
+// Images are signed with the throwaway key the host build generates.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include "esp_ota_ops.h"
+#include "ota_update.h"
+#include "check.h"
+
+#define FLASH_DIR "ota_test_data"
+#define IMAGE_SIZE 200003  // Not a whole number of chunks or sectors
+
+static uint8_t *s_image;
+static uint8_t s_sig[OTA_UPDATE_SIG_MAX];
+static size_t s_sig_len;
+
+static void make_image(unsigned seed)
+{
+    s_image = malloc(IMAGE_SIZE);
+    CHECK(s_image);
+    srand(seed);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        s_image[i] = (uint8_t)rand();
+    }
+    s_image[0] = ESP_IMAGE_HEADER_MAGIC;
+
+    FILE *f = fopen(GW_OTA_KEY, "r");
+    CHECK(f);
+    EVP_PKEY *key = PEM_read_PrivateKey(f, NULL, NULL, NULL);
+    fclose(f);
+    CHECK(key);
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    s_sig_len = sizeof(s_sig);
+    CHECK(EVP_DigestSignInit(md, NULL, EVP_sha256(), NULL, key) == 1);
+    CHECK(EVP_DigestSign(md, s_sig, &s_sig_len, s_image, IMAGE_SIZE) == 1);
+    EVP_MD_CTX_free(md);
+    EVP_PKEY_free(key);
+}
+
+// Streams s_image from pos up to end in uneven pieces, the way they come
+// off a socket
+static void stream(size_t pos, size_t end)
+{
+    static const size_t pieces[] = {1, 4095, 4096, 1000, 16384, 333};
+    for (int i = 0; pos < end; i++) {
+        size_t n = pieces[i % 6];
+        if (n > end - pos) {
+            n = end - pos;
+        }
+        CHECK(ota_update_write(s_image + pos, n) == ESP_OK);
+        pos += n;
+    }
+}
+
+static void check_running(const char *label, const char *state)
+{
+    ota_update_info_t info;
+    ota_update_get_info(&info);
+    CHECK(strcmp(info.running, label) == 0);
+    CHECK(strcmp(info.state, state) == 0);
+    CHECK(!info.updating);
+}
+
+// A fresh device: rejected uploads leave the boot slot alone, a signed one
+// takes over
+static void check_updates(void)
+{
+    check_running("ota_0", "undefined");
+    const esp_partition_t *boot = esp_ota_get_boot_partition();
+    ota_update_info_t info;
+    ota_update_get_info(&info);
+    CHECK(strcmp(info.next, "ota_1") == 0);
+
+    CHECK(ota_update_begin(0) == ESP_ERR_INVALID_SIZE);
+    CHECK(ota_update_begin(info.slot_size + 1) == ESP_ERR_INVALID_SIZE);
+    CHECK(ota_update_write(s_image, 1) == ESP_ERR_INVALID_STATE);
+
+    // Tampered signature; one update at a time meanwhile
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_ERR_INVALID_STATE);
+    stream(0, IMAGE_SIZE / 2);
+    ota_update_get_info(&info);
+    CHECK(info.updating && info.size == IMAGE_SIZE && info.received == IMAGE_SIZE / 2);
+    stream(IMAGE_SIZE / 2, IMAGE_SIZE);
+    s_sig[s_sig_len / 2] ^= 1;
+    CHECK(ota_update_end(s_sig, s_sig_len) == ESP_ERR_INVALID_CRC);
+    s_sig[s_sig_len / 2] ^= 1;
+    CHECK(esp_ota_get_boot_partition() == boot);
+
+    // Good signature, but for a different image
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+    s_image[IMAGE_SIZE - 1] ^= 1;
+    stream(0, IMAGE_SIZE);
+    s_image[IMAGE_SIZE - 1] ^= 1;
+    CHECK(ota_update_end(s_sig, s_sig_len) == ESP_ERR_INVALID_CRC);
+
+    // Cut short, and not an app image at all
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+    stream(0, IMAGE_SIZE - 1);
+    CHECK(ota_update_end(s_sig, s_sig_len) == ESP_ERR_INVALID_SIZE);
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+    const uint8_t zero = 0;
+    CHECK(ota_update_write(&zero, 1) == ESP_ERR_OTA_VALIDATE_FAILED);
+    ota_update_abort();
+    CHECK(esp_ota_get_boot_partition() == boot);
+    ota_update_get_info(&info);
+    CHECK(info.updates == 0 && info.update_failures == 4);
+
+    CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+    stream(0, IMAGE_SIZE);
+    CHECK(ota_update_write(s_image, 1) == ESP_ERR_INVALID_SIZE);
+    CHECK(ota_update_end(s_sig, s_sig_len) == ESP_OK);
+    CHECK(strcmp(esp_ota_get_boot_partition()->label, "ota_1") == 0);
+    check_running("ota_0", "undefined");
+
+    ota_update_get_info(&info);
+    CHECK(info.updates == 1);
+    uint8_t sha[32];
+    char hex[65];
+    unsigned sha_len;
+    CHECK(EVP_Digest(s_image, IMAGE_SIZE, sha, &sha_len, EVP_sha256(), NULL) == 1);
+    for (int i = 0; i < 32; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", sha[i]);
+    }
+    CHECK(strcmp(info.last_sha256, hex) == 0);
+    printf("update: %u bytes in %u ms, %u kbit/s, %u ms writing flash\n", IMAGE_SIZE,
+           (unsigned)info.last_update_ms, (unsigned)info.last_update_kbps, (unsigned)info.last_flash_ms);
+
+    uint8_t *slot = malloc(IMAGE_SIZE);
+    CHECK(slot);
+    CHECK(esp_partition_read(esp_ota_get_boot_partition(), 0, slot, IMAGE_SIZE) == ESP_OK);
+    CHECK(memcmp(slot, s_image, IMAGE_SIZE) == 0);
+    free(slot);
+}
+
+static void run_phase(const char *self, const char *phase)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s %s", self, phase);
+    CHECK(system(cmd) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("GW_HOST_FLASH_DIR", FLASH_DIR, 1);
+    make_image(1);
+    const char *phase = argc > 1 ? argv[1] : "";
+
+    if (strcmp(phase, "trial") == 0) {
+        // First boot of the new image, which fails before confirming itself
+        check_running("ota_1", "pending_verify");
+    } else if (strcmp(phase, "rolled_back") == 0) {
+        check_running("ota_0", "valid");
+        CHECK(strcmp(esp_ota_get_boot_partition()->label, "ota_0") == 0);
+        CHECK(ota_update_begin(IMAGE_SIZE) == ESP_OK);
+        stream(0, IMAGE_SIZE);
+        CHECK(ota_update_end(s_sig, s_sig_len) == ESP_OK);
+    } else if (strcmp(phase, "confirm") == 0) {
+        check_running("ota_1", "pending_verify");
+        ota_update_mark_valid();
+        check_running("ota_1", "valid");
+    } else if (strcmp(phase, "confirmed") == 0) {
+        check_running("ota_1", "valid");
+        ota_update_mark_valid();
+        ota_update_info_t info;
+        ota_update_get_info(&info);
+        CHECK(strcmp(info.next, "ota_0") == 0);
+    } else {
+        CHECK(system("rm -rf " FLASH_DIR " && mkdir " FLASH_DIR) == 0);
+        check_updates();
+        run_phase(argv[0], "trial");
+        run_phase(argv[0], "rolled_back");
+        run_phase(argv[0], "confirm");
+        run_phase(argv[0], "confirmed");
+        printf("test_ota: all checks passed\n");
+    }
+    free(s_image);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// test_rate_limit.c - token buckets, Retry-After and table aging in rate_limit
+//
+// Most checks drive rate_limit_take_addr() with made-up addresses and times;
+// the last one goes through a loopback TCP connection.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "rate_limit.h"
+#include "check.h"
+
+#define SEC 1000000LL
+
+// 3 handshakes, one more a second; 5 requests, ten more a second
+static const rate_limit_bucket_cfg_t s_cfg[RATE_LIMIT_KINDS] = {
+    [RATE_LIMIT_CONNECT] = {3, 60},
+    [RATE_LIMIT_REQUEST] = {5, 600},
+};
+
+static void make_addr(uint8_t *addr, uint32_t n)
+{
+    memset(addr, 0, RATE_LIMIT_ADDR_LEN);
+    addr[0] = 0xfd;   // Unique local range
+    addr[12] = (uint8_t)(n >> 24);
+    addr[13] = (uint8_t)(n >> 16);
+    addr[14] = (uint8_t)(n >> 8);
+    addr[15] = (uint8_t)n;
+}
+
+static void check_buckets(void)
+{
+    rate_limit_init(s_cfg);
+    uint8_t a[RATE_LIMIT_ADDR_LEN], b[RATE_LIMIT_ADDR_LEN];
+    make_addr(a, 1);
+    make_addr(b, 2);
+    int64_t t = 100 * SEC;
+    uint32_t retry = 0;
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, a, t, &retry));
+    }
+    CHECK(!rate_limit_take_addr(RATE_LIMIT_CONNECT, a, t, &retry) && retry == 1000);
+    CHECK(!rate_limit_take_addr(RATE_LIMIT_CONNECT, a, t + SEC / 2, &retry) && retry == 500);
+    CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, a, t + SEC, NULL));
+
+    // Requests have their own bucket, and other clients their own entries
+    for (int i = 0; i < 5; i++) {
+        CHECK(rate_limit_take_addr(RATE_LIMIT_REQUEST, a, t + SEC, NULL));
+    }
+    CHECK(!rate_limit_take_addr(RATE_LIMIT_REQUEST, a, t + SEC, &retry) && retry == 100);
+    CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, b, t + SEC, NULL));
+
+    rate_limit_stats_t s;
+    rate_limit_get_stats(&s);
+    CHECK(s.allowed[RATE_LIMIT_CONNECT] == 5 && s.refused[RATE_LIMIT_CONNECT] == 2);
+    CHECK(s.allowed[RATE_LIMIT_REQUEST] == 5 && s.refused[RATE_LIMIT_REQUEST] == 1);
+
+    // Once refilled a client starts again with a full burst
+    int64_t later = t + 60 * SEC;
+    for (int i = 0; i < 3; i++) {
+        CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, a, later, NULL));
+    }
+    CHECK(!rate_limit_take_addr(RATE_LIMIT_CONNECT, a, later, NULL));
+}
+
+// More live clients than slots: the stalest give way, nobody gets stuck,
+// and expired slots are reused before anything live is dropped
+static void check_aging(void)
+{
+    rate_limit_init(s_cfg);
+    uint8_t addr[RATE_LIMIT_ADDR_LEN];
+    int64_t t = 1000 * SEC;
+    for (uint32_t n = 0; n < 4 * RATE_LIMIT_SLOTS; n++) {
+        make_addr(addr, n);
+        CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, addr, t + n, NULL));
+    }
+    rate_limit_stats_t s;
+    rate_limit_get_stats(&s);
+    CHECK(s.recycled >= 3 * RATE_LIMIT_SLOTS);
+
+    // The newest client kept its entry: two tokens left, then refused
+    CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, addr, t + SEC / 100, NULL));
+    CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, addr, t + SEC / 100, NULL));
+    CHECK(!rate_limit_take_addr(RATE_LIMIT_CONNECT, addr, t + SEC / 100, NULL));
+
+    uint32_t recycled = s.recycled;
+    int64_t later = t + 10 * SEC;
+    for (uint32_t n = 0; n < RATE_LIMIT_SLOTS / 2; n++) {
+        make_addr(addr, 1000 + n);
+        CHECK(rate_limit_take_addr(RATE_LIMIT_CONNECT, addr, later, NULL));
+    }
+    rate_limit_get_stats(&s);
+    CHECK(s.recycled == recycled);
+}
+
+static void check_disabled(void)
+{
+    const rate_limit_bucket_cfg_t off[RATE_LIMIT_KINDS] = {{0, 1}, {0, 1}};
+    rate_limit_init(off);
+    uint8_t addr[RATE_LIMIT_ADDR_LEN];
+    make_addr(addr, 7);
+    for (int i = 0; i < 1000; i++) {
+        CHECK(rate_limit_take_addr(RATE_LIMIT_REQUEST, addr, 0, NULL));
+    }
+    rate_limit_client_t clients[RATE_LIMIT_SLOTS];
+    CHECK(rate_limit_snapshot(clients, RATE_LIMIT_SLOTS) == 0);
+}
+
+// A real peer: IPv4 is keyed as v4-mapped and reported dotted
+static void check_socket(void)
+{
+    rate_limit_init(s_cfg);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(sin);
+    CHECK(bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) == 0 && listen(lfd, 1) == 0);
+    CHECK(getsockname(lfd, (struct sockaddr *)&sin, &len) == 0);
+    int cfd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(connect(cfd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+    int sfd = accept(lfd, NULL, NULL);
+    CHECK(sfd >= 0);
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(rate_limit_take(RATE_LIMIT_CONNECT, sfd, NULL));
+    }
+    uint32_t retry = 0;
+    CHECK(!rate_limit_take(RATE_LIMIT_CONNECT, sfd, &retry) && retry > 900 && retry <= 1000);
+    rate_limit_client_t clients[RATE_LIMIT_SLOTS];
+    CHECK(rate_limit_snapshot(clients, RATE_LIMIT_SLOTS) == 1);
+    CHECK(strcmp(clients[0].ip, "127.0.0.1") == 0);
+    CHECK(clients[0].allowed[RATE_LIMIT_CONNECT] == 3 && clients[0].refused[RATE_LIMIT_CONNECT] == 1);
+
+    // No peer address: let through and counted
+    CHECK(rate_limit_take(RATE_LIMIT_CONNECT, lfd, NULL));
+    rate_limit_stats_t s;
+    rate_limit_get_stats(&s);
+    CHECK(s.unknown_peer == 1);
+    close(sfd);
+    close(cfd);
+    close(lfd);
+}
+
+int main(void)
+{
+    check_buckets();
+    check_aging();
+    check_disabled();
+    check_socket();
+    printf("test_rate_limit: all checks passed\n");
+    return 0;
+}
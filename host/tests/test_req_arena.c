@@ -0,0 +1,184 @@
+// test_req_arena.c - bump allocation, cJSON routing and reset of req_arena
+//
+// Also prints the cost of building and printing a small cJSON reply inside
+// the arena and on the pool/heap path, so the gap shows up in the test log.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cJSON.h"
+#include "heap_monitor.h"
+#include "mem_pool.h"
+#include "req_arena.h"
+#include "sdkconfig.h"
+#include "check.h"
+
+#define BENCH_ROUNDS 20000
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static mem_pool_t *json_pool(void)
+{
+    for (size_t i = 0; i < mem_pool_count(); i++) {
+        mem_pool_stats_t s;
+        mem_pool_get_stats(mem_pool_at(i), &s);
+        if (strcmp(s.name, "json") == 0) {
+            return mem_pool_at(i);
+        }
+    }
+    return NULL;
+}
+
+// Allocations outside any request; used once as the owner's rival and once
+// while nobody holds the arena
+static void *build_elsewhere(void *arg)
+{
+    CHECK(!req_arena_active());
+    CHECK(req_arena_alloc(16) == NULL);
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "k", "v");
+    CHECK(!req_arena_owns(root));
+    cJSON_Delete(root);
+    *(bool *)arg = !req_arena_begin();   // Refused while another task has it
+    return NULL;
+}
+
+static void check_bump(void)
+{
+    CHECK(req_arena_alloc(8) == NULL);   // No request open
+    CHECK(req_arena_begin());
+    CHECK(!req_arena_begin());
+    uint8_t *a = req_arena_alloc(3);
+    uint8_t *b = req_arena_alloc(8);
+    uint8_t *c = req_arena_alloc(0);
+    CHECK(a && b && c);
+    CHECK((uintptr_t)b % 8 == 0 && b - a == 8 && c - b == 8);
+    CHECK(req_arena_owns(a) && !req_arena_owns(&a));
+
+    // Another thread can neither allocate from nor open the arena
+    bool refused = false;
+    pthread_t t;
+    pthread_create(&t, NULL, build_elsewhere, &refused);
+    pthread_join(t, NULL);
+    CHECK(refused);
+
+    req_arena_end();
+    req_arena_stats_t s;
+    req_arena_get_stats(&s);
+    CHECK(s.size == CONFIG_REQ_ARENA_SIZE && s.requests == 1);
+    CHECK(s.last_used == 16 && s.high_water == 16 && s.overflows == 0);
+
+    // After the reset the next request starts at the front again
+    CHECK(req_arena_begin());
+    CHECK(req_arena_alloc(1) == a);
+    req_arena_end();
+}
+
+// A tree built and dropped without cJSON_Delete touches neither the pool
+// nor the heap
+static void check_cjson(void)
+{
+    heap_tag_stats_t before, after;
+    mem_pool_stats_t pool_before, pool_after;
+    heap_monitor_get_tag(HEAP_TAG_JSON, &before);
+    mem_pool_get_stats(json_pool(), &pool_before);
+
+    CHECK(req_arena_begin());
+    cJSON *root = cJSON_Parse("{\"color\":\"red\",\"list\":[1,2,3],\"nested\":{\"a\":true}}");
+    CHECK(root && req_arena_owns(root));
+    cJSON_AddStringToObject(root, "status", "ok");
+    char *text = cJSON_PrintUnformatted(root);
+    CHECK(text && req_arena_owns(text));
+    CHECK(strstr(text, "\"status\":\"ok\"") != NULL);
+    cJSON_free(text);   // A no-op inside the arena, and harmless
+    req_arena_end();
+
+    heap_monitor_get_tag(HEAP_TAG_JSON, &after);
+    mem_pool_get_stats(json_pool(), &pool_after);
+    CHECK(after.allocs == before.allocs && after.current_bytes == before.current_bytes);
+    CHECK(pool_after.allocs == pool_before.allocs && pool_after.in_use == pool_before.in_use);
+
+    // With no request open the hooks are back on the pool
+    bool refused = true;
+    build_elsewhere(&refused);
+    CHECK(!refused);
+    req_arena_end();
+    mem_pool_get_stats(json_pool(), &pool_after);
+    CHECK(pool_after.allocs > pool_before.allocs && pool_after.in_use == pool_before.in_use);
+}
+
+// Past the end of the buffer allocations spill onto the heap, and the
+// reset gives all of it back
+static void check_overflow(void)
+{
+    heap_tag_stats_t before, during, after;
+    heap_monitor_get_tag(HEAP_TAG_HTTPD, &before);
+    CHECK(req_arena_begin());
+    CHECK(req_arena_alloc(CONFIG_REQ_ARENA_SIZE - 8) != NULL);
+    void *spill = req_arena_alloc(64);
+    void *spill2 = req_arena_alloc(CONFIG_REQ_ARENA_SIZE);
+    CHECK(spill && spill2 && (uintptr_t)spill % 8 == 0);
+    CHECK(req_arena_owns(spill) && req_arena_owns(spill2));
+    memset(spill2, 0xa5, CONFIG_REQ_ARENA_SIZE);
+    heap_monitor_get_tag(HEAP_TAG_HTTPD, &during);
+    CHECK(during.allocs == before.allocs + 2);
+    req_arena_end();
+
+    heap_monitor_get_tag(HEAP_TAG_HTTPD, &after);
+    CHECK(after.frees == before.frees + 2 && after.current_bytes == before.current_bytes);
+    req_arena_stats_t s;
+    req_arena_get_stats(&s);
+    CHECK(s.overflows == 2 && s.overflow_fails == 0);
+    CHECK(s.last_used == CONFIG_REQ_ARENA_SIZE - 8 + 64 + CONFIG_REQ_ARENA_SIZE);
+    CHECK(s.high_water == s.last_used);
+}
+
+static void build_reply(void)
+{
+    cJSON *root = cJSON_CreateObject();
+    for (int i = 0; i < 8; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%d", i);
+        cJSON_AddNumberToObject(root, key, i * 1.5);
+    }
+    cJSON_AddStringToObject(root, "state", "connected");
+    char *text = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    cJSON_free(text);
+}
+
+static void report_cost(void)
+{
+    double start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        CHECK(req_arena_begin());
+        build_reply();
+        req_arena_end();
+    }
+    double arena_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        build_reply();
+    }
+    double heap_us = (now_s() - start) * 1e6 / BENCH_ROUNDS;
+    printf("small cJSON reply: arena %.2f us, pool/heap %.2f us\n", arena_us, heap_us);
+}
+
+int main(void)
+{
+    CHECK(heap_monitor_init() == ESP_OK);
+    check_bump();
+    check_cjson();
+    check_overflow();
+    report_cost();
+    printf("test_req_arena: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,264 @@
+// test_ring.c - ordering, wrap-around and blocking waits of the ring buffers
+//
+// Also times 24-byte items, the size of an ingest record, through a ring
+// and through the queue it replaced, so the gap shows up in the test log.
+// The timings are only printed: on a loaded machine, or under ctest -j,
+// they say more about the scheduler than about the ring.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "ring.h"
+#include "check.h"
+
+#define PRODUCERS 4
+#define STRESS_ITEMS 20000
+#define BENCH_ITEMS 50000
+#define BENCH_CAPACITY 256
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+    uint8_t pad[16];
+} item_t;
+
+typedef struct {
+    ring_t *ring;
+    uint32_t producer;
+    uint32_t count;
+} producer_arg_t;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Pushes count items in batches of 1 to 7, spinning while the ring is full
+static void *produce(void *p)
+{
+    producer_arg_t *arg = p;
+    item_t batch[7];
+    uint32_t seq = 0;
+    while (seq < arg->count) {
+        size_t n = 1 + seq % 7;
+        if (n > arg->count - seq) {
+            n = arg->count - seq;
+        }
+        for (size_t i = 0; i < n; i++) {
+            batch[i] = (item_t){.producer = arg->producer, .seq = seq + (uint32_t)i};
+        }
+        size_t done = 0;
+        while (done < n) {
+            done += ring_push(arg->ring, batch + done, n - done);
+        }
+        seq += (uint32_t)n;
+    }
+    return NULL;
+}
+
+static void check_basics(void)
+{
+    ring_t *r;
+    CHECK(ring_create(RING_SPSC, sizeof(uint32_t), 12, &r) == ESP_ERR_INVALID_ARG);
+    CHECK(ring_create(RING_SPSC, 0, 16, &r) == ESP_ERR_INVALID_ARG);
+    CHECK(ring_create(RING_MPSC, sizeof(uint32_t), 4, &r) == ESP_OK);
+    CHECK(ring_capacity(r) == 4);
+
+    // Partial pushes when full, and the items come back across the wrap
+    uint32_t in[6] = {1, 2, 3, 4, 5, 6};
+    uint32_t out[6];
+    CHECK(ring_push(r, in, 3) == 3);
+    CHECK(ring_pop(r, out, 2) == 2 && out[0] == 1 && out[1] == 2);
+    CHECK(ring_push(r, in + 3, 3) == 3);
+    CHECK(ring_push(r, in, 1) == 0);
+    CHECK(ring_count(r) == 4);
+    CHECK(ring_pop(r, out, 6) == 4);
+    CHECK(out[0] == 3 && out[1] == 4 && out[2] == 5 && out[3] == 6);
+    CHECK(ring_pop(r, out, 1) == 0);
+    ring_delete(r);
+}
+
+// One producer, batches of varying size, many laps of a small ring
+static void check_spsc(void)
+{
+    ring_t *r;
+    CHECK(ring_create(RING_SPSC, sizeof(item_t), 64, &r) == ESP_OK);
+    producer_arg_t arg = {.ring = r, .producer = 0, .count = STRESS_ITEMS};
+    pthread_t t;
+    pthread_create(&t, NULL, produce, &arg);
+
+    item_t batch[11];
+    uint32_t expect = 0;
+    while (expect < STRESS_ITEMS) {
+        size_t n = ring_pop(r, batch, 1 + expect % 11);
+        for (size_t i = 0; i < n; i++) {
+            CHECK(batch[i].seq == expect);
+            expect++;
+        }
+    }
+    pthread_join(t, NULL);
+    CHECK(ring_count(r) == 0);
+    ring_delete(r);
+}
+
+// Several producers contending for slots; each one's items stay in order
+// and none is lost or repeated
+static void check_mpsc(void)
+{
+    ring_t *r;
+    CHECK(ring_create(RING_MPSC, sizeof(item_t), 64, &r) == ESP_OK);
+    producer_arg_t args[PRODUCERS];
+    pthread_t threads[PRODUCERS];
+    for (uint32_t p = 0; p < PRODUCERS; p++) {
+        args[p] = (producer_arg_t){.ring = r, .producer = p, .count = STRESS_ITEMS / PRODUCERS};
+        pthread_create(&threads[p], NULL, produce, &args[p]);
+    }
+
+    uint32_t next[PRODUCERS] = {0};
+    uint32_t total = 0;
+    item_t batch[32];
+    while (total < STRESS_ITEMS) {
+        size_t n = ring_pop_wait(r, batch, 32, pdMS_TO_TICKS(1000));
+        CHECK(n > 0);
+        for (size_t i = 0; i < n; i++) {
+            CHECK(batch[i].producer < PRODUCERS);
+            CHECK(batch[i].seq == next[batch[i].producer]);
+            next[batch[i].producer]++;
+        }
+        total += (uint32_t)n;
+    }
+    for (uint32_t p = 0; p < PRODUCERS; p++) {
+        pthread_join(threads[p], NULL);
+        CHECK(next[p] == STRESS_ITEMS / PRODUCERS);
+    }
+    CHECK(ring_count(r) == 0);
+    ring_delete(r);
+}
+
+static void *push_later(void *p)
+{
+    usleep(50000);
+    uint32_t v = 42;
+    CHECK(ring_push(p, &v, 1) == 1);
+    return NULL;
+}
+
+static void *pop_later(void *p)
+{
+    usleep(50000);
+    uint32_t v;
+    CHECK(ring_pop(p, &v, 1) == 1 && v == 0);
+    return NULL;
+}
+
+static void check_waits(void)
+{
+    ring_t *r;
+    CHECK(ring_create(RING_SPSC, sizeof(uint32_t), 2, &r) == ESP_OK);
+    uint32_t v;
+
+    // Times out on an empty ring
+    double start = now_s();
+    CHECK(ring_pop_wait(r, &v, 1, pdMS_TO_TICKS(100)) == 0);
+    double waited = now_s() - start;
+    CHECK(waited >= 0.09 && waited < 0.5);
+
+    // Woken by a push from another thread well before the timeout
+    pthread_t t;
+    pthread_create(&t, NULL, push_later, r);
+    start = now_s();
+    CHECK(ring_pop_wait(r, &v, 1, pdMS_TO_TICKS(2000)) == 1 && v == 42);
+    CHECK(now_s() - start < 1.0);
+    pthread_join(t, NULL);
+
+    // A full ring: the producer waits for the consumer to make room
+    uint32_t in[3] = {0, 1, 2};
+    CHECK(ring_push(r, in, 2) == 2);
+    CHECK(ring_push_wait(r, in + 2, 1, 0) == 0);
+    pthread_create(&t, NULL, pop_later, r);
+    start = now_s();
+    CHECK(ring_push_wait(r, in + 2, 1, pdMS_TO_TICKS(2000)) == 1);
+    CHECK(now_s() - start < 1.0);
+    pthread_join(t, NULL);
+    CHECK(ring_pop(r, in, 3) == 2 && in[0] == 1 && in[1] == 2);
+    ring_delete(r);
+}
+
+typedef struct {
+    ring_t *ring;
+    QueueHandle_t queue;
+    size_t batch;
+} bench_arg_t;
+
+static void *bench_produce(void *p)
+{
+    bench_arg_t *arg = p;
+    item_t batch[32] = {0};
+    for (uint32_t sent = 0; sent < BENCH_ITEMS;) {
+        if (arg->queue) {
+            xQueueSend(arg->queue, batch, portMAX_DELAY);
+            sent++;
+        } else {
+            size_t n = arg->batch < BENCH_ITEMS - sent ? arg->batch : BENCH_ITEMS - sent;
+            sent += (uint32_t)ring_push_wait(arg->ring, batch, n, portMAX_DELAY);
+        }
+    }
+    return NULL;
+}
+
+// Moves BENCH_ITEMS items between two threads and returns ns per item
+static double bench(ring_t *ring, QueueHandle_t queue, size_t batch)
+{
+    bench_arg_t arg = {.ring = ring, .queue = queue, .batch = batch};
+    item_t buf[32];
+    double start = now_s();
+    pthread_t t;
+    pthread_create(&t, NULL, bench_produce, &arg);
+    for (uint32_t got = 0; got < BENCH_ITEMS;) {
+        if (queue) {
+            CHECK(xQueueReceive(queue, buf, portMAX_DELAY) == pdTRUE);
+            got++;
+        } else {
+            got += (uint32_t)ring_pop_wait(ring, buf, batch, portMAX_DELAY);
+        }
+    }
+    pthread_join(t, NULL);
+    return (now_s() - start) * 1e9 / BENCH_ITEMS;
+}
+
+static void report_throughput(void)
+{
+    QueueHandle_t queue = xQueueCreate(BENCH_CAPACITY, sizeof(item_t));
+    CHECK(queue != NULL);
+    double queue_ns = bench(NULL, queue, 1);
+    vQueueDelete(queue);
+
+    ring_t *r;
+    CHECK(ring_create(RING_SPSC, sizeof(item_t), BENCH_CAPACITY, &r) == ESP_OK);
+    double ring1_ns = bench(r, NULL, 1);
+    double ring32_ns = bench(r, NULL, 32);
+    ring_delete(r);
+
+    printf("%zu-byte items: queue %.1f ns, ring %.1f ns, ring batched x32 %.1f ns\n", sizeof(item_t),
+           queue_ns, ring1_ns, ring32_ns);
+}
+
+int main(void)
+{
+    check_basics();
+    check_spsc();
+    check_mpsc();
+    check_waits();
+    report_throughput();
+    printf("test_ring: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+// test_session_table.c - admission, eviction and reaping in session_table
+//
+// The fds are plain numbers; nothing is connected, so peers show up as "?".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "session_table.h"
+#include "check.h"
+
+#define MAX_SESSIONS 5
+#define FIRST_FD 100
+#define LONG_IDLE_US (60 * 1000000LL)
+
+static const session_info_t *row(const session_info_t *rows, size_t n, int fd)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (rows[i].fd == fd) {
+            return &rows[i];
+        }
+    }
+    return NULL;
+}
+
+// Requests end on each fd in turn, 1 ms apart, so the first is the LRU
+static void touch_in_order(const int *fds, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        session_table_note_request(fds[i]);
+        session_table_note_done(fds[i]);
+        usleep(1000);
+    }
+}
+
+int main(void)
+{
+    CHECK(session_table_init() == ESP_OK);
+    for (int fd = FIRST_FD; fd < FIRST_FD + MAX_SESSIONS; fd++) {
+        CHECK(session_table_admit(fd, "TLS-TEST", MAX_SESSIONS, 0) == -1);
+    }
+
+    // Everyone was active just now, so the newcomer is the one turned away
+    CHECK(session_table_admit(105, NULL, MAX_SESSIONS, LONG_IDLE_US) == 105);
+    // A second close for the same fd, as the server's own close path would
+    // do after the trigger, is harmless
+    session_table_close(105);
+    session_table_close(105);
+
+    // With no minimum idle time the least recently active session goes, and
+    // a session already on its way out is not picked twice
+    int order[] = {103, 100, 101, 102, 104};
+    touch_in_order(order, 5);
+    CHECK(session_table_admit(106, NULL, MAX_SESSIONS, 0) == 103);
+    CHECK(session_table_admit(107, NULL, MAX_SESSIONS, 0) == 100);
+
+    session_info_t rows[SESSION_TABLE_SLOTS];
+    size_t n = session_table_snapshot(rows, SESSION_TABLE_SLOTS);
+    CHECK(n == 7);
+    CHECK(row(rows, n, 103)->closing && row(rows, n, 100)->closing && !row(rows, n, 106)->closing);
+    CHECK(strcmp(row(rows, n, 101)->ip, "?") == 0);
+    CHECK(row(rows, n, 101)->requests == 1);
+    session_table_close(103);
+    session_table_close(100);
+
+    // Only sessions inactive since the cutoff are reaped, each once
+    int64_t cutoff = esp_timer_get_time();
+    int recent[] = {106, 107};
+    touch_in_order(recent, 2);
+    int fds[SESSION_TABLE_SLOTS];
+    size_t reaped = session_table_collect_idle(cutoff, fds, SESSION_TABLE_SLOTS);
+    CHECK(reaped == 3);
+    for (size_t i = 0; i < reaped; i++) {
+        CHECK(fds[i] == 101 || fds[i] == 102 || fds[i] == 104);
+        session_table_close(fds[i]);
+    }
+    CHECK(session_table_collect_idle(cutoff, fds, SESSION_TABLE_SLOTS) == 0);
+
+    // Room again: a newcomer fits without touching anyone
+    CHECK(session_table_admit(108, NULL, MAX_SESSIONS, 0) == -1);
+
+    session_stats_t s;
+    session_table_get_stats(&s);
+    CHECK(s.accepted == 9 && s.refused == 1 && s.evicted == 2 && s.reaped == 3);
+    CHECK(s.closed == 6 && s.active == 3 && s.peak == 7);
+
+    // Short of heap: nobody idle long enough, then the LRU session goes
+    CHECK(session_table_note_low_heap(LONG_IDLE_US) == -1);
+    CHECK(session_table_note_low_heap(0) == 106);
+    CHECK(session_table_note_low_heap(0) == 107);
+    session_table_get_stats(&s);
+    CHECK(s.low_heap_refused == 3 && s.low_heap_evicted == 2);
+    printf("test_session_table: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,237 @@
+// test_settings.c - validation, versioned commits, persistence and readers
+// racing commits in settings
+//
+// NVS lives in a scratch file under the working directory; a "reboot" is
+// nvs_flash_deinit() and a fresh settings_init().
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "settings.h"
+#include "check.h"
+
+#define NVS_FILE "test_settings_nvs.bin"
+#define RACE_COMMITS 2000
+
+static uint32_t s_notified;
+static int s_notify_count;
+
+static void on_change(uint32_t changed, void *ctx)
+{
+    (void)ctx;
+    s_notified = changed;
+    s_notify_count++;
+}
+
+static void reboot(void)
+{
+    CHECK(nvs_flash_deinit() == ESP_OK);
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(settings_init() == ESP_OK);
+}
+
+static void get_str(setting_id_t id, char *buf)
+{
+    settings_get_str(id, buf, SETTINGS_STR_MAX + 1);
+}
+
+static void check_validation(void)
+{
+    settings_batch_t b;
+    settings_batch_init(&b);
+    char long_ssid[34];
+    memset(long_ssid, 'x', 33);
+    long_ssid[33] = '\0';
+
+    CHECK(settings_batch_set_int(&b, SETTING_WIFI_SSID, 1) == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_str(&b, SETTING_LED_BLINK_MS, "500") == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_int(&b, SETTING_LED_BLINK_MS, 9) == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_int(&b, SETTING_LED_GPIO, CONFIG_ENV_GPIO_OUT_RANGE_MAX + 1) == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_str(&b, SETTING_WIFI_SSID, long_ssid) == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_str(&b, SETTING_WIFI_SSID, "") == ESP_ERR_INVALID_ARG);
+    CHECK(settings_batch_set_int(&b, SETTING_COUNT, 1) == ESP_ERR_INVALID_ARG);
+    CHECK(b.set == 0);
+
+    // An open network has no password
+    CHECK(settings_batch_set_str(&b, SETTING_WIFI_PASSWORD, "") == ESP_OK);
+    long_ssid[32] = '\0';
+    CHECK(settings_batch_set_str(&b, SETTING_WIFI_SSID, long_ssid) == ESP_OK);
+    CHECK(b.set == (SETTING_BIT(SETTING_WIFI_PASSWORD) | SETTING_BIT(SETTING_WIFI_SSID)));
+
+    CHECK(settings_find("led_blink_ms") == SETTING_LED_BLINK_MS);
+    CHECK(settings_find("led_blink") == -1);
+    CHECK(settings_desc(SETTING_WIFI_PASSWORD)->secret);
+    CHECK(settings_desc(SETTING_LED_GPIO)->restart);
+}
+
+static void check_commits(void)
+{
+    char s[SETTINGS_STR_MAX + 1];
+    CHECK(settings_version() == 0);
+    get_str(SETTING_WIFI_SSID, s);
+    CHECK(strcmp(s, CONFIG_ESP_WIFI_SSID) == 0);
+    CHECK(settings_get_int(SETTING_LED_BLINK_MS) == CONFIG_BLINK_PERIOD);
+    CHECK(settings_subscribe(on_change, NULL) == ESP_OK);
+
+    settings_batch_t b;
+    settings_batch_init(&b);
+    CHECK(settings_batch_set_int(&b, SETTING_LED_BLINK_MS, 500) == ESP_OK);
+    CHECK(settings_batch_set_str(&b, SETTING_WIFI_SSID, "lab-net") == ESP_OK);
+    CHECK(settings_batch_set_int(&b, SETTING_WIFI_MAX_RETRY, CONFIG_ESP_MAXIMUM_RETRY) == ESP_OK);
+    uint32_t version = 0;
+    CHECK(settings_commit(&b, SETTINGS_ANY_VERSION, &version) == ESP_OK && version == 1);
+    CHECK(settings_version() == 1);
+    CHECK(settings_get_int(SETTING_LED_BLINK_MS) == 500);
+    get_str(SETTING_WIFI_SSID, s);
+    CHECK(strcmp(s, "lab-net") == 0);
+    // The retry count was given but did not change
+    CHECK(s_notify_count == 1);
+    CHECK(s_notified == (SETTING_BIT(SETTING_LED_BLINK_MS) | SETTING_BIT(SETTING_WIFI_SSID)));
+
+    // Nothing new: no write, same version, nobody told
+    CHECK(settings_commit(&b, SETTINGS_ANY_VERSION, &version) == ESP_OK && version == 1);
+    CHECK(s_notify_count == 1);
+
+    // A writer that read version 0 lost the race and changes nothing
+    settings_batch_init(&b);
+    CHECK(settings_batch_set_int(&b, SETTING_LED_BLINK_MS, 250) == ESP_OK);
+    CHECK(settings_commit(&b, 0, &version) == ESP_ERR_INVALID_VERSION && version == 1);
+    CHECK(settings_get_int(SETTING_LED_BLINK_MS) == 500);
+    CHECK(settings_commit(&b, 1, &version) == ESP_OK && version == 2);
+    CHECK(s_notify_count == 2 && s_notified == SETTING_BIT(SETTING_LED_BLINK_MS));
+    CHECK(settings_unsubscribe(on_change, NULL) == ESP_OK);
+    CHECK(settings_unsubscribe(on_change, NULL) == ESP_ERR_NOT_FOUND);
+
+    reboot();
+    CHECK(settings_version() == 2);
+    CHECK(settings_get_int(SETTING_LED_BLINK_MS) == 250);
+    get_str(SETTING_WIFI_SSID, s);
+    CHECK(strcmp(s, "lab-net") == 0);
+    get_str(SETTING_WIFI_PASSWORD, s);
+    CHECK(strcmp(s, CONFIG_ESP_WIFI_PASSWORD) == 0);
+}
+
+static void put_entry(uint8_t *buf, size_t *pos, const char *key, uint8_t type, const void *value, uint8_t len)
+{
+    buf[(*pos)++] = (uint8_t)strlen(key);
+    memcpy(buf + *pos, key, strlen(key));
+    *pos += strlen(key);
+    buf[(*pos)++] = type;
+    buf[(*pos)++] = len;
+    memcpy(buf + *pos, value, len);
+    *pos += len;
+}
+
+static void store_blob(const uint8_t *buf, size_t len)
+{
+    nvs_handle_t nvs;
+    CHECK(nvs_open("settings", NVS_READWRITE, &nvs) == ESP_OK);
+    CHECK(nvs_set_blob(nvs, "values", buf, len) == ESP_OK);
+    CHECK(nvs_commit(nvs) == ESP_OK);
+    nvs_close(nvs);
+}
+
+// A record from other firmware: unknown and out-of-range values are
+// skipped, values it lacks keep their defaults
+static void check_foreign_record(void)
+{
+    uint8_t buf[128] = {'S', 'E', 'T', '1', 7, 0, 0, 0};
+    size_t pos = 8;
+    int32_t too_short = 5;
+    int32_t gpio = 4;
+    put_entry(buf, &pos, "old_key", SETTING_TYPE_INT, &gpio, 4);
+    put_entry(buf, &pos, "led_blink_ms", SETTING_TYPE_INT, &too_short, 4);
+    put_entry(buf, &pos, "led_gpio", SETTING_TYPE_STR, "4", 1);
+    put_entry(buf, &pos, "device_name", SETTING_TYPE_STR, "lab", 3);
+    store_blob(buf, pos);
+    reboot();
+
+    char s[SETTINGS_STR_MAX + 1];
+    CHECK(settings_version() == 7);
+    get_str(SETTING_DEVICE_NAME, s);
+    CHECK(strcmp(s, "lab") == 0);
+    CHECK(settings_get_int(SETTING_LED_BLINK_MS) == CONFIG_BLINK_PERIOD);
+    CHECK(settings_get_int(SETTING_LED_GPIO) == CONFIG_BLINK_GPIO);
+    get_str(SETTING_WIFI_SSID, s);
+    CHECK(strcmp(s, CONFIG_ESP_WIFI_SSID) == 0);
+
+    // Cut short: nothing is trusted
+    store_blob(buf, pos - 1);
+    reboot();
+    CHECK(settings_version() == 0);
+    get_str(SETTING_DEVICE_NAME, s);
+    CHECK(strcmp(s, "gateway") == 0);
+}
+
+static atomic_bool s_racing;
+static atomic_int s_torn;
+static atomic_int s_reads;
+
+// Every copy must be one whole value or the other
+static void *read_while_committing(void *arg)
+{
+    (void)arg;
+    char s[SETTINGS_STR_MAX + 1];
+    while (atomic_load(&s_racing)) {
+        get_str(SETTING_DEVICE_NAME, s);
+        size_t len = strlen(s);
+        bool whole = (len == 32 && strspn(s, "a") == 32) || (len == 5 && strcmp(s, "bbbbb") == 0);
+        if (!whole) {
+            atomic_fetch_add(&s_torn, 1);
+        }
+        atomic_fetch_add(&s_reads, 1);
+    }
+    return NULL;
+}
+
+static void check_racing_readers(void)
+{
+    char a[33];
+    memset(a, 'a', 32);
+    a[32] = '\0';
+    settings_batch_t b;
+    settings_batch_init(&b);
+    CHECK(settings_batch_set_str(&b, SETTING_DEVICE_NAME, a) == ESP_OK);
+    CHECK(settings_commit(&b, SETTINGS_ANY_VERSION, NULL) == ESP_OK);
+
+    atomic_store(&s_racing, true);
+    pthread_t readers[2];
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&readers[i], NULL, read_while_committing, NULL);
+    }
+    for (int i = 0; i < RACE_COMMITS; i++) {
+        CHECK(settings_batch_set_str(&b, SETTING_DEVICE_NAME, (i & 1) ? a : "bbbbb") == ESP_OK);
+        CHECK(settings_commit(&b, SETTINGS_ANY_VERSION, NULL) == ESP_OK);
+    }
+    atomic_store(&s_racing, false);
+    for (int i = 0; i < 2; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    printf("racing readers: %d reads over %d commits\n", atomic_load(&s_reads), RACE_COMMITS);
+    CHECK(atomic_load(&s_torn) == 0);
+    CHECK(settings_version() == RACE_COMMITS + 1);
+}
+
+int main(void)
+{
+    remove(NVS_FILE);
+    setenv("GW_HOST_NVS", NVS_FILE, 1);
+    CHECK(nvs_flash_init() == ESP_OK);
+
+    settings_batch_t b;
+    settings_batch_init(&b);
+    CHECK(settings_commit(&b, SETTINGS_ANY_VERSION, NULL) == ESP_ERR_INVALID_STATE);
+    CHECK(settings_init() == ESP_OK);
+
+    check_validation();
+    check_commits();
+    check_foreign_record();
+    check_racing_readers();
+    remove(NVS_FILE);
+    printf("test_settings: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,353 @@
+// test_uplink.c - batching, offline spooling and rate-limited drain of the
+// MQTT uplink, plus the spool on its own
+//
+// A stand-in broker runs on a thread in the test: it speaks just enough
+// MQTT 3.1.1 (CONNECT, QoS 0/1 PUBLISH, PINGREQ) to acknowledge batches and
+// count the readings in them, and can be stopped and restarted to simulate
+// an outage. Scratch files live under the working directory.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "ingest.h"
+#include "log_store.h"
+#include "nvs_flash.h"
+#include "spool.h"
+#include "tsdb.h"
+#include "uplink.h"
+#include "check.h"
+
+#define FLASH_DIR "uplink_test_data"
+#define BROKER_PORT 18883
+#define READINGS_PER_REPORT 4
+#define BATCH_RECORDS ((CONFIG_UPLINK_BATCH_MAX_BYTES - UPLINK_BATCH_HDR_SIZE) / UPLINK_RECORD_SIZE)
+
+static struct {
+    pthread_t thread;
+    int listen_fd;
+    volatile bool running;
+    atomic_uint connects;
+    atomic_uint batches;
+    atomic_uint records;
+    atomic_uint status;
+    atomic_uint bad;
+} s_broker;
+
+static bool read_exact(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (!s_broker.running || poll(&pfd, 1, 100) < 0) {
+            return false;
+        }
+        if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void handle_publish(int fd, uint8_t flags, const uint8_t *body, size_t len)
+{
+    size_t topic_len = (size_t)body[0] << 8 | body[1];
+    const char *topic = (const char *)body + 2;
+    size_t pos = 2 + topic_len;
+    int qos = (flags >> 1) & 3;
+    if (qos) {
+        uint8_t ack[] = {0x40, 2, body[pos], body[pos + 1]};
+        send(fd, ack, sizeof(ack), MSG_NOSIGNAL);
+        pos += 2;
+    }
+    const uint8_t *payload = body + pos;
+    size_t payload_len = len - pos;
+    if (topic_len > 8 && memcmp(topic + topic_len - 8, "/sensors", 8) == 0) {
+        uint16_t count = payload[2] | payload[3] << 8;
+        if (payload[0] != UPLINK_BATCH_VERSION || qos != 1 ||
+            payload_len != UPLINK_BATCH_HDR_SIZE + (size_t)count * UPLINK_RECORD_SIZE) {
+            atomic_fetch_add(&s_broker.bad, 1);
+            return;
+        }
+        atomic_fetch_add(&s_broker.batches, 1);
+        atomic_fetch_add(&s_broker.records, count);
+    } else if (topic_len > 7 && memcmp(topic + topic_len - 7, "/status", 7) == 0) {
+        atomic_fetch_add(&s_broker.status, 1);
+    }
+}
+
+static void serve_client(int fd)
+{
+    static uint8_t body[8192];
+    while (s_broker.running) {
+        uint8_t type;
+        if (!read_exact(fd, &type, 1)) {
+            return;
+        }
+        size_t len = 0;
+        for (int shift = 0; shift < 28; shift += 7) {
+            uint8_t b;
+            if (!read_exact(fd, &b, 1)) {
+                return;
+            }
+            len |= (size_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        if (len > sizeof(body) || !read_exact(fd, body, len)) {
+            return;
+        }
+        switch (type & 0xf0) {
+        case 0x10: {
+            static const uint8_t connack[] = {0x20, 2, 0, 0};
+            send(fd, connack, sizeof(connack), MSG_NOSIGNAL);
+            atomic_fetch_add(&s_broker.connects, 1);
+            break;
+        }
+        case 0x30:
+            handle_publish(fd, type & 0x0f, body, len);
+            break;
+        case 0xc0: {
+            static const uint8_t pong[] = {0xd0, 0};
+            send(fd, pong, sizeof(pong), MSG_NOSIGNAL);
+            break;
+        }
+        case 0xe0:
+            return;
+        }
+    }
+}
+
+static void *broker_thread(void *arg)
+{
+    while (s_broker.running) {
+        struct pollfd pfd = {.fd = s_broker.listen_fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = accept(s_broker.listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            serve_client(fd);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static void broker_start(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(BROKER_PORT)};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(listen(fd, 4) == 0);
+    s_broker.listen_fd = fd;
+    s_broker.running = true;
+    CHECK(pthread_create(&s_broker.thread, NULL, broker_thread, NULL) == 0);
+}
+
+static void broker_stop(void)
+{
+    s_broker.running = false;
+    pthread_join(s_broker.thread, NULL);
+    close(s_broker.listen_fd);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Feeds reports through ingest, pacing so its queue never overflows
+static void send_readings(unsigned reports)
+{
+    static uint16_t seq;
+    uint8_t buf[INGEST_REPORT_HDR_SIZE + READINGS_PER_REPORT * INGEST_READING_SIZE] = {
+        INGEST_REPORT_VERSION, READINGS_PER_REPORT};
+    for (unsigned i = 0; i < reports; i++) {
+        seq++;
+        memcpy(buf + 2, &seq, 2);
+        for (int r = 0; r < READINGS_PER_REPORT; r++) {
+            float value = 20.0f + r;
+            buf[INGEST_REPORT_HDR_SIZE + r * INGEST_READING_SIZE] = INGEST_KIND_TEMPERATURE + r;
+            memcpy(buf + INGEST_REPORT_HDR_SIZE + r * INGEST_READING_SIZE + 1, &value, 4);
+        }
+        CHECK(ingest_submit_report(INGEST_SRC_UDP, buf, sizeof(buf), 0x0a000002) == ESP_OK);
+        if (i % 16 == 15) {
+            usleep(2000);
+        }
+    }
+}
+
+static void wait_until(atomic_uint *counter, unsigned want, double timeout_s)
+{
+    double deadline = now_s() + timeout_s;
+    while (atomic_load(counter) < want && now_s() < deadline) {
+        usleep(10000);
+    }
+    CHECK(atomic_load(counter) == want);
+}
+
+static void check_spool(void)
+{
+    // Items of a partly drained segment come back after a reopen
+    spool_t *sp;
+    CHECK(spool_open(FLASH_DIR "/spool", 8192, 2, &sp) == ESP_OK);
+    uint8_t item[4000] = {1, 2, 3};
+    uint8_t out[4000];
+    size_t len;
+    CHECK(spool_peek(sp, out, sizeof(out), &len) == ESP_ERR_NOT_FOUND);
+    CHECK(spool_push(sp, item, 100) == ESP_OK);
+    CHECK(spool_push(sp, item, 200) == ESP_OK);
+    CHECK(spool_peek(sp, out, sizeof(out), &len) == ESP_OK && len == 100 && out[2] == 3);
+    spool_pop(sp);
+    spool_t *again;
+    CHECK(spool_open(FLASH_DIR "/spool", 8192, 2, &again) == ESP_OK);
+    spool_stats_t st;
+    spool_get_stats(again, &st);
+    CHECK(st.items == 2 && st.bytes == 300);
+
+    // An item too big for the buffer can still be popped
+    CHECK(spool_peek(again, out, 50, &len) == ESP_ERR_INVALID_SIZE && len == 100);
+    spool_pop(again);
+    spool_get_stats(again, &st);
+    CHECK(st.items == 1 && st.bytes == 200);
+
+    // A full spool drops its oldest segment
+    for (int i = 0; i < 6; i++) {
+        CHECK(spool_push(again, item, sizeof(item)) == ESP_OK);
+    }
+    spool_get_stats(again, &st);
+    CHECK(st.dropped > 0 && st.segments <= 2 && st.items == st.pushed + 1 - st.dropped);
+    while (spool_peek(again, out, sizeof(out), &len) == ESP_OK) {
+        spool_pop(again);
+    }
+    spool_get_stats(again, &st);
+    CHECK(st.items == 0 && st.bytes == 0);
+}
+
+// A segment that cannot be created, as on a full partition, fails pushes
+// until it can, without losing what is already spooled
+static void check_spool_open_failure(void)
+{
+    spool_t *sp;
+    CHECK(spool_open(FLASH_DIR "/spool_full", 8192, 4, &sp) == ESP_OK);
+    uint8_t item[4000] = {1, 2, 3};
+    uint8_t out[4000];
+    size_t len;
+    spool_stats_t st;
+
+    // Rolling over into the next segment; a directory in its place makes
+    // fopen() fail even for root
+    CHECK(spool_push(sp, item, sizeof(item)) == ESP_OK);
+    CHECK(spool_push(sp, item, sizeof(item)) == ESP_OK);
+    CHECK(system("mkdir " FLASH_DIR "/spool_full/00000001.q") == 0);
+    CHECK(spool_push(sp, item, sizeof(item)) == ESP_FAIL);
+    CHECK(spool_push(sp, item, 10) == ESP_FAIL);
+    CHECK(system("rmdir " FLASH_DIR "/spool_full/00000001.q") == 0);
+    CHECK(spool_push(sp, item, 10) == ESP_OK);
+    spool_get_stats(sp, &st);
+    CHECK(st.items == 3 && st.write_errors == 2);
+
+    // Reopening the tail once the reader drained it
+    CHECK(system("mkdir " FLASH_DIR "/spool_full/00000002.q") == 0);
+    while (spool_peek(sp, out, sizeof(out), &len) == ESP_OK) {
+        spool_pop(sp);
+    }
+    CHECK(spool_push(sp, item, 10) == ESP_FAIL);
+    CHECK(system("rmdir " FLASH_DIR "/spool_full/00000002.q") == 0);
+    CHECK(spool_push(sp, item, 20) == ESP_OK);
+    CHECK(spool_peek(sp, out, sizeof(out), &len) == ESP_OK && len == 20 && out[2] == 3);
+    spool_pop(sp);
+    spool_get_stats(sp, &st);
+    CHECK(st.items == 0 && st.popped == 4 && st.write_errors == 4);
+}
+
+int main(void)
+{
+    CHECK(system("rm -rf " FLASH_DIR " && mkdir " FLASH_DIR) == 0);
+    setenv("GW_HOST_FLASH_DIR", FLASH_DIR, 1);
+    setenv("GW_HOST_NVS", FLASH_DIR "/nvs.bin", 1);
+    // Off the default ports, which test_ingest or a gateway_host test may
+    // hold meanwhile
+    setenv("GW_HOST_INGEST_UDP_PORT", "18691", 1);
+    setenv("GW_HOST_COAP_PORT", "18681", 1);
+    check_spool();
+    check_spool_open_failure();
+
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(tsdb_init() == ESP_OK);
+    CHECK(log_store_init() == ESP_OK);
+    CHECK(ingest_init() == ESP_OK);
+    CHECK(uplink_start("mqtt://127.0.0.1:18883") == ESP_OK);
+
+    // Broker down: sealed batches go to the spool
+    send_readings(40);
+    usleep(CONFIG_UPLINK_BATCH_MAX_MS * 1000 + 300000);
+    uplink_stats_t st;
+    uplink_get_stats(&st);
+    CHECK(!st.connected && st.records == 40 * READINGS_PER_REPORT && st.records_dropped == 0);
+    CHECK(st.batches == (40 * READINGS_PER_REPORT + BATCH_RECORDS - 1) / BATCH_RECORDS);
+    CHECK(st.spool_items == st.batches && st.spooled == st.batches && st.published == 0);
+
+    // Broker up: the spool drains and every reading arrives
+    broker_start();
+    wait_until(&s_broker.records, 40 * READINGS_PER_REPORT, 5);
+    wait_until(&s_broker.status, 1, 1);
+    usleep(200000);
+    uplink_get_stats(&st);
+    CHECK(st.connected && st.connects == 1 && st.spool_items == 0 && st.acked == st.batches);
+    CHECK(st.latency_ms_max >= CONFIG_UPLINK_BATCH_MAX_MS && st.latency_ms_avg <= st.latency_ms_max);
+    printf("drained %u batches after the outage, latency max %u ms\n", (unsigned)st.acked,
+           (unsigned)st.latency_ms_max);
+
+    // Live batches skip the spool
+    uint32_t spooled = st.spooled;
+    send_readings(BATCH_RECORDS / READINGS_PER_REPORT * 3);
+    unsigned want = 40 * READINGS_PER_REPORT + BATCH_RECORDS / READINGS_PER_REPORT * 3 * READINGS_PER_REPORT;
+    wait_until(&s_broker.records, want, 3);
+    uplink_get_stats(&st);
+    CHECK(st.spooled == spooled && st.latency_ms_last < 1000);
+
+    // A longer outage drains no faster than CONFIG_UPLINK_DRAIN_PER_S
+    broker_stop();
+    usleep(300000);
+    unsigned batches_before = atomic_load(&s_broker.batches);
+    const unsigned outage_batches = 3 * CONFIG_UPLINK_DRAIN_PER_S;
+    send_readings(outage_batches * BATCH_RECORDS / READINGS_PER_REPORT);
+    usleep(CONFIG_UPLINK_BATCH_MAX_MS * 1000 + 300000);
+    uplink_get_stats(&st);
+    CHECK(!st.connected && st.disconnects == 1 && st.spool_items >= outage_batches);
+    unsigned spooled_batches = st.spool_items;
+    broker_start();
+    double t0 = now_s();
+    wait_until(&s_broker.batches, batches_before + spooled_batches, 10);
+    double drain_s = now_s() - t0;
+    printf("drained %u spooled batches in %.2f s (limit %d/s)\n", spooled_batches, drain_s,
+           CONFIG_UPLINK_DRAIN_PER_S);
+    // One second's worth may go out at once, the rest at the limit
+    CHECK(drain_s >= (double)(spooled_batches - CONFIG_UPLINK_DRAIN_PER_S) / CONFIG_UPLINK_DRAIN_PER_S * 0.9);
+    CHECK(atomic_load(&s_broker.bad) == 0);
+    broker_stop();
+
+    printf("uplink: all checks passed\n");
+    return 0;
+}
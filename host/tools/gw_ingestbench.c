@@ -0,0 +1,530 @@
+// gw_ingestbench.c - sensor report throughput over CoAP versus HTTPS
+//
+// Sends the same binary sensor report through each ingest path of a
+// running gateway and prints a JSON report with messages per second and
+// round-trip latency for each:
+//
+//   coap       confirmable POST /ingest, one outstanding request per client
+//   https      POST /api/ingest/report over a keep-alive TLS connection
+//   https-new  the same with a full TLS handshake for every report
+//
+//   gw_ingestbench --port 8443 -c 4 -d 5
+//   gw_ingestbench --port 18445 -d 1 --min-speedup 1   # gate: CoAP beats HTTPS
+//
+// A 5.03 / 503 answer (ingest queue full) is counted as busy, not as an
+// error. Exit code 2 when a gate fails.
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define READINGS 4
+#define REPORT_LEN (8 + READINGS * 5)
+#define COAP_RETRIES 4
+#define COAP_ACK_TIMEOUT_MS 500
+
+typedef enum {
+    MODE_COAP,
+    MODE_HTTPS,
+    MODE_HTTPS_NEW,
+    MODE_COUNT
+} bench_mode_t;
+
+static const char *const s_mode_names[MODE_COUNT] = { "coap", "https", "https-new" };
+
+typedef struct {
+    const char *host;
+    const char *https_port;
+    const char *coap_port;
+    unsigned clients;
+    double duration_s;
+    unsigned timeout_ms;
+    bool modes[MODE_COUNT];
+    double min_speedup;   // Negative means unset
+} bench_opts_t;
+
+typedef struct {
+    const bench_opts_t *opts;
+    bench_mode_t mode;
+    SSL_CTX *ctx;
+    unsigned index;
+    uint32_t *latency_us;
+    size_t latency_len;
+    size_t latency_cap;
+    uint64_t ok;
+    uint64_t busy;
+    uint64_t errors;
+    uint64_t handshakes;
+} client_t;
+
+typedef struct {
+    double msgs_per_s;
+    uint64_t ok;
+    uint64_t busy;
+    uint64_t errors;
+} run_summary_t;
+
+static double s_deadline;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void push_latency(client_t *cl, double seconds)
+{
+    if (cl->latency_len == cl->latency_cap) {
+        size_t cap = cl->latency_cap ? cl->latency_cap * 2 : 4096;
+        uint32_t *v = realloc(cl->latency_us, cap * sizeof(*v));
+        if (v == NULL) {
+            return;
+        }
+        cl->latency_us = v;
+        cl->latency_cap = cap;
+    }
+    cl->latency_us[cl->latency_len++] = (uint32_t)(seconds * 1e6);
+}
+
+// Report with a fixed sensor id per client so the gateway maps a handful
+// of tsdb series, not one per message
+static size_t build_report(uint8_t *p, uint32_t sensor_id, uint16_t seq)
+{
+    p[0] = 1;
+    p[1] = READINGS;
+    memcpy(p + 2, &seq, 2);
+    memcpy(p + 4, &sensor_id, 4);
+    for (int i = 0; i < READINGS; i++) {
+        float value = 20.0f + i;
+        p[8 + i * 5] = (uint8_t)(1 + i);
+        memcpy(p + 9 + i * 5, &value, 4);
+    }
+    return REPORT_LEN;
+}
+
+static int connect_to(const char *host, const char *port, int socktype, unsigned timeout_ms)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = socktype };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+        struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (socktype == SOCK_STREAM) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Confirmable POST /ingest, retransmitted with the same message id until
+// the ACK arrives. Returns the response code, or -1.
+static int coap_post(int fd, uint16_t mid, const uint8_t *report, size_t len)
+{
+    uint8_t req[64] = { 0x41, 0x02, (uint8_t)(mid >> 8), (uint8_t)mid, 0x5a };
+    size_t pos = 5;
+    req[pos++] = 0xb6;   // Uri-Path, six bytes
+    memcpy(req + pos, "ingest", 6);
+    pos += 6;
+    req[pos++] = 0xff;
+    memcpy(req + pos, report, len);
+    pos += len;
+
+    for (int attempt = 0; attempt < COAP_RETRIES; attempt++) {
+        if (send(fd, req, pos, 0) != (ssize_t)pos) {
+            return -1;
+        }
+        uint8_t resp[64];
+        double give_up = now_s() + COAP_ACK_TIMEOUT_MS / 1000.0;
+        while (now_s() < give_up) {
+            ssize_t n = recv(fd, resp, sizeof(resp), 0);
+            if (n < 0) {
+                break;
+            }
+            // Match the ACK to this request; stale ones from a retransmission are skipped
+            if (n >= 4 && (resp[0] & 0x30) == 0x20 && resp[2] == req[2] && resp[3] == req[3]) {
+                return resp[1];
+            }
+        }
+    }
+    return -1;
+}
+
+static void run_coap(client_t *cl)
+{
+    const bench_opts_t *opts = cl->opts;
+    unsigned timeout_ms = COAP_ACK_TIMEOUT_MS;
+    int fd = connect_to(opts->host, opts->coap_port, SOCK_DGRAM, timeout_ms);
+    if (fd < 0) {
+        cl->errors++;
+        return;
+    }
+    uint8_t report[REPORT_LEN];
+    uint16_t mid = (uint16_t)(cl->index << 12);
+    while (now_s() < s_deadline) {
+        build_report(report, 0x1000 + cl->index, mid);
+        double start = now_s();
+        int code = coap_post(fd, mid++, report, sizeof(report));
+        if (code == 0x44) {   // 2.04 Changed
+            cl->ok++;
+            push_latency(cl, now_s() - start);
+        } else if (code == 0xa3) {   // 5.03 Service Unavailable
+            cl->busy++;
+        } else {
+            cl->errors++;
+        }
+    }
+    close(fd);
+}
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+} tls_conn_t;
+
+static void tls_close(tls_conn_t *c)
+{
+    if (c->ssl) {
+        SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+static bool tls_open(client_t *cl, tls_conn_t *c)
+{
+    c->fd = connect_to(cl->opts->host, cl->opts->https_port, SOCK_STREAM, cl->opts->timeout_ms);
+    if (c->fd < 0) {
+        return false;
+    }
+    c->ssl = SSL_new(cl->ctx);
+    SSL_set_fd(c->ssl, c->fd);
+    if (SSL_connect(c->ssl) != 1) {
+        ERR_clear_error();
+        tls_close(c);
+        return false;
+    }
+    cl->handshakes++;
+    return true;
+}
+
+// Sends one report and reads the status line and headers; the gateway
+// answers 204 without a body, errors carry a short one
+static int https_post(tls_conn_t *c, const char *host, const uint8_t *report, size_t len, bool keep_alive)
+{
+    char req[512];
+    int hdr_len = snprintf(req, sizeof(req),
+                           "POST /api/ingest/report HTTP/1.1\r\nHost: %s\r\n"
+                           "Content-Type: application/octet-stream\r\nContent-Length: %zu\r\n"
+                           "Connection: %s\r\n\r\n",
+                           host, len, keep_alive ? "keep-alive" : "close");
+    memcpy(req + hdr_len, report, len);
+    int total = hdr_len + (int)len;
+    if (SSL_write(c->ssl, req, total) != total) {
+        ERR_clear_error();
+        return -1;
+    }
+    char resp[1024];
+    size_t got = 0;
+    char *end = NULL;
+    while (end == NULL) {
+        int n = SSL_read(c->ssl, resp + got, (int)(sizeof(resp) - 1 - got));
+        if (n <= 0) {
+            ERR_clear_error();
+            return -1;
+        }
+        got += n;
+        resp[got] = '\0';
+        end = strstr(resp, "\r\n\r\n");
+    }
+    int status = 0;
+    if (sscanf(resp, "HTTP/1.%*d %d", &status) != 1) {
+        return -1;
+    }
+    const char *cl_hdr = strcasestr(resp, "\r\nContent-Length:");
+    long body = cl_hdr && cl_hdr < end ? strtol(cl_hdr + 17, NULL, 10) : 0;
+    long have = (long)(got - (size_t)(end + 4 - resp));
+    while (have < body) {
+        int n = SSL_read(c->ssl, resp, (int)sizeof(resp));
+        if (n <= 0) {
+            ERR_clear_error();
+            return -1;
+        }
+        have += n;
+    }
+    return status;
+}
+
+static void run_https(client_t *cl)
+{
+    bool keep_alive = cl->mode == MODE_HTTPS;
+    tls_conn_t c = { .fd = -1 };
+    uint8_t report[REPORT_LEN];
+    uint16_t seq = 0;
+    while (now_s() < s_deadline) {
+        build_report(report, 0x2000 + cl->index, seq++);
+        double start = now_s();
+        int status = -1;
+        if (c.ssl || tls_open(cl, &c)) {
+            status = https_post(&c, cl->opts->host, report, sizeof(report), keep_alive);
+        }
+        if (status == 204) {
+            cl->ok++;
+            push_latency(cl, now_s() - start);
+        } else if (status == 503) {
+            cl->busy++;
+        } else {
+            cl->errors++;
+        }
+        if (!keep_alive || status < 0) {
+            tls_close(&c);
+        }
+    }
+    tls_close(&c);
+}
+
+static void *client_thread(void *arg)
+{
+    client_t *cl = arg;
+    if (cl->mode == MODE_COAP) {
+        run_coap(cl);
+    } else {
+        run_https(cl);
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint32_t *v, size_t len, double p)
+{
+    if (len == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * len + 0.5);
+    rank = rank < 1 ? 1 : rank > len ? len : rank;
+    return v[rank - 1] / 1000.0;
+}
+
+static int run_mode(const bench_opts_t *opts, bench_mode_t mode, SSL_CTX *ctx, FILE *out, run_summary_t *sum)
+{
+    client_t *clients = calloc(opts->clients, sizeof(client_t));
+    pthread_t *threads = calloc(opts->clients, sizeof(pthread_t));
+    if (clients == NULL || threads == NULL) {
+        free(clients);
+        free(threads);
+        return -1;
+    }
+    double start = now_s();
+    s_deadline = start + opts->duration_s;
+    for (unsigned i = 0; i < opts->clients; i++) {
+        clients[i] = (client_t){ .opts = opts, .mode = mode, .ctx = ctx, .index = i };
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    for (unsigned i = 0; i < opts->clients; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_s() - start;
+
+    client_t total = { 0 };
+    for (unsigned i = 0; i < opts->clients; i++) {
+        client_t *cl = &clients[i];
+        for (size_t k = 0; k < cl->latency_len; k++) {
+            push_latency(&total, cl->latency_us[k] / 1e6);
+        }
+        total.ok += cl->ok;
+        total.busy += cl->busy;
+        total.errors += cl->errors;
+        total.handshakes += cl->handshakes;
+        free(cl->latency_us);
+    }
+    qsort(total.latency_us, total.latency_len, sizeof(uint32_t), cmp_u32);
+    sum->ok = total.ok;
+    sum->busy = total.busy;
+    sum->errors = total.errors;
+    sum->msgs_per_s = elapsed > 0 ? total.ok / elapsed : 0;
+
+    fprintf(out, "{\"mode\":\"%s\",\"clients\":%u,\"elapsed_s\":%.3f,\"messages\":%" PRIu64 ",\"busy\":%" PRIu64
+            ",\"errors\":%" PRIu64 ",\"handshakes\":%" PRIu64 ",\"msgs_per_s\":%.1f,\"readings_per_s\":%.1f,",
+            s_mode_names[mode], opts->clients, elapsed, total.ok, total.busy, total.errors, total.handshakes,
+            sum->msgs_per_s, sum->msgs_per_s * READINGS);
+    fprintf(out, "\"latency_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}}",
+            percentile_ms(total.latency_us, total.latency_len, 50),
+            percentile_ms(total.latency_us, total.latency_len, 99),
+            total.latency_len ? total.latency_us[total.latency_len - 1] / 1000.0 : 0);
+    free(total.latency_us);
+    free(clients);
+    free(threads);
+    return 0;
+}
+
+static bool parse_modes(bench_opts_t *opts, char *list)
+{
+    memset(opts->modes, 0, sizeof(opts->modes));
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        int m = 0;
+        while (m < MODE_COUNT && strcmp(tok, s_mode_names[m]) != 0) {
+            m++;
+        }
+        if (m == MODE_COUNT) {
+            return false;
+        }
+        opts->modes[m] = true;
+    }
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -H, --host HOST            gateway address (default 127.0.0.1)\n"
+            "  -p, --port PORT            HTTPS port (default 8443)\n"
+            "      --coap-port PORT       CoAP port (default 5683)\n"
+            "  -c, --clients N            concurrent clients per mode (default 4)\n"
+            "  -d, --duration SEC         run time per mode in seconds (default 5)\n"
+            "  -t, --timeout-ms MS        HTTPS socket timeout (default 5000)\n"
+            "      --modes LIST           comma-separated subset of coap,https,https-new\n"
+            "Gate (exit code 2 if it fails; needs coap and https):\n"
+            "      --min-speedup X        CoAP messages/s at least X times HTTPS keep-alive\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    bench_opts_t opts = {
+        .host = "127.0.0.1",
+        .https_port = "8443",
+        .coap_port = "5683",
+        .clients = 4,
+        .duration_s = 5,
+        .timeout_ms = 5000,
+        .modes = { true, true, true },
+        .min_speedup = -1,
+    };
+    enum { OPT_COAP_PORT = 256, OPT_MODES, OPT_MIN_SPEEDUP };
+    static const struct option long_opts[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "coap-port", required_argument, NULL, OPT_COAP_PORT },
+        { "clients", required_argument, NULL, 'c' },
+        { "duration", required_argument, NULL, 'd' },
+        { "timeout-ms", required_argument, NULL, 't' },
+        { "modes", required_argument, NULL, OPT_MODES },
+        { "min-speedup", required_argument, NULL, OPT_MIN_SPEEDUP },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    signal(SIGPIPE, SIG_IGN);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "H:p:c:d:t:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'H': opts.host = optarg; break;
+        case 'p': opts.https_port = optarg; break;
+        case 'c': opts.clients = (unsigned)atoi(optarg); break;
+        case 'd': opts.duration_s = atof(optarg); break;
+        case 't': opts.timeout_ms = (unsigned)atoi(optarg); break;
+        case OPT_COAP_PORT: opts.coap_port = optarg; break;
+        case OPT_MIN_SPEEDUP: opts.min_speedup = atof(optarg); break;
+        case OPT_MODES:
+            if (!parse_modes(&opts, optarg)) {
+                fprintf(stderr, "invalid --modes list\n");
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.clients == 0 || opts.clients > 16 || opts.duration_s <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        fprintf(stderr, "SSL_CTX_new failed\n");
+        return 1;
+    }
+    // Self-signed gateway certificate; no tickets, so https-new pays for
+    // full handshakes
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+    run_summary_t sums[MODE_COUNT] = { 0 };
+    uint64_t errors = 0;
+    bool first = true;
+    printf("{\"runs\":[");
+    for (int m = 0; m < MODE_COUNT; m++) {
+        if (!opts.modes[m]) {
+            continue;
+        }
+        printf("%s", first ? "" : ",");
+        first = false;
+        if (run_mode(&opts, m, ctx, stdout, &sums[m]) != 0) {
+            return 1;
+        }
+        errors += sums[m].errors;
+    }
+    printf("]");
+    SSL_CTX_free(ctx);
+
+    int failures = 0;
+    if (opts.modes[MODE_COAP] && opts.modes[MODE_HTTPS] && sums[MODE_HTTPS].msgs_per_s > 0) {
+        double speedup = sums[MODE_COAP].msgs_per_s / sums[MODE_HTTPS].msgs_per_s;
+        printf(",\"coap_speedup\":%.2f", speedup);
+        if (opts.min_speedup >= 0 && speedup < opts.min_speedup) {
+            fprintf(stderr, "gate min_speedup failed: %.2f (limit %.2f)\n", speedup, opts.min_speedup);
+            failures++;
+        }
+    } else if (opts.min_speedup >= 0) {
+        fprintf(stderr, "gate min_speedup needs both coap and https results\n");
+        failures++;
+    }
+    if (errors) {
+        fprintf(stderr, "%" PRIu64 " messages failed\n", errors);
+        failures++;
+    }
+    printf(",\"pass\":%s}\n", failures ? "false" : "true");
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,881 @@
+// gw_loadgen.c - concurrent HTTPS load generator for the gateway web server
+//
+// Opens N TLS clients against host:port, replays a weighted request mix and
+// prints a JSON report with throughput, latency percentiles, handshake times
+// and status/error counts. Optional thresholds turn the run into a pass/fail
+// gate (exit code 2) for release checks against the host build or a board.
+//
+//   gw_loadgen --port 8443 -c 4 -d 10 --max-p99-ms 50
+//   gw_loadgen --matrix -c 4 -d 5          # keep-alive x resumption grid
+//
+// See usage() for the full option list and the --mix syntax.
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define MAX_MIX_ENTRIES 32
+#define MAX_STATUS_CODES 600
+#define RESP_BUF_LEN 4096
+
+typedef struct {
+    unsigned weight;
+    char method[8];
+    char path[256];
+    char body[512];
+} mix_entry_t;
+
+typedef struct {
+    const char *host;
+    const char *port;
+    unsigned clients;
+    double duration_s;
+    uint64_t max_requests;
+    unsigned timeout_ms;
+    bool keep_alive;
+    bool resume;
+    bool matrix;
+    const char *out_path;
+    mix_entry_t mix[MAX_MIX_ENTRIES];
+    unsigned mix_count;
+    unsigned mix_total_weight;
+    // Gates; negative means unset
+    double max_p50_ms;
+    double max_p95_ms;
+    double max_p99_ms;
+    double max_handshake_p95_ms;
+    double min_rps;
+    double max_error_rate;
+} loadgen_opts_t;
+
+typedef enum {
+    ERR_CONNECT,
+    ERR_HANDSHAKE,
+    ERR_SEND,
+    ERR_RECV,
+    ERR_TIMEOUT,
+    ERR_PARSE,
+    ERR_COUNT
+} err_kind_t;
+
+static const char *const s_err_names[ERR_COUNT] = {
+    "connect", "handshake", "send", "recv", "timeout", "parse",
+};
+
+// Growable array of microsecond samples
+typedef struct {
+    uint32_t *v;
+    size_t len;
+    size_t cap;
+} samples_t;
+
+typedef struct {
+    samples_t latency;
+    uint64_t ok;
+    uint64_t failed;
+} entry_stats_t;
+
+typedef struct {
+    const loadgen_opts_t *opts;
+    SSL_CTX *ctx;
+    uint64_t seed;
+    samples_t latency;
+    samples_t handshake;
+    entry_stats_t entries[MAX_MIX_ENTRIES];
+    uint64_t status[MAX_STATUS_CODES];
+    uint64_t errors[ERR_COUNT];
+    uint64_t requests;
+    uint64_t connections;
+    uint64_t resumed;
+    uint64_t reconnects;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} client_t;
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+    char buf[RESP_BUF_LEN];
+    size_t len;
+    size_t off;
+} conn_t;
+
+static atomic_uint_fast64_t s_issued;
+static double s_deadline;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void samples_push(samples_t *s, double seconds)
+{
+    if (s->len == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 1024;
+        uint32_t *v = realloc(s->v, cap * sizeof(*v));
+        if (v == NULL) {
+            return;
+        }
+        s->v = v;
+        s->cap = cap;
+    }
+    double us = seconds * 1e6;
+    s->v[s->len++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void samples_append(samples_t *dst, const samples_t *src)
+{
+    for (size_t i = 0; i < src->len; i++) {
+        samples_push(dst, src->v[i] / 1e6);
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile in milliseconds; samples must be sorted.
+static double percentile_ms(const samples_t *s, double p)
+{
+    if (s->len == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * s->len + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > s->len) {
+        rank = s->len;
+    }
+    return s->v[rank - 1] / 1000.0;
+}
+
+static double mean_ms(const samples_t *s)
+{
+    if (s->len == 0) {
+        return 0;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < s->len; i++) {
+        sum += s->v[i];
+    }
+    return sum / s->len / 1000.0;
+}
+
+static uint64_t next_rand(uint64_t *state)
+{
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned pick_entry(const loadgen_opts_t *opts, uint64_t *seed)
+{
+    unsigned r = (unsigned)(next_rand(seed) % opts->mix_total_weight);
+    for (unsigned i = 0; i < opts->mix_count; i++) {
+        if (r < opts->mix[i].weight) {
+            return i;
+        }
+        r -= opts->mix[i].weight;
+    }
+    return opts->mix_count - 1;
+}
+
+static void conn_close(conn_t *c)
+{
+    if (c->ssl) {
+        SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->len = 0;
+    c->off = 0;
+}
+
+static int tcp_connect(const loadgen_opts_t *opts)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(opts->host, opts->port, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { .tv_sec = opts->timeout_ms / 1000, .tv_usec = (opts->timeout_ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Connects and handshakes, reusing *session when resumption is enabled.
+static err_kind_t conn_open(client_t *cl, conn_t *c, SSL_SESSION **session)
+{
+    c->fd = tcp_connect(cl->opts);
+    if (c->fd < 0) {
+        return errno == EAGAIN || errno == ETIMEDOUT ? ERR_TIMEOUT : ERR_CONNECT;
+    }
+    double start = now_s();
+    c->ssl = SSL_new(cl->ctx);
+    SSL_set_fd(c->ssl, c->fd);
+    SSL_set_tlsext_host_name(c->ssl, cl->opts->host);
+    if (cl->opts->resume && *session) {
+        SSL_set_session(c->ssl, *session);
+    }
+    if (SSL_connect(c->ssl) != 1) {
+        ERR_clear_error();
+        conn_close(c);
+        return ERR_HANDSHAKE;
+    }
+    samples_push(&cl->handshake, now_s() - start);
+    cl->connections++;
+    if (SSL_session_reused(c->ssl)) {
+        cl->resumed++;
+    }
+    if (cl->opts->resume) {
+        SSL_SESSION *fresh = SSL_get1_session(c->ssl);
+        if (fresh) {
+            SSL_SESSION_free(*session);
+            *session = fresh;
+        }
+    }
+    return ERR_COUNT;
+}
+
+static int conn_fill(conn_t *c)
+{
+    if (c->off > 0) {
+        memmove(c->buf, c->buf + c->off, c->len - c->off);
+        c->len -= c->off;
+        c->off = 0;
+    }
+    if (c->len == sizeof(c->buf)) {
+        return -1;
+    }
+    int n = SSL_read(c->ssl, c->buf + c->len, (int)(sizeof(c->buf) - c->len));
+    if (n <= 0) {
+        int err = SSL_get_error(c->ssl, n);
+        ERR_clear_error();
+        if (err == SSL_ERROR_SYSCALL && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return -2;
+        }
+        return -1;
+    }
+    c->len += n;
+    return n;
+}
+
+// Returns a pointer to the next CRLF-terminated line in the buffer.
+static char *conn_line(conn_t *c, int *err)
+{
+    while (1) {
+        char *start = c->buf + c->off;
+        char *eol = memmem(start, c->len - c->off, "\r\n", 2);
+        if (eol) {
+            *eol = '\0';
+            c->off = eol + 2 - c->buf;
+            return start;
+        }
+        int n = conn_fill(c);
+        if (n <= 0) {
+            *err = n;
+            return NULL;
+        }
+    }
+}
+
+static int conn_skip(conn_t *c, size_t len, uint64_t *bytes_in)
+{
+    while (len > 0) {
+        if (c->off == c->len) {
+            c->off = c->len = 0;
+            int n = conn_fill(c);
+            if (n <= 0) {
+                return n;
+            }
+        }
+        size_t take = c->len - c->off;
+        if (take > len) {
+            take = len;
+        }
+        c->off += take;
+        *bytes_in += take;
+        len -= take;
+    }
+    return 1;
+}
+
+static err_kind_t recv_error(int err)
+{
+    return err == -2 ? ERR_TIMEOUT : ERR_RECV;
+}
+
+// Reads one response. *got_any tells a stale keep-alive connection (closed
+// before any byte came back) from a real failure.
+static err_kind_t read_response(client_t *cl, conn_t *c, int *status, bool *server_close, bool *got_any)
+{
+    int err = 0;
+    *got_any = false;
+    char *line = conn_line(c, &err);
+    if (line == NULL) {
+        return recv_error(err);
+    }
+    *got_any = true;
+    if (sscanf(line, "HTTP/1.%*d %d", status) != 1) {
+        return ERR_PARSE;
+    }
+    long content_len = -1;
+    bool chunked = false;
+    *server_close = false;
+    while ((line = conn_line(c, &err)) != NULL && *line) {
+        cl->bytes_in += strlen(line) + 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_len = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) {
+            chunked = true;
+        } else if (strncasecmp(line, "Connection:", 11) == 0 && strcasestr(line, "close")) {
+            *server_close = true;
+        }
+    }
+    if (line == NULL) {
+        return recv_error(err);
+    }
+    if (chunked) {
+        while (1) {
+            line = conn_line(c, &err);
+            if (line == NULL) {
+                return recv_error(err);
+            }
+            long chunk = strtol(line, NULL, 16);
+            if (chunk == 0) {
+                line = conn_line(c, &err);
+                return line ? ERR_COUNT : recv_error(err);
+            }
+            err = conn_skip(c, chunk + 2, &cl->bytes_in);
+            if (err <= 0) {
+                return recv_error(err);
+            }
+        }
+    }
+    if (content_len < 0) {
+        // Body runs to connection close
+        *server_close = true;
+        while ((err = conn_skip(c, sizeof(c->buf), &cl->bytes_in)) > 0) {
+        }
+        return ERR_COUNT;
+    }
+    err = conn_skip(c, content_len, &cl->bytes_in);
+    return err > 0 ? ERR_COUNT : recv_error(err);
+}
+
+static bool send_request(client_t *cl, conn_t *c, const mix_entry_t *e)
+{
+    char req[1024];
+    size_t body_len = strlen(e->body);
+    int len = snprintf(req, sizeof(req),
+                       "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: gw_loadgen\r\n"
+                       "Connection: %s\r\n",
+                       e->method, e->path, cl->opts->host, cl->opts->keep_alive ? "keep-alive" : "close");
+    if (body_len > 0) {
+        len += snprintf(req + len, sizeof(req) - len,
+                        "Content-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s", body_len, e->body);
+    } else {
+        len += snprintf(req + len, sizeof(req) - len, "\r\n");
+    }
+    if (len >= (int)sizeof(req)) {
+        return false;
+    }
+    if (SSL_write(c->ssl, req, len) != len) {
+        ERR_clear_error();
+        return false;
+    }
+    cl->bytes_out += len;
+    return true;
+}
+
+static bool claim_request(const loadgen_opts_t *opts)
+{
+    if (opts->max_requests) {
+        return atomic_fetch_add(&s_issued, 1) < opts->max_requests;
+    }
+    return now_s() < s_deadline;
+}
+
+static void *client_thread(void *arg)
+{
+    client_t *cl = arg;
+    const loadgen_opts_t *opts = cl->opts;
+    conn_t c = { .fd = -1 };
+    SSL_SESSION *session = NULL;
+
+    while (claim_request(opts)) {
+        unsigned idx = pick_entry(opts, &cl->seed);
+        const mix_entry_t *e = &opts->mix[idx];
+        double start = now_s();
+        err_kind_t err = ERR_COUNT;
+        int status = 0;
+        bool server_close = false;
+
+        // A reused connection may have been closed by the server (idle
+        // timeout, LRU purge); retry once on a fresh one in that case.
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool reused = c.ssl != NULL;
+            if (!reused && (err = conn_open(cl, &c, &session)) != ERR_COUNT) {
+                break;
+            }
+            bool got_any = false;
+            err = send_request(cl, &c, e) ? read_response(cl, &c, &status, &server_close, &got_any) : ERR_SEND;
+            if (err == ERR_COUNT) {
+                break;
+            }
+            conn_close(&c);
+            if (!reused || got_any || err == ERR_TIMEOUT) {
+                break;
+            }
+            cl->reconnects++;
+        }
+
+        double elapsed = now_s() - start;
+        cl->requests++;
+        if (err == ERR_COUNT) {
+            samples_push(&cl->latency, elapsed);
+            samples_push(&cl->entries[idx].latency, elapsed);
+            if (status > 0 && status < MAX_STATUS_CODES) {
+                cl->status[status]++;
+            }
+            if (status >= 200 && status < 400) {
+                cl->entries[idx].ok++;
+            } else {
+                cl->entries[idx].failed++;
+            }
+            if (!opts->keep_alive || server_close) {
+                conn_close(&c);
+            }
+        } else {
+            cl->errors[err]++;
+            cl->entries[idx].failed++;
+            conn_close(&c);
+        }
+    }
+    conn_close(&c);
+    SSL_SESSION_free(session);
+    return NULL;
+}
+
+typedef struct {
+    double elapsed_s;
+    uint64_t requests;
+    uint64_t http_errors;
+    uint64_t transport_errors;
+    double rps;
+    double error_rate;
+    double p50_ms, p95_ms, p99_ms;
+    double hs_p95_ms;
+} run_summary_t;
+
+static void print_latency(FILE *out, samples_t *s)
+{
+    qsort(s->v, s->len, sizeof(s->v[0]), cmp_u32);
+    fprintf(out, "{\"count\":%zu,\"mean\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+            s->len, mean_ms(s), s->len ? s->v[0] / 1000.0 : 0, percentile_ms(s, 50), percentile_ms(s, 95),
+            percentile_ms(s, 99), s->len ? s->v[s->len - 1] / 1000.0 : 0);
+}
+
+static int run_once(const loadgen_opts_t *opts, FILE *out, run_summary_t *sum)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        fprintf(stderr, "SSL_CTX_new failed\n");
+        return -1;
+    }
+    // The gateway uses a self-signed certificate
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    if (!opts->resume) {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+
+    client_t *clients = calloc(opts->clients, sizeof(client_t));
+    pthread_t *threads = calloc(opts->clients, sizeof(pthread_t));
+    if (clients == NULL || threads == NULL) {
+        SSL_CTX_free(ctx);
+        free(clients);
+        free(threads);
+        return -1;
+    }
+    atomic_store(&s_issued, 0);
+    double start = now_s();
+    s_deadline = start + opts->duration_s;
+    for (unsigned i = 0; i < opts->clients; i++) {
+        clients[i].opts = opts;
+        clients[i].ctx = ctx;
+        clients[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    for (unsigned i = 0; i < opts->clients; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_s() - start;
+
+    client_t total = {0};
+    for (unsigned i = 0; i < opts->clients; i++) {
+        client_t *cl = &clients[i];
+        samples_append(&total.latency, &cl->latency);
+        samples_append(&total.handshake, &cl->handshake);
+        for (unsigned e = 0; e < opts->mix_count; e++) {
+            samples_append(&total.entries[e].latency, &cl->entries[e].latency);
+            total.entries[e].ok += cl->entries[e].ok;
+            total.entries[e].failed += cl->entries[e].failed;
+            free(cl->entries[e].latency.v);
+        }
+        for (int s = 0; s < MAX_STATUS_CODES; s++) {
+            total.status[s] += cl->status[s];
+        }
+        for (int k = 0; k < ERR_COUNT; k++) {
+            total.errors[k] += cl->errors[k];
+        }
+        total.requests += cl->requests;
+        total.connections += cl->connections;
+        total.resumed += cl->resumed;
+        total.reconnects += cl->reconnects;
+        total.bytes_in += cl->bytes_in;
+        total.bytes_out += cl->bytes_out;
+        free(cl->latency.v);
+        free(cl->handshake.v);
+    }
+
+    uint64_t transport_errors = 0;
+    for (int k = 0; k < ERR_COUNT; k++) {
+        transport_errors += total.errors[k];
+    }
+    uint64_t http_errors = 0;
+    for (int s = 400; s < MAX_STATUS_CODES; s++) {
+        http_errors += total.status[s];
+    }
+
+    fprintf(out, "{\"target\":\"%s:%s\",\"clients\":%u,\"keep_alive\":%s,\"resumption\":%s,",
+            opts->host, opts->port, opts->clients, opts->keep_alive ? "true" : "false",
+            opts->resume ? "true" : "false");
+    fprintf(out, "\"elapsed_s\":%.3f,\"requests\":%" PRIu64 ",\"throughput_rps\":%.1f,", elapsed, total.requests,
+            elapsed > 0 ? total.requests / elapsed : 0);
+    fprintf(out, "\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64 ",", total.bytes_in, total.bytes_out);
+    fprintf(out, "\"latency_ms\":");
+    print_latency(out, &total.latency);
+    fprintf(out, ",\"handshake_ms\":");
+    print_latency(out, &total.handshake);
+    fprintf(out, ",\"connections\":%" PRIu64 ",\"resumed\":%" PRIu64 ",\"reconnects\":%" PRIu64 ",",
+            total.connections, total.resumed, total.reconnects);
+    fprintf(out, "\"status\":{");
+    bool first = true;
+    for (int s = 0; s < MAX_STATUS_CODES; s++) {
+        if (total.status[s]) {
+            fprintf(out, "%s\"%d\":%" PRIu64, first ? "" : ",", s, total.status[s]);
+            first = false;
+        }
+    }
+    fprintf(out, "},\"errors\":{");
+    for (int k = 0; k < ERR_COUNT; k++) {
+        fprintf(out, "%s\"%s\":%" PRIu64, k ? "," : "", s_err_names[k], total.errors[k]);
+    }
+    fprintf(out, "},\"endpoints\":[");
+    for (unsigned e = 0; e < opts->mix_count; e++) {
+        fprintf(out, "%s{\"method\":\"%s\",\"path\":\"%s\",\"weight\":%u,\"ok\":%" PRIu64 ",\"failed\":%" PRIu64
+                ",\"latency_ms\":",
+                e ? "," : "", opts->mix[e].method, opts->mix[e].path, opts->mix[e].weight,
+                total.entries[e].ok, total.entries[e].failed);
+        print_latency(out, &total.entries[e].latency);
+        fprintf(out, "}");
+        free(total.entries[e].latency.v);
+    }
+    fprintf(out, "]");
+
+    sum->elapsed_s = elapsed;
+    sum->requests = total.requests;
+    sum->http_errors = http_errors;
+    sum->transport_errors = transport_errors;
+    sum->rps = elapsed > 0 ? total.requests / elapsed : 0;
+    sum->error_rate = total.requests ? (double)(http_errors + transport_errors) / total.requests : 0;
+    // print_latency() sorted the samples
+    sum->p50_ms = percentile_ms(&total.latency, 50);
+    sum->p95_ms = percentile_ms(&total.latency, 95);
+    sum->p99_ms = percentile_ms(&total.latency, 99);
+    sum->hs_p95_ms = percentile_ms(&total.handshake, 95);
+
+    free(total.latency.v);
+    free(total.handshake.v);
+    free(clients);
+    free(threads);
+    SSL_CTX_free(ctx);
+    return 0;
+}
+
+// Appends the gate verdicts for one run and returns the number of failures.
+static int check_gates(const loadgen_opts_t *opts, const run_summary_t *sum, FILE *out)
+{
+    struct {
+        const char *name;
+        double limit;
+        double value;
+        bool upper;
+    } gates[] = {
+        { "max_p50_ms", opts->max_p50_ms, sum->p50_ms, true },
+        { "max_p95_ms", opts->max_p95_ms, sum->p95_ms, true },
+        { "max_p99_ms", opts->max_p99_ms, sum->p99_ms, true },
+        { "max_handshake_p95_ms", opts->max_handshake_p95_ms, sum->hs_p95_ms, true },
+        { "min_rps", opts->min_rps, sum->rps, false },
+        { "max_error_rate", opts->max_error_rate, sum->error_rate, true },
+    };
+    int failures = 0;
+    bool first = true;
+    fprintf(out, ",\"gates\":[");
+    for (size_t i = 0; i < sizeof(gates) / sizeof(gates[0]); i++) {
+        if (gates[i].limit < 0) {
+            continue;
+        }
+        bool pass = gates[i].upper ? gates[i].value <= gates[i].limit : gates[i].value >= gates[i].limit;
+        failures += !pass;
+        fprintf(out, "%s{\"gate\":\"%s\",\"limit\":%.3f,\"value\":%.3f,\"pass\":%s}", first ? "" : ",",
+                gates[i].name, gates[i].limit, gates[i].value, pass ? "true" : "false");
+        first = false;
+        if (!pass) {
+            fprintf(stderr, "gate %s failed: %.3f (limit %.3f)%s%s\n", gates[i].name, gates[i].value,
+                    gates[i].limit, opts->keep_alive ? " keep-alive" : "", opts->resume ? " resumption" : "");
+        }
+    }
+    fprintf(out, "],\"pass\":%s}", failures ? "false" : "true");
+    return failures;
+}
+
+static bool add_mix_entry(loadgen_opts_t *opts, const char *spec)
+{
+    // weight:METHOD:path[:body]
+    if (opts->mix_count >= MAX_MIX_ENTRIES) {
+        return false;
+    }
+    mix_entry_t *e = &opts->mix[opts->mix_count];
+    char *end;
+    unsigned long weight = strtoul(spec, &end, 10);
+    if (end == spec || *end != ':' || weight == 0) {
+        return false;
+    }
+    const char *method = end + 1;
+    const char *path = strchr(method, ':');
+    if (path == NULL || path == method || (size_t)(path - method) >= sizeof(e->method)) {
+        return false;
+    }
+    path++;
+    const char *body = strchr(path, ':');
+    size_t path_len = body ? (size_t)(body - path) : strlen(path);
+    if (path_len == 0 || path_len >= sizeof(e->path) || *path != '/') {
+        return false;
+    }
+    memset(e, 0, sizeof(*e));
+    e->weight = (unsigned)weight;
+    memcpy(e->method, method, path - 1 - method);
+    memcpy(e->path, path, path_len);
+    if (body && snprintf(e->body, sizeof(e->body), "%s", body + 1) >= (int)sizeof(e->body)) {
+        return false;
+    }
+    opts->mix_count++;
+    opts->mix_total_weight += e->weight;
+    return true;
+}
+
+// Default mix: mostly static assets and status polling, like a browser with
+// the dashboard open, plus occasional LED control.
+static const char *const s_default_mix[] = {
+    "4:GET:/",
+    "2:GET:/css/styles.css",
+    "2:GET:/js/app.js",
+    "1:GET:/status.html",
+    "4:GET:/api/system_info",
+    "4:GET:/api/wifi_status",
+    "2:GET:/api/clients",
+    "1:POST:/api/led/brightness:{\"brightness\":30}",
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -H, --host HOST            target host (default 127.0.0.1)\n"
+            "  -p, --port PORT            target port (default 8443)\n"
+            "  -c, --clients N            concurrent TLS clients (default 4)\n"
+            "  -d, --duration SEC         run time in seconds (default 10)\n"
+            "  -n, --requests N           stop after N requests instead of a duration\n"
+            "  -t, --timeout-ms MS        socket timeout (default 5000)\n"
+            "      --no-keepalive         one request per connection\n"
+            "      --no-resume            full handshake on every connection\n"
+            "      --matrix               run all keep-alive/resumption combinations\n"
+            "  -m, --mix W:METHOD:PATH[:BODY]\n"
+            "                             add a weighted request (repeatable; replaces the default mix)\n"
+            "  -o, --out FILE             write the JSON report to FILE (default stdout)\n"
+            "Gates (exit code 2 if any fails):\n"
+            "      --max-p50-ms MS  --max-p95-ms MS  --max-p99-ms MS\n"
+            "      --max-handshake-p95-ms MS  --min-rps N  --max-error-rate FRACTION\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    loadgen_opts_t opts = {
+        .host = "127.0.0.1",
+        .port = "8443",
+        .clients = 4,
+        .duration_s = 10,
+        .timeout_ms = 5000,
+        .keep_alive = true,
+        .resume = true,
+        .max_p50_ms = -1,
+        .max_p95_ms = -1,
+        .max_p99_ms = -1,
+        .max_handshake_p95_ms = -1,
+        .min_rps = -1,
+        .max_error_rate = -1,
+    };
+    enum {
+        OPT_NO_KEEPALIVE = 256, OPT_NO_RESUME, OPT_MATRIX, OPT_MAX_P50, OPT_MAX_P95, OPT_MAX_P99,
+        OPT_MAX_HS_P95, OPT_MIN_RPS, OPT_MAX_ERR,
+    };
+    static const struct option long_opts[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "clients", required_argument, NULL, 'c' },
+        { "duration", required_argument, NULL, 'd' },
+        { "requests", required_argument, NULL, 'n' },
+        { "timeout-ms", required_argument, NULL, 't' },
+        { "mix", required_argument, NULL, 'm' },
+        { "out", required_argument, NULL, 'o' },
+        { "no-keepalive", no_argument, NULL, OPT_NO_KEEPALIVE },
+        { "no-resume", no_argument, NULL, OPT_NO_RESUME },
+        { "matrix", no_argument, NULL, OPT_MATRIX },
+        { "max-p50-ms", required_argument, NULL, OPT_MAX_P50 },
+        { "max-p95-ms", required_argument, NULL, OPT_MAX_P95 },
+        { "max-p99-ms", required_argument, NULL, OPT_MAX_P99 },
+        { "max-handshake-p95-ms", required_argument, NULL, OPT_MAX_HS_P95 },
+        { "min-rps", required_argument, NULL, OPT_MIN_RPS },
+        { "max-error-rate", required_argument, NULL, OPT_MAX_ERR },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    // Servers purging connections would otherwise kill us mid-write
+    signal(SIGPIPE, SIG_IGN);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "H:p:c:d:n:t:m:o:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'H': opts.host = optarg; break;
+        case 'p': opts.port = optarg; break;
+        case 'c': opts.clients = (unsigned)atoi(optarg); break;
+        case 'd': opts.duration_s = atof(optarg); break;
+        case 'n': opts.max_requests = strtoull(optarg, NULL, 10); break;
+        case 't': opts.timeout_ms = (unsigned)atoi(optarg); break;
+        case 'o': opts.out_path = optarg; break;
+        case 'm':
+            if (!add_mix_entry(&opts, optarg)) {
+                fprintf(stderr, "invalid --mix entry: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_NO_KEEPALIVE: opts.keep_alive = false; break;
+        case OPT_NO_RESUME: opts.resume = false; break;
+        case OPT_MATRIX: opts.matrix = true; break;
+        case OPT_MAX_P50: opts.max_p50_ms = atof(optarg); break;
+        case OPT_MAX_P95: opts.max_p95_ms = atof(optarg); break;
+        case OPT_MAX_P99: opts.max_p99_ms = atof(optarg); break;
+        case OPT_MAX_HS_P95: opts.max_handshake_p95_ms = atof(optarg); break;
+        case OPT_MIN_RPS: opts.min_rps = atof(optarg); break;
+        case OPT_MAX_ERR: opts.max_error_rate = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.clients == 0 || (opts.duration_s <= 0 && opts.max_requests == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opts.mix_count == 0) {
+        for (size_t i = 0; i < sizeof(s_default_mix) / sizeof(s_default_mix[0]); i++) {
+            add_mix_entry(&opts, s_default_mix[i]);
+        }
+    }
+    if (opts.max_requests) {
+        opts.duration_s = 0;
+    }
+
+    FILE *out = stdout;
+    if (opts.out_path && (out = fopen(opts.out_path, "w")) == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", opts.out_path, strerror(errno));
+        return 1;
+    }
+
+    int failures = 0;
+    run_summary_t sum;
+    if (opts.matrix) {
+        fprintf(out, "{\"runs\":[");
+        for (int i = 0; i < 4; i++) {
+            loadgen_opts_t run = opts;
+            run.keep_alive = (i & 2) == 0;
+            run.resume = (i & 1) == 0;
+            fprintf(out, "%s", i ? "," : "");
+            if (run_once(&run, out, &sum) != 0) {
+                return 1;
+            }
+            failures += check_gates(&run, &sum, out);
+        }
+        fprintf(out, "],\"pass\":%s}\n", failures ? "false" : "true");
+    } else {
+        if (run_once(&opts, out, &sum) != 0) {
+            return 1;
+        }
+        failures = check_gates(&opts, &sum, out);
+        fprintf(out, "\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# Starts the host gateway in a scratch directory, waits until it answers on
+# 127.0.0.1:PORT, runs the given command and stops the gateway again.
+# The command's exit code is passed through.
+#
+#   run_with_gateway.sh GATEWAY_BIN PORT COMMAND [ARGS...]
+
+GATEWAY_BIN="$1"
+PORT="$2"
+shift 2
+
+WORK_DIR=$(mktemp -d) || exit 1
+(cd "$WORK_DIR" && exec env GW_HOST_PORT="$PORT" "$GATEWAY_BIN" >gateway.log 2>&1) &
+GATEWAY_PID=$!
+
+for _ in $(seq 50); do
+    curl -sk -o /dev/null "https://127.0.0.1:$PORT/" && break
+    sleep 0.2
+done
+
+"$@"
+RC=$?
+
+kill "$GATEWAY_PID"
+wait "$GATEWAY_PID" 2>/dev/null
+if [ "$RC" -ne 0 ]; then
+    echo "--- gateway.log (tail) ---"
+    tail -n 40 "$WORK_DIR/gateway.log"
+fi
+rm -rf "$WORK_DIR"
+exit "$RC"
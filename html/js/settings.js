@@ -0,0 +1,95 @@
+document.addEventListener("DOMContentLoaded", () => {
+    const form = document.querySelector(".settings-form");
+    const statusMessage = document.getElementById("status-message");
+    // Form fields by setting key
+    const fields = {
+        wifi_ssid: document.getElementById("wifiSSID"),
+        wifi_password: document.getElementById("wifiPassword"),
+        wifi_max_retry: document.getElementById("wifiMaxRetry"),
+        device_name: document.getElementById("deviceName"),
+        led_gpio: document.getElementById("ledGpio"),
+        led_blink_ms: document.getElementById("ledBlinkMs"),
+    };
+    // Version the form was filled from; a save fails if it is no longer current
+    let version = null;
+    let schema = [];
+    let loaded = {};
+
+    function updateStatus(message, type = "info") {
+        statusMessage.textContent = message;
+        statusMessage.className = `status-message ${type}`;
+    }
+
+    function fill(data) {
+        version = data.version;
+        schema = data.schema;
+        loaded = data.settings;
+        schema.forEach(item => {
+            const field = fields[item.key];
+            if (!field) {
+                return;
+            }
+            if (item.type === "int") {
+                field.min = item.min;
+                field.max = item.max;
+            } else {
+                field.maxLength = item.max;
+            }
+            field.value = item.secret ? "" : data.settings[item.key];
+        });
+    }
+
+    function loadSettings() {
+        fetch("/api/settings")
+            .then(response => response.json())
+            .then(fill)
+            .catch(error => {
+                console.error("Error fetching settings:", error);
+                updateStatus(`Error: ${error.message}`, "error");
+            });
+    }
+
+    form.addEventListener("submit", event => {
+        event.preventDefault();
+        const settings = {};
+        let restart = false;
+        schema.forEach(item => {
+            const field = fields[item.key];
+            // A blank secret means "keep the current one"
+            if (!field || (item.secret && field.value === "")) {
+                return;
+            }
+            // Unchanged values are sent too; the gateway leaves them be
+            const value = item.type === "int" ? Number(field.value) : field.value;
+            settings[item.key] = value;
+            restart = restart || (item.restart && value !== loaded[item.key]);
+        });
+        fetch("/api/settings", {
+            method: "PUT",
+            headers: {
+                "Content-Type": "application/json",
+            },
+            body: JSON.stringify({ version, settings }),
+        })
+            .then(response => {
+                if (response.status === 409) {
+                    throw new Error("Changed elsewhere meanwhile; reloaded, please check and save again");
+                }
+                if (!response.ok) {
+                    return response.text().then(text => { throw new Error(text); });
+                }
+                return response.json();
+            })
+            .then(data => {
+                fill(data);
+                updateStatus(restart ? "Saved; the LED GPIO applies after a restart" : "Saved", "success");
+            })
+            .catch(error => {
+                console.error(error);
+                updateStatus(`Error: ${error.message}`, "error");
+                loadSettings();
+            });
+    });
+
+    loadSettings();
+});
@@ -0,0 +1,80 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// Deferred-format binary log for hot paths. A call site stores a pointer to
+// its format string and the raw arguments in a fixed-size record of a
+// lock-free RAM ring; nothing is formatted until the record is read. A
+// low-priority task echoes new records to the console (CONFIG_BINLOG_CONSOLE)
+// and GET /api/log dumps the ring as text.
+//
+// Formats are printf-style with at most BINLOG_MAX_ARGS conversions and no
+// long double or %n. %s arguments are copied, truncated to
+// BINLOG_MAX_STR bytes; arguments that do not fit in the record are dropped
+// and the message is marked truncated. Safe to call from any task or ISR,
+// before binlog_init() too.
+
+#define BINLOG_RECORD_SIZE 64
+#define BINLOG_MAX_ARGS 8
+#define BINLOG_MAX_STR 32
+
+// Parsed argument layout of one call site, filled in on its first use
+typedef struct {
+    uint8_t state;
+    uint8_t nargs;
+    uint8_t kinds[BINLOG_MAX_ARGS];
+} binlog_site_t;
+
+typedef struct {
+    uint32_t seq;          // Position in the log, for GET /api/log?since=
+    int64_t ts_us;         // esp_timer_get_time() at the call
+    uint8_t level;         // esp_log_level_t
+    const char *tag;
+    uint32_t skipped;      // Records overwritten before the reader got to them
+} binlog_entry_t;
+
+typedef struct {
+    uint32_t written;      // Records since boot
+    uint32_t capacity;     // Records the ring holds
+    uint32_t truncated;    // Records with arguments dropped
+    uint32_t console_lost; // Overwritten before the console task printed them
+} binlog_stats_t;
+
+void binlog_write(binlog_site_t *site, uint8_t level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#define BINLOG_LEVEL(level, tag, format, ...) do {                              \
+        if ((level) <= CONFIG_BINLOG_LEVEL) {                                   \
+            static binlog_site_t binlog_site_;                                  \
+            binlog_write(&binlog_site_, (level), (tag), format, ##__VA_ARGS__); \
+        }                                                                       \
+    } while (0)
+
+#define BINLOG_E(tag, format, ...) BINLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define BINLOG_W(tag, format, ...) BINLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define BINLOG_I(tag, format, ...) BINLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define BINLOG_D(tag, format, ...) BINLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+// Starts the console task when CONFIG_BINLOG_CONSOLE is set.
+esp_err_t binlog_init(void);
+
+// Sequence number of the oldest record still in the ring, and of the next
+// one to be written.
+uint32_t binlog_oldest(void);
+uint32_t binlog_head(void);
+
+// Formats the record at *cursor into msg (always NUL-terminated) and moves
+// the cursor past it. Returns false when the reader has caught up or the
+// next record is still being written. A cursor that has been lapped skips
+// ahead and reports how far in entry->skipped.
+bool binlog_read(uint32_t *cursor, binlog_entry_t *entry, char *msg, size_t size);
+
+void binlog_get_stats(binlog_stats_t *stats);
+
+#endif // BINLOG_H
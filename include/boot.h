@@ -0,0 +1,50 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Boot orchestrator: runs init phases on their own tasks as soon as their
+// dependencies finish and keeps a monotonic timeline for /api/boot.
+
+#define BOOT_MAX_PHASES 16
+#define BOOT_MAX_MARKS 8
+#define BOOT_PHASE_STACK_SIZE 4096
+#define BOOT_DEP(i) (1UL << (i))
+
+typedef struct {
+    const char *name;
+    esp_err_t (*fn)(void);
+    uint32_t deps;       // BOOT_DEP() of earlier entries in the same table
+    uint32_t after;      // Likewise, but only waited for: these may fail
+    uint32_t stack_size; // 0 for BOOT_PHASE_STACK_SIZE
+} boot_phase_t;
+
+typedef struct {
+    const char *name;
+    uint32_t deps;
+    int64_t start_us;    // esp_timer_get_time(), -1 if the phase never ran
+    int64_t end_us;
+    esp_err_t err;       // ESP_ERR_INVALID_STATE if a dependency failed
+} boot_phase_record_t;
+
+typedef struct {
+    const char *name;
+    int64_t t_us;
+} boot_mark_t;
+
+// Runs the phases and returns when all have finished. A phase is skipped
+// when one of its deps fails; its after entries only order it. Both only
+// name entries before it, so the table cannot contain a cycle. Returns the
+// first phase error, or ESP_OK. The table must outlive the call.
+esp_err_t boot_run(const boot_phase_t *phases, size_t count);
+
+// Records a milestone (e.g. first IP) the first time name is seen.
+void boot_mark(const char *name);
+
+// Copy out the timeline; each returns the number of entries written.
+size_t boot_get_phases(boot_phase_record_t *out, size_t max);
+size_t boot_get_marks(boot_mark_t *out, size_t max);
+
+#endif // BOOT_H
@@ -0,0 +1,101 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+// Minimal CBOR (RFC 8949) codec. Neither side allocates.
+//
+// The writer encodes into a caller buffer. When a flush callback is given,
+// the buffer is handed to it whenever it fills, so output of any size
+// streams through a small buffer. Errors are sticky and reported by
+// cbor_writer_finish(). Containers have definite lengths, and integers take
+// the shortest form.
+//
+// The reader pulls one data item header at a time from a complete buffer.
+// Strings point into that buffer, which must outlive them. Indefinite-length
+// strings are not supported; indefinite arrays and maps are, ending with a
+// CBOR_BREAK item.
+
+#define CBOR_CONTENT_TYPE "application/cbor"
+#define CBOR_MAX_DEPTH 16
+
+typedef esp_err_t (*cbor_flush_fn)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;          // Bytes waiting in buf
+    size_t total;        // Bytes encoded so far, flushed or not
+    cbor_flush_fn flush;
+    void *ctx;
+    esp_err_t err;
+} cbor_writer_t;
+
+// flush may be NULL; the encoding then has to fit in buf.
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size, cbor_flush_fn flush, void *ctx);
+void cbor_put_uint(cbor_writer_t *w, uint64_t value);
+void cbor_put_int(cbor_writer_t *w, int64_t value);
+// Integral values are written as integers, others as a 32-bit float when
+// that holds them exactly and a 64-bit one otherwise.
+void cbor_put_number(cbor_writer_t *w, double value);
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len);
+void cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len);
+void cbor_put_bool(cbor_writer_t *w, bool value);
+void cbor_put_null(cbor_writer_t *w);
+void cbor_open_array(cbor_writer_t *w, size_t items);
+void cbor_open_map(cbor_writer_t *w, size_t pairs);
+// Flushes what is left, if there is a callback. Returns the first error:
+// ESP_ERR_NO_MEM when the encoding outgrew a buffer without one.
+esp_err_t cbor_writer_finish(cbor_writer_t *w);
+
+typedef enum {
+    CBOR_UINT,
+    CBOR_NEGINT,     // value is -1 - uint
+    CBOR_BYTES,
+    CBOR_TEXT,
+    CBOR_ARRAY,
+    CBOR_MAP,
+    CBOR_TAG,        // The tagged item follows
+    CBOR_FALSE,
+    CBOR_TRUE,
+    CBOR_NULL,
+    CBOR_UNDEFINED,
+    CBOR_SIMPLE,     // Any other simple value
+    CBOR_FLOAT,
+    CBOR_BREAK,      // End of an indefinite array or map
+} cbor_type_t;
+
+typedef struct {
+    cbor_type_t type;
+    bool indefinite;     // Arrays and maps only
+    uint64_t uint;       // Integer magnitude, string length, item or pair count, tag or simple value
+    double number;       // Integers and floats as a double
+    const uint8_t *data; // Strings
+} cbor_item_t;
+
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+} cbor_reader_t;
+
+void cbor_reader_init(cbor_reader_t *r, const void *buf, size_t len);
+// Reads the next item header; a string's bytes are consumed with it.
+// ESP_ERR_NOT_FOUND at the end of the buffer, ESP_ERR_INVALID_SIZE on a
+// truncated or malformed item and ESP_ERR_NOT_SUPPORTED on an indefinite
+// string.
+esp_err_t cbor_next(cbor_reader_t *r, cbor_item_t *item);
+bool cbor_at_end(const cbor_reader_t *r);
+
+// cJSON bridge for the HTTP API, which builds its replies as cJSON trees.
+// Encoding walks the tree without copying it. Decoding builds a tree
+// through the cJSON hooks, so inside a request it lands in the request
+// arena. Map keys must be text, byte strings and undefined are rejected,
+// and tags are skipped. Nesting is limited to CBOR_MAX_DEPTH.
+esp_err_t cbor_encode_cjson(cbor_writer_t *w, const cJSON *item);
+esp_err_t cbor_decode_cjson(const void *buf, size_t len, cJSON **out);
+
+#endif // CBOR_H
@@ -0,0 +1,106 @@
+#ifndef COAP_H
+#define COAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Minimal CoAP (RFC 7252) message codec. Parsing never allocates or copies:
+// the parsed message and its options point into the caller's buffer, which
+// must outlive them. Responses are written into a caller buffer.
+
+#define COAP_VERSION 1
+#define COAP_HDR_SIZE 4
+#define COAP_MAX_TOKEN_LEN 8
+#define COAP_PAYLOAD_MARKER 0xff
+
+typedef enum {
+    COAP_TYPE_CON = 0,
+    COAP_TYPE_NON = 1,
+    COAP_TYPE_ACK = 2,
+    COAP_TYPE_RST = 3,
+} coap_type_t;
+
+#define COAP_CODE(class, detail) ((uint8_t)((class) << 5 | (detail)))
+#define COAP_CODE_CLASS(code) ((code) >> 5)
+
+enum {
+    COAP_CODE_EMPTY = COAP_CODE(0, 0),
+    COAP_CODE_GET = COAP_CODE(0, 1),
+    COAP_CODE_POST = COAP_CODE(0, 2),
+    COAP_CODE_PUT = COAP_CODE(0, 3),
+    COAP_CODE_DELETE = COAP_CODE(0, 4),
+    COAP_CODE_CHANGED = COAP_CODE(2, 4),
+    COAP_CODE_CONTENT = COAP_CODE(2, 5),
+    COAP_CODE_BAD_REQUEST = COAP_CODE(4, 0),
+    COAP_CODE_BAD_OPTION = COAP_CODE(4, 2),
+    COAP_CODE_NOT_FOUND = COAP_CODE(4, 4),
+    COAP_CODE_METHOD_NOT_ALLOWED = COAP_CODE(4, 5),
+    COAP_CODE_TOO_LARGE = COAP_CODE(4, 13),
+    COAP_CODE_UNSUPPORTED_FORMAT = COAP_CODE(4, 15),
+    COAP_CODE_SERVICE_UNAVAILABLE = COAP_CODE(5, 3),
+};
+
+enum {
+    COAP_OPT_URI_HOST = 3,
+    COAP_OPT_URI_PORT = 7,
+    COAP_OPT_URI_PATH = 11,
+    COAP_OPT_CONTENT_FORMAT = 12,
+    COAP_OPT_URI_QUERY = 15,
+    COAP_OPT_ACCEPT = 17,
+};
+
+#define COAP_FORMAT_NONE (-1)
+#define COAP_FORMAT_LINK 40
+#define COAP_FORMAT_OCTET_STREAM 42
+
+// Odd option numbers are critical: a request carrying one the server does
+// not understand must be rejected
+#define COAP_OPT_IS_CRITICAL(num) ((num) & 1)
+
+typedef struct {
+    uint8_t type;               // coap_type_t
+    uint8_t code;
+    uint16_t mid;
+    uint8_t token_len;
+    const uint8_t *token;
+    const uint8_t *options;     // Encoded options, walked with coap_option_next()
+    size_t options_len;
+    const uint8_t *payload;
+    size_t payload_len;
+} coap_msg_t;
+
+typedef struct {
+    uint16_t num;
+    uint16_t len;
+    const uint8_t *value;
+} coap_option_t;
+
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+    uint16_t num;
+} coap_option_iter_t;
+
+// Checks the header, token and option encoding. Returns
+// ESP_ERR_INVALID_SIZE or ESP_ERR_INVALID_VERSION for a message format
+// error, after filling in as much of msg as could be read (type and mid are
+// valid whenever len >= COAP_HDR_SIZE, for answering with a reset).
+esp_err_t coap_parse(const uint8_t *buf, size_t len, coap_msg_t *msg);
+
+void coap_option_iter_init(const coap_msg_t *msg, coap_option_iter_t *it);
+
+// Steps to the next option of a message that passed coap_parse().
+bool coap_option_next(coap_option_iter_t *it, coap_option_t *opt);
+
+// Value of a uint option (big-endian, leading zeros dropped, up to 4 bytes).
+uint32_t coap_option_uint(const coap_option_t *opt);
+
+// Writes a message with an optional Content-Format option (COAP_FORMAT_NONE
+// for none) and payload. Returns its length, or 0 if it does not fit.
+size_t coap_build(uint8_t *buf, size_t size, coap_type_t type, uint8_t code, uint16_t mid,
+                  const uint8_t *token, uint8_t token_len, int format, const void *payload,
+                  size_t payload_len);
+
+#endif // COAP_H
@@ -0,0 +1,85 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Heap telemetry. A sampler task records free size, largest free block and
+// fragmentation per capability class, keeps their low-water marks and logs
+// when a CONFIG_HEAP_MONITOR_* threshold is crossed (and again on
+// recovery). Subsystems that allocate through the tagged wrappers below are
+// accounted separately; mbedTLS and cJSON are routed through them by
+// heap_monitor_init(). Failed allocations anywhere are counted with the
+// size and caps of the latest one.
+//
+// heap_monitor_init() also creates two fixed-block pools (mem_pool.h):
+// small cJSON allocations are served from "json" before the heap, and
+// "scratch" hands out short-lived HEAP_SCRATCH_SIZE buffers.
+
+typedef enum {
+    HEAP_TAG_TLS,       // mbedTLS, via the custom allocator hooks
+    HEAP_TAG_HTTPD,     // Buffers allocated by request and session handlers
+    HEAP_TAG_JSON,      // cJSON, via cJSON_InitHooks
+    HEAP_TAG_STORAGE,   // log_store and tsdb
+    HEAP_TAG_OTHER,
+    HEAP_TAG_COUNT,
+} heap_tag_t;
+
+typedef enum {
+    HEAP_CLASS_INTERNAL,  // MALLOC_CAP_INTERNAL
+    HEAP_CLASS_DMA,       // MALLOC_CAP_DMA
+    HEAP_CLASS_COUNT,
+} heap_class_t;
+
+typedef struct {
+    uint32_t free_bytes;
+    uint32_t min_free_bytes;      // Low-water mark since boot
+    uint32_t largest_block;
+    uint32_t min_largest_block;   // Low-water mark of the largest block
+    uint8_t frag_pct;             // 100 * (1 - largest_block / free_bytes)
+    uint8_t max_frag_pct;
+    uint32_t free_blocks;
+} heap_class_stats_t;
+
+typedef struct {
+    uint32_t current_bytes;
+    uint32_t peak_bytes;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+} heap_tag_stats_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t last_size;
+    uint32_t last_caps;
+    int64_t last_us;
+} heap_failure_stats_t;
+
+esp_err_t heap_monitor_init(void);
+
+// Tagged allocators; memory from these must be released with
+// heap_monitor_free() under the same tag.
+void *heap_monitor_malloc(heap_tag_t tag, size_t size);
+void *heap_monitor_calloc(heap_tag_t tag, size_t n, size_t size);
+void heap_monitor_free(heap_tag_t tag, void *ptr);
+
+#define HEAP_SCRATCH_SIZE 1024
+
+// A HEAP_SCRATCH_SIZE buffer from the scratch pool, or NULL when every one
+// is in use. Not zeroed.
+void *heap_monitor_scratch_alloc(void);
+void heap_monitor_scratch_free(void *buf);
+
+// Current sample per class; takes a fresh one rather than waiting for the
+// task.
+void heap_monitor_get_class(heap_class_t cls, heap_class_stats_t *out);
+void heap_monitor_get_tag(heap_tag_t tag, heap_tag_stats_t *out);
+void heap_monitor_get_failures(heap_failure_stats_t *out);
+
+const char *heap_monitor_class_name(heap_class_t cls);
+const char *heap_monitor_tag_name(heap_tag_t tag);
+
+#endif // HEAP_MONITOR_H
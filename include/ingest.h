@@ -0,0 +1,137 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Sensor ingest pipeline. Sources (802.15.4 radio, UDP, CoAP, HTTPS, a
+// simulated generator) hand received frames to ingest_submit_*() from their own task.
+// The frame is parsed in place, without copying, into fixed-layout records
+// that are queued for a dispatcher task, which passes them in batches to
+// every registered consumer. Storage is a built-in consumer: each reading
+// goes to its own tsdb series and batches are archived in log_store.
+//
+// Sensor report, the payload of every frame (little-endian):
+//   u8 version (INGEST_REPORT_VERSION), u8 count, u16 seq, u32 sensor_id,
+//   then count readings of { u8 kind, f32 value }.
+// A sensor_id of 0 takes the sender's address (802.15.4 short or extended
+// address, low 32 bits, or the IPv4 address).
+
+#define INGEST_REPORT_VERSION 1
+#define INGEST_REPORT_HDR_SIZE 8
+#define INGEST_READING_SIZE 5
+#define INGEST_MAX_READINGS 16
+#define INGEST_MAX_CONSUMERS 4
+#define INGEST_BATCH_MAX 32
+#define INGEST_SIM_RATE_MAX 100000   // Frames per second, as for CONFIG_INGEST_SIM_RATE
+#define INGEST_SIM_SENSORS_MAX 0xffff // Each takes an 802.15.4 short address
+
+typedef enum {
+    INGEST_SRC_SIM,
+    INGEST_SRC_UDP,
+    INGEST_SRC_802154,
+    INGEST_SRC_COAP,
+    INGEST_SRC_HTTPS,
+    INGEST_SRC_COUNT,
+} ingest_source_id_t;
+
+typedef enum {
+    INGEST_KIND_TEMPERATURE = 1,   // deg C
+    INGEST_KIND_HUMIDITY = 2,      // %RH
+    INGEST_KIND_PRESSURE = 3,      // hPa
+    INGEST_KIND_BATTERY = 4,       // V
+} ingest_kind_t;
+
+typedef struct {
+    int64_t ts_ms;        // Gateway receive time, ms since the epoch
+    uint32_t sensor_id;
+    float value;
+    uint16_t seq;         // Report sequence number from the sensor
+    uint8_t kind;         // ingest_kind_t, or any value the sensor defines
+    uint8_t source;       // ingest_source_id_t
+} ingest_record_t;
+
+// Called on the dispatcher task with up to INGEST_BATCH_MAX records. Returns
+// how many it accepted; the rest are counted as that consumer's drops.
+typedef size_t (*ingest_consume_fn_t)(const ingest_record_t *records, size_t count, void *ctx);
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t records;
+    uint32_t parse_errors;
+    uint32_t queue_drops;   // Records lost because the queue was full
+} ingest_source_stats_t;
+
+typedef struct {
+    const char *name;
+    uint32_t records;
+    uint32_t batches;
+    uint32_t drops;
+} ingest_consumer_stats_t;
+
+typedef struct {
+    ingest_source_stats_t sources[INGEST_SRC_COUNT];
+    ingest_consumer_stats_t consumers[INGEST_MAX_CONSUMERS];
+    size_t consumer_count;
+    uint32_t queue_len;
+    uint32_t queue_depth;
+    uint32_t queue_peak;
+    uint32_t dispatched;
+    uint32_t batches;
+    uint32_t in_per_s;      // Records queued over the last second
+    uint32_t out_per_s;     // Records dispatched over the last second
+    uint32_t tsdb_unmapped; // Readings with no free tsdb series left
+    uint32_t sim_rate;      // Simulated frames per second, 0 when idle
+} ingest_stats_t;
+
+// Creates the queue and dispatcher, registers the storage consumer and
+// starts the sources enabled in Kconfig.
+esp_err_t ingest_init(void);
+
+// Consumers are called in registration order. Register before sources
+// produce data to see every record.
+esp_err_t ingest_add_consumer(const char *name, ingest_consume_fn_t fn, void *ctx);
+
+// Parses a bare sensor report. Returns ESP_ERR_INVALID_SIZE or
+// ESP_ERR_INVALID_VERSION for malformed frames and ESP_ERR_NO_MEM if any
+// record was dropped because the queue was full.
+esp_err_t ingest_submit_report(ingest_source_id_t src, const uint8_t *data, size_t len, uint32_t sender);
+
+// Parses an IEEE 802.15.4 MAC data frame (PSDU, FCS included) carrying a
+// sensor report. Secured and non-data frames are rejected.
+esp_err_t ingest_submit_802154(ingest_source_id_t src, const uint8_t *frame, size_t len);
+
+// Simulated source: frames per second over the given number of sensors.
+// 0 stops it. Every frame goes through the 802.15.4 parser. Returns
+// ESP_ERR_INVALID_ARG beyond INGEST_SIM_RATE_MAX or INGEST_SIM_SENSORS_MAX.
+esp_err_t ingest_sim_set_rate(uint32_t frames_per_s, uint32_t sensors);
+uint32_t ingest_sim_rate(void);
+
+// Starts the simulated, UDP, CoAP and 802.15.4 sources (ingest_sources.c).
+// Called by ingest_init().
+esp_err_t ingest_sources_start(void);
+
+// CoAP listener (ingest_coap.c): POST /ingest with a sensor report as the
+// payload (Content-Format 42 or none), confirmable or not. A confirmable
+// request is answered with a piggybacked ACK, 2.04 on success; a
+// non-confirmable one only gets a response when it is rejected.
+typedef struct {
+    uint32_t requests;
+    uint32_t confirmable;
+    uint32_t duplicates;     // Retransmitted CON requests answered from the cache
+    uint32_t pings;          // Empty CON messages, answered with a reset
+    uint32_t format_errors;
+    uint32_t rejected;       // Answered with a 4.xx or 5.xx code
+    uint32_t responses;
+} ingest_coap_stats_t;
+
+esp_err_t ingest_coap_start(void);
+void ingest_coap_get_stats(ingest_coap_stats_t *stats);
+
+const char *ingest_source_name(ingest_source_id_t src);
+void ingest_get_stats(ingest_stats_t *stats);
+
+#endif // INGEST_H
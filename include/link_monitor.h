@@ -0,0 +1,50 @@
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+// One periodic reading of the station link. rssi, channel and phy_mode are
+// zero while not associated; ip is zero without an address.
+typedef struct {
+    int64_t t_us;
+    uint32_t ip;             // network byte order, as in esp_ip4_addr_t
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t phy_mode;        // wifi_phy_mode_t + 1, 0 when unknown
+    uint8_t disconnects;     // Disconnects since the previous sample (saturates)
+    uint8_t last_reason;     // Reason of the latest of those, 0 if none
+} link_sample_t;
+
+// Downsampled history point covering one or more consecutive samples.
+typedef struct {
+    int64_t t_us;            // Time of the newest sample in the bucket
+    int8_t rssi_avg;         // Over associated samples only, 0 if none
+    int8_t rssi_min;
+    uint8_t samples;
+    uint8_t associated;      // Samples with a link
+    uint16_t disconnects;
+} link_point_t;
+
+// Starts the sampler task. Needs the default event loop and Wi-Fi driver.
+esp_err_t link_monitor_start(void);
+
+// Copies the newest sample; ESP_ERR_NOT_FOUND before the first one.
+esp_err_t link_monitor_get_latest(link_sample_t *out);
+
+// Splits the history (oldest first) into at most max_points buckets of
+// equal size and returns the number written.
+size_t link_monitor_get_history(link_point_t *out, size_t max_points);
+
+// Total disconnects since start; last_reason (optional) gets the reason of
+// the most recent one, 0 if none.
+uint32_t link_monitor_get_disconnects(uint8_t *last_reason);
+
+// Nominal single-stream 20/40 MHz rate for a negotiated mode, in kbit/s.
+// IDF does not expose the live rate control state.
+uint32_t link_monitor_phy_rate_kbps(uint8_t phy_mode);
+const char *link_monitor_phy_mode_str(uint8_t phy_mode);
+
+#endif // LINK_MONITOR_H
@@ -0,0 +1,55 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Append-only record log on the LittleFS "storage" partition. Records are
+// collected in a RAM buffer and written in batches when it fills or every
+// CONFIG_LOG_STORE_FLUSH_MS, into fixed-size segment files. The oldest
+// segment is deleted once CONFIG_LOG_STORE_MAX_SEGMENTS exist.
+
+#define LOG_STORE_MAX_RECORD_SIZE 1024
+
+// Position of the next record to read. Copy it to resume later.
+typedef struct {
+    uint32_t segment;  // Segment sequence number
+    uint32_t offset;   // Byte offset within that segment
+} log_cursor_t;
+
+typedef struct {
+    uint32_t records;          // Appended since boot
+    uint64_t record_bytes;     // Payload bytes appended
+    uint32_t flushes;          // Batched writes to flash
+    uint64_t flushed_bytes;    // Bytes written, record headers included
+    uint32_t rotations;
+    uint32_t dropped;          // Rejected or lost to a write error
+    uint32_t write_errors;
+    uint32_t reader_skips;     // Reads that jumped over deleted or damaged data
+    uint32_t first_segment;
+    uint32_t last_segment;
+    size_t buffered;           // Bytes waiting in RAM
+} log_store_stats_t;
+
+// Mounts the partition, recovers the segment list and starts the flusher.
+esp_err_t log_store_init(void);
+
+// Copies the record into the write buffer. Only fails for empty records,
+// records over LOG_STORE_MAX_RECORD_SIZE, or a failed flush.
+esp_err_t log_store_append(const void *data, size_t len);
+
+// Writes out everything buffered so far.
+esp_err_t log_store_flush(void);
+
+// Points cursor at the oldest record still stored.
+void log_store_cursor_oldest(log_cursor_t *cursor);
+
+// Reads the record at cursor and advances it. Only flushed records are
+// visible. Returns ESP_ERR_NOT_FOUND when there is nothing newer, or
+// ESP_ERR_INVALID_SIZE with *len set if buf is too small.
+esp_err_t log_store_read(log_cursor_t *cursor, void *buf, size_t buf_size, size_t *len);
+
+void log_store_get_stats(log_store_stats_t *stats);
+
+#endif // LOG_STORE_H
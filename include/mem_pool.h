@@ -0,0 +1,54 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Fixed-block pools. Each pool takes one slab from the heap when it is
+// created and never returns it, so objects allocated and freed all day
+// leave the heap's shape alone. Allocation and free pop and push a free
+// list under a spinlock: O(1), with no search.
+//
+// Pools are created at boot and live forever; every pool is listed for
+// /api/heap with its own counters.
+
+#define MEM_POOL_MAX 8
+
+// Slab from internal RAM, and mem_pool_alloc_from_isr() is allowed
+#define MEM_POOL_ISR_SAFE (1u << 0)
+
+typedef struct mem_pool mem_pool_t;
+
+typedef struct {
+    const char *name;
+    uint32_t block_size;
+    uint32_t blocks;
+    uint32_t in_use;
+    uint32_t peak_in_use;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t exhausted;   // Allocations refused because every block was in use
+} mem_pool_stats_t;
+
+// block_size is rounded up to keep every block pointer-aligned.
+esp_err_t mem_pool_create(const char *name, size_t block_size, uint32_t blocks, uint32_t flags,
+                          mem_pool_t **out);
+
+// Returns NULL when the pool is exhausted; the caller decides whether to
+// fall back to the heap.
+void *mem_pool_alloc(mem_pool_t *pool);
+void *mem_pool_alloc_from_isr(mem_pool_t *pool);
+// Safe from tasks and, for MEM_POOL_ISR_SAFE pools, from ISRs.
+void mem_pool_free(mem_pool_t *pool, void *block);
+
+// True when ptr is a block of pool; pool may be NULL.
+bool mem_pool_owns(const mem_pool_t *pool, const void *ptr);
+size_t mem_pool_block_size(const mem_pool_t *pool);
+
+void mem_pool_get_stats(mem_pool_t *pool, mem_pool_stats_t *out);
+size_t mem_pool_count(void);
+mem_pool_t *mem_pool_at(size_t index);
+
+#endif // MEM_POOL_H
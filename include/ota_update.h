@@ -0,0 +1,59 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Firmware updates into the app slot that is not running. The image is
+// streamed: each piece is hashed and written to flash as it arrives, so no
+// buffer the size of the image is ever held. The image must carry an ECDSA
+// P-256 signature over its SHA-256, made with the private half of
+// certs/ota_pub.pem; the boot slot only changes once that checks out. The
+// new image then boots on trial and is rolled back at the next reset unless
+// it calls ota_update_mark_valid().
+
+#define OTA_UPDATE_SIG_MAX 72     // Longest DER-encoded P-256 signature
+#define OTA_UPDATE_LABEL_LEN 17
+
+typedef struct {
+    char running[OTA_UPDATE_LABEL_LEN];  // Slot the app runs from
+    char next[OTA_UPDATE_LABEL_LEN];     // Slot the next update goes to
+    char version[32];                    // Version of the running app
+    const char *state;                   // Rollback state of the running slot
+    uint32_t slot_size;
+    bool updating;
+    uint32_t received;        // Bytes of the update in progress
+    uint32_t size;            // Size it announced
+    uint32_t updates;
+    uint32_t update_failures;
+    uint32_t last_update_ms;
+    uint32_t last_update_kbps;
+    uint32_t last_flash_ms;   // Part of last_update_ms spent writing flash
+    char last_sha256[65];     // Hex digest of the last accepted image
+} ota_update_info_t;
+
+void ota_update_get_info(ota_update_info_t *info);
+
+// Streaming update in the style of esp_ota_*. Only one update runs at a
+// time (ESP_ERR_INVALID_STATE otherwise); image_size must be known up front
+// and fit the slot (ESP_ERR_INVALID_SIZE otherwise).
+esp_err_t ota_update_begin(size_t image_size);
+esp_err_t ota_update_write(const void *data, size_t len);
+// Checks the image and its signature and, if both hold, selects it for the
+// next boot. Returns ESP_ERR_INVALID_SIZE for a short image and
+// ESP_ERR_INVALID_CRC for a signature that does not match.
+esp_err_t ota_update_end(const uint8_t *sig, size_t sig_len);
+void ota_update_abort(void);
+
+// Checks sig, a DER ECDSA signature made with the update key, against a
+// SHA-256 digest. Returns ESP_ERR_INVALID_CRC when it does not match. Web
+// UI bundles are signed with the same key.
+esp_err_t ota_update_verify_signature(const uint8_t *sha256, const uint8_t *sig, size_t sig_len);
+
+// Confirms a new image on its first boot, cancelling the rollback. Call it
+// once the app has shown it can take the next update.
+void ota_update_mark_valid(void);
+
+#endif // OTA_UPDATE_H
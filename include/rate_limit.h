@@ -0,0 +1,63 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Per-client token buckets for new TLS connections and for HTTP requests,
+// so one busy client cannot keep the single httpd task handshaking.
+//
+// Clients are keyed by IP address in a small open-addressed table. Nothing
+// is ever removed: a client whose buckets have refilled is no different
+// from one never seen, so its slot is free for the next newcomer. When every
+// slot a newcomer may probe is still live, the least recently seen client
+// there is recycled.
+
+#define RATE_LIMIT_SLOTS 32   // Power of two
+#define RATE_LIMIT_PROBE 8    // Slots a client may land in, from its hash
+#define RATE_LIMIT_ADDR_LEN 16
+#define RATE_LIMIT_IP_LEN 40
+
+typedef enum {
+    RATE_LIMIT_CONNECT,
+    RATE_LIMIT_REQUEST,
+    RATE_LIMIT_KINDS,
+} rate_limit_kind_t;
+
+typedef struct {
+    uint32_t burst;           // Bucket size; 0 turns the limit off
+    uint32_t per_min;         // Refill rate in tokens per minute
+} rate_limit_bucket_cfg_t;
+
+typedef struct {
+    char ip[RATE_LIMIT_IP_LEN];
+    uint32_t allowed[RATE_LIMIT_KINDS];
+    uint32_t refused[RATE_LIMIT_KINDS];
+    int64_t last_seen_us;
+} rate_limit_client_t;
+
+typedef struct {
+    uint32_t allowed[RATE_LIMIT_KINDS];
+    uint32_t refused[RATE_LIMIT_KINDS];
+    uint32_t recycled;        // Live clients dropped to make room
+    uint32_t unknown_peer;    // Lookups with no peer address, let through
+} rate_limit_stats_t;
+
+// Sets the bucket sizes and rates and forgets every client.
+void rate_limit_init(const rate_limit_bucket_cfg_t cfg[RATE_LIMIT_KINDS]);
+
+// Takes one token of kind for the peer of the connected socket fd. Returns
+// false when the bucket is empty; retry_after_ms, if given, is then set to
+// the wait for the next token.
+bool rate_limit_take(rate_limit_kind_t kind, int fd, uint32_t *retry_after_ms);
+// The same for an IPv6 address (IPv4 as v4-mapped) at a given time.
+bool rate_limit_take_addr(rate_limit_kind_t kind, const uint8_t addr[RATE_LIMIT_ADDR_LEN], int64_t now_us,
+                          uint32_t *retry_after_ms);
+
+// Copies up to max clients that are still being limited, that is whose
+// buckets have not refilled, and returns the number written.
+size_t rate_limit_snapshot(rate_limit_client_t *out, size_t max);
+void rate_limit_get_stats(rate_limit_stats_t *stats);
+
+#endif // RATE_LIMIT_H
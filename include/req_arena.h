@@ -0,0 +1,46 @@
+#ifndef REQ_ARENA_H
+#define REQ_ARENA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Per-request bump arena. dispatch_request() opens it on the httpd task
+// before a handler runs and resets it once the handler returns. While it is
+// open, cJSON allocations made on that task (through heap_monitor's hooks)
+// and req_arena_alloc() are pointer bumps in a fixed CONFIG_REQ_ARENA_SIZE
+// buffer, and frees are no-ops. Allocations that do not fit come from the
+// heap and are released at the reset too, so nothing allocated during a
+// request can leak, whatever path the handler returns by.
+//
+// Memory from the arena is only valid until the request completes; nothing
+// allocated here may be kept past it. Other tasks never see the arena.
+
+typedef struct {
+    uint32_t size;
+    uint32_t requests;
+    uint32_t last_used;       // Bytes the latest request took, overflow included
+    uint32_t high_water;      // Most any single request took
+    uint32_t overflows;       // Allocations that went to the heap
+    uint32_t overflow_fails;  // ...and found no heap either
+} req_arena_stats_t;
+
+// Opens the arena for the calling task. Returns false, and the request runs
+// on the heap as before, if it is already open elsewhere.
+bool req_arena_begin(void);
+// Releases everything allocated since req_arena_begin().
+void req_arena_end(void);
+
+// Request-scoped memory, 8-byte aligned. NULL outside a request or when
+// neither the arena nor the heap has room.
+void *req_arena_alloc(size_t size);
+
+// True when the calling task has the arena open.
+bool req_arena_active(void);
+// True when ptr came from the open arena, overflow included; such pointers
+// are never freed individually.
+bool req_arena_owns(const void *ptr);
+
+void req_arena_get_stats(req_arena_stats_t *out);
+
+#endif // REQ_ARENA_H
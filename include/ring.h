@@ -0,0 +1,61 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Lock-free ring buffers of fixed-size items for moving data between tasks
+// without a kernel call per item. Capacity is a power of two, items are
+// copied in and out in batches, and the producer and consumer indexes sit
+// on separate cache lines.
+//
+// RING_SPSC: one producer and one consumer, each a single task or ISR.
+// RING_MPSC: any number of producers, tasks or ISRs, and one consumer.
+//   Producers reserve slots with a compare-and-swap and mark each slot
+//   written; the consumer stops at the first slot still being written.
+//
+// The non-blocking calls never wait. ring_pop_wait() and ring_push_wait()
+// sleep on the calling task's notification value, so that task must not
+// use task notifications for anything else while it waits.
+
+#define RING_CACHE_LINE 64
+
+typedef enum {
+    RING_SPSC,
+    RING_MPSC,
+} ring_kind_t;
+
+typedef struct ring ring_t;
+
+// capacity must be a power of two.
+esp_err_t ring_create(ring_kind_t kind, size_t item_size, uint32_t capacity, ring_t **out);
+void ring_delete(ring_t *ring);
+
+// Copies up to n items in and returns how many fit. Wakes a consumer
+// blocked in ring_pop_wait().
+size_t ring_push(ring_t *ring, const void *items, size_t n);
+
+// ring_push() for interrupt handlers; *woken is set when a higher-priority
+// task was unblocked.
+size_t ring_push_from_isr(ring_t *ring, const void *items, size_t n, BaseType_t *woken);
+
+// Copies up to max items out and returns how many there were. Wakes a
+// producer blocked in ring_push_wait().
+size_t ring_pop(ring_t *ring, void *items, size_t max);
+
+// ring_pop() that waits up to timeout ticks for the first item.
+size_t ring_pop_wait(ring_t *ring, void *items, size_t max, TickType_t timeout);
+
+// SPSC only: pushes all n items, waiting up to timeout ticks for room.
+// Returns how many were pushed.
+size_t ring_push_wait(ring_t *ring, const void *items, size_t n, TickType_t timeout);
+
+// Items pushed and not yet popped, including slots an MPSC producer has
+// reserved but not finished writing.
+uint32_t ring_count(const ring_t *ring);
+uint32_t ring_capacity(const ring_t *ring);
+
+#endif // RING_H
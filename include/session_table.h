@@ -0,0 +1,76 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Live HTTPS sessions keyed by socket fd. Rows are added and removed from
+// the TLS session hooks on the httpd task; byte counts arrive through the
+// esp_http_server data events, which carry the fd.
+//
+// The table also decides which sessions to close when sockets run short.
+// The server keeps one socket more than it admits sessions, so a newcomer
+// can always finish its handshake and be weighed against the others: the
+// least recently active idle session makes room for it, or, when every
+// other session is busy, the newcomer itself is turned away. Sessions idle
+// past a timeout are reaped, and when the heap runs low an idle session is
+// given up so a later newcomer has the memory. The caller does the closing.
+
+#define SESSION_TABLE_SLOTS 16 // Power of two, at least twice max_open_sockets
+#define SESSION_IP_LEN 40
+#define SESSION_CIPHER_LEN 48
+
+typedef struct {
+    int fd;
+    char ip[SESSION_IP_LEN];
+    uint16_t port;
+    int64_t connected_us;
+    int64_t last_active_us;   // Start or end of the latest request, or its latest payload bytes
+    uint64_t bytes_in;        // HTTP payload bytes, excluding headers and TLS
+    uint64_t bytes_out;
+    uint32_t requests;
+    bool closing;             // Picked for eviction or reaping, close pending
+    char cipher[SESSION_CIPHER_LEN];
+} session_info_t;
+
+typedef struct {
+    uint32_t active;
+    uint32_t peak;
+    uint32_t accepted;        // Sessions that completed the TLS handshake
+    uint32_t closed;
+    uint32_t evicted;         // Idle sessions closed to make room for a newcomer
+    uint32_t refused;         // Newcomers closed because every other session was busy
+    uint32_t reaped;          // Sessions closed for being idle too long
+    uint32_t low_heap_refused; // Handshakes turned away for want of heap
+    uint32_t low_heap_evicted; // Idle sessions closed to give heap back
+    uint32_t table_full;      // Sessions not tracked because every slot was used
+    uint32_t tls_errors;      // HTTPS_SERVER_EVENT_ERROR count
+} session_stats_t;
+
+// Registers the event handlers; needs the default event loop.
+esp_err_t session_table_init(void);
+
+// Adds a row for a new session. When that leaves more than max_sessions
+// sessions open, returns the fd to close: the least recently active one
+// that has been idle for at least min_idle_us, or fd itself when there is
+// none. Returns -1 when the session fits.
+int session_table_admit(int fd, const char *cipher, size_t max_sessions, int64_t min_idle_us);
+void session_table_close(int fd);
+// Called as each request starts and again when it completes.
+void session_table_note_request(int fd);
+void session_table_note_done(int fd);
+// Marks sessions inactive since before idle_since_us as closing and writes
+// up to max of their fds to fds. Returns the number written.
+size_t session_table_collect_idle(int64_t idle_since_us, int *fds, size_t max);
+// Counts a handshake refused because the heap is low. Returns the fd of the
+// least recently active session idle for at least min_idle_us, marked as
+// closing, or -1 when there is none.
+int session_table_note_low_heap(int64_t min_idle_us);
+
+// Copies up to max rows and returns the number written.
+size_t session_table_snapshot(session_info_t *out, size_t max);
+void session_table_get_stats(session_stats_t *stats);
+
+#endif // SESSION_TABLE_H
@@ -0,0 +1,87 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Runtime settings: a fixed table of typed values that start out as their
+// Kconfig defaults and are kept in NVS. Reads are served from RAM without a
+// lock, so they are cheap enough for hot paths. Changes are made in
+// batches: a batch is checked as a whole, stored as a single NVS record
+// under a new version number, and only then becomes visible to readers.
+// Subscribers are told which values changed.
+
+typedef enum {
+    SETTING_WIFI_SSID,
+    SETTING_WIFI_PASSWORD,
+    SETTING_WIFI_MAX_RETRY,
+    SETTING_DEVICE_NAME,
+    SETTING_LED_GPIO,
+    SETTING_LED_BLINK_MS,
+    SETTING_COUNT,
+} setting_id_t;
+
+typedef enum {
+    SETTING_TYPE_INT,
+    SETTING_TYPE_STR,
+} setting_type_t;
+
+#define SETTING_BIT(id) (1UL << (id))
+#define SETTINGS_STR_MAX 64                  // Longest string value, without the terminator
+#define SETTINGS_ANY_VERSION UINT32_MAX      // settings_commit() without a version check
+#define SETTINGS_MAX_SUBSCRIBERS 8
+
+typedef struct {
+    const char *key;          // Name in the API and in the stored record
+    setting_type_t type;
+    int32_t min;              // Range of an int, or of a string's length
+    int32_t max;
+    bool secret;              // Can be set but is never reported back
+    bool restart;             // Read once at boot; a change applies after a restart
+} setting_desc_t;
+
+// Changes to commit together; fill with the settings_batch_set_*() calls
+typedef struct {
+    uint32_t set;             // SETTING_BIT() of each value given
+    int32_t ints[SETTING_COUNT];
+    char strs[SETTING_COUNT][SETTINGS_STR_MAX + 1];
+} settings_batch_t;
+
+// Called after a commit with SETTING_BIT() of each value that changed. It
+// runs on the committing task, so keep it short.
+typedef void (*settings_cb_t)(uint32_t changed, void *ctx);
+
+// Loads the stored values over the defaults; needs NVS. Values that are
+// missing, unknown or out of range in the stored record keep their default.
+esp_err_t settings_init(void);
+
+const setting_desc_t *settings_desc(setting_id_t id);
+// The id for key, or -1
+int settings_find(const char *key);
+
+int32_t settings_get_int(setting_id_t id);
+// Copies a string value into buf, truncated to len - 1 characters
+void settings_get_str(setting_id_t id, char *buf, size_t len);
+// Version of the values in effect: 0 until the first commit, then one more
+// for each commit that changed something
+uint32_t settings_version(void);
+
+void settings_batch_init(settings_batch_t *batch);
+// Return ESP_ERR_INVALID_ARG for the wrong type or a value out of range
+esp_err_t settings_batch_set_int(settings_batch_t *batch, setting_id_t id, int32_t value);
+esp_err_t settings_batch_set_str(settings_batch_t *batch, setting_id_t id, const char *value);
+
+// Stores and applies a batch. Values equal to the current ones are not
+// changes; a batch without any writes nothing and keeps the version.
+// Returns ESP_ERR_INVALID_VERSION, changing nothing, when expected_version
+// is not SETTINGS_ANY_VERSION and another commit got there first. version,
+// if given, receives the version in effect on return.
+esp_err_t settings_commit(const settings_batch_t *batch, uint32_t expected_version, uint32_t *version);
+
+// Returns ESP_ERR_NO_MEM when all SETTINGS_MAX_SUBSCRIBERS slots are taken.
+esp_err_t settings_subscribe(settings_cb_t cb, void *ctx);
+esp_err_t settings_unsubscribe(settings_cb_t cb, void *ctx);
+
+#endif // SETTINGS_H
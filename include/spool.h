@@ -0,0 +1,50 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Flash-backed FIFO of opaque items, for data that has to wait for a
+// network link. Items are appended to numbered segment files in a
+// directory on a mounted filesystem; a segment is deleted once every item
+// in it has been popped, and the oldest segment is dropped when the spool
+// is full. The read position is kept in RAM only, so after a reset the
+// items of a partly drained segment are returned again: delivery is
+// at-least-once. Not thread-safe; one task owns a spool.
+
+#define SPOOL_MAX_ITEM_SIZE 4096
+
+typedef struct {
+    uint32_t items;
+    uint32_t bytes;
+    uint32_t segments;
+    uint32_t pushed;        // Since open
+    uint32_t popped;
+    uint32_t dropped;       // Lost when the oldest segment was dropped
+    uint32_t write_errors;
+    uint32_t read_errors;   // Damaged items skipped
+} spool_stats_t;
+
+typedef struct spool spool_t;
+
+// Opens or creates the spool in dir (created if missing) and counts the
+// items left from before a reset.
+esp_err_t spool_open(const char *dir, uint32_t segment_size, uint32_t max_segments, spool_t **out);
+
+// Appends one item and syncs it to flash.
+esp_err_t spool_push(spool_t *spool, const void *data, size_t len);
+
+// Copies the oldest item into buf without removing it. Returns
+// ESP_ERR_NOT_FOUND when empty, ESP_ERR_INVALID_SIZE with *len set when the
+// item does not fit in size bytes.
+esp_err_t spool_peek(spool_t *spool, void *buf, size_t size, size_t *len);
+
+// Removes the item last returned by spool_peek(), including one that did
+// not fit.
+void spool_pop(spool_t *spool);
+
+void spool_get_stats(const spool_t *spool, spool_stats_t *stats);
+
+#endif // SPOOL_H
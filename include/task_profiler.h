@@ -0,0 +1,59 @@
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Task profiler. Every CONFIG_TASK_PROFILER_INTERVAL_MS a sampler reads the
+// FreeRTOS run-time counter and stack high-water mark of every task, and
+// keeps the last CONFIG_TASK_PROFILER_WINDOW samples so CPU% is available
+// over the latest interval and over the whole window.
+//
+// FreeRTOS does not report stack sizes, so tasks are matched by name to the
+// sizes declared with task_profiler_declare_stack(); the IDF system tasks
+// are declared from their Kconfig options. For a declared task the profiler
+// recommends a size from the deepest use seen plus
+// CONFIG_TASK_PROFILER_STACK_MARGIN_PCT.
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t number;              // FreeRTOS task number, unique per task
+    uint8_t priority;
+    uint8_t state;                // eTaskState
+    float cpu_pct;                // Over the latest interval, -1 if new
+    float cpu_pct_window;         // Over the window, or since first seen
+    uint32_t stack_size;          // Declared size in bytes, 0 if unknown
+    uint32_t stack_free;          // High-water mark at the latest sample
+    uint32_t stack_free_min;      // Lowest high-water mark seen
+    uint32_t stack_recommended;   // 0 if the size is unknown
+} task_profile_t;
+
+typedef struct {
+    uint32_t samples;             // Taken since boot
+    uint32_t interval_ms;         // Span of cpu_pct
+    uint32_t window_ms;           // Span of cpu_pct_window for long-lived tasks
+    uint32_t tasks;               // Profiled at the latest sample
+    uint32_t overflow;            // Tasks not profiled for lack of slots
+    uint32_t stack_declared;      // Sum of the known stack sizes
+    uint32_t stack_reclaimable;   // Sum of size - recommended where positive
+} task_profiler_info_t;
+
+esp_err_t task_profiler_init(void);
+
+// Records the stack size tasks named name are created with. May be called
+// before task_profiler_init(); a later call for the same name replaces it.
+void task_profiler_declare_stack(const char *name, uint32_t stack_size);
+
+// Copies up to max profiles, busiest first over the window, and returns the
+// number copied. info may be NULL.
+size_t task_profiler_get(task_profile_t *out, size_t max, task_profiler_info_t *info);
+
+// Writes the recommended-stack-size report to the log.
+void task_profiler_log_report(void);
+
+const char *task_profiler_state_name(uint8_t state);
+
+#endif // TASK_PROFILER_H
@@ -0,0 +1,60 @@
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Compressed time-series store on the raw "tsdb" partition. Each series
+// fills one open chunk in RAM using Gorilla encoding (delta-of-delta
+// timestamps, XOR'd float values); full chunks are written to flash as a
+// ring of TSDB_CHUNK_SIZE slots, erasing a sector ahead of the write head.
+// A RAM index of each slot's series and time range lets queries read only
+// the chunks that can match.
+
+#define TSDB_CHUNK_SIZE 1024
+#define TSDB_PARTITION "tsdb"
+
+// Return false to stop the query early.
+typedef bool (*tsdb_visit_cb_t)(uint8_t series, int64_t ts_ms, float value, void *ctx);
+
+typedef struct {
+    uint32_t samples;          // Appended since boot
+    uint32_t sealed_chunks;    // Written to flash since boot
+    uint32_t sealed_samples;
+    uint32_t sealed_bits;      // Encoded payload bits in those chunks
+    uint32_t erased_sectors;
+    uint32_t dropped_chunks;   // Overwritten by the ring
+    uint32_t write_errors;
+    uint32_t bad_chunks;       // Failed the CRC during the boot scan
+    uint32_t chunks_read;      // Read from flash by queries
+    uint32_t chunks_skipped;   // Right series, ruled out by the index
+    uint32_t live_chunks;      // Indexed chunks on flash
+    uint32_t total_chunks;     // Slots in the partition
+} tsdb_stats_t;
+
+// Scans the partition to rebuild the index and find the write head.
+esp_err_t tsdb_init(void);
+
+// Adds a sample to series (below CONFIG_TSDB_MAX_SERIES). Timestamps are
+// milliseconds, must not be negative and must not go backwards within a
+// series. May block for a chunk write and sector erase.
+esp_err_t tsdb_append(uint8_t series, int64_t ts_ms, float value);
+
+// Seals every open chunk to flash, e.g. before a planned restart. Samples
+// still open are lost on reset, and sealing early costs the unused space
+// in each chunk.
+esp_err_t tsdb_flush(void);
+
+// Calls cb for each sample of series with from_ms <= ts <= to_ms, oldest
+// first, including samples not yet sealed. Samples appended while the
+// query runs may be missed.
+esp_err_t tsdb_query(uint8_t series, int64_t from_ms, int64_t to_ms, tsdb_visit_cb_t cb, void *ctx);
+
+void tsdb_get_stats(tsdb_stats_t *stats);
+
+// Newest timestamp in any series, sealed chunks from earlier boots
+// included; 0 when the store is empty.
+int64_t tsdb_last_ts(void);
+
+#endif // TSDB_H
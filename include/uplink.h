@@ -0,0 +1,60 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// MQTT uplink. Readings from the ingest pipeline are packed into batches
+// that are sealed when they reach CONFIG_UPLINK_BATCH_MAX_BYTES or are
+// CONFIG_UPLINK_BATCH_MAX_MS old, and published with QoS 1 over one
+// persistent connection to <prefix>/<client id>/sensors. A status message
+// goes to .../status on every connect and every
+// CONFIG_UPLINK_STATUS_INTERVAL_S. While the broker is unreachable, or
+// while older data is still queued, sealed batches go to a spool on the
+// storage partition, which is drained at up to CONFIG_UPLINK_DRAIN_PER_S
+// batches a second once the connection is back. A batch in flight when the
+// connection drops is spooled again, so it may arrive twice.
+//
+// Batch payload (little-endian): a header of u8 version (UPLINK_BATCH_VERSION),
+// u8 reserved, u16 count, u32 batch sequence, i64 base_ts_ms, then count
+// records of { u32 sensor_id, u32 ts offset from base_ts_ms, f32 value,
+// u16 seq, u8 kind, u8 source }.
+
+#define UPLINK_BATCH_VERSION 1
+#define UPLINK_BATCH_HDR_SIZE 16
+#define UPLINK_RECORD_SIZE 16
+
+typedef struct {
+    bool connected;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t records;          // Readings accepted into batches
+    uint32_t records_dropped;  // Readings refused because batches were backed up
+    uint32_t batches;          // Sealed
+    uint32_t published;        // Publish calls, live and from the spool
+    uint32_t acked;
+    uint32_t publish_errors;
+    uint32_t inflight;
+    uint32_t open_records;     // In the batch being filled
+    uint32_t ready;            // Sealed, waiting for the uplink task
+    uint32_t spooled;          // Batches written to the spool
+    uint32_t spool_items;      // Waiting in the spool
+    uint32_t spool_bytes;
+    uint32_t spool_dropped;    // Lost when the spool was full
+    uint32_t spool_errors;     // Write and read errors
+    uint32_t latency_ms_last;  // Oldest reading of a batch to its PUBACK
+    uint32_t latency_ms_avg;
+    uint32_t latency_ms_max;
+} uplink_stats_t;
+
+// Starts the uplink with CONFIG_UPLINK_BROKER_URI; does nothing when it is
+// empty. Needs the storage partition mounted and the ingest pipeline up.
+esp_err_t uplink_init(void);
+
+// Starts the uplink against the given broker (mqtt:// or mqtts://).
+esp_err_t uplink_start(const char *broker_uri);
+
+void uplink_get_stats(uplink_stats_t *stats);
+
+#endif // UPLINK_H
@@ -0,0 +1,24 @@
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+// Last good link parameters, persisted in NVS so the next connect can skip
+// the channel scan (and optionally DHCP).
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t dns;
+} wifi_cache_t;
+
+// Loads the cached entry for this SSID. Returns ESP_ERR_NOT_FOUND if there is
+// none, or if it was recorded for a different SSID or layout.
+esp_err_t wifi_cache_load(const char *ssid, wifi_cache_t *entry);
+
+// Persists the entry for this SSID. Skips the flash write when nothing changed.
+esp_err_t wifi_cache_store(const char *ssid, const wifi_cache_t *entry);
+
+#endif // WIFI_CACHE_H
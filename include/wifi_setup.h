@@ -13,8 +13,44 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
-// Wi-Fi Initialization
+typedef struct {
+    int64_t time_to_ip_ms;      // Last connect: link loss or start to IP, -1 before the first IP
+    int64_t boot_time_to_ip_ms; // Time since boot at the first IP, -1 before it
+    bool fast_connect;          // Last connect used the cached BSSID and channel
+    uint32_t scan_fallbacks;    // Directed connects that fell back to a full scan
+    uint32_t failed_attempts;   // Consecutive failed attempts, 0 once connected
+    uint32_t next_retry_ms;     // Delay of the pending backoff, 0 if none
+} wifi_connect_stats_t;
+
+// Connection state as seen by the reconnect scheduler
+typedef enum {
+    WIFI_STATE_IDLE,       // Driver not started yet
+    WIFI_STATE_CONNECTING, // Association in progress
+    WIFI_STATE_CONNECTED,  // Associated, waiting for an address
+    WIFI_STATE_GOT_IP,     // Link up with an address
+    WIFI_STATE_BACKOFF,    // Waiting before the next attempt
+} wifi_state_t;
+
+// Called from the event loop task on every state change; keep it short.
+typedef void (*wifi_state_cb_t)(wifi_state_t state, void *ctx);
+
+#define WIFI_MAX_STATE_SUBSCRIBERS 8
+
+// Wi-Fi Initialization. Returns once the driver is started; the connection
+// is brought up and kept up in the background.
 void wifi_init_sta(void);
 
+// Current connection state
+wifi_state_t wifi_get_state(void);
+const char *wifi_state_to_str(wifi_state_t state);
+
+// Registers cb for state changes and calls it once with the current state.
+// Returns ESP_ERR_NO_MEM when all WIFI_MAX_STATE_SUBSCRIBERS slots are taken.
+esp_err_t wifi_subscribe_state(wifi_state_cb_t cb, void *ctx);
+esp_err_t wifi_unsubscribe_state(wifi_state_cb_t cb, void *ctx);
+
+// Connection timing for diagnostics and the status API
+void wifi_get_connect_stats(wifi_connect_stats_t *stats);
+
 #endif // WIFI_SETUP_H
 
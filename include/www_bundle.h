@@ -0,0 +1,87 @@
+#ifndef WWW_BUNDLE_H
+#define WWW_BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Web UI assets in the "www" partition, packed by tools/mkwww.py. The
+// partition holds two bundle slots; the valid one with the higher sequence
+// number is served straight out of memory-mapped flash. Updates are written
+// to the other slot and only take over once their CRC checks out, so a
+// failed or interrupted upload leaves the current UI in place.
+
+#define WWW_BUNDLE_PARTITION "www"
+#define WWW_BUNDLE_MAGIC 0x42575757 // "WWWB"
+#define WWW_BUNDLE_VERSION 1
+#define WWW_BUNDLE_PATH_LEN 48
+
+// Image header; crc covers the fields before it and everything after the
+// header. seq is assigned by the device when the image is accepted.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;    // Index entries
+    uint32_t size;     // Whole image, header included
+    uint32_t crc;
+    uint32_t seq;
+} www_bundle_hdr_t;
+
+// Index entry; entries are sorted by path
+typedef struct __attribute__((packed)) {
+    char path[WWW_BUNDLE_PATH_LEN]; // "/css/styles.css", NUL-padded
+    uint32_t offset;                // From the start of the image
+    uint32_t size;
+} www_bundle_entry_t;
+
+typedef struct {
+    const uint8_t *data;  // Mapped flash; valid until www_bundle_close()
+    uint32_t size;
+    const char *type;     // Content type from the extension
+    uint32_t etag;        // CRC of the bundle it came from
+    int slot;
+} www_asset_t;
+
+typedef struct {
+    int slot;                 // -1 when no valid bundle is installed
+    uint32_t seq;
+    uint32_t files;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t slot_size;
+    uint32_t served;
+    uint32_t updates;
+    uint32_t update_failures;
+    uint32_t last_update_ms;
+    uint32_t last_update_kbps;
+} www_bundle_info_t;
+
+// Maps the partition and selects the newest valid slot. A missing bundle
+// is not an error; assets just report ESP_ERR_INVALID_STATE until one is
+// uploaded.
+esp_err_t www_bundle_init(void);
+
+// Looks up path (len bytes, need not be NUL-terminated). Returns
+// ESP_ERR_NOT_FOUND for unknown paths. A successful open must be paired
+// with www_bundle_close() once the data has been sent.
+esp_err_t www_bundle_open(const char *path, size_t len, www_asset_t *asset);
+void www_bundle_close(www_asset_t *asset);
+
+void www_bundle_get_info(www_bundle_info_t *info);
+
+// Streaming update into the inactive slot, in the style of esp_ota_*.
+// Only one update runs at a time (ESP_ERR_INVALID_STATE otherwise).
+// begin may wait up to two seconds for responses still reading the slot,
+// and write erases sectors as the data reaches them, so neither belongs on
+// the server task.
+// www_bundle_update_end() checks the image and switches to it. The image
+// must carry an ECDSA signature over its SHA-256 made with the firmware
+// update key (see ota_update.h), as it is served from the device's origin.
+// end returns ESP_ERR_INVALID_CRC for a signature that does not match and
+// ESP_ERR_INVALID_ARG for an image that is not a bundle.
+esp_err_t www_bundle_update_begin(size_t image_size);
+esp_err_t www_bundle_update_write(const void *data, size_t len);
+esp_err_t www_bundle_update_end(const uint8_t *sig, size_t sig_len);
+void www_bundle_update_abort(void);
+
+#endif // WWW_BUNDLE_H
@@ -0,0 +1,477 @@
+#include "binlog.h"
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "BINLOG";
+
+#define RING_RECORDS (1u << CONFIG_BINLOG_RECORDS_LOG2)
+#define RING_MASK (RING_RECORDS - 1)
+
+#define FLAG_TRUNCATED 0x01  // Arguments past the end of args were dropped
+#define FLAG_RAW 0x02        // Format not understood; printed verbatim
+
+enum {
+    SITE_NEW,
+    SITE_PARSED,
+    SITE_RAW,
+};
+
+enum {
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_PTR,
+    ARG_DOUBLE,
+    ARG_STR,
+    ARG_NONE,   // "%%"
+    ARG_BAD,
+};
+
+// seq is written last with the record's position + 1, and cleared while the
+// record is being filled, so a reader can tell a finished record from one
+// in progress or already reused.
+typedef struct {
+    _Atomic uint32_t seq;
+    uint8_t level;
+    uint8_t flags;
+    uint8_t len;         // Bytes used in args
+    uint8_t reserved;
+    int64_t ts_us;
+    const char *tag;
+    const char *fmt;
+    uint8_t args[BINLOG_RECORD_SIZE - 16 - 2 * sizeof(const char *)];
+} record_t;
+
+_Static_assert(sizeof(record_t) == BINLOG_RECORD_SIZE, "record layout");
+
+typedef struct {
+    const char *start;   // The '%'
+    const char *end;     // Past the conversion character
+    uint8_t stars;       // '*' width and precision arguments
+    uint8_t kind;
+} spec_t;
+
+static record_t s_ring[RING_RECORDS];
+static _Atomic uint32_t s_head;
+static _Atomic uint32_t s_truncated;
+static _Atomic uint32_t s_console_lost;
+
+// Finds the next conversion at or after p; false at the end of the format.
+static bool next_spec(const char *p, spec_t *spec) {
+    p = strchr(p, '%');
+    if (p == NULL) {
+        return false;
+    }
+    spec->start = p++;
+    spec->stars = 0;
+    if (*p == '%') {
+        spec->end = p + 1;
+        spec->kind = ARG_NONE;
+        return true;
+    }
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    }
+    while (isdigit((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            p++;
+        }
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+    }
+    char len = 0;
+    if (*p == 'h') {
+        len = *p++;
+        if (*p == 'h') {
+            p++;
+        }
+    } else if (*p == 'l') {
+        len = *p++;
+        if (*p == 'l') {
+            len = 'L';
+            p++;
+        }
+    } else if (*p == 'z' || *p == 'j' || *p == 't') {
+        len = *p++;
+    }
+    spec->end = *p ? p + 1 : p;
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        spec->kind = len == 'l' ? ARG_LONG : len == 'L' ? ARG_LLONG : len == 'z' ? ARG_SIZE :
+                     len == 'j' ? ARG_INTMAX : len == 't' ? ARG_PTRDIFF : ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->kind = (len == 0 || len == 'l') ? ARG_DOUBLE : ARG_BAD;
+        break;
+    case 'p':
+        spec->kind = len == 0 ? ARG_PTR : ARG_BAD;
+        break;
+    case 's':
+        spec->kind = len == 0 ? ARG_STR : ARG_BAD;
+        break;
+    default:
+        spec->kind = ARG_BAD;
+        break;
+    }
+    return true;
+}
+
+static void parse_site(binlog_site_t *site, const char *fmt) {
+    uint8_t nargs = 0;
+    uint8_t state = SITE_PARSED;
+    spec_t spec;
+    for (const char *p = fmt; state == SITE_PARSED && next_spec(p, &spec); p = spec.end) {
+        if (spec.kind == ARG_NONE) {
+            continue;
+        }
+        if (spec.kind == ARG_BAD || nargs + spec.stars + 1 > BINLOG_MAX_ARGS) {
+            state = SITE_RAW;
+            break;
+        }
+        for (int i = 0; i < spec.stars; i++) {
+            site->kinds[nargs++] = ARG_INT;
+        }
+        site->kinds[nargs++] = spec.kind;
+    }
+    site->nargs = state == SITE_PARSED ? nargs : 0;
+    // Racing first calls store the same result
+    __atomic_store_n(&site->state, state, __ATOMIC_RELEASE);
+}
+
+#define PUT(value) do {                                 \
+        if (room < sizeof(value)) {                     \
+            goto truncated;                             \
+        }                                               \
+        memcpy(out, &(value), sizeof(value));           \
+        out += sizeof(value);                           \
+        room -= sizeof(value);                          \
+    } while (0)
+
+void binlog_write(binlog_site_t *site, uint8_t level, const char *tag, const char *fmt, ...) {
+    if (__atomic_load_n(&site->state, __ATOMIC_ACQUIRE) == SITE_NEW) {
+        parse_site(site, fmt);
+    }
+    uint32_t pos = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    record_t *r = &s_ring[pos & RING_MASK];
+    atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    r->ts_us = esp_timer_get_time();
+    r->level = level;
+    r->flags = site->state == SITE_RAW ? FLAG_RAW : 0;
+    r->tag = tag;
+    r->fmt = fmt;
+
+    uint8_t *out = r->args;
+    size_t room = sizeof(r->args);
+    va_list ap;
+    va_start(ap, fmt);
+    for (int i = 0; i < site->nargs; i++) {
+        switch (site->kinds[i]) {
+        case ARG_INT: {
+            int v = va_arg(ap, int);
+            PUT(v);
+            break;
+        }
+        case ARG_LONG: {
+            long v = va_arg(ap, long);
+            PUT(v);
+            break;
+        }
+        case ARG_LLONG: {
+            long long v = va_arg(ap, long long);
+            PUT(v);
+            break;
+        }
+        case ARG_SIZE: {
+            size_t v = va_arg(ap, size_t);
+            PUT(v);
+            break;
+        }
+        case ARG_INTMAX: {
+            intmax_t v = va_arg(ap, intmax_t);
+            PUT(v);
+            break;
+        }
+        case ARG_PTRDIFF: {
+            ptrdiff_t v = va_arg(ap, ptrdiff_t);
+            PUT(v);
+            break;
+        }
+        case ARG_PTR: {
+            void *v = va_arg(ap, void *);
+            PUT(v);
+            break;
+        }
+        case ARG_DOUBLE: {
+            double v = va_arg(ap, double);
+            PUT(v);
+            break;
+        }
+        case ARG_STR: {
+            const char *s = va_arg(ap, const char *);
+            if (s == NULL) {
+                s = "(null)";
+            }
+            if (room < 1) {
+                goto truncated;
+            }
+            size_t n = strnlen(s, room - 1 < BINLOG_MAX_STR ? room - 1 : BINLOG_MAX_STR);
+            *out = (uint8_t)n;
+            memcpy(out + 1, s, n);
+            out += n + 1;
+            room -= n + 1;
+            break;
+        }
+        }
+    }
+    goto done;
+truncated:
+    r->flags |= FLAG_TRUNCATED;
+    atomic_fetch_add_explicit(&s_truncated, 1, memory_order_relaxed);
+done:
+    va_end(ap);
+    r->len = (uint8_t)(out - r->args);
+    atomic_store_explicit(&r->seq, pos + 1, memory_order_release);
+}
+
+static void append(char *msg, size_t size, size_t *pos, const char *s, size_t n) {
+    if (*pos + 1 >= size) {
+        return;
+    }
+    if (n > size - 1 - *pos) {
+        n = size - 1 - *pos;
+    }
+    memcpy(msg + *pos, s, n);
+    *pos += n;
+    msg[*pos] = '\0';
+}
+
+// snprintf into the rest of msg, keeping pos at the terminator
+#define APPENDF(...) do {                                               \
+        if (pos + 1 < size) {                                           \
+            int n_ = snprintf(msg + pos, size - pos, __VA_ARGS__);      \
+            if (n_ > 0) {                                               \
+                pos += (size_t)n_ < size - pos ? (size_t)n_ : size - 1 - pos; \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+#define TAKE(var) do {                                                  \
+        if ((size_t)(end - in) < sizeof(var)) {                         \
+            goto missing;                                               \
+        }                                                               \
+        memcpy(&(var), in, sizeof(var));                                \
+        in += sizeof(var);                                              \
+    } while (0)
+
+static void format_record(const record_t *r, char *msg, size_t size) {
+    size_t pos = 0;
+    msg[0] = '\0';
+    if (r->flags & FLAG_RAW) {
+        append(msg, size, &pos, r->fmt, strlen(r->fmt));
+        return;
+    }
+    const uint8_t *in = r->args;
+    const uint8_t *end = r->args + r->len;
+    const char *p = r->fmt;
+    spec_t spec;
+    while (next_spec(p, &spec)) {
+        append(msg, size, &pos, p, spec.start - p);
+        p = spec.end;
+        if (spec.kind == ARG_NONE) {
+            append(msg, size, &pos, "%", 1);
+            continue;
+        }
+        // Rebuild the conversion with '*' replaced by the stored values
+        char f[32];
+        size_t flen = 0;
+        for (const char *c = spec.start; c < spec.end && flen < sizeof(f) - 12; c++) {
+            if (*c != '*') {
+                f[flen++] = *c;
+                continue;
+            }
+            int v;
+            TAKE(v);
+            if (v < 0 && flen > 0 && f[flen - 1] == '.') {
+                flen--;   // Negative precision means none
+            } else {
+                flen += snprintf(f + flen, sizeof(f) - flen, "%d", v);
+            }
+        }
+        f[flen] = '\0';
+        switch (spec.kind) {
+        case ARG_INT: {
+            int v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_LONG: {
+            long v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_LLONG: {
+            long long v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_SIZE: {
+            size_t v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_INTMAX: {
+            intmax_t v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_PTRDIFF: {
+            ptrdiff_t v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_PTR: {
+            void *v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_DOUBLE: {
+            double v;
+            TAKE(v);
+            APPENDF(f, v);
+            break;
+        }
+        case ARG_STR: {
+            char s[BINLOG_MAX_STR + 1];
+            if (in >= end || (size_t)(end - in) < 1u + in[0]) {
+                goto missing;
+            }
+            memcpy(s, in + 1, in[0]);
+            s[in[0]] = '\0';
+            in += 1 + in[0];
+            APPENDF(f, s);
+            break;
+        }
+        }
+    }
+    append(msg, size, &pos, p, strlen(p));
+    if (!(r->flags & FLAG_TRUNCATED)) {
+        return;
+    }
+missing:
+    append(msg, size, &pos, " [truncated]", 12);
+}
+
+uint32_t binlog_head(void) {
+    return atomic_load_explicit(&s_head, memory_order_acquire);
+}
+
+uint32_t binlog_oldest(void) {
+    uint32_t head = binlog_head();
+    return head > RING_RECORDS ? head - RING_RECORDS : 0;
+}
+
+bool binlog_read(uint32_t *cursor, binlog_entry_t *entry, char *msg, size_t size) {
+    uint32_t skipped = 0;
+    uint32_t head = binlog_head();
+    while (*cursor != head) {
+        if (head - *cursor > RING_RECORDS) {
+            skipped += head - *cursor - RING_RECORDS;
+            *cursor = head - RING_RECORDS;
+        }
+        const record_t *r = &s_ring[*cursor & RING_MASK];
+        uint32_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+        if (seq != *cursor + 1) {
+            if (seq == 0 || (int32_t)(seq - (*cursor + 1)) < 0) {
+                break;   // Still being written
+            }
+            skipped++;   // Reused since the head was read
+            (*cursor)++;
+            continue;
+        }
+        record_t copy;
+        memcpy((uint8_t *)&copy + sizeof(copy.seq), (const uint8_t *)r + sizeof(r->seq),
+               sizeof(copy) - sizeof(copy.seq));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&r->seq, memory_order_relaxed) != seq) {
+            skipped++;
+            (*cursor)++;
+            continue;
+        }
+        entry->seq = *cursor;
+        entry->ts_us = copy.ts_us;
+        entry->level = copy.level;
+        entry->tag = copy.tag;
+        entry->skipped = skipped;
+        (*cursor)++;
+        format_record(&copy, msg, size);
+        return true;
+    }
+    return false;
+}
+
+void binlog_get_stats(binlog_stats_t *stats) {
+    stats->written = binlog_head();
+    stats->capacity = RING_RECORDS;
+    stats->truncated = atomic_load_explicit(&s_truncated, memory_order_relaxed);
+    stats->console_lost = atomic_load_explicit(&s_console_lost, memory_order_relaxed);
+}
+
+#if CONFIG_BINLOG_CONSOLE
+// Prints new records at low priority, so callers never wait on the UART
+static void console_task(void *arg) {
+    static char msg[160];
+    uint32_t cursor = binlog_oldest();
+    while (1) {
+        binlog_entry_t e;
+        while (binlog_read(&cursor, &e, msg, sizeof(msg))) {
+            if (e.skipped) {
+                atomic_fetch_add_explicit(&s_console_lost, e.skipped, memory_order_relaxed);
+                ESP_LOGW(TAG, "%" PRIu32 " records overwritten before printing", e.skipped);
+            }
+            ESP_LOG_LEVEL((esp_log_level_t)e.level, e.tag, "%s", msg);
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_BINLOG_DRAIN_MS));
+    }
+}
+#endif
+
+esp_err_t binlog_init(void) {
+#if CONFIG_BINLOG_CONSOLE
+    task_profiler_declare_stack("binlog", 3072);
+    if (xTaskCreate(console_task, "binlog", 3072, NULL, 1, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
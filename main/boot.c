@@ -0,0 +1,154 @@
+#include "boot.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdint.h>
+#include <string.h>
+
+static const char *TAG = "BOOT";
+
+static const boot_phase_t *s_phases;
+static size_t s_phase_count;
+static boot_phase_record_t s_records[BOOT_MAX_PHASES];
+static boot_mark_t s_marks[BOOT_MAX_MARKS];
+static size_t s_mark_count;
+static EventGroupHandle_t s_done;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_mark(const char *name) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    bool seen = false;
+    for (size_t i = 0; i < s_mark_count; i++) {
+        if (strcmp(s_marks[i].name, name) == 0) {
+            seen = true;
+            break;
+        }
+    }
+    if (!seen && s_mark_count < BOOT_MAX_MARKS) {
+        s_marks[s_mark_count].name = name;
+        s_marks[s_mark_count].t_us = now;
+        s_mark_count++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (!seen) {
+        ESP_LOGI(TAG, "Mark %s at %lld ms", name, (long long)(now / 1000));
+    }
+}
+
+static void phase_task(void *arg) {
+    size_t idx = (size_t)(uintptr_t)arg;
+    const boot_phase_t *phase = &s_phases[idx];
+
+    if (phase->deps | phase->after) {
+        xEventGroupWaitBits(s_done, phase->deps | phase->after, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    bool dep_failed = false;
+    taskENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < idx; i++) {
+        if ((phase->deps & BOOT_DEP(i)) && s_records[i].err != ESP_OK) {
+            dep_failed = true;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    int64_t start = -1;
+    int64_t end = -1;
+    if (dep_failed) {
+        ESP_LOGE(TAG, "Skipping %s: a dependency failed", phase->name);
+    } else {
+        start = esp_timer_get_time();
+        err = phase->fn();
+        end = esp_timer_get_time();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Phase %s failed: %s", phase->name, esp_err_to_name(err));
+        }
+    }
+    taskENTER_CRITICAL(&s_lock);
+    s_records[idx].start_us = start;
+    s_records[idx].end_us = end;
+    s_records[idx].err = err;
+    taskEXIT_CRITICAL(&s_lock);
+
+    xEventGroupSetBits(s_done, BOOT_DEP(idx));
+    vTaskDelete(NULL);
+}
+
+esp_err_t boot_run(const boot_phase_t *phases, size_t count) {
+    if (count == 0 || count > BOOT_MAX_PHASES || s_phases != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (phases[i].fn == NULL || ((phases[i].deps | phases[i].after) >> i) != 0) {
+            ESP_LOGE(TAG, "Phase %u (%s) must only depend on earlier phases",
+                     (unsigned)i, phases[i].name ? phases[i].name : "?");
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    s_done = xEventGroupCreate();
+    if (s_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        s_records[i] = (boot_phase_record_t){
+            .name = phases[i].name,
+            .deps = phases[i].deps,
+            .start_us = -1,
+            .end_us = -1,
+            .err = ESP_ERR_INVALID_STATE,
+        };
+    }
+    s_phases = phases;
+    s_phase_count = count;
+
+    int64_t start = esp_timer_get_time();
+    EventBits_t all = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t stack = phases[i].stack_size ? phases[i].stack_size : BOOT_PHASE_STACK_SIZE;
+        if (xTaskCreate(phase_task, phases[i].name, stack, (void *)(uintptr_t)i, 5, NULL) != pdPASS) {
+            // Mark it finished so dependents skip instead of waiting forever
+            ESP_LOGE(TAG, "Failed to create task for %s", phases[i].name);
+            taskENTER_CRITICAL(&s_lock);
+            s_records[i].err = ESP_ERR_NO_MEM;
+            taskEXIT_CRITICAL(&s_lock);
+            xEventGroupSetBits(s_done, BOOT_DEP(i));
+        }
+        all |= BOOT_DEP(i);
+    }
+    xEventGroupWaitBits(s_done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    esp_err_t first_err = ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        const boot_phase_record_t *r = &s_records[i];
+        if (r->start_us >= 0) {
+            ESP_LOGI(TAG, "%-10s %6lld .. %6lld ms (%lld ms)", r->name,
+                     (long long)(r->start_us / 1000), (long long)(r->end_us / 1000),
+                     (long long)((r->end_us - r->start_us) / 1000));
+        }
+        if (first_err == ESP_OK && r->err != ESP_OK) {
+            first_err = r->err;
+        }
+    }
+    ESP_LOGI(TAG, "Init finished in %lld ms", (long long)((esp_timer_get_time() - start) / 1000));
+    boot_mark("init_done");
+    return first_err;
+}
+
+size_t boot_get_phases(boot_phase_record_t *out, size_t max) {
+    taskENTER_CRITICAL(&s_lock);
+    size_t n = s_phase_count < max ? s_phase_count : max;
+    memcpy(out, s_records, n * sizeof(*out));
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+size_t boot_get_marks(boot_mark_t *out, size_t max) {
+    taskENTER_CRITICAL(&s_lock);
+    size_t n = s_mark_count < max ? s_mark_count : max;
+    memcpy(out, s_marks, n * sizeof(*out));
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
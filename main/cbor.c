@@ -0,0 +1,256 @@
+#include "cbor.h"
+#include <math.h>
+#include <string.h>
+
+enum {
+    MAJOR_UINT = 0,
+    MAJOR_NEGINT = 1,
+    MAJOR_BYTES = 2,
+    MAJOR_TEXT = 3,
+    MAJOR_ARRAY = 4,
+    MAJOR_MAP = 5,
+    MAJOR_TAG = 6,
+    MAJOR_SIMPLE = 7,
+};
+
+#define AI_1BYTE 24
+#define AI_2BYTE 25
+#define AI_4BYTE 26
+#define AI_8BYTE 27
+#define AI_INDEFINITE 31
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size, cbor_flush_fn flush, void *ctx) {
+    *w = (cbor_writer_t){.buf = buf, .size = size, .flush = flush, .ctx = ctx, .err = ESP_OK};
+}
+
+static void emit(cbor_writer_t *w, const void *data, size_t len) {
+    const uint8_t *p = data;
+    w->total += len;
+    while (len > 0 && w->err == ESP_OK) {
+        if (w->len == w->size) {
+            if (w->flush == NULL) {
+                w->err = ESP_ERR_NO_MEM;
+                return;
+            }
+            w->err = w->flush(w->ctx, w->buf, w->len);
+            w->len = 0;
+            continue;
+        }
+        size_t n = len < w->size - w->len ? len : w->size - w->len;
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+// The initial byte and its big-endian argument in the shortest form
+static void put_head(cbor_writer_t *w, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t n;
+    if (value < AI_1BYTE) {
+        head[0] = (uint8_t)(major << 5 | value);
+        n = 1;
+    } else {
+        int ai = value <= 0xff ? AI_1BYTE : value <= 0xffff ? AI_2BYTE : value <= 0xffffffffu ? AI_4BYTE : AI_8BYTE;
+        int bytes = 1 << (ai - AI_1BYTE);
+        head[0] = (uint8_t)(major << 5 | ai);
+        for (int i = 0; i < bytes; i++) {
+            head[bytes - i] = (uint8_t)(value >> (8 * i));
+        }
+        n = 1 + bytes;
+    }
+    emit(w, head, n);
+}
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t value) {
+    put_head(w, MAJOR_UINT, value);
+}
+
+void cbor_put_int(cbor_writer_t *w, int64_t value) {
+    if (value >= 0) {
+        put_head(w, MAJOR_UINT, (uint64_t)value);
+    } else {
+        put_head(w, MAJOR_NEGINT, (uint64_t)(-1 - value));
+    }
+}
+
+void cbor_put_number(cbor_writer_t *w, double value) {
+    // 2^64 and -2^63 bound the integers both major types can carry
+    if (value == floor(value) && value >= -9223372036854775808.0 && value < 18446744073709551616.0) {
+        if (value >= 0) {
+            put_head(w, MAJOR_UINT, (uint64_t)value);
+        } else {
+            cbor_put_int(w, (int64_t)value);
+        }
+        return;
+    }
+    uint8_t out[9];
+    float f = (float)value;
+    if (f == value || isnan(value)) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        out[0] = MAJOR_SIMPLE << 5 | AI_4BYTE;
+        for (int i = 0; i < 4; i++) {
+            out[4 - i] = (uint8_t)(bits >> (8 * i));
+        }
+        emit(w, out, 5);
+        return;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    out[0] = MAJOR_SIMPLE << 5 | AI_8BYTE;
+    for (int i = 0; i < 8; i++) {
+        out[8 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    emit(w, out, 9);
+}
+
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len) {
+    put_head(w, MAJOR_TEXT, len);
+    emit(w, text, len);
+}
+
+void cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len) {
+    put_head(w, MAJOR_BYTES, len);
+    emit(w, data, len);
+}
+
+void cbor_put_bool(cbor_writer_t *w, bool value) {
+    uint8_t b = MAJOR_SIMPLE << 5 | (value ? 21 : 20);
+    emit(w, &b, 1);
+}
+
+void cbor_put_null(cbor_writer_t *w) {
+    uint8_t b = MAJOR_SIMPLE << 5 | 22;
+    emit(w, &b, 1);
+}
+
+void cbor_open_array(cbor_writer_t *w, size_t items) {
+    put_head(w, MAJOR_ARRAY, items);
+}
+
+void cbor_open_map(cbor_writer_t *w, size_t pairs) {
+    put_head(w, MAJOR_MAP, pairs);
+}
+
+esp_err_t cbor_writer_finish(cbor_writer_t *w) {
+    if (w->err == ESP_OK && w->flush && w->len > 0) {
+        w->err = w->flush(w->ctx, w->buf, w->len);
+        w->len = 0;
+    }
+    return w->err;
+}
+
+void cbor_reader_init(cbor_reader_t *r, const void *buf, size_t len) {
+    r->pos = buf;
+    r->end = r->pos + len;
+}
+
+bool cbor_at_end(const cbor_reader_t *r) {
+    return r->pos >= r->end;
+}
+
+static double half_to_double(uint16_t half) {
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+    double value;
+    if (exp == 0) {
+        value = ldexp(mant, -24);
+    } else if (exp != 31) {
+        value = ldexp(mant + 1024, exp - 25);
+    } else {
+        value = mant == 0 ? INFINITY : NAN;
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+esp_err_t cbor_next(cbor_reader_t *r, cbor_item_t *item) {
+    if (r->pos >= r->end) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memset(item, 0, sizeof(*item));
+    uint8_t first = *r->pos++;
+    uint8_t major = first >> 5;
+    uint8_t ai = first & 0x1f;
+    uint64_t value = ai;
+    if (ai >= AI_1BYTE && ai <= AI_8BYTE) {
+        size_t bytes = (size_t)1 << (ai - AI_1BYTE);
+        if ((size_t)(r->end - r->pos) < bytes) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        value = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            value = value << 8 | *r->pos++;
+        }
+    } else if (ai == AI_INDEFINITE) {
+        if (major == MAJOR_BYTES || major == MAJOR_TEXT) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (major != MAJOR_ARRAY && major != MAJOR_MAP && major != MAJOR_SIMPLE) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        item->indefinite = true;
+    } else if (ai > AI_8BYTE) {
+        return ESP_ERR_INVALID_SIZE;   // 28-30 are reserved
+    }
+    item->uint = value;
+
+    switch (major) {
+    case MAJOR_UINT:
+        item->type = CBOR_UINT;
+        item->number = (double)value;
+        return ESP_OK;
+    case MAJOR_NEGINT:
+        item->type = CBOR_NEGINT;
+        item->number = -1.0 - (double)value;
+        return ESP_OK;
+    case MAJOR_BYTES:
+    case MAJOR_TEXT:
+        if ((uint64_t)(r->end - r->pos) < value) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        item->type = major == MAJOR_TEXT ? CBOR_TEXT : CBOR_BYTES;
+        item->data = r->pos;
+        r->pos += value;
+        return ESP_OK;
+    case MAJOR_ARRAY:
+        item->type = CBOR_ARRAY;
+        return ESP_OK;
+    case MAJOR_MAP:
+        item->type = CBOR_MAP;
+        return ESP_OK;
+    case MAJOR_TAG:
+        item->type = CBOR_TAG;
+        return ESP_OK;
+    default:
+        break;
+    }
+
+    // Major type 7: simple values, floats and break
+    if (ai == AI_INDEFINITE) {
+        item->type = CBOR_BREAK;
+        item->indefinite = false;
+    } else if (ai == AI_2BYTE) {
+        item->type = CBOR_FLOAT;
+        item->number = half_to_double((uint16_t)value);
+    } else if (ai == AI_4BYTE) {
+        uint32_t bits = (uint32_t)value;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        item->type = CBOR_FLOAT;
+        item->number = f;
+    } else if (ai == AI_8BYTE) {
+        item->type = CBOR_FLOAT;
+        memcpy(&item->number, &value, sizeof(item->number));
+    } else if (ai == AI_1BYTE && value < 32) {
+        return ESP_ERR_INVALID_SIZE;   // Two-byte form of a one-byte value
+    } else {
+        item->type = value == 20   ? CBOR_FALSE
+                     : value == 21 ? CBOR_TRUE
+                     : value == 22 ? CBOR_NULL
+                     : value == 23 ? CBOR_UNDEFINED
+                                   : CBOR_SIMPLE;
+    }
+    return ESP_OK;
+}
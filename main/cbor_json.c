@@ -0,0 +1,195 @@
+#include "cbor.h"
+#include <string.h>
+
+#define BREAK_BYTE 0xff
+
+static size_t count_children(const cJSON *item) {
+    size_t n = 0;
+    for (const cJSON *c = item->child; c; c = c->next) {
+        n++;
+    }
+    return n;
+}
+
+static esp_err_t encode(cbor_writer_t *w, const cJSON *item, int depth) {
+    if (depth > CBOR_MAX_DEPTH) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    switch (item->type & 0xff) {
+    case cJSON_False:
+        cbor_put_bool(w, false);
+        break;
+    case cJSON_True:
+        cbor_put_bool(w, true);
+        break;
+    case cJSON_NULL:
+        cbor_put_null(w);
+        break;
+    case cJSON_Number:
+        cbor_put_number(w, item->valuedouble);
+        break;
+    case cJSON_String:
+        cbor_put_text(w, item->valuestring, strlen(item->valuestring));
+        break;
+    case cJSON_Array:
+        cbor_open_array(w, count_children(item));
+        for (const cJSON *c = item->child; c && w->err == ESP_OK; c = c->next) {
+            esp_err_t err = encode(w, c, depth + 1);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        break;
+    case cJSON_Object:
+        cbor_open_map(w, count_children(item));
+        for (const cJSON *c = item->child; c && w->err == ESP_OK; c = c->next) {
+            cbor_put_text(w, c->string, strlen(c->string));
+            esp_err_t err = encode(w, c, depth + 1);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        break;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;   // cJSON_Raw has no CBOR form
+    }
+    return w->err;
+}
+
+esp_err_t cbor_encode_cjson(cbor_writer_t *w, const cJSON *item) {
+    return encode(w, item, 0);
+}
+
+// A NUL-terminated copy through the cJSON hooks, so cJSON_Delete frees it
+static char *copy_text(const cbor_item_t *item) {
+    if (item->uint >= SIZE_MAX) {
+        return NULL;
+    }
+    char *s = cJSON_malloc((size_t)item->uint + 1);
+    if (s) {
+        memcpy(s, item->data, (size_t)item->uint);
+        s[item->uint] = '\0';
+    }
+    return s;
+}
+
+// Consumes a break byte if one is next
+static bool take_break(cbor_reader_t *r) {
+    if (r->pos < r->end && *r->pos == BREAK_BYTE) {
+        r->pos++;
+        return true;
+    }
+    return false;
+}
+
+static esp_err_t decode(cbor_reader_t *r, int depth, cJSON **out);
+
+// Reads the members of an array or map into container
+static esp_err_t decode_members(cbor_reader_t *r, const cbor_item_t *head, int depth, cJSON *container) {
+    bool is_map = head->type == CBOR_MAP;
+    for (uint64_t i = 0; head->indefinite || i < head->uint; i++) {
+        if (head->indefinite && take_break(r)) {
+            return ESP_OK;
+        }
+        char *key = NULL;
+        if (is_map) {
+            cbor_item_t k;
+            esp_err_t err = cbor_next(r, &k);
+            if (err != ESP_OK) {
+                return err == ESP_ERR_NOT_FOUND ? ESP_ERR_INVALID_SIZE : err;
+            }
+            if (k.type != CBOR_TEXT) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            key = copy_text(&k);
+            if (key == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        cJSON *child = NULL;
+        esp_err_t err = decode(r, depth + 1, &child);
+        if (err != ESP_OK) {
+            cJSON_free(key);
+            return err;
+        }
+        child->string = key;
+        cJSON_AddItemToArray(container, child);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t decode(cbor_reader_t *r, int depth, cJSON **out) {
+    if (depth > CBOR_MAX_DEPTH) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    cbor_item_t item;
+    esp_err_t err;
+    do {
+        err = cbor_next(r, &item);
+    } while (err == ESP_OK && item.type == CBOR_TAG);
+    if (err != ESP_OK) {
+        return err == ESP_ERR_NOT_FOUND ? ESP_ERR_INVALID_SIZE : err;
+    }
+
+    cJSON *node = NULL;
+    switch (item.type) {
+    case CBOR_UINT:
+    case CBOR_NEGINT:
+    case CBOR_FLOAT:
+        node = cJSON_CreateNumber(item.number);
+        break;
+    case CBOR_TEXT: {
+        char *text = copy_text(&item);
+        node = text ? cJSON_CreateString("") : NULL;
+        if (node) {
+            cJSON_free(node->valuestring);
+            node->valuestring = text;
+        } else {
+            cJSON_free(text);
+        }
+        break;
+    }
+    case CBOR_FALSE:
+        node = cJSON_CreateFalse();
+        break;
+    case CBOR_TRUE:
+        node = cJSON_CreateTrue();
+        break;
+    case CBOR_NULL:
+        node = cJSON_CreateNull();
+        break;
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+        node = item.type == CBOR_MAP ? cJSON_CreateObject() : cJSON_CreateArray();
+        if (node) {
+            err = decode_members(r, &item, depth, node);
+            if (err != ESP_OK) {
+                cJSON_Delete(node);
+                return err;
+            }
+        }
+        break;
+    case CBOR_BREAK:
+        return ESP_ERR_INVALID_SIZE;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;   // Byte strings, undefined, other simple values
+    }
+    if (node == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *out = node;
+    return ESP_OK;
+}
+
+esp_err_t cbor_decode_cjson(const void *buf, size_t len, cJSON **out) {
+    cbor_reader_t r;
+    cbor_reader_init(&r, buf, len);
+    cJSON *root = NULL;
+    esp_err_t err = decode(&r, 0, &root);
+    if (err == ESP_OK && !cbor_at_end(&r)) {
+        cJSON_Delete(root);
+        err = ESP_ERR_INVALID_SIZE;   // Trailing bytes after the top-level item
+    }
+    *out = err == ESP_OK ? root : NULL;
+    return err;
+}
@@ -0,0 +1,144 @@
+#include "coap.h"
+#include <string.h>
+
+// Decodes an option delta or length nibble with its extended bytes
+static bool read_ext(uint8_t nibble, const uint8_t **pos, const uint8_t *end, uint32_t *value) {
+    if (nibble < 13) {
+        *value = nibble;
+        return true;
+    }
+    if (nibble == 13) {
+        if (end - *pos < 1) {
+            return false;
+        }
+        *value = 13 + (*pos)[0];
+        *pos += 1;
+        return true;
+    }
+    if (nibble == 14) {
+        if (end - *pos < 2) {
+            return false;
+        }
+        *value = 269 + ((uint32_t)(*pos)[0] << 8 | (*pos)[1]);
+        *pos += 2;
+        return true;
+    }
+    return false;   // 15 is reserved outside the payload marker
+}
+
+// Decodes one option at *pos. Returns false on a format error.
+static bool decode_option(const uint8_t **pos, const uint8_t *end, uint16_t *num, coap_option_t *opt) {
+    const uint8_t *p = *pos;
+    uint8_t first = *p++;
+    uint32_t delta;
+    uint32_t len;
+    if (!read_ext(first >> 4, &p, end, &delta) || !read_ext(first & 0x0f, &p, end, &len) ||
+        (uint32_t)(end - p) < len || *num + delta > UINT16_MAX) {
+        return false;
+    }
+    *num += (uint16_t)delta;
+    opt->num = *num;
+    opt->len = (uint16_t)len;
+    opt->value = p;
+    *pos = p + len;
+    return true;
+}
+
+esp_err_t coap_parse(const uint8_t *buf, size_t len, coap_msg_t *msg) {
+    memset(msg, 0, sizeof(*msg));
+    if (len < COAP_HDR_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    msg->type = (buf[0] >> 4) & 0x03;
+    msg->token_len = buf[0] & 0x0f;
+    msg->code = buf[1];
+    msg->mid = (uint16_t)(buf[2] << 8 | buf[3]);
+    if (buf[0] >> 6 != COAP_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (msg->token_len > COAP_MAX_TOKEN_LEN || len < COAP_HDR_SIZE + (size_t)msg->token_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // An empty message is the header alone
+    if (msg->code == COAP_CODE_EMPTY && len != COAP_HDR_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    msg->token = buf + COAP_HDR_SIZE;
+
+    const uint8_t *p = msg->token + msg->token_len;
+    const uint8_t *end = buf + len;
+    msg->options = p;
+    uint16_t num = 0;
+    coap_option_t opt;
+    while (p < end && *p != COAP_PAYLOAD_MARKER) {
+        if (!decode_option(&p, end, &num, &opt)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    msg->options_len = (size_t)(p - msg->options);
+    if (p < end) {
+        // A marker must be followed by a payload
+        if (end - p == 1) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        msg->payload = p + 1;
+        msg->payload_len = (size_t)(end - p - 1);
+    }
+    return ESP_OK;
+}
+
+void coap_option_iter_init(const coap_msg_t *msg, coap_option_iter_t *it) {
+    it->pos = msg->options;
+    it->end = msg->options + msg->options_len;
+    it->num = 0;
+}
+
+bool coap_option_next(coap_option_iter_t *it, coap_option_t *opt) {
+    if (it->pos >= it->end) {
+        return false;
+    }
+    return decode_option(&it->pos, it->end, &it->num, opt);
+}
+
+uint32_t coap_option_uint(const coap_option_t *opt) {
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < opt->len && i < 4; i++) {
+        value = value << 8 | opt->value[i];
+    }
+    return value;
+}
+
+size_t coap_build(uint8_t *buf, size_t size, coap_type_t type, uint8_t code, uint16_t mid,
+                  const uint8_t *token, uint8_t token_len, int format, const void *payload,
+                  size_t payload_len) {
+    size_t need = COAP_HDR_SIZE + token_len + (format >= 0 ? 3 : 0) + (payload_len ? 1 + payload_len : 0);
+    if (token_len > COAP_MAX_TOKEN_LEN || need > size) {
+        return 0;
+    }
+    size_t pos = 0;
+    buf[pos++] = (uint8_t)(COAP_VERSION << 6 | type << 4 | token_len);
+    buf[pos++] = code;
+    buf[pos++] = (uint8_t)(mid >> 8);
+    buf[pos++] = (uint8_t)mid;
+    memcpy(buf + pos, token, token_len);
+    pos += token_len;
+    if (format >= 0) {
+        // Content-Format is the only option, so its delta is its number
+        if (format == 0) {
+            buf[pos++] = COAP_OPT_CONTENT_FORMAT << 4;
+        } else if (format < 0x100) {
+            buf[pos++] = COAP_OPT_CONTENT_FORMAT << 4 | 1;
+            buf[pos++] = (uint8_t)format;
+        } else {
+            buf[pos++] = COAP_OPT_CONTENT_FORMAT << 4 | 2;
+            buf[pos++] = (uint8_t)(format >> 8);
+            buf[pos++] = (uint8_t)format;
+        }
+    }
+    if (payload_len) {
+        buf[pos++] = COAP_PAYLOAD_MARKER;
+        memcpy(buf + pos, payload, payload_len);
+        pos += payload_len;
+    }
+    return pos;
+}
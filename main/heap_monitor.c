@@ -0,0 +1,270 @@
+#include "heap_monitor.h"
+#include "mem_pool.h"
+#include "req_arena.h"
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <string.h>
+#ifdef CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+#include "esp_mem.h"
+#endif
+
+static const char *TAG = "HEAP_MON";
+
+static const uint32_t class_caps[HEAP_CLASS_COUNT] = {
+    [HEAP_CLASS_INTERNAL] = MALLOC_CAP_INTERNAL,
+    [HEAP_CLASS_DMA] = MALLOC_CAP_DMA,
+};
+
+static const char *const class_names[HEAP_CLASS_COUNT] = {
+    [HEAP_CLASS_INTERNAL] = "internal",
+    [HEAP_CLASS_DMA] = "dma",
+};
+
+static const char *const tag_names[HEAP_TAG_COUNT] = {
+    [HEAP_TAG_TLS] = "tls",
+    [HEAP_TAG_HTTPD] = "httpd",
+    [HEAP_TAG_JSON] = "json",
+    [HEAP_TAG_STORAGE] = "storage",
+    [HEAP_TAG_OTHER] = "other",
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static heap_class_stats_t s_classes[HEAP_CLASS_COUNT];
+static heap_tag_stats_t s_tags[HEAP_TAG_COUNT];
+static heap_failure_stats_t s_failures;
+
+#define JSON_POOL_BLOCK 64   // A cJSON node on 32- and 64-bit targets, or a short string
+
+static mem_pool_t *s_json_pool;
+static mem_pool_t *s_scratch_pool;
+
+// Thresholds currently crossed, so each crossing is logged once
+static bool s_low_free;
+static bool s_low_block;
+static bool s_high_frag;
+
+static void *tagged_alloc(heap_tag_t tag, size_t size, uint32_t caps, bool zero) {
+    void *ptr = zero ? heap_caps_calloc(1, size, caps) : heap_caps_malloc(size, caps);
+    size_t got = ptr ? heap_caps_get_allocated_size(ptr) : 0;
+    taskENTER_CRITICAL(&s_lock);
+    heap_tag_stats_t *t = &s_tags[tag];
+    if (ptr) {
+        t->allocs++;
+        t->current_bytes += got;
+        if (t->current_bytes > t->peak_bytes) {
+            t->peak_bytes = t->current_bytes;
+        }
+    } else if (size > 0) {
+        t->failures++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return ptr;
+}
+
+void *heap_monitor_malloc(heap_tag_t tag, size_t size) {
+    return tagged_alloc(tag, size, MALLOC_CAP_DEFAULT, false);
+}
+
+void *heap_monitor_calloc(heap_tag_t tag, size_t n, size_t size) {
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    return tagged_alloc(tag, n * size, MALLOC_CAP_DEFAULT, true);
+}
+
+void heap_monitor_free(heap_tag_t tag, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    size_t size = heap_caps_get_allocated_size(ptr);
+    heap_caps_free(ptr);
+    taskENTER_CRITICAL(&s_lock);
+    heap_tag_stats_t *t = &s_tags[tag];
+    t->frees++;
+    t->current_bytes = t->current_bytes > size ? t->current_bytes - size : 0;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+#ifdef CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+// Replaces IDF's default mbedTLS allocator; internal RAM, as its default
+// CONFIG_MBEDTLS_INTERNAL_MEM_ALLOC mode uses
+void *esp_mbedtls_mem_calloc(size_t n, size_t size) {
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    return tagged_alloc(HEAP_TAG_TLS, n * size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, true);
+}
+
+void esp_mbedtls_mem_free(void *ptr) {
+    heap_monitor_free(HEAP_TAG_TLS, ptr);
+}
+#endif
+
+// Inside a request the httpd task allocates from its arena. Elsewhere,
+// small allocations come from the pool while it has blocks; its own
+// counters account for them, so only heap fallbacks are tagged.
+static void *json_malloc(size_t size) {
+    if (req_arena_active()) {
+        return req_arena_alloc(size);
+    }
+    if (s_json_pool && size <= JSON_POOL_BLOCK) {
+        void *ptr = mem_pool_alloc(s_json_pool);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    return heap_monitor_malloc(HEAP_TAG_JSON, size);
+}
+
+static void json_free(void *ptr) {
+    if (req_arena_owns(ptr)) {
+        return;   // Released with the rest of the request
+    }
+    if (mem_pool_owns(s_json_pool, ptr)) {
+        mem_pool_free(s_json_pool, ptr);
+    } else {
+        heap_monitor_free(HEAP_TAG_JSON, ptr);
+    }
+}
+
+void *heap_monitor_scratch_alloc(void) {
+    return s_scratch_pool ? mem_pool_alloc(s_scratch_pool) : NULL;
+}
+
+void heap_monitor_scratch_free(void *buf) {
+    if (buf) {
+        mem_pool_free(s_scratch_pool, buf);
+    }
+}
+
+// Runs in the context of the failing allocation, possibly an ISR
+static void alloc_failed_hook(size_t size, uint32_t caps, const char *function_name) {
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_failures.count++;
+    s_failures.last_size = size;
+    s_failures.last_caps = caps;
+    s_failures.last_us = esp_timer_get_time();
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+static void sample_class(heap_class_t cls) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, class_caps[cls]);
+    uint32_t frag = info.total_free_bytes
+                        ? 100 - (uint32_t)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes)
+                        : 0;
+    taskENTER_CRITICAL(&s_lock);
+    heap_class_stats_t *c = &s_classes[cls];
+    c->free_bytes = info.total_free_bytes;
+    c->min_free_bytes = info.minimum_free_bytes;
+    c->largest_block = info.largest_free_block;
+    if (c->min_largest_block == 0 || info.largest_free_block < c->min_largest_block) {
+        c->min_largest_block = info.largest_free_block;
+    }
+    c->frag_pct = frag;
+    if (frag > c->max_frag_pct) {
+        c->max_frag_pct = frag;
+    }
+    c->free_blocks = info.free_blocks;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+// Logs threshold crossings on the internal heap in both directions
+static void check_thresholds(void) {
+    heap_class_stats_t c;
+    heap_monitor_get_class(HEAP_CLASS_INTERNAL, &c);
+    bool low_free = c.free_bytes < CONFIG_HEAP_MONITOR_MIN_FREE;
+    bool low_block = c.largest_block < CONFIG_HEAP_MONITOR_MIN_BLOCK;
+    bool high_frag = c.frag_pct > CONFIG_HEAP_MONITOR_MAX_FRAG_PCT;
+    if (low_free != s_low_free) {
+        ESP_LOG_LEVEL(low_free ? ESP_LOG_WARN : ESP_LOG_INFO, TAG, "Free heap %s: %" PRIu32 " bytes (threshold %d)",
+                      low_free ? "low" : "recovered", c.free_bytes, CONFIG_HEAP_MONITOR_MIN_FREE);
+    }
+    if (low_block != s_low_block) {
+        ESP_LOG_LEVEL(low_block ? ESP_LOG_WARN : ESP_LOG_INFO, TAG,
+                      "Largest free block %s: %" PRIu32 " bytes (threshold %d)",
+                      low_block ? "low" : "recovered", c.largest_block, CONFIG_HEAP_MONITOR_MIN_BLOCK);
+    }
+    if (high_frag != s_high_frag) {
+        ESP_LOG_LEVEL(high_frag ? ESP_LOG_WARN : ESP_LOG_INFO, TAG, "Fragmentation %s: %u%% (threshold %d%%)",
+                      high_frag ? "high" : "recovered", c.frag_pct, CONFIG_HEAP_MONITOR_MAX_FRAG_PCT);
+    }
+    s_low_free = low_free;
+    s_low_block = low_block;
+    s_high_frag = high_frag;
+}
+
+static void heap_monitor_task(void *arg) {
+    uint32_t seen_failures = 0;
+    while (1) {
+        check_thresholds();
+        heap_failure_stats_t f;
+        heap_monitor_get_failures(&f);
+        if (f.count != seen_failures) {
+            ESP_LOGW(TAG, "%" PRIu32 " allocation failure(s), latest %" PRIu32 " bytes with caps 0x%" PRIx32,
+                     f.count - seen_failures, f.last_size, f.last_caps);
+            seen_failures = f.count;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_HEAP_MONITOR_INTERVAL_MS));
+    }
+}
+
+void heap_monitor_get_class(heap_class_t cls, heap_class_stats_t *out) {
+    sample_class(cls);
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_classes[cls];
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void heap_monitor_get_tag(heap_tag_t tag, heap_tag_stats_t *out) {
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_tags[tag];
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void heap_monitor_get_failures(heap_failure_stats_t *out) {
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_failures;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+const char *heap_monitor_class_name(heap_class_t cls) {
+    return cls < HEAP_CLASS_COUNT ? class_names[cls] : "?";
+}
+
+const char *heap_monitor_tag_name(heap_tag_t tag) {
+    return tag < HEAP_TAG_COUNT ? tag_names[tag] : "?";
+}
+
+esp_err_t heap_monitor_init(void) {
+    // Before the hooks go in, so no cJSON allocation predates the pool
+    esp_err_t err = mem_pool_create("scratch", HEAP_SCRATCH_SIZE, CONFIG_HEAP_MONITOR_SCRATCH_BLOCKS, 0,
+                                    &s_scratch_pool);
+    if (err == ESP_OK && CONFIG_HEAP_MONITOR_JSON_POOL_BLOCKS > 0) {
+        err = mem_pool_create("json", JSON_POOL_BLOCK, CONFIG_HEAP_MONITOR_JSON_POOL_BLOCKS, 0, &s_json_pool);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_malloc,
+        .free_fn = json_free,
+    };
+    cJSON_InitHooks(&hooks);
+    ESP_ERROR_CHECK(heap_caps_register_failed_alloc_callback(alloc_failed_hook));
+    for (int i = 0; i < HEAP_CLASS_COUNT; i++) {
+        sample_class(i);
+    }
+    task_profiler_declare_stack("heap_mon", 3072);
+    if (xTaskCreate(heap_monitor_task, "heap_mon", 3072, NULL, 5, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -2,41 +2,60 @@
 
 #include "https_server.h"
 #include "led_control.h"
+#include "wifi_setup.h"
+#include "binlog.h"
+#include "boot.h"
+#include "heap_monitor.h"
+#include "mem_pool.h"
+#include "ota_update.h"
+#include "req_arena.h"
+#include "cbor.h"
+#include "ingest.h"
+#include "link_monitor.h"
+#include "rate_limit.h"
+#include "session_table.h"
+#include "settings.h"
+#include "task_profiler.h"
+#include "uplink.h"
+#include "www_bundle.h"
 #include "esp_tls.h" 
+#ifdef CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+#include "mbedtls/net_sockets.h"
+#endif
 #include "cJSON.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
+#include "esp_heap_caps.h"
 #include "esp_https_server.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_ota_ops.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "lwip/sockets.h"
 #include "nvs_flash.h"
 #include "sys/param.h"
+#include <ctype.h>
 #include <inttypes.h>
+#include <stdlib.h>
 
 static const char *TAG = "HTTPS_SERVER";
 
+// Must cover every entry in the uri_handlers table in start_https_server()
+#define HTTPS_MAX_URI_HANDLERS 24
+#define HTTPS_MAX_OPEN_SOCKETS 6
+// One socket stays free so a newcomer can finish its handshake and then
+// displace an idle session; see session_table_admit()
+#define HTTPS_MAX_SESSIONS (HTTPS_MAX_OPEN_SOCKETS - 1)
+
 static void https_server_user_callback(esp_https_server_user_cb_arg_t *user_cb);
 static void handle_tls_error(esp_https_server_last_error_t *error);
 static const char* get_tls_version_string(esp_tls_proto_ver_t version);
 
-// Embedded HTML, CSS, and JS files
-extern const uint8_t index_html_start[] asm("_binary_index_html_start");
-extern const uint8_t index_html_end[] asm("_binary_index_html_end");
-extern const uint8_t status_html_start[] asm("_binary_status_html_start");
-extern const uint8_t status_html_end[] asm("_binary_status_html_end");
-// Embedded HTML for LED Control
-extern const uint8_t led_control_html_start[] asm("_binary_led_control_html_start");
-extern const uint8_t led_control_html_end[] asm("_binary_led_control_html_end");
-extern const uint8_t clients_html_start[] asm("_binary_clients_html_start");
-extern const uint8_t clients_html_end[] asm("_binary_clients_html_end");
-extern const uint8_t settings_html_start[] asm("_binary_settings_html_start");
-extern const uint8_t settings_html_end[] asm("_binary_settings_html_end");
-extern const uint8_t styles_css_start[] asm("_binary_styles_css_start");
-extern const uint8_t styles_css_end[] asm("_binary_styles_css_end");
-extern const uint8_t app_js_start[] asm("_binary_app_js_start");
-extern const uint8_t app_js_end[] asm("_binary_app_js_end");
+// Set while the server runs, for the session hooks and the idle reaper
+static httpd_handle_t s_server;
+static esp_timer_handle_t s_reaper;
 
 // Embedded certificate and key files
 extern const unsigned char cert_pem_start[] asm("_binary_cert_pem_start");
@@ -44,65 +63,217 @@ extern const unsigned char cert_pem_end[] asm("_binary_cert_pem_end");
 extern const unsigned char key_pem_start[] asm("_binary_key_pem_start");
 extern const unsigned char key_pem_end[] asm("_binary_key_pem_end");
 
-// Helper function to serve embedded files
-static esp_err_t serve_embedded_file(httpd_req_t *req,
-                                     const unsigned char *start,
-                                     const unsigned char *end,
-                                     const char *content_type) {
-  size_t file_len = end - start;
-  httpd_resp_set_type(req, content_type);
-  return httpd_resp_send(req, (const char *)start, file_len);
+// Serves UI assets straight from the mapped bundle partition; "/" is
+// index.html. The whole bundle shares one ETag, so browsers revalidate
+// with a cheap 304 until an update lands.
+static esp_err_t asset_handler(httpd_req_t *req) {
+  const char *path = req->uri;
+  size_t len = strcspn(path, "?#");
+  if (len == 1) {
+    path = "/index.html";
+    len = strlen(path);
+  }
+  www_asset_t asset;
+  esp_err_t err = www_bundle_open(path, len, &asset);
+  if (err == ESP_ERR_INVALID_STATE) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Web UI bundle not installed; POST one to /api/www", HTTPD_RESP_USE_STRLEN);
+  }
+  if (err != ESP_OK) {
+    return httpd_resp_send_404(req);
+  }
+  BINLOG_I(TAG, "Serving %.*s (%" PRIu32 " bytes)", (int)len, path, asset.size);
+  char etag[12];
+  char if_none_match[12];
+  snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", asset.etag);
+  httpd_resp_set_hdr(req, "ETag", etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+      strcmp(if_none_match, etag) == 0) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    err = httpd_resp_send(req, NULL, 0);
+  } else {
+    httpd_resp_set_type(req, asset.type);
+    err = httpd_resp_send(req, (const char *)asset.data, asset.size);
+  }
+  www_bundle_close(&asset);
+  return err;
 }
 static esp_err_t httpd_resp_send_400(httpd_req_t *req) {
     httpd_resp_set_status(req, "400 Bad Request");
     return httpd_resp_send(req, "400 Bad Request", HTTPD_RESP_USE_STRLEN);
 }
-// URI Handlers
-static esp_err_t handle_index(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving index.html");
-  return serve_embedded_file(req, index_html_start, index_html_end,
-                             "text/html");
-}
-static esp_err_t handle_led_control(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Serving led_control.html");
-  return serve_embedded_file(req, led_control_html_start, led_control_html_end,
-                             "text/html");
-}
-static esp_err_t handle_status(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving status.html");
-  return serve_embedded_file(req, status_html_start, status_html_end,
-                             "text/html");
-}
-static esp_err_t handle_clients(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving clients.html");
-  return serve_embedded_file(req, clients_html_start, clients_html_end,
-                             "text/html");
+
+// Content negotiation for the JSON APIs: replies go out as CBOR when the
+// Accept header asks for it, and request bodies are read as CBOR when their
+// Content-Type says so. Either way handlers only deal in cJSON trees.
+#define CBOR_CHUNK_SIZE 1024
+#define REQUEST_BODY_MAX 512
+
+static bool header_has(httpd_req_t *req, const char *field, const char *type) {
+  char value[96];
+  esp_err_t err = httpd_req_get_hdr_value_str(req, field, value, sizeof(value));
+  return (err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && strstr(value, type) != NULL;
 }
-esp_err_t clients_handler(httpd_req_t *req) {
-  const char *response =
-      "{\"count\": 2, \"clients\": [{\"name\": \"Device1\", \"ip\": "
-      "\"192.168.0.101\"}, {\"name\": \"Device2\", \"ip\": "
-      "\"192.168.0.102\"}]}";
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-  return ESP_OK;
+
+static esp_err_t send_chunk(void *ctx, const uint8_t *data, size_t len) {
+  return httpd_resp_send_chunk(ctx, (const char *)data, len);
+}
+
+// A reply that fits one buffer goes out with a Content-Length; larger ones
+// stream through the buffer as chunks
+static esp_err_t send_cbor(httpd_req_t *req, const cJSON *root) {
+  // On the stack: upload tasks reply through here too, alongside the
+  // server task
+  uint8_t buf[CBOR_CHUNK_SIZE];
+  httpd_resp_set_type(req, CBOR_CONTENT_TYPE);
+  cbor_writer_t w;
+  cbor_writer_init(&w, buf, sizeof(buf), send_chunk, req);
+  esp_err_t err = cbor_encode_cjson(&w, root);
+  bool streaming = w.total > w.len;
+  if (err == ESP_OK && !streaming) {
+    return httpd_resp_send(req, (const char *)buf, w.len);
+  }
+  if (err == ESP_OK) {
+    err = cbor_writer_finish(&w);
+  }
+  if (err == ESP_OK) {
+    return httpd_resp_send_chunk(req, NULL, 0);
+  }
+  ESP_LOGE(TAG, "CBOR reply failed: %s", esp_err_to_name(err));
+  return streaming ? ESP_FAIL : httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Encoding failed");
 }
 
-static esp_err_t handle_settings(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving settings.html");
-  return serve_embedded_file(req, settings_html_start, settings_html_end,
-                             "text/html");
+// Sends a handler's reply tree in the representation the client asked for
+static esp_err_t send_tree(httpd_req_t *req, cJSON *root) {
+  httpd_resp_set_hdr(req, "Vary", "Accept");
+  if (root == NULL) {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+  }
+  if (header_has(req, "Accept", CBOR_CONTENT_TYPE)) {
+    esp_err_t err = send_cbor(req, root);
+    cJSON_Delete(root);
+    return err;
+  }
+  char *json = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  if (json == NULL) {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+  }
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+  cJSON_free(json);
+  return err;
 }
 
-static esp_err_t handle_css(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving styles.css");
-  return serve_embedded_file(req, styles_css_start, styles_css_end, "text/css");
+// Reads a JSON or CBOR request body into a tree that lives in the request
+// arena. On failure the error response has been sent and ESP_FAIL returned.
+static esp_err_t recv_tree(httpd_req_t *req, cJSON **out) {
+  *out = NULL;
+  if (req->content_len > REQUEST_BODY_MAX) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+    return ESP_FAIL;
+  }
+  char *buf = req_arena_alloc(req->content_len + 1);
+  if (buf == NULL) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+  size_t received = 0;
+  while (received < req->content_len) {
+    int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+    if (ret <= 0) {
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+      }
+      return ESP_FAIL;
+    }
+    received += ret;
+  }
+  buf[received] = '\0';
+  if (header_has(req, "Content-Type", CBOR_CONTENT_TYPE)) {
+    cbor_decode_cjson(buf, received, out);
+  } else {
+    *out = cJSON_Parse(buf);
+  }
+  if (*out == NULL) {
+    httpd_resp_send_400(req);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
 }
 
-static esp_err_t handle_js(httpd_req_t *req) {
-  ESP_LOGI(TAG, "Serving app.js");
-  return serve_embedded_file(req, app_js_start, app_js_end,
-                             "application/javascript");
+// URI Handlers
+// Handler for the live session table
+esp_err_t clients_handler(httpd_req_t *req) {
+  session_info_t sessions[SESSION_TABLE_SLOTS];
+  size_t count = session_table_snapshot(sessions, SESSION_TABLE_SLOTS);
+  session_stats_t stats;
+  session_table_get_stats(&stats);
+  int self_fd = httpd_req_to_sockfd(req);
+  int64_t now_us = esp_timer_get_time();
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "count", count);
+  cJSON_AddNumberToObject(root, "max_open_sockets", HTTPS_MAX_OPEN_SOCKETS);
+  cJSON_AddNumberToObject(root, "max_sessions", HTTPS_MAX_SESSIONS);
+  cJSON_AddNumberToObject(root, "idle_timeout_s", CONFIG_HTTPS_IDLE_TIMEOUT_S);
+  cJSON_AddNumberToObject(root, "peak", stats.peak);
+  cJSON_AddNumberToObject(root, "accepted", stats.accepted);
+  cJSON_AddNumberToObject(root, "closed", stats.closed);
+  cJSON_AddNumberToObject(root, "evicted", stats.evicted);
+  cJSON_AddNumberToObject(root, "refused", stats.refused);
+  cJSON_AddNumberToObject(root, "reaped", stats.reaped);
+  cJSON_AddNumberToObject(root, "untracked", stats.table_full);
+  cJSON_AddNumberToObject(root, "tls_errors", stats.tls_errors);
+
+  cJSON *heap_gate = cJSON_AddObjectToObject(root, "heap_gate");
+  cJSON_AddNumberToObject(heap_gate, "min_free", CONFIG_HTTPS_ADMIT_MIN_FREE);
+  cJSON_AddNumberToObject(heap_gate, "min_block", CONFIG_HTTPS_ADMIT_MIN_BLOCK);
+  cJSON_AddNumberToObject(heap_gate, "refused", stats.low_heap_refused);
+  cJSON_AddNumberToObject(heap_gate, "evicted", stats.low_heap_evicted);
+
+  rate_limit_stats_t limits;
+  rate_limit_get_stats(&limits);
+  rate_limit_client_t limited[RATE_LIMIT_SLOTS];
+  size_t limited_count = rate_limit_snapshot(limited, RATE_LIMIT_SLOTS);
+  cJSON *throttle = cJSON_AddObjectToObject(root, "throttle");
+  cJSON_AddNumberToObject(throttle, "handshakes_allowed", limits.allowed[RATE_LIMIT_CONNECT]);
+  cJSON_AddNumberToObject(throttle, "handshakes_refused", limits.refused[RATE_LIMIT_CONNECT]);
+  cJSON_AddNumberToObject(throttle, "requests_allowed", limits.allowed[RATE_LIMIT_REQUEST]);
+  cJSON_AddNumberToObject(throttle, "requests_refused", limits.refused[RATE_LIMIT_REQUEST]);
+  cJSON_AddNumberToObject(throttle, "recycled", limits.recycled);
+  cJSON *sources = cJSON_AddArrayToObject(throttle, "sources");
+  for (size_t i = 0; i < limited_count; i++) {
+    const rate_limit_client_t *c = &limited[i];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "ip", c->ip);
+    cJSON_AddNumberToObject(item, "handshakes", c->allowed[RATE_LIMIT_CONNECT]);
+    cJSON_AddNumberToObject(item, "handshakes_refused", c->refused[RATE_LIMIT_CONNECT]);
+    cJSON_AddNumberToObject(item, "requests", c->allowed[RATE_LIMIT_REQUEST]);
+    cJSON_AddNumberToObject(item, "requests_refused", c->refused[RATE_LIMIT_REQUEST]);
+    cJSON_AddNumberToObject(item, "idle_ms", (double)((now_us - c->last_seen_us) / 1000));
+    cJSON_AddItemToArray(sources, item);
+  }
+
+  cJSON *clients = cJSON_AddArrayToObject(root, "clients");
+  for (size_t i = 0; i < count; i++) {
+    const session_info_t *s = &sessions[i];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddNumberToObject(item, "fd", s->fd);
+    cJSON_AddStringToObject(item, "ip", s->ip);
+    cJSON_AddNumberToObject(item, "port", s->port);
+    cJSON_AddNumberToObject(item, "connected_ms", (double)((now_us - s->connected_us) / 1000));
+    cJSON_AddNumberToObject(item, "idle_ms", (double)((now_us - s->last_active_us) / 1000));
+    cJSON_AddNumberToObject(item, "bytes_in", (double)s->bytes_in);
+    cJSON_AddNumberToObject(item, "bytes_out", (double)s->bytes_out);
+    cJSON_AddNumberToObject(item, "requests", s->requests);
+    cJSON_AddStringToObject(item, "cipher", s->cipher);
+    cJSON_AddBoolToObject(item, "self", s->fd == self_fd);
+    cJSON_AddItemToArray(clients, item);
+  }
+
+  return send_tree(req, root);
 }
 
 static esp_err_t example_uri_handler(httpd_req_t *req) {
@@ -120,42 +291,29 @@ static esp_err_t example_uri_handler(httpd_req_t *req) {
 
 // Handler to turn on the LED
 static esp_err_t led_on_handler(httpd_req_t *req) {
-    char buf[100];
-    int ret;
-
-    if ((ret = httpd_req_recv(req, buf, sizeof(buf))) <= 0) {
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
-        }
-        return ESP_FAIL;
-    }
-
-    buf[ret] = '\0';
-    cJSON *json = cJSON_Parse(buf);
-    if (json == NULL) {
-        httpd_resp_send_400(req);
+    // The tree lives in the request arena and goes with it
+    cJSON *json;
+    if (recv_tree(req, &json) != ESP_OK) {
         return ESP_FAIL;
     }
 
     cJSON *color_json = cJSON_GetObjectItem(json, "color");
     if (!cJSON_IsString(color_json)) {
-        cJSON_Delete(json);
         httpd_resp_send_400(req);
         return ESP_FAIL;
     }
 
     const char *color = color_json->valuestring;
-    ESP_LOGI(TAG, "Turning on LED with color %s", color);
+    BINLOG_I(TAG, "Turning on LED with color %s", color);
     // Add code to set LED color based on the color value
     set_led_state(LED_STATE_ON);
-    cJSON_Delete(json);
     httpd_resp_sendstr(req, "LED turned on");
     return ESP_OK;
 }
 
 // Handler to turn off the LED
 static esp_err_t led_off_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Turning off LED");
+    BINLOG_I(TAG, "Turning off LED");
     set_led_state(LED_STATE_OFF);
     httpd_resp_sendstr(req, "LED turned off");
     return ESP_OK;
@@ -163,34 +321,22 @@ static esp_err_t led_off_handler(httpd_req_t *req) {
 
 // Handler to adjust LED brightness
 static esp_err_t led_brightness_handler(httpd_req_t *req) {
-    char buf[100];
-    int ret, brightness;
-
-    if ((ret = httpd_req_recv(req, buf, sizeof(buf))) <= 0) {
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
-        }
-        return ESP_FAIL;
-    }
-
-    buf[ret] = '\0';
-    cJSON *json = cJSON_Parse(buf);
-    if (json == NULL) {
-        httpd_resp_send_400(req);
+    int brightness;
+    // The tree lives in the request arena and goes with it
+    cJSON *json;
+    if (recv_tree(req, &json) != ESP_OK) {
         return ESP_FAIL;
     }
 
     cJSON *brightness_json = cJSON_GetObjectItem(json, "brightness");
     if (!cJSON_IsNumber(brightness_json)) {
-        cJSON_Delete(json);
         httpd_resp_send_400(req);
         return ESP_FAIL;
     }
 
     brightness = brightness_json->valueint;
-    ESP_LOGI(TAG, "Setting LED brightness to %d", brightness);
+    BINLOG_I(TAG, "Setting LED brightness to %d", brightness);
     set_brightness(brightness); // Corrected function call
-    cJSON_Delete(json);
     httpd_resp_sendstr(req, "LED brightness set");
     return ESP_OK;
 }
@@ -203,53 +349,935 @@ esp_err_t system_info_handler(httpd_req_t *req) {
   esp_chip_info(&chip_info);
 
   // Collect system info
-  char response[256];
-  snprintf(response, sizeof(response),
-           "{"
-           "\"chip\":\"%s\","
-           "\"cores\":%d,"
-           "\"features\":\"%s%s%s%s\","
-           "\"revision\":\"v%d.%d\","
-           "\"flash_size\":\"%" PRIu32 "MB\","
-           "\"heap_free\":%" PRIu32 "}",
-           CONFIG_IDF_TARGET, chip_info.cores,
+  char features[64];
+  char revision[12];
+  char flash[16];
+  snprintf(features, sizeof(features), "%s%s%s%s",
            (chip_info.features & CHIP_FEATURE_WIFI_BGN) ? "WiFi/" : "",
            (chip_info.features & CHIP_FEATURE_BT) ? "BT" : "",
            (chip_info.features & CHIP_FEATURE_BLE) ? "BLE" : "",
            (chip_info.features & CHIP_FEATURE_IEEE802154)
                ? ", 802.15.4 (Zigbee/Thread)"
-               : "",
-           chip_info.revision / 100, chip_info.revision % 100,
+               : "");
+  snprintf(revision, sizeof(revision), "v%d.%d", chip_info.revision / 100, chip_info.revision % 100);
+  snprintf(flash, sizeof(flash), "%" PRIu32 "MB",
            (esp_flash_get_size(NULL, &flash_size) == ESP_OK)
                ? flash_size / (1024 * 1024)
-               : 0,
-           esp_get_free_heap_size());
+               : 0);
 
-  // Set response headers and send the JSON data
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-  return ESP_OK;
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddStringToObject(root, "chip", CONFIG_IDF_TARGET);
+  cJSON_AddNumberToObject(root, "cores", chip_info.cores);
+  cJSON_AddStringToObject(root, "features", features);
+  cJSON_AddStringToObject(root, "revision", revision);
+  cJSON_AddStringToObject(root, "flash_size", flash);
+  cJSON_AddNumberToObject(root, "heap_free", esp_get_free_heap_size());
+  char name[SETTINGS_STR_MAX + 1];
+  settings_get_str(SETTING_DEVICE_NAME, name, sizeof(name));
+  cJSON_AddStringToObject(root, "device_name", name);
+  return send_tree(req, root);
+}
+
+// The settings in effect, without secrets, and what each one accepts
+static esp_err_t send_settings(httpd_req_t *req) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "version", settings_version());
+  cJSON *values = cJSON_AddObjectToObject(root, "settings");
+  cJSON *schema = cJSON_AddArrayToObject(root, "schema");
+  for (int id = 0; id < SETTING_COUNT; id++) {
+    const setting_desc_t *desc = settings_desc(id);
+    if (desc->type == SETTING_TYPE_INT) {
+      cJSON_AddNumberToObject(values, desc->key, settings_get_int(id));
+    } else if (!desc->secret) {
+      char value[SETTINGS_STR_MAX + 1];
+      settings_get_str(id, value, sizeof(value));
+      cJSON_AddStringToObject(values, desc->key, value);
+    }
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "key", desc->key);
+    cJSON_AddStringToObject(item, "type", desc->type == SETTING_TYPE_INT ? "int" : "string");
+    cJSON_AddNumberToObject(item, "min", desc->min);
+    cJSON_AddNumberToObject(item, "max", desc->max);
+    cJSON_AddBoolToObject(item, "secret", desc->secret);
+    cJSON_AddBoolToObject(item, "restart", desc->restart);
+    cJSON_AddItemToArray(schema, item);
+  }
+  return send_tree(req, root);
+}
+
+// Ints in JSON arrive as doubles; the cast alone is undefined out of range
+static bool is_int32(double v) {
+  return v >= INT32_MIN && v <= INT32_MAX && v == (int32_t)v;
+}
+
+// Likewise for a settings version. SETTINGS_ANY_VERSION is left out: it
+// would skip the check the client asked for.
+static bool is_version(double v) {
+  return v >= 0 && v < SETTINGS_ANY_VERSION && v == (uint32_t)v;
+}
+
+static esp_err_t settings_get_handler(httpd_req_t *req) {
+  return send_settings(req);
+}
+
+// {"version": n, "settings": {"key": value, ...}}. The values are applied
+// together or not at all; with a version, only if nobody else committed
+// since that version was read (409 otherwise).
+static esp_err_t settings_put_handler(httpd_req_t *req) {
+  // The tree lives in the request arena and goes with it
+  cJSON *json;
+  if (recv_tree(req, &json) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  cJSON *version = cJSON_GetObjectItem(json, "version");
+  cJSON *values = cJSON_GetObjectItem(json, "settings");
+  if (!cJSON_IsObject(values) || (version && !(cJSON_IsNumber(version) && is_version(version->valuedouble)))) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected {\"version\": n, \"settings\": {...}}");
+  }
+
+  static settings_batch_t batch;   // Handlers run one at a time on the server task
+  settings_batch_init(&batch);
+  cJSON *item;
+  cJSON_ArrayForEach(item, values) {
+    int id = settings_find(item->string);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (id >= 0 && cJSON_IsNumber(item) && is_int32(item->valuedouble)) {
+      err = settings_batch_set_int(&batch, id, (int32_t)item->valuedouble);
+    } else if (id >= 0 && cJSON_IsString(item)) {
+      err = settings_batch_set_str(&batch, id, item->valuestring);
+    }
+    if (err != ESP_OK) {
+      char msg[64];
+      snprintf(msg, sizeof(msg), "%s: %s", id < 0 ? "Unknown setting" : "Bad value for", item->string);
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+    }
+  }
+
+  uint32_t expected = version ? (uint32_t)version->valuedouble : SETTINGS_ANY_VERSION;
+  esp_err_t err = settings_commit(&batch, expected, NULL);
+  if (err == ESP_ERR_INVALID_VERSION) {
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_send(req, "Settings changed since that version", HTTPD_RESP_USE_STRLEN);
+  }
+  if (err != ESP_OK) {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store settings");
+  }
+  BINLOG_I(TAG, "Settings now at version %" PRIu32, settings_version());
+  return send_settings(req);
 }
-// Handler for Wi-Fi Status API
+// Handler for Wi-Fi Status API. Link data comes from the link monitor's
+// last sample, so requests never query the radio. ?points=N (default 30)
+// sets the number of history points.
+#define WIFI_STATUS_DEFAULT_POINTS 30
+#define WIFI_STATUS_MAX_POINTS 60
 esp_err_t wifi_status_handler(httpd_req_t *req) {
-  wifi_ap_record_t ap_info;
-  esp_wifi_sta_get_ap_info(&ap_info);
-
-  char response[128];
-  snprintf(response, sizeof(response),
-           "{"
-           "\"ssid\":\"%s\","
-           "\"ip\":\"%s\","
-           "\"rssi\":%d"
-           "}",
-           ap_info.ssid,
-           "192.168.0.109", // Replace with dynamic IP retrieval
-           ap_info.rssi);
+  wifi_connect_stats_t stats;
+  wifi_get_connect_stats(&stats);
+  wifi_config_t wifi_config = {0};
+  esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+  link_sample_t latest = {0};
+  bool have_sample = link_monitor_get_latest(&latest) == ESP_OK;
 
-  httpd_resp_set_type(req, "application/json");
-  return httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+  size_t max_points = WIFI_STATUS_DEFAULT_POINTS;
+  char query[32];
+  char value[8];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "points", value, sizeof(value)) == ESP_OK) {
+    int requested = atoi(value);
+    max_points = requested < 1 ? 1 : MIN(requested, WIFI_STATUS_MAX_POINTS);
+  }
+  link_point_t points[WIFI_STATUS_MAX_POINTS];
+  size_t point_count = link_monitor_get_history(points, max_points);
+
+  char ip_str[16];
+  esp_ip4_addr_t ip = {.addr = latest.ip};
+  snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&ip));
+  int64_t now_us = esp_timer_get_time();
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddStringToObject(root, "state", wifi_state_to_str(wifi_get_state()));
+  cJSON_AddStringToObject(root, "ssid", (const char *)wifi_config.sta.ssid);
+  cJSON_AddStringToObject(root, "ip", ip_str);
+  cJSON_AddNumberToObject(root, "rssi", latest.rssi);
+  cJSON_AddNumberToObject(root, "channel", latest.channel);
+  cJSON_AddStringToObject(root, "phy_mode", link_monitor_phy_mode_str(latest.phy_mode));
+  cJSON_AddNumberToObject(root, "phy_rate_kbps", link_monitor_phy_rate_kbps(latest.phy_mode));
+  cJSON_AddNumberToObject(root, "sample_age_ms", have_sample ? (double)((now_us - latest.t_us) / 1000) : -1);
+  uint8_t last_reason;
+  cJSON_AddNumberToObject(root, "disconnects", link_monitor_get_disconnects(&last_reason));
+  cJSON_AddNumberToObject(root, "last_disconnect_reason", last_reason);
+  cJSON_AddNumberToObject(root, "time_to_ip_ms", (double)stats.time_to_ip_ms);
+  cJSON_AddNumberToObject(root, "boot_time_to_ip_ms", (double)stats.boot_time_to_ip_ms);
+  cJSON_AddBoolToObject(root, "fast_connect", stats.fast_connect);
+  cJSON_AddNumberToObject(root, "scan_fallbacks", stats.scan_fallbacks);
+  cJSON_AddNumberToObject(root, "failed_attempts", stats.failed_attempts);
+  cJSON_AddNumberToObject(root, "next_retry_ms", stats.next_retry_ms);
+
+  cJSON *history = cJSON_AddObjectToObject(root, "history");
+  cJSON_AddNumberToObject(history, "interval_ms", CONFIG_LINK_MONITOR_INTERVAL_MS);
+  cJSON *arr = cJSON_AddArrayToObject(history, "points");
+  for (size_t i = 0; i < point_count; i++) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddNumberToObject(item, "age_ms", (double)((now_us - points[i].t_us) / 1000));
+    cJSON_AddNumberToObject(item, "rssi_avg", points[i].rssi_avg);
+    cJSON_AddNumberToObject(item, "rssi_min", points[i].rssi_min);
+    cJSON_AddNumberToObject(item, "samples", points[i].samples);
+    cJSON_AddNumberToObject(item, "associated", points[i].associated);
+    cJSON_AddNumberToObject(item, "disconnects", points[i].disconnects);
+    cJSON_AddItemToArray(arr, item);
+  }
+
+  return send_tree(req, root);
+}
+
+// Handler for the boot timeline API; times are microseconds since boot
+esp_err_t boot_handler(httpd_req_t *req) {
+  boot_phase_record_t phases[BOOT_MAX_PHASES];
+  boot_mark_t marks[BOOT_MAX_MARKS];
+  size_t phase_count = boot_get_phases(phases, BOOT_MAX_PHASES);
+  size_t mark_count = boot_get_marks(marks, BOOT_MAX_MARKS);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "now_us", (double)esp_timer_get_time());
+  cJSON *phase_arr = cJSON_AddArrayToObject(root, "phases");
+  for (size_t i = 0; i < phase_count; i++) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", phases[i].name);
+    cJSON *deps = cJSON_AddArrayToObject(item, "deps");
+    for (size_t d = 0; d < phase_count; d++) {
+      if (phases[i].deps & BOOT_DEP(d)) {
+        cJSON_AddItemToArray(deps, cJSON_CreateString(phases[d].name));
+      }
+    }
+    cJSON_AddNumberToObject(item, "start_us", (double)phases[i].start_us);
+    cJSON_AddNumberToObject(item, "end_us", (double)phases[i].end_us);
+    cJSON_AddNumberToObject(item, "duration_us",
+                            phases[i].start_us < 0 ? -1 : (double)(phases[i].end_us - phases[i].start_us));
+    cJSON_AddStringToObject(item, "status", esp_err_to_name(phases[i].err));
+    cJSON_AddItemToArray(phase_arr, item);
+  }
+  cJSON *mark_arr = cJSON_AddArrayToObject(root, "marks");
+  for (size_t i = 0; i < mark_count; i++) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", marks[i].name);
+    cJSON_AddNumberToObject(item, "t_us", (double)marks[i].t_us);
+    cJSON_AddItemToArray(mark_arr, item);
+  }
+
+  return send_tree(req, root);
+}
+
+// Heap telemetry: per-capability free/largest block/fragmentation with
+// low-water marks, per-subsystem accounting, fixed-block pools, the
+// request arena and allocation failures
+static esp_err_t heap_handler(httpd_req_t *req) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON *classes = cJSON_AddObjectToObject(root, "classes");
+  for (int i = 0; i < HEAP_CLASS_COUNT; i++) {
+    heap_class_stats_t c;
+    heap_monitor_get_class(i, &c);
+    cJSON *item = cJSON_AddObjectToObject(classes, heap_monitor_class_name(i));
+    cJSON_AddNumberToObject(item, "free", c.free_bytes);
+    cJSON_AddNumberToObject(item, "min_free", c.min_free_bytes);
+    cJSON_AddNumberToObject(item, "largest_block", c.largest_block);
+    cJSON_AddNumberToObject(item, "min_largest_block", c.min_largest_block);
+    cJSON_AddNumberToObject(item, "frag_pct", c.frag_pct);
+    cJSON_AddNumberToObject(item, "max_frag_pct", c.max_frag_pct);
+    cJSON_AddNumberToObject(item, "free_blocks", c.free_blocks);
+  }
+  cJSON *tags = cJSON_AddObjectToObject(root, "tags");
+  for (int i = 0; i < HEAP_TAG_COUNT; i++) {
+    heap_tag_stats_t t;
+    heap_monitor_get_tag(i, &t);
+    cJSON *item = cJSON_AddObjectToObject(tags, heap_monitor_tag_name(i));
+    cJSON_AddNumberToObject(item, "bytes", t.current_bytes);
+    cJSON_AddNumberToObject(item, "peak", t.peak_bytes);
+    cJSON_AddNumberToObject(item, "allocs", t.allocs);
+    cJSON_AddNumberToObject(item, "frees", t.frees);
+    cJSON_AddNumberToObject(item, "failures", t.failures);
+  }
+  cJSON *pools = cJSON_AddArrayToObject(root, "pools");
+  for (size_t i = 0; i < mem_pool_count(); i++) {
+    mem_pool_stats_t p;
+    mem_pool_get_stats(mem_pool_at(i), &p);
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", p.name);
+    cJSON_AddNumberToObject(item, "block_size", p.block_size);
+    cJSON_AddNumberToObject(item, "blocks", p.blocks);
+    cJSON_AddNumberToObject(item, "in_use", p.in_use);
+    cJSON_AddNumberToObject(item, "peak", p.peak_in_use);
+    cJSON_AddNumberToObject(item, "allocs", p.allocs);
+    cJSON_AddNumberToObject(item, "frees", p.frees);
+    cJSON_AddNumberToObject(item, "exhausted", p.exhausted);
+    cJSON_AddItemToArray(pools, item);
+  }
+  req_arena_stats_t a;
+  req_arena_get_stats(&a);
+  cJSON *arena = cJSON_AddObjectToObject(root, "request_arena");
+  cJSON_AddNumberToObject(arena, "size", a.size);
+  cJSON_AddNumberToObject(arena, "requests", a.requests);
+  cJSON_AddNumberToObject(arena, "last_used", a.last_used);
+  cJSON_AddNumberToObject(arena, "high_water", a.high_water);
+  cJSON_AddNumberToObject(arena, "overflows", a.overflows);
+  cJSON_AddNumberToObject(arena, "overflow_fails", a.overflow_fails);
+  heap_failure_stats_t f;
+  heap_monitor_get_failures(&f);
+  cJSON *failures = cJSON_AddObjectToObject(root, "alloc_failures");
+  cJSON_AddNumberToObject(failures, "count", f.count);
+  cJSON_AddNumberToObject(failures, "last_size", f.last_size);
+  cJSON_AddNumberToObject(failures, "last_caps", f.last_caps);
+  cJSON_AddNumberToObject(failures, "last_age_ms",
+                          f.count ? (double)((esp_timer_get_time() - f.last_us) / 1000) : -1);
+  cJSON *thresholds = cJSON_AddObjectToObject(root, "thresholds");
+  cJSON_AddNumberToObject(thresholds, "min_free", CONFIG_HEAP_MONITOR_MIN_FREE);
+  cJSON_AddNumberToObject(thresholds, "min_block", CONFIG_HEAP_MONITOR_MIN_BLOCK);
+  cJSON_AddNumberToObject(thresholds, "max_frag_pct", CONFIG_HEAP_MONITOR_MAX_FRAG_PCT);
+
+  return send_tree(req, root);
+}
+
+// Per-task CPU% over the latest interval and the whole window, busiest
+// first, with stack high-water marks and recommended stack sizes
+static esp_err_t tasks_handler(httpd_req_t *req) {
+  // Handlers run one at a time on the server task
+  static task_profile_t profiles[CONFIG_TASK_PROFILER_MAX_TASKS];
+  task_profiler_info_t info;
+  size_t n = task_profiler_get(profiles, CONFIG_TASK_PROFILER_MAX_TASKS, &info);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "samples", info.samples);
+  cJSON_AddNumberToObject(root, "interval_ms", info.interval_ms);
+  cJSON_AddNumberToObject(root, "window_ms", info.window_ms);
+  cJSON_AddNumberToObject(root, "overflow", info.overflow);
+  cJSON *stack = cJSON_AddObjectToObject(root, "stack");
+  cJSON_AddNumberToObject(stack, "declared", info.stack_declared);
+  cJSON_AddNumberToObject(stack, "reclaimable", info.stack_reclaimable);
+  cJSON *tasks = cJSON_AddArrayToObject(root, "tasks");
+  for (size_t i = 0; i < n; i++) {
+    const task_profile_t *p = &profiles[i];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", p->name);
+    cJSON_AddNumberToObject(item, "number", p->number);
+    cJSON_AddNumberToObject(item, "priority", p->priority);
+    cJSON_AddStringToObject(item, "state", task_profiler_state_name(p->state));
+    // One decimal is plenty and keeps the response small
+    cJSON_AddNumberToObject(item, "cpu_pct", p->cpu_pct < 0 ? -1 : (int)(p->cpu_pct * 10 + 0.5f) / 10.0);
+    cJSON_AddNumberToObject(item, "cpu_pct_window",
+                            p->cpu_pct_window < 0 ? -1 : (int)(p->cpu_pct_window * 10 + 0.5f) / 10.0);
+    cJSON_AddNumberToObject(item, "stack_size", p->stack_size);
+    cJSON_AddNumberToObject(item, "stack_free", p->stack_free);
+    cJSON_AddNumberToObject(item, "stack_free_min", p->stack_free_min);
+    cJSON_AddNumberToObject(item, "stack_recommended", p->stack_recommended);
+    cJSON_AddItemToArray(tasks, item);
+  }
+
+  return send_tree(req, root);
+}
+
+static esp_err_t ingest_handler(httpd_req_t *req) {
+  ingest_stats_t st;
+  ingest_get_stats(&st);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON *queue = cJSON_AddObjectToObject(root, "queue");
+  cJSON_AddNumberToObject(queue, "len", st.queue_len);
+  cJSON_AddNumberToObject(queue, "depth", st.queue_depth);
+  cJSON_AddNumberToObject(queue, "peak", st.queue_peak);
+  cJSON_AddNumberToObject(root, "dispatched", st.dispatched);
+  cJSON_AddNumberToObject(root, "batches", st.batches);
+  cJSON_AddNumberToObject(root, "in_per_s", st.in_per_s);
+  cJSON_AddNumberToObject(root, "out_per_s", st.out_per_s);
+  cJSON_AddNumberToObject(root, "tsdb_unmapped", st.tsdb_unmapped);
+  cJSON_AddNumberToObject(root, "sim_rate", st.sim_rate);
+  cJSON *sources = cJSON_AddObjectToObject(root, "sources");
+  for (int i = 0; i < INGEST_SRC_COUNT; i++) {
+    const ingest_source_stats_t *s = &st.sources[i];
+    cJSON *item = cJSON_AddObjectToObject(sources, ingest_source_name(i));
+    cJSON_AddNumberToObject(item, "frames", s->frames);
+    cJSON_AddNumberToObject(item, "bytes", s->bytes);
+    cJSON_AddNumberToObject(item, "records", s->records);
+    cJSON_AddNumberToObject(item, "parse_errors", s->parse_errors);
+    cJSON_AddNumberToObject(item, "queue_drops", s->queue_drops);
+  }
+  cJSON *consumers = cJSON_AddArrayToObject(root, "consumers");
+  for (size_t i = 0; i < st.consumer_count; i++) {
+    const ingest_consumer_stats_t *c = &st.consumers[i];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", c->name);
+    cJSON_AddNumberToObject(item, "records", c->records);
+    cJSON_AddNumberToObject(item, "batches", c->batches);
+    cJSON_AddNumberToObject(item, "drops", c->drops);
+    cJSON_AddItemToArray(consumers, item);
+  }
+  ingest_coap_stats_t coap_st;
+  ingest_coap_get_stats(&coap_st);
+  cJSON *coap = cJSON_AddObjectToObject(root, "coap");
+  cJSON_AddNumberToObject(coap, "requests", coap_st.requests);
+  cJSON_AddNumberToObject(coap, "confirmable", coap_st.confirmable);
+  cJSON_AddNumberToObject(coap, "duplicates", coap_st.duplicates);
+  cJSON_AddNumberToObject(coap, "pings", coap_st.pings);
+  cJSON_AddNumberToObject(coap, "format_errors", coap_st.format_errors);
+  cJSON_AddNumberToObject(coap, "rejected", coap_st.rejected);
+  cJSON_AddNumberToObject(coap, "responses", coap_st.responses);
+
+  return send_tree(req, root);
+}
+
+// {"rate": frames per second, "sensors": n}; rate 0 stops the generator
+static esp_err_t ingest_sim_handler(httpd_req_t *req) {
+  // The tree lives in the request arena and goes with it
+  cJSON *json;
+  if (recv_tree(req, &json) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  cJSON *rate = cJSON_GetObjectItem(json, "rate");
+  cJSON *sensors = cJSON_GetObjectItem(json, "sensors");
+  if (!cJSON_IsNumber(rate) || !is_int32(rate->valuedouble) || rate->valuedouble < 0 ||
+      rate->valuedouble > INGEST_SIM_RATE_MAX ||
+      (sensors && (!cJSON_IsNumber(sensors) || !is_int32(sensors->valuedouble) || sensors->valuedouble < 1 ||
+                   sensors->valuedouble > INGEST_SIM_SENSORS_MAX))) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected {\"rate\": n, \"sensors\": n}");
+  }
+  esp_err_t err = ingest_sim_set_rate((uint32_t)rate->valuedouble,
+                                      sensors ? (uint32_t)sensors->valuedouble : CONFIG_INGEST_SIM_SENSORS);
+  if (err != ESP_OK) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+  }
+  return ingest_handler(req);
+}
+
+// IPv4 address of the peer, 0 if it has none. The server listens on IPv6,
+// so IPv4 peers show up mapped.
+static uint32_t peer_ipv4(int fd) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  if (getpeername(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+    return 0;
+  }
+  if (addr.ss_family == AF_INET) {
+    return ntohl(((struct sockaddr_in *)&addr)->sin_addr.s_addr);
+  }
+  if (addr.ss_family == AF_INET6) {
+    const uint8_t *b = (const uint8_t *)&((struct sockaddr_in6 *)&addr)->sin6_addr;
+    static const uint8_t v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (memcmp(b, v4_mapped, sizeof(v4_mapped)) == 0) {
+      return (uint32_t)b[12] << 24 | b[13] << 16 | b[14] << 8 | b[15];
+    }
+  }
+  return 0;
+}
+
+// Body: one binary sensor report, the same payload as over UDP or CoAP
+static esp_err_t ingest_report_handler(httpd_req_t *req) {
+  uint8_t buf[INGEST_REPORT_HDR_SIZE + INGEST_MAX_READINGS * INGEST_READING_SIZE];
+  if (req->content_len > sizeof(buf)) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Report too large");
+  }
+  size_t received = 0;
+  while (received < req->content_len) {
+    int ret = httpd_req_recv(req, (char *)buf + received, req->content_len - received);
+    if (ret <= 0) {
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+      }
+      return ESP_FAIL;
+    }
+    received += ret;
+  }
+  esp_err_t err = ingest_submit_report(INGEST_SRC_HTTPS, buf, received, peer_ipv4(httpd_req_to_sockfd(req)));
+  if (err == ESP_ERR_NO_MEM) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Ingest queue full", HTTPD_RESP_USE_STRLEN);
+  }
+  if (err != ESP_OK) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+  }
+  httpd_resp_set_status(req, "204 No Content");
+  return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t uplink_handler(httpd_req_t *req) {
+  uplink_stats_t st;
+  uplink_get_stats(&st);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddBoolToObject(root, "connected", st.connected);
+  cJSON_AddNumberToObject(root, "connects", st.connects);
+  cJSON_AddNumberToObject(root, "disconnects", st.disconnects);
+  cJSON_AddNumberToObject(root, "records", st.records);
+  cJSON_AddNumberToObject(root, "records_dropped", st.records_dropped);
+  cJSON_AddNumberToObject(root, "batches", st.batches);
+  cJSON_AddNumberToObject(root, "published", st.published);
+  cJSON_AddNumberToObject(root, "acked", st.acked);
+  cJSON_AddNumberToObject(root, "publish_errors", st.publish_errors);
+  cJSON *queue = cJSON_AddObjectToObject(root, "queue");
+  cJSON_AddNumberToObject(queue, "open_records", st.open_records);
+  cJSON_AddNumberToObject(queue, "ready", st.ready);
+  cJSON_AddNumberToObject(queue, "inflight", st.inflight);
+  cJSON_AddNumberToObject(queue, "spool_items", st.spool_items);
+  cJSON_AddNumberToObject(queue, "spool_bytes", st.spool_bytes);
+  cJSON_AddNumberToObject(queue, "spooled", st.spooled);
+  cJSON_AddNumberToObject(queue, "spool_dropped", st.spool_dropped);
+  cJSON_AddNumberToObject(queue, "spool_errors", st.spool_errors);
+  cJSON *latency = cJSON_AddObjectToObject(root, "latency_ms");
+  cJSON_AddNumberToObject(latency, "last", st.latency_ms_last);
+  cJSON_AddNumberToObject(latency, "avg", st.latency_ms_avg);
+  cJSON_AddNumberToObject(latency, "max", st.latency_ms_max);
+
+  return send_tree(req, root);
 }
 
+// Dumps the binary log ring as text, oldest first. ?since=<seq> starts at
+// a later record; X-Binlog-Next is the value to pass next time.
+static esp_err_t log_handler(httpd_req_t *req) {
+  // Handlers run one at a time on the server task
+  static char chunk[1024];
+  static char msg[160];
+  char query[32];
+  char param[12];
+  uint32_t cursor = binlog_oldest();
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "since", param, sizeof(param)) == ESP_OK) {
+    cursor = strtoul(param, NULL, 10);
+  }
+  uint32_t stop = binlog_head();
+  char next[12];
+  snprintf(next, sizeof(next), "%" PRIu32, stop);
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_set_hdr(req, "X-Binlog-Next", next);
+
+  binlog_stats_t stats;
+  binlog_get_stats(&stats);
+  size_t len = snprintf(chunk, sizeof(chunk),
+                        "# %" PRIu32 " records written, ring holds %" PRIu32 ", %" PRIu32 " truncated, %" PRIu32
+                        " lost before printing\n",
+                        stats.written, stats.capacity, stats.truncated, stats.console_lost);
+  binlog_entry_t e;
+  // Records written during the dump are left for the next one
+  while (cursor != stop && binlog_read(&cursor, &e, msg, sizeof(msg))) {
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    char line[sizeof(msg) + 64];
+    int n = 0;
+    if (e.skipped) {
+      n = snprintf(line, sizeof(line), "# %" PRIu32 " records overwritten\n", e.skipped);
+    }
+    n += snprintf(line + n, sizeof(line) - n, "%c (%lld) %s: %s\n", letters[e.level < 6 ? e.level : 0],
+                  (long long)(e.ts_us / 1000), e.tag, msg);
+    n = MIN(n, (int)sizeof(line) - 1);
+    if (len + n > sizeof(chunk)) {
+      if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+        return ESP_FAIL;
+      }
+      len = 0;
+    }
+    memcpy(chunk + len, line, n);
+    len += n;
+  }
+  if (len > 0 && httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Bundle status, also returned after an upload
+static esp_err_t send_www_info(httpd_req_t *req) {
+  www_bundle_info_t info;
+  www_bundle_get_info(&info);
+  char crc[9];
+  snprintf(crc, sizeof(crc), "%08" PRIx32, info.crc);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "slot", info.slot);
+  cJSON_AddNumberToObject(root, "seq", info.seq);
+  cJSON_AddNumberToObject(root, "files", info.files);
+  cJSON_AddNumberToObject(root, "size", info.size);
+  cJSON_AddStringToObject(root, "crc", crc);
+  cJSON_AddNumberToObject(root, "slot_size", info.slot_size);
+  cJSON_AddNumberToObject(root, "served", info.served);
+  cJSON_AddNumberToObject(root, "updates", info.updates);
+  cJSON_AddNumberToObject(root, "update_failures", info.update_failures);
+  cJSON_AddNumberToObject(root, "last_update_ms", info.last_update_ms);
+  cJSON_AddNumberToObject(root, "last_update_kbps", info.last_update_kbps);
+
+  return send_tree(req, root);
+}
+
+static esp_err_t www_info_handler(httpd_req_t *req) {
+  return send_www_info(req);
+}
+
+// Hex from X-Signature into sig. Returns the byte count, or 0 if malformed.
+static size_t parse_signature(const char *hex, uint8_t *sig, size_t max) {
+  size_t len = strlen(hex);
+  if (len == 0 || len % 2 != 0 || len / 2 > max) {
+    return 0;
+  }
+  for (size_t i = 0; i < len / 2; i++) {
+    char byte[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+    char *end;
+    sig[i] = (uint8_t)strtoul(byte, &end, 16);
+    if (*end != '\0' || !isxdigit((unsigned char)byte[0])) {
+      return 0;
+    }
+  }
+  return len / 2;
+}
+
+// X-Signature of an upload into sig, which holds OTA_UPDATE_SIG_MAX bytes.
+// Returns the byte count, or 0 if missing or malformed.
+static size_t read_signature(httpd_req_t *req, uint8_t *sig) {
+  char hex[OTA_UPDATE_SIG_MAX * 2 + 1];
+  if (httpd_req_get_hdr_value_str(req, "X-Signature", hex, sizeof(hex)) != ESP_OK) {
+    return 0;
+  }
+  return parse_signature(hex, sig, OTA_UPDATE_SIG_MAX);
+}
+
+#define UPLOAD_TASK_STACK_SIZE 8192 // TLS reads and the ECDSA check run on it
+
+// Sockets of the requests handed to upload tasks, -1 when free. Each
+// session holds at most one. stop_https_server() cuts them off and waits
+// for the tasks to let go before the server frees the sessions.
+static portMUX_TYPE s_upload_lock = portMUX_INITIALIZER_UNLOCKED;
+static int s_upload_fds[HTTPS_MAX_SESSIONS];
+static bool s_uploads_closed;
+
+// Claims a slot for fd; false once the server is stopping
+static bool track_upload(int fd) {
+  bool ok = false;
+  taskENTER_CRITICAL(&s_upload_lock);
+  for (int i = 0; i < HTTPS_MAX_SESSIONS && !s_uploads_closed; i++) {
+    if (s_upload_fds[i] < 0) {
+      s_upload_fds[i] = fd;
+      ok = true;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&s_upload_lock);
+  return ok;
+}
+
+static bool uploads_closed(void) {
+  taskENTER_CRITICAL(&s_upload_lock);
+  bool closed = s_uploads_closed;
+  taskEXIT_CRITICAL(&s_upload_lock);
+  return closed;
+}
+
+static void untrack_upload(int fd) {
+  taskENTER_CRITICAL(&s_upload_lock);
+  for (int i = 0; i < HTTPS_MAX_SESSIONS; i++) {
+    if (s_upload_fds[i] == fd) {
+      s_upload_fds[i] = -1;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&s_upload_lock);
+}
+
+// Hands the request back to the server; the last thing an upload task does
+// with it
+static void finish_upload(httpd_req_t *req) {
+  int fd = httpd_req_to_sockfd(req);
+  httpd_req_async_handler_complete(req);
+  untrack_upload(fd);
+}
+
+// Hands req over to a new task running fn, leaving the server task free for
+// other clients while a large body streams in. Returns false, having
+// answered and closed the session, if that is not possible.
+static bool start_upload_task(httpd_req_t *req, TaskFunction_t fn, const char *name) {
+  int fd = httpd_req_to_sockfd(req);
+  if (!track_upload(fd)) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_send(req, "Server stopping", HTTPD_RESP_USE_STRLEN);
+    httpd_sess_trigger_close(req->handle, fd);
+    return false;
+  }
+  httpd_req_t *async_req;
+  if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+    untrack_upload(fd);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return false;
+  }
+  task_profiler_declare_stack(name, UPLOAD_TASK_STACK_SIZE);
+  // Below the server task, so other clients are served first
+  if (xTaskCreate(fn, name, UPLOAD_TASK_STACK_SIZE, async_req, 4, NULL) != pdPASS) {
+    httpd_resp_send_err(async_req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    httpd_sess_trigger_close(req->handle, fd);
+    finish_upload(async_req);
+    return false;
+  }
+  return true;
+}
+
+// Streams the body into the inactive bundle slot. Waiting out responses
+// still reading that slot and erasing it sector by sector run here rather
+// than on the server task.
+static void www_upload_task(void *arg) {
+  httpd_req_t *req = arg;
+  // Only one upload runs at a time, so the buffer can be shared
+  static char buf[1024];
+  size_t remaining = req->content_len;
+  uint8_t sig[OTA_UPDATE_SIG_MAX];
+  size_t sig_len = read_signature(req, sig);
+  esp_err_t err = ESP_ERR_INVALID_ARG;
+  if (uploads_closed()) {
+    // Cut off before it began; waiting out readers would only hold up
+    // stop_https_server()
+    err = ESP_ERR_TIMEOUT;
+  } else if (sig_len) {
+    err = www_bundle_update_begin(remaining);
+  }
+  if (err == ESP_ERR_TIMEOUT) {
+    ESP_LOGW(TAG, "Bundle upload dropped, server stopping");
+  } else if (err == ESP_ERR_INVALID_ARG) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or malformed X-Signature");
+  } else if (err == ESP_ERR_INVALID_SIZE) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bundle size out of range");
+  } else if (err != ESP_OK) {
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_send(req, "Bundle update already in progress", HTTPD_RESP_USE_STRLEN);
+  } else {
+    int timeouts = 0;
+    while (remaining > 0 && err == ESP_OK) {
+      int n = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)));
+      if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3) {
+        continue;
+      }
+      if (n <= 0) {
+        err = ESP_ERR_TIMEOUT;
+        break;
+      }
+      timeouts = 0;
+      err = www_bundle_update_write(buf, n);
+      remaining -= n;
+    }
+    if (err == ESP_OK) {
+      err = www_bundle_update_end(sig, sig_len);
+      if (err == ESP_OK) {
+        send_www_info(req);
+      } else if (err == ESP_ERR_INVALID_CRC) {
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Signature does not match the bundle");
+      } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bundle rejected");
+      }
+    } else {
+      www_bundle_update_abort();
+      if (err != ESP_ERR_TIMEOUT) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Flash write failed");
+      }
+    }
+  }
+  if (remaining > 0) {
+    // The rest of the body is not worth reading
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+  }
+  finish_upload(req);
+  vTaskDelete(NULL);
+}
+
+// Streams a bundle image (tools/mkwww.py output) into the inactive slot.
+// The request body is the raw image; X-Signature is signed with the
+// firmware update key, as for POST /api/ota.
+static esp_err_t www_upload_handler(httpd_req_t *req) {
+  start_upload_task(req, www_upload_task, "www_upload");
+  return ESP_OK;
+}
+
+static esp_timer_handle_t s_reboot_timer;
+
+static cJSON *ota_info_tree(void) {
+  ota_update_info_t info;
+  ota_update_get_info(&info);
+  cJSON *root = cJSON_CreateObject();
+  if (root == NULL) {
+    return NULL;
+  }
+  cJSON_AddStringToObject(root, "running", info.running);
+  cJSON_AddStringToObject(root, "next", info.next);
+  cJSON_AddStringToObject(root, "version", info.version);
+  cJSON_AddStringToObject(root, "state", info.state);
+  cJSON_AddNumberToObject(root, "slot_size", info.slot_size);
+  cJSON_AddBoolToObject(root, "updating", info.updating);
+  if (info.updating) {
+    cJSON_AddNumberToObject(root, "received", info.received);
+    cJSON_AddNumberToObject(root, "size", info.size);
+  }
+  cJSON_AddNumberToObject(root, "updates", info.updates);
+  cJSON_AddNumberToObject(root, "update_failures", info.update_failures);
+  cJSON_AddNumberToObject(root, "last_update_ms", info.last_update_ms);
+  cJSON_AddNumberToObject(root, "last_update_kbps", info.last_update_kbps);
+  cJSON_AddNumberToObject(root, "last_flash_ms", info.last_flash_ms);
+  cJSON_AddStringToObject(root, "last_sha256", info.last_sha256);
+  return root;
+}
+
+static esp_err_t ota_info_handler(httpd_req_t *req) {
+  return send_tree(req, ota_info_tree());
+}
+
+static void reboot_timer_cb(void *arg) {
+  ESP_LOGI(TAG, "Restarting into the new firmware");
+  esp_restart();
+}
+
+// Upload handed from ota_upload_handler to ota_upload_task; only one runs
+// at a time, as ota_update_begin() enforces
+static struct {
+  uint8_t sig[OTA_UPDATE_SIG_MAX];
+  size_t sig_len;
+  bool reboot;
+} s_ota_upload;
+
+// Reads the body in CONFIG_OTA_CHUNK_SIZE pieces, so each flash write
+// covers whole sectors. Runs on its own task, leaving the server task free
+// for other clients while the image streams in.
+static void ota_upload_task(void *arg) {
+  httpd_req_t *req = arg;
+  static char buf[CONFIG_OTA_CHUNK_SIZE];
+  size_t remaining = req->content_len;
+  int timeouts = 0;
+  esp_err_t err = ESP_OK;
+  while (remaining > 0 && err == ESP_OK) {
+    size_t want = MIN(remaining, sizeof(buf));
+    size_t fill = 0;
+    while (fill < want) {
+      int n = httpd_req_recv(req, buf + fill, want - fill);
+      if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3) {
+        continue;
+      }
+      if (n <= 0) {
+        err = ESP_ERR_TIMEOUT;
+        break;
+      }
+      timeouts = 0;
+      fill += n;
+    }
+    if (err == ESP_OK) {
+      err = ota_update_write(buf, fill);
+      remaining -= fill;
+    }
+  }
+
+  if (err == ESP_OK) {
+    err = ota_update_end(s_ota_upload.sig, s_ota_upload.sig_len);
+    if (err == ESP_ERR_INVALID_CRC) {
+      httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Signature does not match the image");
+    } else if (err != ESP_OK) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image rejected");
+    } else {
+      cJSON *root = ota_info_tree();
+      if (root) {
+        cJSON_AddNumberToObject(root, "reboot_in_ms", s_ota_upload.reboot ? CONFIG_OTA_REBOOT_DELAY_MS : -1);
+      }
+      send_tree(req, root);
+    }
+  } else {
+    ota_update_abort();
+    if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not an app image");
+    } else if (err != ESP_ERR_TIMEOUT) {
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Flash write failed");
+    }
+    // The rest of the body is not worth reading
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+  }
+  finish_upload(req);
+
+  if (err == ESP_OK && s_ota_upload.reboot) {
+    const esp_timer_create_args_t args = {
+        .callback = reboot_timer_cb,
+        .name = "ota_reboot",
+    };
+    if (s_reboot_timer == NULL) {
+      esp_timer_create(&args, &s_reboot_timer);
+    }
+    if (s_reboot_timer) {
+      esp_timer_start_once(s_reboot_timer, (uint64_t)CONFIG_OTA_REBOOT_DELAY_MS * 1000);
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+// Streams a signed app image into the inactive slot. The body is the raw
+// image (build/<project>.bin); X-Signature is the hex DER ECDSA signature
+// from `openssl dgst -sha256 -sign ota_key.pem`. The device restarts into
+// the new image once it is accepted, unless ?reboot=0.
+static esp_err_t ota_upload_handler(httpd_req_t *req) {
+  uint8_t sig[OTA_UPDATE_SIG_MAX];
+  size_t sig_len = read_signature(req, sig);
+  if (sig_len == 0) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or malformed X-Signature");
+  }
+  bool reboot = true;
+  char query[32];
+  char param[4];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "reboot", param, sizeof(param)) == ESP_OK) {
+    reboot = strcmp(param, "0") != 0;
+  }
+
+  esp_err_t err = ota_update_begin(req->content_len);
+  if (err == ESP_ERR_INVALID_SIZE) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image size out of range");
+  }
+  if (err == ESP_ERR_INVALID_STATE) {
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_send(req, "Firmware update already in progress", HTTPD_RESP_USE_STRLEN);
+  }
+  if (err != ESP_OK) {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No update slot");
+  }
+  memcpy(s_ota_upload.sig, sig, sig_len);
+  s_ota_upload.sig_len = sig_len;
+  s_ota_upload.reboot = reboot;
+
+  if (!start_upload_task(req, ota_upload_task, "ota_upload")) {
+    ota_update_abort();
+  }
+  return ESP_OK;
+}
+
+// A session's record buffers and handshake state take tens of KB, the
+// record buffers in one piece. Below the watermarks the handshake would most
+// likely fail partway, having fragmented the heap on the way, so the
+// newcomer is turned away and an idle session, if any, closed to make room
+// for the next one.
+static bool heap_admits_session(int fd) {
+  size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+  if (free_bytes >= CONFIG_HTTPS_ADMIT_MIN_FREE && largest >= CONFIG_HTTPS_ADMIT_MIN_BLOCK) {
+    return true;
+  }
+  BINLOG_W(TAG, "Session on fd %d refused, heap low: %u free, largest block %u",
+           fd, (unsigned)free_bytes, (unsigned)largest);
+  int victim = session_table_note_low_heap((int64_t)CONFIG_HTTPS_EVICT_MIN_IDLE_MS * 1000);
+  if (victim >= 0 && s_server) {
+    BINLOG_I(TAG, "Evicting idle fd %d to free heap", victim);
+    httpd_sess_trigger_close(s_server, victim);
+  }
+  return false;
+}
+
+#ifdef CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+// Runs once the ClientHello is parsed, before the key exchange that makes a
+// handshake expensive, so a client over its connection rate or a newcomer
+// the heap cannot hold costs little
+static int admit_handshake(mbedtls_ssl_context *ssl) {
+  const mbedtls_net_context *net = ssl->MBEDTLS_PRIVATE(p_bio);
+  int fd = net->MBEDTLS_PRIVATE(fd);
+  if (!rate_limit_take(RATE_LIMIT_CONNECT, fd, NULL)) {
+    BINLOG_W(TAG, "Handshake on fd %d refused, connection rate exceeded", fd);
+    return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+  }
+  if (!heap_admits_session(fd)) {
+    return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+  }
+  return 0;
+}
+#endif
+
 // SSL Configuration Function
 httpd_ssl_config_t get_ssl_config(void) {
     httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
@@ -259,8 +1287,12 @@ httpd_ssl_config_t get_ssl_config(void) {
     ssl_config.prvtkey_len = key_pem_end - key_pem_start;
     ssl_config.port_secure = 443;
     ssl_config.transport_mode = HTTPD_SSL_TRANSPORT_SECURE;
-    ssl_config.httpd.max_uri_handlers = 12;
-    ssl_config.httpd.max_open_sockets = 6;
+    ssl_config.httpd.max_uri_handlers = HTTPS_MAX_URI_HANDLERS;
+    ssl_config.httpd.max_open_sockets = HTTPS_MAX_OPEN_SOCKETS;
+    // httpd's own purge would drop the LRU session even mid-use and without
+    // a trace; the session hooks make room instead
+    ssl_config.httpd.lru_purge_enable = false;
+    ssl_config.httpd.uri_match_fn = httpd_uri_match_wildcard; // For the "/*" asset route
     ssl_config.httpd.recv_wait_timeout = 10;
     ssl_config.httpd.send_wait_timeout = 10;
     ssl_config.httpd.keep_alive_enable = true;
@@ -270,43 +1302,125 @@ httpd_ssl_config_t get_ssl_config(void) {
      // Advanced Features
     ssl_config.session_tickets = true;  // Enable session tickets
     ssl_config.user_cb = https_server_user_callback;
+#ifdef CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+    ssl_config.cert_select_cb = admit_handshake;
+#endif
 
 
     return ssl_config;
 }
 // Start HTTPS Server
+// Common entry for all URI handlers; user_ctx is the registered table entry.
+// Handlers run inside the request arena, released once they return.
+static esp_err_t dispatch_request(httpd_req_t *req) {
+  const httpd_uri_t *uri = req->user_ctx;
+  int fd = httpd_req_to_sockfd(req);
+  session_table_note_request(fd);
+  uint32_t retry_ms;
+  if (!rate_limit_take(RATE_LIMIT_REQUEST, fd, &retry_ms)) {
+    // Refused before the handler, and before any body is read or memory taken
+    char retry_s[12];
+    snprintf(retry_s, sizeof(retry_s), "%" PRIu32, (retry_ms + 999) / 1000);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry_s);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, "Too many requests", HTTPD_RESP_USE_STRLEN);
+  }
+  bool arena = req_arena_begin();
+  esp_err_t err = uri->handler(req);
+  if (arena) {
+    req_arena_end();
+  }
+  session_table_note_done(fd);
+  return err;
+}
+
+// Runs on the httpd task, between requests and session events, so a picked
+// fd cannot be closed and reused before the close is queued
+static void reap_idle_sessions(void *arg) {
+  httpd_handle_t server = arg;
+  int fds[HTTPS_MAX_OPEN_SOCKETS];
+  int64_t idle_since = esp_timer_get_time() - (int64_t)CONFIG_HTTPS_IDLE_TIMEOUT_S * 1000000;
+  size_t n = session_table_collect_idle(idle_since, fds, HTTPS_MAX_OPEN_SOCKETS);
+  for (size_t i = 0; i < n; i++) {
+    ESP_LOGI(TAG, "Closing fd %d, idle for over %ds", fds[i], CONFIG_HTTPS_IDLE_TIMEOUT_S);
+    httpd_sess_trigger_close(server, fds[i]);
+  }
+}
+
+static void reaper_timer_cb(void *arg) {
+  httpd_queue_work(arg, reap_idle_sessions, arg);
+}
+
 httpd_handle_t start_https_server(void) {
   httpd_handle_t server = NULL;
   httpd_ssl_config_t ssl_config = get_ssl_config();
+  const rate_limit_bucket_cfg_t limits[RATE_LIMIT_KINDS] = {
+      [RATE_LIMIT_CONNECT] = {CONFIG_HTTPS_CONN_BURST, CONFIG_HTTPS_CONN_PER_MIN},
+      [RATE_LIMIT_REQUEST] = {CONFIG_HTTPS_REQ_BURST, CONFIG_HTTPS_REQ_PER_MIN},
+  };
+  rate_limit_init(limits);
 
   ESP_LOGI(TAG, "Starting server on port: '%d'", ssl_config.port_secure);
+  task_profiler_declare_stack("httpd", ssl_config.httpd.stack_size);
 
   esp_err_t ret = httpd_ssl_start(&server, &ssl_config);
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "Failed to start HTTPS server: %s", esp_err_to_name(ret));
     return NULL;
   }
+  s_server = server;
+  taskENTER_CRITICAL(&s_upload_lock);
+  for (int i = 0; i < HTTPS_MAX_SESSIONS; i++) {
+    s_upload_fds[i] = -1;
+  }
+  s_uploads_closed = false;
+  taskEXIT_CRITICAL(&s_upload_lock);
+
+  if (CONFIG_HTTPS_IDLE_TIMEOUT_S > 0) {
+    const esp_timer_create_args_t reaper_args = {
+        .callback = reaper_timer_cb,
+        .arg = server,
+        .name = "https_reaper",
+    };
+    // Sessions go between one and one and a half timeouts after their last request
+    if (esp_timer_create(&reaper_args, &s_reaper) == ESP_OK) {
+      esp_timer_start_periodic(s_reaper, (uint64_t)CONFIG_HTTPS_IDLE_TIMEOUT_S * 1000000 / 2);
+    }
+  }
 
- httpd_uri_t uri_handlers[] = {
-        {.uri = "/", .method = HTTP_GET, .handler = handle_index},
-        {.uri = "/index.html", .method = HTTP_GET, .handler = handle_index},
-        {.uri = "/status.html", .method = HTTP_GET, .handler = handle_status},
-        {.uri = "/clients.html", .method = HTTP_GET, .handler = handle_clients},
-        {.uri = "/settings.html", .method = HTTP_GET, .handler = handle_settings},
-        {.uri = "/led_control.html", .method = HTTP_GET, .handler = handle_led_control}, 
-        {.uri = "/css/styles.css", .method = HTTP_GET, .handler = handle_css},
-        {.uri = "/js/app.js", .method = HTTP_GET, .handler = handle_js},
+ static const httpd_uri_t uri_handlers[] = {
         {.uri = "/api/system_info", .method = HTTP_GET, .handler = system_info_handler},
         {.uri = "/api/wifi_status", .method = HTTP_GET, .handler = wifi_status_handler},
         {.uri = "/api/clients", .method = HTTP_GET, .handler = clients_handler},
+        {.uri = "/api/boot", .method = HTTP_GET, .handler = boot_handler},
+        {.uri = "/api/heap", .method = HTTP_GET, .handler = heap_handler},
+        {.uri = "/api/tasks", .method = HTTP_GET, .handler = tasks_handler},
+        {.uri = "/api/log", .method = HTTP_GET, .handler = log_handler},
+        {.uri = "/api/ingest", .method = HTTP_GET, .handler = ingest_handler},
+        {.uri = "/api/ingest/sim", .method = HTTP_POST, .handler = ingest_sim_handler},
+        {.uri = "/api/ingest/report", .method = HTTP_POST, .handler = ingest_report_handler},
+        {.uri = "/api/uplink", .method = HTTP_GET, .handler = uplink_handler},
         {.uri = "/api/resource", .method = HTTP_GET, .handler = example_uri_handler},
         {.uri = "/api/led/on", .method = HTTP_POST, .handler = led_on_handler},
         {.uri = "/api/led/off", .method = HTTP_POST, .handler = led_off_handler},
         {.uri = "/api/led/brightness", .method = HTTP_POST, .handler = led_brightness_handler},
+        {.uri = "/api/www", .method = HTTP_GET, .handler = www_info_handler},
+        {.uri = "/api/www", .method = HTTP_POST, .handler = www_upload_handler},
+        {.uri = "/api/settings", .method = HTTP_GET, .handler = settings_get_handler},
+        {.uri = "/api/settings", .method = HTTP_PUT, .handler = settings_put_handler},
+        {.uri = "/api/ota", .method = HTTP_GET, .handler = ota_info_handler},
+        {.uri = "/api/ota", .method = HTTP_POST, .handler = ota_upload_handler},
+        // Matched in order, so the asset catch-all must stay last
+        {.uri = "/*", .method = HTTP_GET, .handler = asset_handler},
     };
   
   for (int i = 0; i < sizeof(uri_handlers) / sizeof(uri_handlers[0]); i++) {
-    httpd_register_uri_handler(server, &uri_handlers[i]);
+    // Every request goes through dispatch_request for per-session accounting
+    httpd_uri_t uri = uri_handlers[i];
+    uri.handler = dispatch_request;
+    uri.user_ctx = (void *)&uri_handlers[i];
+    httpd_register_uri_handler(server, &uri);
   }
 
   ESP_LOGI(TAG, "HTTPS server started successfully");
@@ -319,6 +1433,36 @@ void stop_https_server(httpd_handle_t server) {
     return;
   }
 
+  if (s_reaper) {
+    esp_timer_stop(s_reaper);
+    esp_timer_delete(s_reaper);
+    s_reaper = NULL;
+  }
+  // Upload tasks hold requests the server would free under them: cut off
+  // their sockets so their reads fail, and wait for them to hand back
+  int fds[HTTPS_MAX_SESSIONS];
+  taskENTER_CRITICAL(&s_upload_lock);
+  s_uploads_closed = true;
+  memcpy(fds, s_upload_fds, sizeof(fds));
+  taskEXIT_CRITICAL(&s_upload_lock);
+  for (int i = 0; i < HTTPS_MAX_SESSIONS; i++) {
+    if (fds[i] >= 0) {
+      ESP_LOGI(TAG, "Aborting upload on socket %d", fds[i]);
+      shutdown(fds[i], SHUT_RDWR);
+    }
+  }
+  for (bool busy = true; busy;) {
+    busy = false;
+    taskENTER_CRITICAL(&s_upload_lock);
+    for (int i = 0; i < HTTPS_MAX_SESSIONS; i++) {
+      busy |= s_upload_fds[i] >= 0;
+    }
+    taskEXIT_CRITICAL(&s_upload_lock);
+    if (busy) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+  s_server = NULL;
   httpd_ssl_stop(server);
   ESP_LOGI(TAG, "HTTPS server stopped.");
 }
@@ -333,6 +1477,9 @@ void https_connect_handler(void *arg, esp_event_base_t event_base,
         *server_handle = start_https_server();
         if (*server_handle) {
             ESP_LOGI(TAG, "HTTPS server started successfully.");
+            boot_mark("https_serving");
+            // Serving again means this image can take the next update
+            ota_update_mark_valid();
             set_led_state(LED_STATE_WEBSERVER_RUNNING); // Update LED
         } else {
             ESP_LOGE(TAG, "Failed to start HTTPS server. Retrying...");
@@ -341,6 +1488,7 @@ void https_connect_handler(void *arg, esp_event_base_t event_base,
             *server_handle = start_https_server();
             if (*server_handle) {
                 ESP_LOGI(TAG, "HTTPS server recovered successfully.");
+                ota_update_mark_valid();
                 set_led_state(LED_STATE_WEBSERVER_RUNNING);
             } else {
                 ESP_LOGE(TAG, "Retry failed. Server remains stopped.");
@@ -383,23 +1531,23 @@ void https_server_event_handler(void *arg, esp_event_base_t event_base, int32_t
                 break;
 
             case HTTPS_SERVER_EVENT_ON_CONNECTED:
-                ESP_LOGI("HTTPS_SERVER", "Client connected.");
+                BINLOG_I("HTTPS_SERVER", "Client connected.");
                 // Optionally blink the LED briefly to indicate a new connection
                 set_led_state(LED_STATE_CLIENT_CONNECTED);
                 break;
 
             case HTTPS_SERVER_EVENT_ON_DATA:
-                ESP_LOGI("HTTPS_SERVER", "Data received.");
+                BINLOG_I("HTTPS_SERVER", "Data received.");
                 // Add additional LED indications or processing logic if needed
                 break;
 
             case HTTPS_SERVER_EVENT_SENT_DATA:
-                ESP_LOGI("HTTPS_SERVER", "Data sent to client.");
+                BINLOG_I("HTTPS_SERVER", "Data sent to client.");
                 // You can add specific LED indication for data sent if necessary
                 break;
 
             case HTTPS_SERVER_EVENT_DISCONNECTED:
-                ESP_LOGI("HTTPS_SERVER", "Client disconnected.");
+                BINLOG_I("HTTPS_SERVER", "Client disconnected.");
                set_led_state(LED_STATE_WEBSERVER_RUNNING); // Revert to running state
                 break;
 
@@ -451,33 +1599,34 @@ static const char* get_tls_version_string(esp_tls_proto_ver_t version) {
 static void print_peer_cert_info(const mbedtls_ssl_context *ssl)
 {
     const mbedtls_x509_crt *cert;
-    const size_t buf_size = 1024;
-    char *buf = calloc(buf_size, sizeof(char));
+    const size_t buf_size = HEAP_SCRATCH_SIZE;
+    char *buf = heap_monitor_scratch_alloc();
     if (buf == NULL) {
-        ESP_LOGE(TAG, "Out of memory - Callback execution failed!");
+        ESP_LOGW(TAG, "No scratch buffer free, skipping the peer certificate dump");
         return;
     }
 
     // Logging the peer certificate info
     cert = mbedtls_ssl_get_peer_cert(ssl);
     if (cert != NULL) {
+        buf[0] = '\0';
         mbedtls_x509_crt_info((char *) buf, buf_size - 1, "    ", cert);
         ESP_LOGI(TAG, "Peer certificate info:\n%s", buf);
     } else {
         ESP_LOGW(TAG, "Could not obtain the peer certificate!");
     }
 
-    free(buf);
+    heap_monitor_scratch_free(buf);
 }
 static void https_server_user_callback(esp_https_server_user_cb_arg_t *user_cb) {
     // Log the session creation or closure
-     ESP_LOGI(TAG, "User callback invoked!");
+     BINLOG_I(TAG, "User callback invoked!");
 #ifdef CONFIG_ESP_TLS_USING_MBEDTLS
     mbedtls_ssl_context *ssl_ctx = NULL;
 #endif
     switch(user_cb->user_cb_state) {
         case HTTPD_SSL_USER_CB_SESS_CREATE:
-            ESP_LOGD(TAG, "At session creation");
+            BINLOG_D(TAG, "At session creation");
 
             // Logging the socket FD
             int sockfd = -1;
@@ -487,20 +1636,49 @@ static void https_server_user_callback(esp_https_server_user_cb_arg_t *user_cb)
                 ESP_LOGE(TAG, "Error in obtaining the sockfd from tls context");
                 break;
             }
-            ESP_LOGI(TAG, "Socket FD: %d", sockfd);
+            BINLOG_I(TAG, "Socket FD: %d", sockfd);
+            const char *cipher = NULL;
 #ifdef CONFIG_ESP_TLS_USING_MBEDTLS
             ssl_ctx = (mbedtls_ssl_context *) esp_tls_get_ssl_context(user_cb->tls);
             if (ssl_ctx == NULL) {
                 ESP_LOGE(TAG, "Error in obtaining ssl context");
+            } else {
+                // Logging the current ciphersuite
+                cipher = mbedtls_ssl_get_ciphersuite(ssl_ctx);
+                BINLOG_I(TAG, "Current Ciphersuite: %s", cipher);
+            }
+#endif
+#ifndef CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+            // Without the ClientHello hook the best left is not to keep the session
+            if (!rate_limit_take(RATE_LIMIT_CONNECT, sockfd, NULL)) {
+                BINLOG_W(TAG, "Session on fd %d closed, connection rate exceeded", sockfd);
+                if (s_server) {
+                    httpd_sess_trigger_close(s_server, sockfd);
+                }
+                break;
+            }
+            if (!heap_admits_session(sockfd)) {
+                if (s_server) {
+                    httpd_sess_trigger_close(s_server, sockfd);
+                }
                 break;
             }
-            // Logging the current ciphersuite
-            ESP_LOGI(TAG, "Current Ciphersuite: %s", mbedtls_ssl_get_ciphersuite(ssl_ctx));
 #endif
+            int victim = session_table_admit(sockfd, cipher, HTTPS_MAX_SESSIONS,
+                                             (int64_t)CONFIG_HTTPS_EVICT_MIN_IDLE_MS * 1000);
+            if (victim >= 0 && s_server) {
+                ESP_LOGI(TAG, "Sessions full: %s fd %d", victim == sockfd ? "refusing" : "evicting", victim);
+                httpd_sess_trigger_close(s_server, victim);
+            }
             break;
 
         case HTTPD_SSL_USER_CB_SESS_CLOSE:
-            ESP_LOGD(TAG, "At session close");
+            BINLOG_D(TAG, "At session close");
+            int close_fd = -1;
+            // The callback argument holds the context const; the getter only reads it
+            if (esp_tls_get_conn_sockfd((esp_tls_t *)user_cb->tls, &close_fd) == ESP_OK) {
+                session_table_close(close_fd);
+            }
 #ifdef CONFIG_ESP_TLS_USING_MBEDTLS
             // Logging the peer certificate
             ssl_ctx = (mbedtls_ssl_context *) esp_tls_get_ssl_context(user_cb->tls);
@@ -0,0 +1,435 @@
+#include "ingest.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "log_store.h"
+#include "tsdb.h"
+#include "task_profiler.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "INGEST";
+
+#define DISPATCH_TASK_STACK_SIZE 4096
+
+// ring_create() only takes power-of-two capacities
+_Static_assert((CONFIG_INGEST_QUEUE_LEN & (CONFIG_INGEST_QUEUE_LEN - 1)) == 0,
+               "CONFIG_INGEST_QUEUE_LEN must be a power of two");
+#define SERIES_NAMESPACE "ingest"
+#define SERIES_KEY "series"
+
+// 802.15.4 frame control field
+#define FCF_TYPE_MASK 0x0007
+#define FCF_TYPE_DATA 0x0001
+#define FCF_SECURITY 0x0008
+#define FCF_PANID_COMPRESSION 0x0040
+#define FCF_SEQ_SUPPRESSION 0x0100
+#define FCF_DST_MODE(fcf) (((fcf) >> 10) & 3)
+#define FCF_VERSION(fcf) (((fcf) >> 12) & 3)
+#define FCF_SRC_MODE(fcf) (((fcf) >> 14) & 3)
+#define ADDR_MODE_SHORT 2
+#define ADDR_MODE_EXTENDED 3
+#define FCS_SIZE 2
+
+typedef struct {
+    atomic_uint_fast32_t frames;
+    atomic_uint_fast32_t bytes;
+    atomic_uint_fast32_t records;
+    atomic_uint_fast32_t parse_errors;
+    atomic_uint_fast32_t queue_drops;
+} source_counters_t;
+
+typedef struct {
+    const char *name;
+    ingest_consume_fn_t fn;
+    void *ctx;
+    uint32_t records;
+    uint32_t batches;
+    uint32_t drops;
+} consumer_t;
+
+// Which tsdb series holds a sensor's readings of one kind. Persisted so
+// series numbers stay stable across reboots.
+typedef struct {
+    uint32_t sensor_id;
+    uint8_t kind;
+    uint8_t used;
+} series_map_t;
+
+static const char *const source_names[INGEST_SRC_COUNT] = {
+    [INGEST_SRC_SIM] = "sim",
+    [INGEST_SRC_UDP] = "udp",
+    [INGEST_SRC_802154] = "802154",
+    [INGEST_SRC_COAP] = "coap",
+    [INGEST_SRC_HTTPS] = "https",
+};
+
+static ring_t *s_ring;
+static source_counters_t s_sources[INGEST_SRC_COUNT];
+static consumer_t s_consumers[INGEST_MAX_CONSUMERS];
+static atomic_size_t s_consumer_count;
+
+// Dispatcher counters, written by the dispatcher task only
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_dispatched;
+static uint32_t s_batches;
+static uint32_t s_queue_peak;
+static uint32_t s_in_per_s;
+static uint32_t s_out_per_s;
+
+static series_map_t s_series[CONFIG_TSDB_MAX_SERIES];
+static uint32_t s_tsdb_unmapped;
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline float get_lef32(const uint8_t *p) {
+    uint32_t bits = get_le32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Nothing sets the clock, so after a reset it starts over near zero, behind
+// the samples tsdb kept from before, and tsdb rejects anything older than
+// those. Until the clock catches up, time runs on from the newest stored
+// sample with the uptime.
+static int64_t s_ts_floor_ms;   // Less the uptime at ingest_init()
+
+static int64_t now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t wall = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    int64_t floor = s_ts_floor_ms + esp_timer_get_time() / 1000;
+    return wall > floor ? wall : floor;
+}
+
+const char *ingest_source_name(ingest_source_id_t src) {
+    return src < INGEST_SRC_COUNT ? source_names[src] : "?";
+}
+
+// Validates the report and queues one record per reading, straight from the
+// frame buffer
+static esp_err_t parse_report(ingest_source_id_t src, const uint8_t *data, size_t len, uint32_t sender) {
+    if (len < INGEST_REPORT_HDR_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (data[0] != INGEST_REPORT_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    uint8_t count = data[1];
+    if (count == 0 || count > INGEST_MAX_READINGS ||
+        len < INGEST_REPORT_HDR_SIZE + (size_t)count * INGEST_READING_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ingest_record_t rec = {
+        .ts_ms = now_ms(),
+        .seq = get_le16(data + 2),
+        .sensor_id = get_le32(data + 4),
+        .source = (uint8_t)src,
+    };
+    if (rec.sensor_id == 0) {
+        rec.sensor_id = sender;
+    }
+    ingest_record_t recs[INGEST_MAX_READINGS];
+    const uint8_t *reading = data + INGEST_REPORT_HDR_SIZE;
+    for (uint8_t i = 0; i < count; i++, reading += INGEST_READING_SIZE) {
+        recs[i] = rec;
+        recs[i].kind = reading[0];
+        recs[i].value = get_lef32(reading + 1);
+    }
+    uint32_t dropped = count - (uint32_t)ring_push(s_ring, recs, count);
+    source_counters_t *c = &s_sources[src];
+    atomic_fetch_add_explicit(&c->records, count - dropped, memory_order_relaxed);
+    if (dropped) {
+        atomic_fetch_add_explicit(&c->queue_drops, dropped, memory_order_relaxed);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t submit_checked(ingest_source_id_t src, size_t len) {
+    if (src >= INGEST_SRC_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_ring == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    source_counters_t *c = &s_sources[src];
+    atomic_fetch_add_explicit(&c->frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->bytes, len, memory_order_relaxed);
+    return ESP_OK;
+}
+
+static void count_error(ingest_source_id_t src, esp_err_t err) {
+    if (err != ESP_OK && err != ESP_ERR_NO_MEM) {
+        atomic_fetch_add_explicit(&s_sources[src].parse_errors, 1, memory_order_relaxed);
+    }
+}
+
+esp_err_t ingest_submit_report(ingest_source_id_t src, const uint8_t *data, size_t len, uint32_t sender) {
+    esp_err_t err = submit_checked(src, len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = parse_report(src, data, len, sender);
+    count_error(src, err);
+    return err;
+}
+
+static size_t addr_size(int mode) {
+    return mode == ADDR_MODE_SHORT ? 2 : mode == ADDR_MODE_EXTENDED ? 8 : 0;
+}
+
+// Walks the MAC header to the payload. The radio has already checked the
+// FCS, so it is only stripped.
+static esp_err_t parse_802154(const uint8_t *frame, size_t len, ingest_source_id_t src) {
+    if (len < 3 + FCS_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint16_t fcf = get_le16(frame);
+    if ((fcf & FCF_TYPE_MASK) != FCF_TYPE_DATA || (fcf & FCF_SECURITY)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    int dst_mode = FCF_DST_MODE(fcf);
+    int src_mode = FCF_SRC_MODE(fcf);
+    if (dst_mode == 1 || src_mode == 1) {
+        return ESP_ERR_INVALID_ARG;   // Reserved addressing mode
+    }
+    size_t pos = 2;
+    if (!(FCF_VERSION(fcf) == 2 && (fcf & FCF_SEQ_SUPPRESSION))) {
+        pos++;
+    }
+    if (dst_mode) {
+        pos += 2 + addr_size(dst_mode);
+    }
+    uint32_t sender = 0;
+    if (src_mode) {
+        if (!(fcf & FCF_PANID_COMPRESSION) || !dst_mode) {
+            pos += 2;
+        }
+        if (pos + addr_size(src_mode) > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        // Extended addresses are sent least significant byte first too
+        sender = src_mode == ADDR_MODE_SHORT ? get_le16(frame + pos) : get_le32(frame + pos);
+        pos += addr_size(src_mode);
+    }
+    if (pos + FCS_SIZE > len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return parse_report(src, frame + pos, len - pos - FCS_SIZE, sender);
+}
+
+esp_err_t ingest_submit_802154(ingest_source_id_t src, const uint8_t *frame, size_t len) {
+    esp_err_t err = submit_checked(src, len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = parse_802154(frame, len, src);
+    count_error(src, err);
+    return err;
+}
+
+esp_err_t ingest_add_consumer(const char *name, ingest_consume_fn_t fn, void *ctx) {
+    if (fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_stats_lock);
+    size_t n = atomic_load(&s_consumer_count);
+    if (n >= INGEST_MAX_CONSUMERS) {
+        taskEXIT_CRITICAL(&s_stats_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_consumers[n] = (consumer_t){.name = name, .fn = fn, .ctx = ctx};
+    // Publish the entry before the dispatcher can see the new count
+    atomic_store_explicit(&s_consumer_count, n + 1, memory_order_release);
+    taskEXIT_CRITICAL(&s_stats_lock);
+    return ESP_OK;
+}
+
+static void load_series_map(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(SERIES_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t len = sizeof(s_series);
+    if (nvs_get_blob(nvs, SERIES_KEY, s_series, &len) != ESP_OK || len != sizeof(s_series)) {
+        memset(s_series, 0, sizeof(s_series));
+    }
+    nvs_close(nvs);
+}
+
+static void save_series_map(void) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SERIES_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, SERIES_KEY, s_series, sizeof(s_series));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save the series map: %s", esp_err_to_name(err));
+    }
+}
+
+// First come, first served: a new (sensor, kind) pair takes the next free
+// series until they run out
+static int series_for(uint32_t sensor_id, uint8_t kind) {
+    for (int i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        series_map_t *m = &s_series[i];
+        if (!m->used) {
+            *m = (series_map_t){.sensor_id = sensor_id, .kind = kind, .used = 1};
+            ESP_LOGI(TAG, "Sensor %08" PRIx32 " kind %u -> tsdb series %d", sensor_id, kind, i);
+            save_series_map();
+            return i;
+        }
+        if (m->sensor_id == sensor_id && m->kind == kind) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static size_t storage_consume(const ingest_record_t *records, size_t count, void *ctx) {
+    size_t stored = 0;
+    for (size_t i = 0; i < count; i++) {
+        const ingest_record_t *r = &records[i];
+        int series = series_for(r->sensor_id, r->kind);
+        if (series < 0) {
+            s_tsdb_unmapped++;
+            continue;
+        }
+        if (tsdb_append((uint8_t)series, r->ts_ms, r->value) == ESP_OK) {
+            stored++;
+        }
+    }
+#if CONFIG_INGEST_ARCHIVE
+    _Static_assert(INGEST_BATCH_MAX * sizeof(ingest_record_t) <= LOG_STORE_MAX_RECORD_SIZE,
+                   "a batch must fit in one log_store record");
+    log_store_append(records, count * sizeof(*records));
+#endif
+    return stored;
+}
+
+static uint32_t source_records(void) {
+    uint32_t total = 0;
+    for (int i = 0; i < INGEST_SRC_COUNT; i++) {
+        total += atomic_load_explicit(&s_sources[i].records, memory_order_relaxed);
+    }
+    return total;
+}
+
+static void dispatch_task(void *arg) {
+    static ingest_record_t batch[INGEST_BATCH_MAX];
+    int64_t window_start = esp_timer_get_time();
+    uint32_t in_mark = source_records();
+    uint32_t out_mark = 0;
+
+    while (1) {
+        size_t n = ring_pop_wait(s_ring, batch, INGEST_BATCH_MAX, pdMS_TO_TICKS(1000));
+        uint32_t depth = n + ring_count(s_ring);
+
+        size_t consumers = atomic_load_explicit(&s_consumer_count, memory_order_acquire);
+        for (size_t i = 0; i < consumers && n > 0; i++) {
+            consumer_t *c = &s_consumers[i];
+            size_t accepted = c->fn(batch, n, c->ctx);
+            if (accepted > n) {
+                accepted = n;
+            }
+            taskENTER_CRITICAL(&s_stats_lock);
+            c->records += accepted;
+            c->drops += n - accepted;
+            c->batches++;
+            taskEXIT_CRITICAL(&s_stats_lock);
+        }
+
+        int64_t now = esp_timer_get_time();
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_dispatched += n;
+        s_batches += n > 0;
+        if (depth > s_queue_peak) {
+            s_queue_peak = depth;
+        }
+        if (now - window_start >= 1000000) {
+            uint32_t in = source_records();
+            s_in_per_s = (uint32_t)((uint64_t)(in - in_mark) * 1000000 / (now - window_start));
+            s_out_per_s = (uint32_t)((uint64_t)(s_dispatched - out_mark) * 1000000 / (now - window_start));
+            in_mark = in;
+            out_mark = s_dispatched;
+            window_start = now;
+        }
+        taskEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+void ingest_get_stats(ingest_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < INGEST_SRC_COUNT; i++) {
+        const source_counters_t *c = &s_sources[i];
+        ingest_source_stats_t *s = &stats->sources[i];
+        s->frames = atomic_load_explicit(&c->frames, memory_order_relaxed);
+        s->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+        s->records = atomic_load_explicit(&c->records, memory_order_relaxed);
+        s->parse_errors = atomic_load_explicit(&c->parse_errors, memory_order_relaxed);
+        s->queue_drops = atomic_load_explicit(&c->queue_drops, memory_order_relaxed);
+    }
+    taskENTER_CRITICAL(&s_stats_lock);
+    stats->consumer_count = atomic_load(&s_consumer_count);
+    for (size_t i = 0; i < stats->consumer_count; i++) {
+        const consumer_t *c = &s_consumers[i];
+        stats->consumers[i] = (ingest_consumer_stats_t){
+            .name = c->name,
+            .records = c->records,
+            .batches = c->batches,
+            .drops = c->drops,
+        };
+    }
+    stats->dispatched = s_dispatched;
+    stats->batches = s_batches;
+    stats->queue_peak = s_queue_peak;
+    stats->in_per_s = s_in_per_s;
+    stats->out_per_s = s_out_per_s;
+    stats->tsdb_unmapped = s_tsdb_unmapped;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    stats->queue_len = CONFIG_INGEST_QUEUE_LEN;
+    stats->queue_depth = s_ring ? ring_count(s_ring) : 0;
+    stats->sim_rate = ingest_sim_rate();
+}
+
+esp_err_t ingest_init(void) {
+    esp_err_t err = ring_create(RING_MPSC, sizeof(ingest_record_t), CONFIG_INGEST_QUEUE_LEN, &s_ring);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the record ring: %s", esp_err_to_name(err));
+        return err;
+    }
+    load_series_map();
+    s_ts_floor_ms = tsdb_last_ts() + 1 - esp_timer_get_time() / 1000;
+    err = ingest_add_consumer("storage", storage_consume, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    task_profiler_declare_stack("ingest", DISPATCH_TASK_STACK_SIZE);
+    if (xTaskCreate(dispatch_task, "ingest", DISPATCH_TASK_STACK_SIZE, NULL, 6, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the dispatcher task");
+        return ESP_ERR_NO_MEM;
+    }
+    err = ingest_sources_start();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Ingest ready: queue %d records, batches of %d", CONFIG_INGEST_QUEUE_LEN, INGEST_BATCH_MAX);
+    }
+    return err;
+}
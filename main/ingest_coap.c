@@ -0,0 +1,266 @@
+#include "ingest.h"
+#include "coap.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "task_profiler.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <string.h>
+
+static const char *TAG = "INGEST_COAP";
+
+#define COAP_TASK_STACK_SIZE 3072
+#define DEDUP_SLOTS 32
+#define MAX_PATH_LEN 32
+// Room for a full report with a token and a few options; anything that
+// fills the buffer may have been truncated
+#define MAX_DATAGRAM 256
+#define RESPONSE_SIZE 96
+
+static const char s_core_links[] = "</ingest>;rt=\"sensor-report\";ct=42";
+
+// Recent CON requests and their response codes, so a retransmission is
+// acknowledged again without being ingested twice
+typedef struct {
+    uint32_t addr;
+    uint16_t port;
+    uint16_t mid;
+    uint8_t code;
+    bool used;
+} dedup_entry_t;
+
+static dedup_entry_t s_dedup[DEDUP_SLOTS];
+static uint32_t s_dedup_next;
+static uint16_t s_next_mid;
+
+static struct {
+    atomic_uint requests;
+    atomic_uint confirmable;
+    atomic_uint duplicates;
+    atomic_uint pings;
+    atomic_uint format_errors;
+    atomic_uint rejected;
+    atomic_uint responses;
+} s_stats;
+
+static void count(atomic_uint *counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static dedup_entry_t *dedup_find(uint32_t addr, uint16_t port, uint16_t mid) {
+    for (int i = 0; i < DEDUP_SLOTS; i++) {
+        dedup_entry_t *e = &s_dedup[i];
+        if (e->used && e->mid == mid && e->port == port && e->addr == addr) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void dedup_add(uint32_t addr, uint16_t port, uint16_t mid, uint8_t code) {
+    s_dedup[s_dedup_next++ % DEDUP_SLOTS] = (dedup_entry_t){
+        .addr = addr,
+        .port = port,
+        .mid = mid,
+        .code = code,
+        .used = true,
+    };
+}
+
+// Routes a request and returns the response code. *format and *body are
+// set for responses that carry a payload.
+static uint8_t handle_request(const coap_msg_t *msg, uint32_t sender, int *format, const char **body) {
+    char path[MAX_PATH_LEN];
+    size_t path_len = 0;
+    bool path_too_long = false;
+    int content_format = COAP_FORMAT_NONE;
+
+    coap_option_iter_t it;
+    coap_option_t opt;
+    coap_option_iter_init(msg, &it);
+    while (coap_option_next(&it, &opt)) {
+        switch (opt.num) {
+        case COAP_OPT_URI_PATH:
+            if (path_len + 1 + opt.len >= sizeof(path)) {
+                path_too_long = true;
+                break;
+            }
+            path[path_len++] = '/';
+            memcpy(path + path_len, opt.value, opt.len);
+            path_len += opt.len;
+            break;
+        case COAP_OPT_CONTENT_FORMAT:
+            content_format = (int)coap_option_uint(&opt);
+            break;
+        case COAP_OPT_URI_HOST:
+        case COAP_OPT_URI_PORT:
+        case COAP_OPT_URI_QUERY:
+        case COAP_OPT_ACCEPT:
+            break;
+        default:
+            if (COAP_OPT_IS_CRITICAL(opt.num)) {
+                return COAP_CODE_BAD_OPTION;
+            }
+            break;
+        }
+    }
+    path[path_len] = '\0';
+    if (path_too_long) {
+        return COAP_CODE_NOT_FOUND;
+    }
+
+    if (strcmp(path, "/ingest") == 0) {
+        if (msg->code != COAP_CODE_POST) {
+            return COAP_CODE_METHOD_NOT_ALLOWED;
+        }
+        if (content_format != COAP_FORMAT_NONE && content_format != COAP_FORMAT_OCTET_STREAM) {
+            return COAP_CODE_UNSUPPORTED_FORMAT;
+        }
+        esp_err_t err = ingest_submit_report(INGEST_SRC_COAP, msg->payload, msg->payload_len, sender);
+        if (err == ESP_ERR_NO_MEM) {
+            return COAP_CODE_SERVICE_UNAVAILABLE;
+        }
+        return err == ESP_OK ? COAP_CODE_CHANGED : COAP_CODE_BAD_REQUEST;
+    }
+    if (strcmp(path, "/.well-known/core") == 0) {
+        if (msg->code != COAP_CODE_GET) {
+            return COAP_CODE_METHOD_NOT_ALLOWED;
+        }
+        *format = COAP_FORMAT_LINK;
+        *body = s_core_links;
+        return COAP_CODE_CONTENT;
+    }
+    return COAP_CODE_NOT_FOUND;
+}
+
+static void reply(int sock, const struct sockaddr_in *to, coap_type_t type, uint8_t code, uint16_t mid,
+                  const coap_msg_t *req, int format, const char *body) {
+    uint8_t out[RESPONSE_SIZE];
+    size_t len = coap_build(out, sizeof(out), type, code, mid, req->token, req->token_len, format, body,
+                            body ? strlen(body) : 0);
+    if (len && sendto(sock, out, len, 0, (const struct sockaddr *)to, sizeof(*to)) == (int)len) {
+        count(&s_stats.responses);
+    }
+}
+
+static void reset(int sock, const struct sockaddr_in *to, uint16_t mid) {
+    static const coap_msg_t empty;
+    reply(sock, to, COAP_TYPE_RST, COAP_CODE_EMPTY, mid, &empty, COAP_FORMAT_NONE, NULL);
+}
+
+static void handle_datagram(int sock, const uint8_t *buf, size_t len, const struct sockaddr_in *from) {
+    count(&s_stats.requests);
+    coap_msg_t msg;
+    esp_err_t err = coap_parse(buf, len, &msg);
+    if (err != ESP_OK || len >= MAX_DATAGRAM) {
+        // Other versions are ignored outright, as RFC 7252 asks
+        count(&s_stats.format_errors);
+        if (err == ESP_OK) {
+            if (msg.type == COAP_TYPE_CON) {
+                reply(sock, from, COAP_TYPE_ACK, COAP_CODE_TOO_LARGE, msg.mid, &msg, COAP_FORMAT_NONE, NULL);
+            }
+        } else if (err != ESP_ERR_INVALID_VERSION && len >= COAP_HDR_SIZE && msg.type == COAP_TYPE_CON) {
+            reset(sock, from, msg.mid);
+        }
+        return;
+    }
+    if (msg.type == COAP_TYPE_ACK || msg.type == COAP_TYPE_RST) {
+        return;   // The listener never sends anything that expects one
+    }
+    if (msg.code == COAP_CODE_EMPTY || COAP_CODE_CLASS(msg.code) != 0) {
+        if (msg.type == COAP_TYPE_CON) {
+            if (msg.code == COAP_CODE_EMPTY) {
+                count(&s_stats.pings);
+            }
+            reset(sock, from, msg.mid);
+        }
+        return;
+    }
+
+    uint32_t addr = ntohl(from->sin_addr.s_addr);
+    uint16_t port = ntohs(from->sin_port);
+    if (msg.type == COAP_TYPE_CON) {
+        count(&s_stats.confirmable);
+        const dedup_entry_t *seen = dedup_find(addr, port, msg.mid);
+        if (seen) {
+            count(&s_stats.duplicates);
+            reply(sock, from, COAP_TYPE_ACK, seen->code, msg.mid, &msg, COAP_FORMAT_NONE, NULL);
+            return;
+        }
+    }
+
+    int format = COAP_FORMAT_NONE;
+    const char *body = NULL;
+    uint8_t code = handle_request(&msg, addr, &format, &body);
+    bool rejected = COAP_CODE_CLASS(code) >= 4;
+    if (rejected) {
+        count(&s_stats.rejected);
+    }
+    if (msg.type == COAP_TYPE_CON) {
+        if (body == NULL) {
+            dedup_add(addr, port, msg.mid, code);
+        }
+        reply(sock, from, COAP_TYPE_ACK, code, msg.mid, &msg, format, body);
+    } else if (rejected || body) {
+        reply(sock, from, COAP_TYPE_NON, code, s_next_mid++, &msg, format, body);
+    }
+}
+
+static void coap_task(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    static uint8_t buf[MAX_DATAGRAM];
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            if (errno != EINTR) {
+                ESP_LOGW(TAG, "CoAP receive failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
+            continue;
+        }
+        handle_datagram(sock, buf, (size_t)len, &from);
+    }
+}
+
+esp_err_t ingest_coap_start(void) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create CoAP socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+    // No SO_REUSEADDR, as for the bare UDP listener
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_INGEST_COAP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind CoAP port %d: errno %d", CONFIG_INGEST_COAP_PORT, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+    s_next_mid = (uint16_t)esp_random();
+    task_profiler_declare_stack("ingest_coap", COAP_TASK_STACK_SIZE);
+    if (xTaskCreate(coap_task, "ingest_coap", COAP_TASK_STACK_SIZE, (void *)(intptr_t)sock, 5, NULL) != pdPASS) {
+        close(sock);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Listening for CoAP sensor reports on UDP port %d", CONFIG_INGEST_COAP_PORT);
+    return ESP_OK;
+}
+
+void ingest_coap_get_stats(ingest_coap_stats_t *stats) {
+    stats->requests = atomic_load_explicit(&s_stats.requests, memory_order_relaxed);
+    stats->confirmable = atomic_load_explicit(&s_stats.confirmable, memory_order_relaxed);
+    stats->duplicates = atomic_load_explicit(&s_stats.duplicates, memory_order_relaxed);
+    stats->pings = atomic_load_explicit(&s_stats.pings, memory_order_relaxed);
+    stats->format_errors = atomic_load_explicit(&s_stats.format_errors, memory_order_relaxed);
+    stats->rejected = atomic_load_explicit(&s_stats.rejected, memory_order_relaxed);
+    stats->responses = atomic_load_explicit(&s_stats.responses, memory_order_relaxed);
+}
@@ -0,0 +1,253 @@
+#include "ingest.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "task_profiler.h"
+#include "binlog.h"
+#include "ring.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#if CONFIG_INGEST_802154
+#include "esp_ieee802154.h"
+#endif
+
+static const char *TAG = "INGEST_SRC";
+
+#define SIM_TASK_STACK_SIZE 3072
+#define SIM_TICK_MS 10
+#define SIM_SHORT_ADDR_BASE 0x1000
+#define SIM_PANID 0x1a62
+#define UDP_TASK_STACK_SIZE 3072
+#define RADIO_TASK_STACK_SIZE 3072
+#define RADIO_RING_LEN 8
+#define MAX_REPORT_SIZE (INGEST_REPORT_HDR_SIZE + INGEST_MAX_READINGS * INGEST_READING_SIZE)
+
+static TaskHandle_t s_sim_task;
+static atomic_uint s_sim_rate;
+static atomic_uint s_sim_sensors = 1;
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_reading(uint8_t *p, uint8_t kind, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    p[0] = kind;
+    p[1] = (uint8_t)bits;
+    p[2] = (uint8_t)(bits >> 8);
+    p[3] = (uint8_t)(bits >> 16);
+    p[4] = (uint8_t)(bits >> 24);
+}
+
+// 2006 data frame, PAN ID compressed, short addresses, sensor id taken from
+// the source address. The FCS is left zero; the parser never checks it.
+static size_t build_sim_frame(uint8_t *f, uint32_t n, uint32_t sensors) {
+    uint16_t sensor = (uint16_t)(n % sensors);
+    float t = (float)(esp_timer_get_time() / 1000) / 1000.0f;
+    float phase = t * (2.0f * (float)M_PI / 600.0f) + sensor;
+
+    put_le16(f, 0x0001 | 0x0040 | 2 << 10 | 1 << 12 | 2 << 14);
+    f[2] = (uint8_t)n;
+    put_le16(f + 3, SIM_PANID);
+    put_le16(f + 5, 0x0000);
+    put_le16(f + 7, SIM_SHORT_ADDR_BASE + sensor);
+    uint8_t *report = f + 9;
+    report[0] = INGEST_REPORT_VERSION;
+    report[1] = 3;
+    put_le16(report + 2, (uint16_t)(n / sensors));
+    memset(report + 4, 0, 4);
+    uint8_t *reading = report + INGEST_REPORT_HDR_SIZE;
+    put_reading(reading, INGEST_KIND_TEMPERATURE, 21.0f + 3.0f * sinf(phase));
+    put_reading(reading + INGEST_READING_SIZE, INGEST_KIND_HUMIDITY, 45.0f + 10.0f * cosf(phase));
+    put_reading(reading + 2 * INGEST_READING_SIZE, INGEST_KIND_BATTERY, 3.0f - sensor * 0.01f);
+    size_t len = 9 + INGEST_REPORT_HDR_SIZE + 3 * INGEST_READING_SIZE;
+    put_le16(f + len, 0);
+    return len + 2;
+}
+
+// Sends whatever is due at the configured rate every tick, dropping the
+// backlog after a stall instead of bursting to catch up
+static void sim_task(void *arg) {
+    uint8_t frame[64];
+    uint32_t n = 0;
+    uint32_t rate = 0;
+    int64_t start = 0;
+    uint64_t sent = 0;
+
+    while (1) {
+        uint32_t want = atomic_load(&s_sim_rate);
+        if (want == 0) {
+            rate = 0;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (want != rate) {
+            rate = want;
+            start = esp_timer_get_time();
+            sent = 0;
+        }
+        uint64_t due = (uint64_t)(esp_timer_get_time() - start) * rate / 1000000;
+        uint64_t max_burst = rate / 10 + 1;
+        if (due - sent > max_burst) {
+            sent = due - max_burst;
+        }
+        uint32_t sensors = atomic_load(&s_sim_sensors);
+        for (; sent < due; sent++, n++) {
+            size_t len = build_sim_frame(frame, n, sensors);
+            ingest_submit_802154(INGEST_SRC_SIM, frame, len);
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_TICK_MS) ? pdMS_TO_TICKS(SIM_TICK_MS) : 1);
+    }
+}
+
+esp_err_t ingest_sim_set_rate(uint32_t frames_per_s, uint32_t sensors) {
+    if (frames_per_s > INGEST_SIM_RATE_MAX || sensors == 0 || sensors > INGEST_SIM_SENSORS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_sim_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store(&s_sim_sensors, sensors);
+    atomic_store(&s_sim_rate, frames_per_s);
+    xTaskNotifyGive(s_sim_task);
+    ESP_LOGI(TAG, "Simulated source: %" PRIu32 " frames/s over %" PRIu32 " sensors", frames_per_s, sensors);
+    return ESP_OK;
+}
+
+uint32_t ingest_sim_rate(void) {
+    return atomic_load(&s_sim_rate);
+}
+
+#if CONFIG_INGEST_UDP_PORT
+// Bare sensor reports, one per datagram; the sensor id defaults to the
+// sender's IPv4 address
+static void udp_task(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    static uint8_t buf[MAX_REPORT_SIZE];
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            if (errno != EINTR) {
+                ESP_LOGW(TAG, "UDP receive failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
+            continue;
+        }
+        ingest_submit_report(INGEST_SRC_UDP, buf, (size_t)len, ntohl(from.sin_addr.s_addr));
+    }
+}
+
+static esp_err_t udp_start(void) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create UDP socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+    // No SO_REUSEADDR: another listener on the port would take some of the
+    // datagrams, so a clash should fail here instead
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_INGEST_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind UDP port %d: errno %d", CONFIG_INGEST_UDP_PORT, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+    task_profiler_declare_stack("ingest_udp", UDP_TASK_STACK_SIZE);
+    if (xTaskCreate(udp_task, "ingest_udp", UDP_TASK_STACK_SIZE, (void *)(intptr_t)sock, 5, NULL) != pdPASS) {
+        close(sock);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Listening for sensor reports on UDP port %d", CONFIG_INGEST_UDP_PORT);
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_INGEST_802154
+// The driver's receive buffers are handed to the radio task as-is and only
+// released once parsed. The receive ISR is the ring's only producer.
+static ring_t *s_radio_ring;
+
+void esp_ieee802154_receive_done(uint8_t *frame, esp_ieee802154_frame_info_t *frame_info) {
+    BaseType_t woken = pdFALSE;
+    if (ring_push_from_isr(s_radio_ring, &frame, 1, &woken) == 0) {
+        esp_ieee802154_receive_handle_done(frame);
+        BINLOG_W(TAG, "802.15.4 frame dropped, radio ring full");
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+static void radio_task(void *arg) {
+    uint8_t *frames[RADIO_RING_LEN];
+    while (1) {
+        size_t n = ring_pop_wait(s_radio_ring, frames, RADIO_RING_LEN, portMAX_DELAY);
+        for (size_t i = 0; i < n; i++) {
+            // frame[0] is the PSDU length, FCS included
+            ingest_submit_802154(INGEST_SRC_802154, frames[i] + 1, frames[i][0]);
+            esp_ieee802154_receive_handle_done(frames[i]);
+        }
+    }
+}
+
+static esp_err_t radio_start(void) {
+    esp_err_t err = ring_create(RING_SPSC, sizeof(uint8_t *), RADIO_RING_LEN, &s_radio_ring);
+    if (err != ESP_OK) {
+        return err;
+    }
+    task_profiler_declare_stack("ingest_radio", RADIO_TASK_STACK_SIZE);
+    if (xTaskCreate(radio_task, "ingest_radio", RADIO_TASK_STACK_SIZE, NULL, 7, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = esp_ieee802154_enable();
+    if (err == ESP_OK) {
+        esp_ieee802154_set_channel(CONFIG_INGEST_802154_CHANNEL);
+        esp_ieee802154_set_panid(CONFIG_INGEST_802154_PANID);
+        esp_ieee802154_set_short_address(0x0000);
+        esp_ieee802154_set_rx_when_idle(true);
+        err = esp_ieee802154_receive();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the 802.15.4 radio: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Receiving on 802.15.4 channel %d, PAN 0x%04x", CONFIG_INGEST_802154_CHANNEL, CONFIG_INGEST_802154_PANID);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t ingest_sources_start(void) {
+    task_profiler_declare_stack("ingest_sim", SIM_TASK_STACK_SIZE);
+    if (xTaskCreate(sim_task, "ingest_sim", SIM_TASK_STACK_SIZE, NULL, 4, &s_sim_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (CONFIG_INGEST_SIM_RATE > 0) {
+        ingest_sim_set_rate(CONFIG_INGEST_SIM_RATE, CONFIG_INGEST_SIM_SENSORS);
+    }
+    esp_err_t err = ESP_OK;
+#if CONFIG_INGEST_UDP_PORT
+    err = udp_start();
+#endif
+#if CONFIG_INGEST_COAP_PORT
+    if (err == ESP_OK) {
+        err = ingest_coap_start();
+    }
+#endif
+#if CONFIG_INGEST_802154
+    if (err == ESP_OK) {
+        err = radio_start();
+    }
+#endif
+    return err;
+}
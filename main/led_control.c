@@ -1,4 +1,7 @@
 #include "led_control.h"
+#include "settings.h"
+#include "binlog.h"
+#include "task_profiler.h"
 #include "esp_log.h"
 #include "led_strip.h"
 #include "freertos/FreeRTOS.h"
@@ -7,6 +10,8 @@
 
 static const char *TAG = "LED_CONTROL";
 
+#define BLINK_TASK_STACK_SIZE 2048
+
 static led_strip_handle_t led_strip;
 static uint8_t brightness = 30; // Default brightness percentage (0-100)
 static TaskHandle_t blinking_task_handle = NULL;
@@ -20,7 +25,7 @@ static uint8_t scale_brightness(uint8_t color) {
 void configure_led() {
     ESP_LOGI(TAG, "Configuring LED strip...");
     led_strip_config_t strip_config = {
-        .strip_gpio_num = CONFIG_BLINK_GPIO,
+        .strip_gpio_num = settings_get_int(SETTING_LED_GPIO),
         .max_leds = 1, // Number of LEDs in the strip
     };
     led_strip_rmt_config_t rmt_config = {
@@ -30,43 +35,46 @@ void configure_led() {
     ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
     led_strip_clear(led_strip); // Clear the strip
     led_mutex = xSemaphoreCreateMutex();
+    task_profiler_declare_stack("blinking_task", BLINK_TASK_STACK_SIZE);
 }
-// Blinking task for specific states
+// Blinking task for specific states. Timings are shares of the
+// led_blink_ms setting, read each cycle so a change applies at once.
 static void blinking_task(void *state) {
     led_state_t led_state = (led_state_t)state;
 
     while (1) {
         uint8_t r = 0, g = 0, b = 0;
+        uint32_t period_ms = settings_get_int(SETTING_LED_BLINK_MS);
 
         if (led_state == LED_STATE_CONNECTING) {
             r = scale_brightness(255);
             g = scale_brightness(255);
             b = 0; // Yellow
-            ESP_LOGI(TAG, "Blinking yellow...");
-            vTaskDelay(pdMS_TO_TICKS(300)); // 300ms on
+            BINLOG_I(TAG, "Blinking yellow...");
+            vTaskDelay(pdMS_TO_TICKS(period_ms * 30 / 100)); // 300ms on at the default period
         } else if (led_state == LED_STATE_FAILED) {
             r = scale_brightness(255);
             g = 0;
             b = 0; // Red
-            ESP_LOGI(TAG, "Blinking red...");
-            vTaskDelay(pdMS_TO_TICKS(200)); // 200ms on
+            BINLOG_I(TAG, "Blinking red...");
+            vTaskDelay(pdMS_TO_TICKS(period_ms * 20 / 100)); // 200ms on at the default period
         } else if (led_state == LED_STATE_WEBSERVER_STARTING) {
             r = scale_brightness(128); // Purple (dim red + blue)
             g = 0;
             b = scale_brightness(255);
-            ESP_LOGI(TAG, "Blinking purple (webserver starting)...");
-            vTaskDelay(pdMS_TO_TICKS(500)); // 500ms on
+            BINLOG_I(TAG, "Blinking purple (webserver starting)...");
+            vTaskDelay(pdMS_TO_TICKS(period_ms * 50 / 100)); // 500ms on at the default period
         } else if (led_state == LED_STATE_CONNECTED_NO_IP) {
             r = 0;
             g = scale_brightness(255);
             b = scale_brightness(128); // Teal (green + dim blue)
-            ESP_LOGI(TAG, "Blinking teal (connected, no IP)...");
-            vTaskDelay(pdMS_TO_TICKS(400)); // 400ms on
+            BINLOG_I(TAG, "Blinking teal (connected, no IP)...");
+            vTaskDelay(pdMS_TO_TICKS(period_ms * 40 / 100)); // 400ms on at the default period
         }
 
         ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, 0, r, g, b));
         ESP_ERROR_CHECK(led_strip_refresh(led_strip));
-        vTaskDelay(pdMS_TO_TICKS(700)); // Off time
+        vTaskDelay(pdMS_TO_TICKS(period_ms * 70 / 100)); // Off time
         ESP_ERROR_CHECK(led_strip_clear(led_strip));
     }
 }
@@ -92,7 +100,7 @@ void set_led_state(led_state_t state) {
 
     switch (state) {
     case LED_STATE_OFF:
-            ESP_LOGI(TAG, "LED state: OFF");
+            BINLOG_I(TAG, "LED state: OFF");
             r = 0;
             g = 0;
             b = 0; // Off
@@ -101,7 +109,7 @@ void set_led_state(led_state_t state) {
             break;
 
         case LED_STATE_ON:
-            ESP_LOGI(TAG, "LED state: ON (steady white)");
+            BINLOG_I(TAG, "LED state: ON (steady white)");
             r = scale_brightness(255);
             g = scale_brightness(255);
             b = scale_brightness(255); // White
@@ -109,31 +117,31 @@ void set_led_state(led_state_t state) {
             ESP_ERROR_CHECK(led_strip_refresh(led_strip));
             break;
     case LED_STATE_CONNECTING:
-        ESP_LOGI(TAG, "LED state: CONNECTING (blinking yellow)");
-        xTaskCreatePinnedToCore(blinking_task, "blinking_task", 2048, (void *)state,
+        BINLOG_I(TAG, "LED state: CONNECTING (blinking yellow)");
+        xTaskCreatePinnedToCore(blinking_task, "blinking_task", BLINK_TASK_STACK_SIZE, (void *)state,
                                 5, &blinking_task_handle, 0);
         break;
 
     case LED_STATE_FAILED:
-        ESP_LOGI(TAG, "LED state: FAILED (blinking red)");
-        xTaskCreatePinnedToCore(blinking_task, "blinking_task", 2048, (void *)state,
+        BINLOG_I(TAG, "LED state: FAILED (blinking red)");
+        xTaskCreatePinnedToCore(blinking_task, "blinking_task", BLINK_TASK_STACK_SIZE, (void *)state,
                                 5, &blinking_task_handle, 0);
         break;
 
     case LED_STATE_WEBSERVER_STARTING:
-        ESP_LOGI(TAG, "LED state: WEBSERVER STARTING (blinking purple)");
-        xTaskCreatePinnedToCore(blinking_task, "blinking_task", 2048, (void *)state,
+        BINLOG_I(TAG, "LED state: WEBSERVER STARTING (blinking purple)");
+        xTaskCreatePinnedToCore(blinking_task, "blinking_task", BLINK_TASK_STACK_SIZE, (void *)state,
                                 5, &blinking_task_handle, 0);
         break;
 
     case LED_STATE_CONNECTED_NO_IP:
-        ESP_LOGI(TAG, "LED state: CONNECTED (no IP) - blinking teal");
-        xTaskCreatePinnedToCore(blinking_task, "blinking_task", 2048, (void *)state,
+        BINLOG_I(TAG, "LED state: CONNECTED (no IP) - blinking teal");
+        xTaskCreatePinnedToCore(blinking_task, "blinking_task", BLINK_TASK_STACK_SIZE, (void *)state,
                                 5, &blinking_task_handle, 0);
         break;
 
     case LED_STATE_CONNECTED:
-        ESP_LOGI(TAG, "LED state: CONNECTED (steady green)");
+        BINLOG_I(TAG, "LED state: CONNECTED (steady green)");
         r = 0;
         g = scale_brightness(255);
         b = 0; // Green
@@ -142,7 +150,7 @@ void set_led_state(led_state_t state) {
         break;
 // add  case for LED_STATE_CLIENT_CONNECTED
     case LED_STATE_CLIENT_CONNECTED:
-        ESP_LOGI(TAG, "LED state: CLIENT CONNECTED (steady cyan)");
+        BINLOG_I(TAG, "LED state: CLIENT CONNECTED (steady cyan)");
         r = 0;
         g = scale_brightness(255);
         b = scale_brightness(255); // Cyan
@@ -150,7 +158,7 @@ void set_led_state(led_state_t state) {
         ESP_ERROR_CHECK(led_strip_refresh(led_strip));
         break;
     case LED_STATE_WEBSERVER_RUNNING:
-        ESP_LOGI(TAG, "LED state: WEBSERVER RUNNING (steady white)");
+        BINLOG_I(TAG, "LED state: WEBSERVER RUNNING (steady white)");
         r = scale_brightness(255);
         g = scale_brightness(255);
         b = scale_brightness(255); // White
@@ -159,7 +167,7 @@ void set_led_state(led_state_t state) {
         break;
 
     case LED_STATE_WEBSERVER_STOPPED:
-        ESP_LOGI(TAG, "LED state: WEBSERVER STOPPED (steady blue)");
+        BINLOG_I(TAG, "LED state: WEBSERVER STOPPED (steady blue)");
         r = 0;
         g = 0;
         b = scale_brightness(255); // Blue
@@ -182,5 +190,5 @@ void set_brightness(uint8_t level) {
     if (level > 100)
         level = 100; // Clamp brightness to max 100%
     brightness = level;
-    ESP_LOGI(TAG, "Brightness set to %d%%", brightness);
+    BINLOG_I(TAG, "Brightness set to %d%%", brightness);
 }
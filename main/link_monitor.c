@@ -0,0 +1,166 @@
+#include "link_monitor.h"
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "LINK_MON";
+
+#define LINK_HISTORY_LEN CONFIG_LINK_MONITOR_HISTORY_LEN
+
+static link_sample_t s_ring[LINK_HISTORY_LEN];
+static size_t s_head;      // Next slot to write
+static size_t s_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Disconnects reported by the event loop since the last sample
+static uint8_t s_pending_disconnects;
+static uint32_t s_total_disconnects;
+static uint8_t s_last_reason;
+
+static void disconnect_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    const wifi_event_sta_disconnected_t *event = (const wifi_event_sta_disconnected_t *)event_data;
+    taskENTER_CRITICAL(&s_lock);
+    if (s_pending_disconnects < UINT8_MAX) {
+        s_pending_disconnects++;
+    }
+    s_total_disconnects++;
+    s_last_reason = event->reason;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static void take_sample(esp_netif_t *netif) {
+    link_sample_t sample = { .t_us = esp_timer_get_time() };
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        sample.rssi = ap_info.rssi;
+        sample.channel = ap_info.primary;
+        wifi_phy_mode_t mode;
+        if (esp_wifi_sta_get_negotiated_phymode(&mode) == ESP_OK) {
+            sample.phy_mode = (uint8_t)mode + 1;
+        }
+    }
+    esp_netif_ip_info_t ip_info;
+    if (netif && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) {
+        sample.ip = ip_info.ip.addr;
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    sample.disconnects = s_pending_disconnects;
+    sample.last_reason = s_pending_disconnects ? s_last_reason : 0;
+    s_pending_disconnects = 0;
+    s_ring[s_head] = sample;
+    s_head = (s_head + 1) % LINK_HISTORY_LEN;
+    if (s_count < LINK_HISTORY_LEN) {
+        s_count++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static void link_monitor_task(void *arg) {
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        take_sample(netif);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_LINK_MONITOR_INTERVAL_MS));
+    }
+}
+
+esp_err_t link_monitor_start(void) {
+    esp_err_t err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnect_handler, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    task_profiler_declare_stack("link_monitor", 3072);
+    if (xTaskCreate(link_monitor_task, "link_monitor", 3072, NULL, 3, NULL) != pdPASS) {
+        esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnect_handler);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Sampling every %d ms, %d samples of history",
+             CONFIG_LINK_MONITOR_INTERVAL_MS, LINK_HISTORY_LEN);
+    return ESP_OK;
+}
+
+esp_err_t link_monitor_get_latest(link_sample_t *out) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&s_lock);
+    if (s_count > 0) {
+        *out = s_ring[(s_head + LINK_HISTORY_LEN - 1) % LINK_HISTORY_LEN];
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+size_t link_monitor_get_history(link_point_t *out, size_t max_points) {
+    if (max_points == 0) {
+        return 0;
+    }
+    // Bucketing a few hundred samples is short enough to do under the lock
+    taskENTER_CRITICAL(&s_lock);
+    size_t count = s_count;
+    size_t first = (s_head + LINK_HISTORY_LEN - count) % LINK_HISTORY_LEN;
+    size_t points = count < max_points ? count : max_points;
+    for (size_t p = 0; p < points; p++) {
+        // Bucket p covers samples [start, end); sizes differ by at most one
+        size_t start = p * count / points;
+        size_t end = (p + 1) * count / points;
+        link_point_t point = { 0 };
+        int32_t rssi_sum = 0;
+        for (size_t i = start; i < end; i++) {
+            const link_sample_t *s = &s_ring[(first + i) % LINK_HISTORY_LEN];
+            point.samples++;
+            point.disconnects += s->disconnects;
+            point.t_us = s->t_us;
+            if (s->channel != 0) {
+                if (point.associated == 0 || s->rssi < point.rssi_min) {
+                    point.rssi_min = s->rssi;
+                }
+                point.associated++;
+                rssi_sum += s->rssi;
+            }
+        }
+        point.rssi_avg = point.associated ? (int8_t)(rssi_sum / point.associated) : 0;
+        out[p] = point;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return points;
+}
+
+uint32_t link_monitor_get_disconnects(uint8_t *last_reason) {
+    taskENTER_CRITICAL(&s_lock);
+    uint32_t count = s_total_disconnects;
+    if (last_reason) {
+        *last_reason = s_last_reason;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return count;
+}
+
+uint32_t link_monitor_phy_rate_kbps(uint8_t phy_mode) {
+    switch (phy_mode) {
+    case WIFI_PHY_MODE_LR + 1:   return 500;
+    case WIFI_PHY_MODE_11B + 1:  return 11000;
+    case WIFI_PHY_MODE_11G + 1:  return 54000;
+    case WIFI_PHY_MODE_HT20 + 1: return 72200;
+    case WIFI_PHY_MODE_HT40 + 1: return 150000;
+    case WIFI_PHY_MODE_HE20 + 1: return 143400;
+    default:                     return 0;
+    }
+}
+
+const char *link_monitor_phy_mode_str(uint8_t phy_mode) {
+    switch (phy_mode) {
+    case WIFI_PHY_MODE_LR + 1:   return "LR";
+    case WIFI_PHY_MODE_11B + 1:  return "11b";
+    case WIFI_PHY_MODE_11G + 1:  return "11g";
+    case WIFI_PHY_MODE_HT20 + 1: return "HT20";
+    case WIFI_PHY_MODE_HT40 + 1: return "HT40";
+    case WIFI_PHY_MODE_HE20 + 1: return "HE20";
+    default:                     return "none";
+    }
+}
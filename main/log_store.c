@@ -0,0 +1,349 @@
+#include "log_store.h"
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_littlefs.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *TAG = "LOG_STORE";
+
+// The host build points this at a directory relative to the working dir
+#ifndef LOG_STORE_BASE_PATH
+#define LOG_STORE_BASE_PATH "/data"
+#endif
+#define LOG_STORE_PARTITION "storage"
+#define SEGMENT_PATH_LEN 48
+
+#define RECORD_MAGIC 0x4C47 // "GL"
+
+// On-flash record header; crc covers len and the payload
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;
+} record_hdr_t;
+
+static SemaphoreHandle_t s_lock;
+static uint8_t s_buf[CONFIG_LOG_STORE_BUFFER_SIZE];
+static size_t s_buf_len;
+
+static FILE *s_seg_file;        // Segment being appended to
+static uint32_t s_first_seg;
+static uint32_t s_last_seg;
+static uint32_t s_seg_len;      // Bytes flushed to s_last_seg
+static uint32_t s_flush_gen;    // Bumped on every flush
+
+// Reader keeps its segment open between calls
+static FILE *s_read_file;
+static uint32_t s_read_seg;
+static uint32_t s_read_gen;
+
+static log_store_stats_t s_stats;
+
+static void segment_path(char *path, uint32_t seg) {
+    snprintf(path, SEGMENT_PATH_LEN, LOG_STORE_BASE_PATH "/%08" PRIx32 ".log", seg);
+}
+
+static uint32_t record_crc(const record_hdr_t *hdr, const void *data) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->len, sizeof(hdr->len));
+    return esp_rom_crc32_le(crc, data, hdr->len);
+}
+
+static void close_reader(void) {
+    if (s_read_file) {
+        fclose(s_read_file);
+        s_read_file = NULL;
+    }
+}
+
+static esp_err_t open_segment(uint32_t seg) {
+    char path[SEGMENT_PATH_LEN];
+    segment_path(path, seg);
+    s_seg_file = fopen(path, "ab");
+    if (s_seg_file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    s_last_seg = seg;
+    s_seg_len = 0;
+    return ESP_OK;
+}
+
+static esp_err_t rotate(void) {
+    if (s_seg_file) {
+        fclose(s_seg_file);
+        s_seg_file = NULL;
+    }
+    esp_err_t err = open_segment(s_last_seg + 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_stats.rotations++;
+    while (s_last_seg - s_first_seg + 1 > CONFIG_LOG_STORE_MAX_SEGMENTS) {
+        char path[SEGMENT_PATH_LEN];
+        segment_path(path, s_first_seg);
+        if (s_read_file && s_read_seg == s_first_seg) {
+            close_reader();
+        }
+        remove(path);
+        s_first_seg++;
+    }
+    return ESP_OK;
+}
+
+// Writes the buffer out in as few writes as segment boundaries allow.
+// Caller holds s_lock.
+static esp_err_t flush_locked(void) {
+    if (s_buf_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    size_t pos = 0;
+    while (pos < s_buf_len && err == ESP_OK) {
+        // Take whole records while they fit in the current segment
+        size_t end = pos;
+        while (end < s_buf_len) {
+            const record_hdr_t *hdr = (const record_hdr_t *)&s_buf[end];
+            size_t rec_len = sizeof(*hdr) + hdr->len;
+            if (s_seg_len + (end - pos) + rec_len > CONFIG_LOG_STORE_SEGMENT_SIZE) {
+                break;
+            }
+            end += rec_len;
+        }
+        if (end == pos) {
+            err = rotate();
+            continue;
+        }
+        if (s_seg_file == NULL || fwrite(&s_buf[pos], 1, end - pos, s_seg_file) != end - pos) {
+            err = ESP_FAIL;
+            break;
+        }
+        s_seg_len += end - pos;
+        s_stats.flushed_bytes += end - pos;
+        pos = end;
+    }
+    if (err == ESP_OK && (fflush(s_seg_file) != 0 || fsync(fileno(s_seg_file)) != 0)) {
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        // Count what was lost so the stats stay honest
+        for (size_t p = pos; p < s_buf_len;) {
+            const record_hdr_t *hdr = (const record_hdr_t *)&s_buf[p];
+            p += sizeof(*hdr) + hdr->len;
+            s_stats.dropped++;
+        }
+        s_stats.write_errors++;
+        ESP_LOGE(TAG, "Flush to segment %08" PRIx32 " failed", s_last_seg);
+    }
+    s_buf_len = 0;
+    s_stats.flushes++;
+    s_flush_gen++;
+    return err;
+}
+
+esp_err_t log_store_append(const void *data, size_t len) {
+    if (data == NULL || len == 0 || len > LOG_STORE_MAX_RECORD_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    record_hdr_t hdr = {
+        .magic = RECORD_MAGIC,
+        .len = (uint16_t)len,
+    };
+    hdr.crc = record_crc(&hdr, data);
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_buf_len + sizeof(hdr) + len > sizeof(s_buf)) {
+        err = flush_locked();
+    }
+    memcpy(&s_buf[s_buf_len], &hdr, sizeof(hdr));
+    memcpy(&s_buf[s_buf_len + sizeof(hdr)], data, len);
+    s_buf_len += sizeof(hdr) + len;
+    s_stats.records++;
+    s_stats.record_bytes += len;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t log_store_flush(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = flush_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void log_store_cursor_oldest(log_cursor_t *cursor) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cursor->segment = s_first_seg;
+    cursor->offset = 0;
+    xSemaphoreGive(s_lock);
+}
+
+// Moves cursor to the next segment if there is one. Caller holds s_lock.
+static bool next_segment(log_cursor_t *cursor) {
+    if (cursor->segment >= s_last_seg) {
+        return false;
+    }
+    cursor->segment++;
+    cursor->offset = 0;
+    return true;
+}
+
+esp_err_t log_store_read(log_cursor_t *cursor, void *buf, size_t buf_size, size_t *len) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (cursor->segment < s_first_seg) {
+        // Rotated away under the reader
+        cursor->segment = s_first_seg;
+        cursor->offset = 0;
+        s_stats.reader_skips++;
+    }
+    while (cursor->segment <= s_last_seg) {
+        if (cursor->segment == s_last_seg && cursor->offset >= s_seg_len) {
+            break;
+        }
+        // The active segment grows, so reopen it after each flush
+        if (s_read_file && (s_read_seg != cursor->segment ||
+                            (s_read_seg == s_last_seg && s_read_gen != s_flush_gen))) {
+            close_reader();
+        }
+        if (s_read_file == NULL) {
+            char path[SEGMENT_PATH_LEN];
+            segment_path(path, cursor->segment);
+            s_read_file = fopen(path, "rb");
+            s_read_seg = cursor->segment;
+            s_read_gen = s_flush_gen;
+            if (s_read_file == NULL) {
+                s_stats.reader_skips++;
+                if (!next_segment(cursor)) {
+                    break;
+                }
+                continue;
+            }
+        }
+        record_hdr_t hdr;
+        if (fseek(s_read_file, cursor->offset, SEEK_SET) != 0 ||
+            fread(&hdr, sizeof(hdr), 1, s_read_file) != 1) {
+            // End of a closed segment, or a torn tail after a reset
+            if (!next_segment(cursor)) {
+                break;
+            }
+            continue;
+        }
+        if (hdr.magic != RECORD_MAGIC || hdr.len == 0 || hdr.len > LOG_STORE_MAX_RECORD_SIZE) {
+            s_stats.reader_skips++;
+            if (!next_segment(cursor)) {
+                break;
+            }
+            continue;
+        }
+        *len = hdr.len;
+        if (hdr.len > buf_size) {
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        if (fread(buf, 1, hdr.len, s_read_file) != hdr.len || record_crc(&hdr, buf) != hdr.crc) {
+            s_stats.reader_skips++;
+            if (!next_segment(cursor)) {
+                break;
+            }
+            continue;
+        }
+        cursor->offset += sizeof(hdr) + hdr.len;
+        err = ESP_OK;
+        break;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void log_store_get_stats(log_store_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    stats->first_segment = s_first_seg;
+    stats->last_segment = s_last_seg;
+    stats->buffered = s_buf_len;
+    xSemaphoreGive(s_lock);
+}
+
+static void flush_task(void *arg) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_LOG_STORE_FLUSH_MS));
+        log_store_flush();
+    }
+}
+
+// Finds the existing segment range from the file names.
+static bool scan_segments(uint32_t *first, uint32_t *last) {
+    DIR *dir = opendir(LOG_STORE_BASE_PATH);
+    if (dir == NULL) {
+        return false;
+    }
+    bool found = false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char *end;
+        unsigned long seg = strtoul(entry->d_name, &end, 16);
+        if (end == entry->d_name || strcmp(end, ".log") != 0) {
+            continue;
+        }
+        if (!found || seg < *first) {
+            *first = seg;
+        }
+        if (!found || seg > *last) {
+            *last = seg;
+        }
+        found = true;
+    }
+    closedir(dir);
+    return found;
+}
+
+esp_err_t log_store_init(void) {
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = LOG_STORE_BASE_PATH,
+        .partition_label = LOG_STORE_PARTITION,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t err = esp_vfs_littlefs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS mount failed (%s)", esp_err_to_name(err));
+        return err;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Always start a fresh segment so a torn tail from the last run is
+    // never appended to
+    uint32_t first = 0;
+    uint32_t last = 0;
+    if (scan_segments(&first, &last)) {
+        s_first_seg = first;
+        s_last_seg = last;
+        err = rotate();
+        s_stats.rotations = 0;
+    } else {
+        err = open_segment(0);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    task_profiler_declare_stack("log_flush", 3072);
+    if (xTaskCreate(flush_task, "log_flush", 3072, NULL, 4, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Segments %08" PRIx32 "..%08" PRIx32 ", %d KB each, flush every %d ms",
+             s_first_seg, s_last_seg, CONFIG_LOG_STORE_SEGMENT_SIZE / 1024, CONFIG_LOG_STORE_FLUSH_MS);
+    return ESP_OK;
+}
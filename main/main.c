@@ -1,7 +1,18 @@
-// #include "file_storage.h"
+#include "binlog.h"
+#include "boot.h"
+#include "heap_monitor.h"
 #include "https_server.h"
+#include "ingest.h"
 #include "led_control.h"
+#include "link_monitor.h"
+#include "log_store.h"
+#include "session_table.h"
+#include "settings.h"
+#include "task_profiler.h"
+#include "tsdb.h"
+#include "uplink.h"
 #include "wifi_setup.h"
+#include "www_bundle.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -9,69 +20,106 @@
 #include <inttypes.h>
 
 static const char *TAG = "MAIN";
-// Task to log free heap memory periodically
-void log_free_heap_task(void *arg) {
-    while (1) {
-    ESP_LOGI(TAG, "Free heap memory: %" PRIu32 " bytes", esp_get_free_heap_size());
-    vTaskDelay(pdMS_TO_TICKS(50000)); // Log every 5 seconds
-    }
-}
+static httpd_handle_t https_server_handle = NULL;
 
-// Function to start the heap logging task
-void start_heap_logging(void) {
-    xTaskCreate(log_free_heap_task, "log_free_heap_task", 2048, NULL, 5, NULL);
-}
-void app_main() {
-  ESP_LOGI(TAG, "Initializing LED...");
+static esp_err_t led_phase(void) {
   configure_led(); // Initialize the LED strip
   set_brightness(30);
-  ESP_LOGI(TAG, "Initializing NVS...");
+  return ESP_OK;
+}
+
+static esp_err_t nvs_phase(void) {
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
       ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    ret = nvs_flash_init();
+    ret = nvs_flash_erase();
+    if (ret == ESP_OK) {
+      ret = nvs_flash_init();
+    }
   }
-  ESP_ERROR_CHECK(ret);
-  ESP_LOGI(TAG, "Initializing Wi-Fi...");
-  wifi_init_sta();
-  static httpd_handle_t https_server_handle = NULL;
-
-ESP_LOGI(TAG, "Registering HTTPS server event handlers...");
-ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &https_connect_handler, &https_server_handle));
-ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &https_disconnect_handler, &https_server_handle));
-ESP_ERROR_CHECK(esp_event_handler_register(ESP_HTTPS_SERVER_EVENT, ESP_EVENT_ANY_ID, &https_server_event_handler, NULL));
+  return ret;
+}
 
+// Handlers go in before Wi-Fi starts so the server comes up on the first
+// GOT_IP; nothing else waits for the network.
+static esp_err_t events_phase(void) {
+  esp_err_t err = esp_netif_init();
+  if (err == ESP_OK) {
+    err = esp_event_loop_create_default();
+  }
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &https_connect_handler, &https_server_handle);
+  }
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &https_disconnect_handler, &https_server_handle);
+  }
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(ESP_HTTPS_SERVER_EVENT, ESP_EVENT_ANY_ID, &https_server_event_handler, NULL);
+  }
+  if (err == ESP_OK) {
+    err = session_table_init();
+  }
+  return err;
+}
 
-ESP_LOGI(TAG, "Event handlers registered.");
- /* Start the server for the first time */
-   // https_server_handle= start_https_server();
-    // Start HTTPS server if already connected
-    esp_netif_ip_info_t ip_info;
-    if (esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"), &ip_info) == ESP_OK && ip_info.ip.addr != 0) {
-        ESP_LOGI(TAG, "Network already connected, starting HTTPS server...");
-        set_led_state(LED_STATE_WEBSERVER_STARTING);
+static esp_err_t wifi_phase(void) {
+  wifi_init_sta();
+  return ESP_OK;
+}
 
-        https_server_handle = start_https_server();
-        if (https_server_handle) {
-            ESP_LOGI(TAG, "HTTPS server started successfully.");
-            set_led_state(LED_STATE_WEBSERVER_RUNNING); // Update LED state here
+enum { PHASE_HEAP, PHASE_TASKS, PHASE_BINLOG, PHASE_NVS, PHASE_SETTINGS, PHASE_LED, PHASE_STORAGE, PHASE_TSDB, PHASE_WWW, PHASE_EVENTS, PHASE_WIFI, PHASE_LINK_MONITOR, PHASE_INGEST, PHASE_UPLINK };
 
-        } else {
-            ESP_LOGE(TAG, "Failed to start HTTPS server.");
-            set_led_state(LED_STATE_FAILED); // Update LED state on failure
+static const boot_phase_t boot_phases[] = {
+    [PHASE_HEAP] = {.name = "heap_mon", .fn = heap_monitor_init},
+    [PHASE_TASKS] = {.name = "task_prof", .fn = task_profiler_init},
+    [PHASE_BINLOG] = {.name = "binlog", .fn = binlog_init},
+    [PHASE_NVS] = {.name = "nvs", .fn = nvs_phase},
+    [PHASE_SETTINGS] = {.name = "settings", .fn = settings_init, .deps = BOOT_DEP(PHASE_NVS)},
+    // The LED's GPIO is a setting; without the stored ones the Kconfig
+    // defaults apply
+    [PHASE_LED] = {.name = "led", .fn = led_phase, .after = BOOT_DEP(PHASE_SETTINGS)},
+    [PHASE_STORAGE] = {.name = "storage", .fn = log_store_init},
+    [PHASE_TSDB] = {.name = "tsdb", .fn = tsdb_init},
+    [PHASE_WWW] = {.name = "www", .fn = www_bundle_init},
+    [PHASE_EVENTS] = {.name = "events", .fn = events_phase},
+    // Wi-Fi drives the LED and needs NVS for the driver and link cache. It
+    // takes its credentials from the settings, falling back to the Kconfig
+    // ones: it is fatal, so an optional phase must not hold it back.
+    [PHASE_WIFI] = {.name = "wifi", .fn = wifi_phase,
+                    .deps = BOOT_DEP(PHASE_LED) | BOOT_DEP(PHASE_NVS) | BOOT_DEP(PHASE_EVENTS),
+                    .after = BOOT_DEP(PHASE_SETTINGS)},
+    [PHASE_LINK_MONITOR] = {.name = "link_mon", .fn = link_monitor_start, .deps = BOOT_DEP(PHASE_WIFI)},
+    // Storage consumer, its NVS series map, and the network stack for UDP
+    [PHASE_INGEST] = {.name = "ingest", .fn = ingest_init,
+                      .deps = BOOT_DEP(PHASE_NVS) | BOOT_DEP(PHASE_STORAGE) | BOOT_DEP(PHASE_TSDB) |
+                              BOOT_DEP(PHASE_EVENTS)},
+    // Spools to the storage partition and takes its client id from the MAC
+    [PHASE_UPLINK] = {.name = "uplink", .fn = uplink_init,
+                      .deps = BOOT_DEP(PHASE_STORAGE) | BOOT_DEP(PHASE_INGEST) | BOOT_DEP(PHASE_WIFI)},
+};
 
-        }
-    } else {
-        ESP_LOGI(TAG, "Waiting for network connection to start HTTPS server...");
-    }
+void app_main() {
+  boot_mark("app_main");
+  esp_err_t err = boot_run(boot_phases, sizeof(boot_phases) / sizeof(boot_phases[0]));
+  if (err != ESP_OK) {
+    // Optional phases may fail, e.g. a partition missing from an older table
+    // after an OTA update; the gateway runs on without them and their
+    // dependents
+    ESP_LOGE(TAG, "Boot incomplete (%s), see the phase log", esp_err_to_name(err));
+  }
+  // Without these the device cannot be reached to fix anything, so restart
+  static const int fatal_phases[] = {PHASE_NVS, PHASE_EVENTS, PHASE_WIFI};
+  boot_phase_record_t records[BOOT_MAX_PHASES];
+  size_t count = boot_get_phases(records, BOOT_MAX_PHASES);
+  for (size_t i = 0; i < sizeof(fatal_phases) / sizeof(fatal_phases[0]); i++) {
+    // A table boot_run() refused never ran at all
+    ESP_ERROR_CHECK((size_t)fatal_phases[i] < count ? records[fatal_phases[i]].err : err);
+  }
 
   #ifdef TEST_HTTP_EVENT_DISCONNECT
     test_trigger_https_event(&https_server_handle);
   #endif
 
-    // Start logging free heap memory
-    start_heap_logging();
     ESP_LOGI(TAG, "Main function setup complete.");
 
 }
@@ -0,0 +1,138 @@
+#include "mem_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "MEM_POOL";
+
+// A free block holds the link to the next free block
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+struct mem_pool {
+    portMUX_TYPE lock;
+    uint32_t flags;
+    uint8_t *slab;
+    uint8_t *slab_end;
+    free_block_t *free_list;
+    mem_pool_stats_t stats;
+};
+
+static mem_pool_t s_pools[MEM_POOL_MAX];
+static size_t s_pool_count;
+static portMUX_TYPE s_registry_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t mem_pool_create(const char *name, size_t block_size, uint32_t blocks, uint32_t flags,
+                          mem_pool_t **out) {
+    if (block_size == 0 || blocks == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t align = sizeof(void *);
+    block_size = (block_size + align - 1) & ~(align - 1);
+    uint32_t caps = flags & MEM_POOL_ISR_SAFE ? MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT : MALLOC_CAP_DEFAULT;
+    uint8_t *slab = heap_caps_malloc(block_size * blocks, caps);
+    if (slab == NULL) {
+        ESP_LOGE(TAG, "No room for pool %s: %u x %u bytes", name, (unsigned)blocks, (unsigned)block_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    taskENTER_CRITICAL(&s_registry_lock);
+    mem_pool_t *pool = s_pool_count < MEM_POOL_MAX ? &s_pools[s_pool_count++] : NULL;
+    taskEXIT_CRITICAL(&s_registry_lock);
+    if (pool == NULL) {
+        heap_caps_free(slab);
+        return ESP_ERR_NO_MEM;
+    }
+    *pool = (mem_pool_t){
+        .lock = portMUX_INITIALIZER_UNLOCKED,
+        .flags = flags,
+        .slab = slab,
+        .slab_end = slab + block_size * blocks,
+        .stats = {.name = name, .block_size = (uint32_t)block_size, .blocks = blocks},
+    };
+    // Thread the free list so the lowest block is handed out first
+    for (uint32_t i = blocks; i-- > 0;) {
+        free_block_t *b = (free_block_t *)(slab + (size_t)i * block_size);
+        b->next = pool->free_list;
+        pool->free_list = b;
+    }
+    *out = pool;
+    return ESP_OK;
+}
+
+// Callers hold the pool lock
+static void *take(mem_pool_t *pool) {
+    free_block_t *b = pool->free_list;
+    if (b == NULL) {
+        pool->stats.exhausted++;
+        return NULL;
+    }
+    pool->free_list = b->next;
+    pool->stats.allocs++;
+    if (++pool->stats.in_use > pool->stats.peak_in_use) {
+        pool->stats.peak_in_use = pool->stats.in_use;
+    }
+    return b;
+}
+
+void *mem_pool_alloc(mem_pool_t *pool) {
+    taskENTER_CRITICAL(&pool->lock);
+    void *block = take(pool);
+    taskEXIT_CRITICAL(&pool->lock);
+    return block;
+}
+
+void *mem_pool_alloc_from_isr(mem_pool_t *pool) {
+    if (!(pool->flags & MEM_POOL_ISR_SAFE)) {
+        return NULL;
+    }
+    portENTER_CRITICAL_ISR(&pool->lock);
+    void *block = take(pool);
+    portEXIT_CRITICAL_ISR(&pool->lock);
+    return block;
+}
+
+void mem_pool_free(mem_pool_t *pool, void *block) {
+    if (block == NULL) {
+        return;
+    }
+    if (!mem_pool_owns(pool, block) ||
+        (size_t)((uint8_t *)block - pool->slab) % pool->stats.block_size != 0) {
+        ESP_EARLY_LOGE(TAG, "Pool %s: %p is not one of its blocks", pool->stats.name, block);
+        return;
+    }
+    free_block_t *b = block;
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    b->next = pool->free_list;
+    pool->free_list = b;
+    pool->stats.in_use--;
+    pool->stats.frees++;
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+}
+
+bool mem_pool_owns(const mem_pool_t *pool, const void *ptr) {
+    return pool && (const uint8_t *)ptr >= pool->slab && (const uint8_t *)ptr < pool->slab_end;
+}
+
+size_t mem_pool_block_size(const mem_pool_t *pool) {
+    return pool->stats.block_size;
+}
+
+void mem_pool_get_stats(mem_pool_t *pool, mem_pool_stats_t *out) {
+    taskENTER_CRITICAL(&pool->lock);
+    *out = pool->stats;
+    taskEXIT_CRITICAL(&pool->lock);
+}
+
+size_t mem_pool_count(void) {
+    taskENTER_CRITICAL(&s_registry_lock);
+    size_t n = s_pool_count;
+    taskEXIT_CRITICAL(&s_registry_lock);
+    return n;
+}
+
+mem_pool_t *mem_pool_at(size_t index) {
+    return index < mem_pool_count() ? &s_pools[index] : NULL;
+}
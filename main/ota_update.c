@@ -0,0 +1,220 @@
+#include "ota_update.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "OTA_UPDATE";
+
+// Public half of the update signing key
+extern const unsigned char ota_pub_pem_start[] asm("_binary_ota_pub_pem_start");
+extern const unsigned char ota_pub_pem_end[] asm("_binary_ota_pub_pem_end");
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static ota_update_info_t s_info;
+
+// Update in progress; only the task that began it touches these
+static bool s_updating;
+static const esp_partition_t *s_upd_part;
+static esp_ota_handle_t s_upd_handle;
+static mbedtls_sha256_context s_upd_sha;
+static size_t s_upd_size;
+static size_t s_upd_received;
+static int64_t s_upd_start_us;
+static int64_t s_upd_flash_us;
+
+static const char *state_name(esp_ota_img_states_t state) {
+    switch (state) {
+    case ESP_OTA_IMG_NEW:
+        return "new";
+    case ESP_OTA_IMG_PENDING_VERIFY:
+        return "pending_verify";
+    case ESP_OTA_IMG_VALID:
+        return "valid";
+    case ESP_OTA_IMG_INVALID:
+        return "invalid";
+    case ESP_OTA_IMG_ABORTED:
+        return "aborted";
+    default:
+        return "undefined";
+    }
+}
+
+void ota_update_get_info(ota_update_info_t *info) {
+    taskENTER_CRITICAL(&s_lock);
+    *info = s_info;
+    info->received = s_upd_received;
+    taskEXIT_CRITICAL(&s_lock);
+
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    snprintf(info->running, sizeof(info->running), "%s", running ? running->label : "");
+    snprintf(info->next, sizeof(info->next), "%s", next ? next->label : "");
+    snprintf(info->version, sizeof(info->version), "%s", esp_app_get_description()->version);
+    if (running) {
+        esp_ota_get_state_partition(running, &state);
+    }
+    info->state = state_name(state);
+    info->slot_size = next ? next->size : 0;
+}
+
+// Ends the update in progress and counts how it went. Caller is the task
+// that began it.
+static void finish(esp_err_t err, const uint8_t *sha256) {
+    int64_t elapsed_us = esp_timer_get_time() - s_upd_start_us;
+    mbedtls_sha256_free(&s_upd_sha);
+    taskENTER_CRITICAL(&s_lock);
+    if (err == ESP_OK) {
+        s_info.updates++;
+        s_info.last_update_ms = (uint32_t)(elapsed_us / 1000);
+        s_info.last_update_kbps = elapsed_us > 0 ? (uint32_t)((int64_t)s_upd_size * 8000 / elapsed_us) : 0;
+        s_info.last_flash_ms = (uint32_t)(s_upd_flash_us / 1000);
+        for (int i = 0; i < 32; i++) {
+            snprintf(&s_info.last_sha256[i * 2], 3, "%02x", sha256[i]);
+        }
+    } else {
+        s_info.update_failures++;
+    }
+    s_info.updating = false;
+    s_updating = false;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t ota_update_begin(size_t image_size) {
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size == 0 || image_size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    bool busy = s_updating;
+    s_updating = true;
+    taskEXIT_CRITICAL(&s_lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Sequential writes erase each sector just ahead of the data, so the
+    // first bytes go out without a long erase of the whole slot up front
+    esp_err_t err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &s_upd_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Starting update of %s failed (%s)", part->label, esp_err_to_name(err));
+        taskENTER_CRITICAL(&s_lock);
+        s_updating = false;
+        taskEXIT_CRITICAL(&s_lock);
+        return err;
+    }
+    mbedtls_sha256_init(&s_upd_sha);
+    mbedtls_sha256_starts(&s_upd_sha, 0);
+    s_upd_part = part;
+    s_upd_size = image_size;
+    s_upd_flash_us = 0;
+    s_upd_start_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    s_upd_received = 0;
+    s_info.updating = true;
+    s_info.size = image_size;
+    taskEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Receiving %u byte image into %s", (unsigned)image_size, part->label);
+    return ESP_OK;
+}
+
+esp_err_t ota_update_write(const void *data, size_t len) {
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > s_upd_size - s_upd_received) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mbedtls_sha256_update(&s_upd_sha, data, len);
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = esp_ota_write(s_upd_handle, data, len);
+    s_upd_flash_us += esp_timer_get_time() - start_us;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Writing %s at %u failed (%s)", s_upd_part->label, (unsigned)s_upd_received,
+                 esp_err_to_name(err));
+        return err;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    s_upd_received += len;
+    taskEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t ota_update_verify_signature(const uint8_t *sha256, const uint8_t *sig, size_t sig_len) {
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    int ret = mbedtls_pk_parse_public_key(&pk, ota_pub_pem_start, ota_pub_pem_end - ota_pub_pem_start);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Bad update key (-0x%04x)", (unsigned)-ret);
+        mbedtls_pk_free(&pk);
+        return ESP_ERR_INVALID_STATE;
+    }
+    ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, sha256, 32, sig, sig_len);
+    mbedtls_pk_free(&pk);
+    return ret == 0 ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+esp_err_t ota_update_end(const uint8_t *sig, size_t sig_len) {
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&s_upd_sha, sha256);
+    esp_err_t err = ESP_OK;
+    if (s_upd_received != s_upd_size) {
+        err = ESP_ERR_INVALID_SIZE;
+        esp_ota_abort(s_upd_handle);
+    } else {
+        err = esp_ota_end(s_upd_handle);
+    }
+    if (err == ESP_OK) {
+        err = ota_update_verify_signature(sha256, sig, sig_len);
+    }
+    // Only a checked and signed image may become the boot slot
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(s_upd_part);
+    }
+    finish(err, sha256);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Image for %s accepted: %u bytes in %" PRIu32 " ms (%" PRIu32 " kbit/s, %" PRIu32 " ms writing flash)",
+                 s_upd_part->label, (unsigned)s_upd_size, s_info.last_update_ms, s_info.last_update_kbps,
+                 s_info.last_flash_ms);
+    } else {
+        ESP_LOGW(TAG, "Rejected image for %s (%s)", s_upd_part->label, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void ota_update_abort(void) {
+    if (!s_updating) {
+        return;
+    }
+    esp_ota_abort(s_upd_handle);
+    finish(ESP_FAIL, NULL);
+}
+
+void ota_update_mark_valid(void) {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (running == NULL || esp_ota_get_state_partition(running, &state) != ESP_OK ||
+        state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return;
+    }
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Image in %s confirmed", running->label);
+    } else {
+        ESP_LOGE(TAG, "Confirming image in %s failed (%s)", running->label, esp_err_to_name(err));
+    }
+}
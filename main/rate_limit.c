@@ -0,0 +1,189 @@
+#include "rate_limit.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SLOT_MASK (RATE_LIMIT_SLOTS - 1)
+#define MILLI 1000                       // Tokens are kept in thousandths
+#define MAX_REFILL_US (3600LL * 1000000)  // Caps the refill arithmetic
+
+typedef struct {
+    bool used;
+    uint8_t addr[RATE_LIMIT_ADDR_LEN];
+    uint32_t milli[RATE_LIMIT_KINDS];
+    int64_t updated_us;                  // Last refill, which is also the last visit
+    uint32_t allowed[RATE_LIMIT_KINDS];
+    uint32_t refused[RATE_LIMIT_KINDS];
+} client_t;
+
+static rate_limit_bucket_cfg_t s_cfg[RATE_LIMIT_KINDS];
+static client_t s_clients[RATE_LIMIT_SLOTS];
+static rate_limit_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint8_t s_v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+void rate_limit_init(const rate_limit_bucket_cfg_t cfg[RATE_LIMIT_KINDS]) {
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(s_cfg, cfg, sizeof(s_cfg));
+    memset(s_clients, 0, sizeof(s_clients));
+    memset(&s_stats, 0, sizeof(s_stats));
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+// FNV-1a
+static unsigned home_slot(const uint8_t *addr) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < RATE_LIMIT_ADDR_LEN; i++) {
+        h = (h ^ addr[i]) * 16777619u;
+    }
+    return h & SLOT_MASK;
+}
+
+// Thousandths of a token bucket kind holds at now_us
+static uint32_t level(const client_t *c, int kind, int64_t now_us) {
+    const rate_limit_bucket_cfg_t *cfg = &s_cfg[kind];
+    int64_t elapsed = now_us - c->updated_us;
+    if (elapsed > MAX_REFILL_US) {
+        elapsed = MAX_REFILL_US;
+    }
+    int64_t milli = c->milli[kind] + (elapsed > 0 ? elapsed * cfg->per_min / 60000 : 0);
+    int64_t full = (int64_t)cfg->burst * MILLI;
+    return (uint32_t)(milli < full ? milli : full);
+}
+
+// A client whose buckets are all full again is as good as forgotten
+static bool expired(const client_t *c, int64_t now_us) {
+    for (int kind = 0; kind < RATE_LIMIT_KINDS; kind++) {
+        if (s_cfg[kind].burst && level(c, kind, now_us) < s_cfg[kind].burst * MILLI) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Finds the client for addr or makes room for it. Caller holds s_lock.
+static client_t *lookup(const uint8_t *addr, int64_t now_us) {
+    unsigned home = home_slot(addr);
+    client_t *spare = NULL;
+    client_t *oldest = NULL;
+    for (unsigned i = 0; i < RATE_LIMIT_PROBE; i++) {
+        client_t *c = &s_clients[(home + i) & SLOT_MASK];
+        if (!c->used) {
+            // Slots are never emptied, so the client cannot be further on
+            if (spare == NULL) {
+                spare = c;
+            }
+            break;
+        }
+        if (memcmp(c->addr, addr, RATE_LIMIT_ADDR_LEN) == 0) {
+            return c;
+        }
+        if (spare == NULL && expired(c, now_us)) {
+            spare = c;
+        }
+        if (oldest == NULL || c->updated_us < oldest->updated_us) {
+            oldest = c;
+        }
+    }
+    if (spare == NULL) {
+        spare = oldest;
+        s_stats.recycled++;
+    }
+    memset(spare, 0, sizeof(*spare));
+    spare->used = true;
+    memcpy(spare->addr, addr, RATE_LIMIT_ADDR_LEN);
+    for (int kind = 0; kind < RATE_LIMIT_KINDS; kind++) {
+        spare->milli[kind] = s_cfg[kind].burst * MILLI;
+    }
+    spare->updated_us = now_us;
+    return spare;
+}
+
+bool rate_limit_take_addr(rate_limit_kind_t kind, const uint8_t addr[RATE_LIMIT_ADDR_LEN], int64_t now_us,
+                          uint32_t *retry_after_ms) {
+    const rate_limit_bucket_cfg_t *cfg = &s_cfg[kind];
+    bool allowed = true;
+    uint32_t need = 0;
+    taskENTER_CRITICAL(&s_lock);
+    if (cfg->burst == 0) {
+        s_stats.allowed[kind]++;
+        taskEXIT_CRITICAL(&s_lock);
+        return true;
+    }
+    client_t *c = lookup(addr, now_us);
+    for (int k = 0; k < RATE_LIMIT_KINDS; k++) {
+        c->milli[k] = level(c, k, now_us);
+    }
+    c->updated_us = now_us;
+    if (c->milli[kind] >= MILLI) {
+        c->milli[kind] -= MILLI;
+        c->allowed[kind]++;
+        s_stats.allowed[kind]++;
+    } else {
+        need = MILLI - c->milli[kind];
+        c->refused[kind]++;
+        s_stats.refused[kind]++;
+        allowed = false;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (!allowed && retry_after_ms) {
+        // A token per minute is per_min / 60 thousandths per millisecond
+        *retry_after_ms = cfg->per_min ? (need * 60 + cfg->per_min - 1) / cfg->per_min : 60000;
+    }
+    return allowed;
+}
+
+bool rate_limit_take(rate_limit_kind_t kind, int fd, uint32_t *retry_after_ms) {
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    uint8_t addr[RATE_LIMIT_ADDR_LEN];
+    bool known = getpeername(fd, (struct sockaddr *)&ss, &len) == 0;
+    if (known && ss.ss_family == AF_INET6) {
+        memcpy(addr, &((struct sockaddr_in6 *)&ss)->sin6_addr, sizeof(addr));
+    } else if (known && ss.ss_family == AF_INET) {
+        memcpy(addr, s_v4_mapped, sizeof(s_v4_mapped));
+        memcpy(addr + sizeof(s_v4_mapped), &((struct sockaddr_in *)&ss)->sin_addr, 4);
+    } else {
+        taskENTER_CRITICAL(&s_lock);
+        s_stats.unknown_peer++;
+        taskEXIT_CRITICAL(&s_lock);
+        return true;
+    }
+    return rate_limit_take_addr(kind, addr, esp_timer_get_time(), retry_after_ms);
+}
+
+static void format_addr(const uint8_t *addr, char *ip, size_t len) {
+    if (memcmp(addr, s_v4_mapped, sizeof(s_v4_mapped)) == 0) {
+        snprintf(ip, len, "%u.%u.%u.%u", addr[12], addr[13], addr[14], addr[15]);
+    } else {
+        inet_ntop(AF_INET6, addr, ip, len);
+    }
+}
+
+size_t rate_limit_snapshot(rate_limit_client_t *out, size_t max) {
+    int64_t now = esp_timer_get_time();
+    size_t n = 0;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < RATE_LIMIT_SLOTS && n < max; i++) {
+        const client_t *c = &s_clients[i];
+        if (!c->used || expired(c, now)) {
+            continue;
+        }
+        rate_limit_client_t *o = &out[n++];
+        format_addr(c->addr, o->ip, sizeof(o->ip));
+        memcpy(o->allowed, c->allowed, sizeof(o->allowed));
+        memcpy(o->refused, c->refused, sizeof(o->refused));
+        o->last_seen_us = c->updated_us;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+void rate_limit_get_stats(rate_limit_stats_t *stats) {
+    taskENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,109 @@
+#include "req_arena.h"
+#include "heap_monitor.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+
+#define ARENA_ALIGN 8
+
+// Heap blocks taken once the arena is full, chained so the reset frees them
+typedef union overflow {
+    union overflow *next;
+    uint8_t align[ARENA_ALIGN];
+} overflow_t;
+
+static _Alignas(ARENA_ALIGN) uint8_t s_buf[CONFIG_REQ_ARENA_SIZE];
+static size_t s_used;
+static size_t s_overflow_bytes;
+static overflow_t *s_overflow;
+static _Atomic(TaskHandle_t) s_owner;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static req_arena_stats_t s_stats = {.size = CONFIG_REQ_ARENA_SIZE};
+
+bool req_arena_active(void) {
+    TaskHandle_t owner = atomic_load_explicit(&s_owner, memory_order_relaxed);
+    return owner != NULL && owner == xTaskGetCurrentTaskHandle();
+}
+
+bool req_arena_begin(void) {
+    TaskHandle_t expected = NULL;
+    return atomic_compare_exchange_strong(&s_owner, &expected, xTaskGetCurrentTaskHandle());
+}
+
+void req_arena_end(void) {
+    if (!req_arena_active()) {
+        return;
+    }
+    while (s_overflow) {
+        overflow_t *next = s_overflow->next;
+        heap_monitor_free(HEAP_TAG_HTTPD, s_overflow);
+        s_overflow = next;
+    }
+    uint32_t used = (uint32_t)(s_used + s_overflow_bytes);
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.requests++;
+    s_stats.last_used = used;
+    if (used > s_stats.high_water) {
+        s_stats.high_water = used;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    s_used = 0;
+    s_overflow_bytes = 0;
+    atomic_store(&s_owner, NULL);
+}
+
+static void *overflow_alloc(size_t size) {
+    if (size > SIZE_MAX - sizeof(overflow_t)) {
+        return NULL;
+    }
+    overflow_t *block = heap_monitor_malloc(HEAP_TAG_HTTPD, sizeof(overflow_t) + size);
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.overflows++;
+    if (block == NULL) {
+        s_stats.overflow_fails++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = s_overflow;
+    s_overflow = block;
+    s_overflow_bytes += size;
+    return block + 1;
+}
+
+void *req_arena_alloc(size_t size) {
+    if (!req_arena_active()) {
+        return NULL;
+    }
+    size_t start = (s_used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > sizeof(s_buf) || size > sizeof(s_buf) - start) {
+        return overflow_alloc(size);
+    }
+    s_used = start + size;
+    return s_buf + start;
+}
+
+bool req_arena_owns(const void *ptr) {
+    const uint8_t *p = ptr;
+    if (p >= s_buf && p < s_buf + sizeof(s_buf)) {
+        return true;
+    }
+    if (!req_arena_active() || s_overflow == NULL) {
+        return false;
+    }
+    for (const overflow_t *o = s_overflow; o; o = o->next) {
+        if (p == (const uint8_t *)(o + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void req_arena_get_stats(req_arena_stats_t *out) {
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,245 @@
+#include "ring.h"
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ring {
+    // Fixed at creation
+    ring_kind_t kind;
+    uint32_t mask;
+    uint32_t item_size;
+    uint8_t *slots;
+    atomic_uint *ready;            // MPSC: index + 1 once the slot's item is written
+    TaskHandle_t consumer;         // Set by the waiting side before it sleeps
+    TaskHandle_t producer;
+    char pad0[RING_CACHE_LINE];
+
+    // Written by producers
+    atomic_uint head;
+    uint32_t tail_cache;           // SPSC producer's last view of tail
+    atomic_bool producer_waiting;
+    char pad1[RING_CACHE_LINE];
+
+    // Written by the consumer
+    atomic_uint tail;
+    uint32_t head_cache;           // SPSC consumer's last view of head
+    atomic_bool consumer_waiting;
+    char pad2[RING_CACHE_LINE];
+};
+
+static inline uint8_t *slot(const ring_t *r, uint32_t index) {
+    return r->slots + (size_t)(index & r->mask) * r->item_size;
+}
+
+esp_err_t ring_create(ring_kind_t kind, size_t item_size, uint32_t capacity, ring_t **out) {
+    if (item_size == 0 || capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ring_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    r->kind = kind;
+    r->mask = capacity - 1;
+    r->item_size = (uint32_t)item_size;
+    r->slots = malloc((size_t)capacity * item_size);
+    if (kind == RING_MPSC) {
+        r->ready = malloc(capacity * sizeof(atomic_uint));
+    }
+    if (r->slots == NULL || (kind == RING_MPSC && r->ready == NULL)) {
+        ring_delete(r);
+        return ESP_ERR_NO_MEM;
+    }
+    // Each slot starts out as written on the lap before index 0, so no
+    // index reads as ready until its item is in, even across wrap-around
+    for (uint32_t i = 0; kind == RING_MPSC && i < capacity; i++) {
+        atomic_init(&r->ready[i], i + 1 - capacity);
+    }
+    *out = r;
+    return ESP_OK;
+}
+
+void ring_delete(ring_t *r) {
+    if (r) {
+        free(r->slots);
+        free(r->ready);
+        free(r);
+    }
+}
+
+// Notifies the task sleeping on the other side, if any. The fence orders
+// the index update before the flag check; the sleeper does the mirror image.
+static void wake(atomic_bool *waiting, TaskHandle_t task, BaseType_t *woken) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(waiting, memory_order_relaxed) ||
+        !atomic_exchange_explicit(waiting, false, memory_order_acq_rel)) {
+        return;
+    }
+    if (woken) {
+        vTaskNotifyGiveFromISR(task, woken);
+    } else {
+        xTaskNotifyGive(task);
+    }
+}
+
+static size_t push_spsc(ring_t *r, const void *items, size_t n) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t capacity = r->mask + 1;
+    if (capacity - (head - r->tail_cache) < n) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    }
+    uint32_t space = capacity - (head - r->tail_cache);
+    size_t k = n < space ? n : space;
+    if (k == 0) {
+        return 0;
+    }
+    // At most two copies: up to the end of the array, then from the start
+    uint32_t first = capacity - (head & r->mask);
+    size_t first_n = k < first ? k : first;
+    memcpy(slot(r, head), items, first_n * r->item_size);
+    memcpy(r->slots, (const uint8_t *)items + first_n * r->item_size, (k - first_n) * r->item_size);
+    atomic_store_explicit(&r->head, head + (uint32_t)k, memory_order_release);
+    return k;
+}
+
+static size_t push_mpsc(ring_t *r, const void *items, size_t n) {
+    uint32_t capacity = r->mask + 1;
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t k;
+    do {
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        uint32_t space = capacity - (head - tail);
+        k = n < space ? n : space;
+        if (k == 0) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&r->head, &head, head + (uint32_t)k,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    const uint8_t *src = items;
+    for (size_t i = 0; i < k; i++, src += r->item_size) {
+        uint32_t index = head + (uint32_t)i;
+        memcpy(slot(r, index), src, r->item_size);
+        atomic_store_explicit(&r->ready[index & r->mask], index + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t push(ring_t *r, const void *items, size_t n, BaseType_t *woken) {
+    size_t k = r->kind == RING_SPSC ? push_spsc(r, items, n) : push_mpsc(r, items, n);
+    if (k) {
+        wake(&r->consumer_waiting, r->consumer, woken);
+    }
+    return k;
+}
+
+size_t ring_push(ring_t *r, const void *items, size_t n) {
+    return push(r, items, n, NULL);
+}
+
+size_t ring_push_from_isr(ring_t *r, const void *items, size_t n, BaseType_t *woken) {
+    BaseType_t local = pdFALSE;
+    return push(r, items, n, woken ? woken : &local);
+}
+
+size_t ring_pop(ring_t *r, void *items, size_t max) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t k = 0;
+    if (r->kind == RING_SPSC) {
+        if (r->head_cache - tail < max) {
+            r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        }
+        uint32_t avail = r->head_cache - tail;
+        k = max < avail ? max : avail;
+        if (k == 0) {
+            return 0;
+        }
+        uint32_t first = r->mask + 1 - (tail & r->mask);
+        size_t first_n = k < first ? k : first;
+        memcpy(items, slot(r, tail), first_n * r->item_size);
+        memcpy((uint8_t *)items + first_n * r->item_size, r->slots, (k - first_n) * r->item_size);
+    } else {
+        uint8_t *dst = items;
+        for (; k < max; k++, dst += r->item_size) {
+            uint32_t index = tail + (uint32_t)k;
+            if (atomic_load_explicit(&r->ready[index & r->mask], memory_order_acquire) != index + 1) {
+                break;
+            }
+            memcpy(dst, slot(r, index), r->item_size);
+        }
+        if (k == 0) {
+            return 0;
+        }
+    }
+    atomic_store_explicit(&r->tail, tail + (uint32_t)k, memory_order_release);
+    wake(&r->producer_waiting, r->producer, NULL);
+    return k;
+}
+
+// Arms the flag, then checks once more before sleeping so an item that
+// arrived in between is not missed. Returns false on timeout.
+static bool sleep_until(atomic_bool *waiting, TaskHandle_t *self, TickType_t *remaining, bool (*ready)(ring_t *),
+                        ring_t *r) {
+    *self = xTaskGetCurrentTaskHandle();
+    atomic_store_explicit(waiting, true, memory_order_release);   // Publishes *self to the waker
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ready(r)) {
+        atomic_store_explicit(waiting, false, memory_order_relaxed);
+        return true;
+    }
+    if (*remaining == 0) {
+        atomic_store_explicit(waiting, false, memory_order_relaxed);
+        return false;
+    }
+    TickType_t start = xTaskGetTickCount();
+    ulTaskNotifyTake(pdTRUE, *remaining);
+    atomic_store_explicit(waiting, false, memory_order_relaxed);
+    if (*remaining != portMAX_DELAY) {
+        TickType_t spent = xTaskGetTickCount() - start;
+        *remaining = spent < *remaining ? *remaining - spent : 0;
+    }
+    return true;
+}
+
+static bool has_items(ring_t *r) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (r->kind == RING_SPSC) {
+        return atomic_load_explicit(&r->head, memory_order_acquire) != tail;
+    }
+    return atomic_load_explicit(&r->ready[tail & r->mask], memory_order_acquire) == tail + 1;
+}
+
+static bool has_space(ring_t *r) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    return head - atomic_load_explicit(&r->tail, memory_order_acquire) <= r->mask;
+}
+
+size_t ring_pop_wait(ring_t *r, void *items, size_t max, TickType_t timeout) {
+    while (1) {
+        size_t k = ring_pop(r, items, max);
+        if (k || !sleep_until(&r->consumer_waiting, &r->consumer, &timeout, has_items, r)) {
+            return k;
+        }
+    }
+}
+
+size_t ring_push_wait(ring_t *r, const void *items, size_t n, TickType_t timeout) {
+    if (r->kind != RING_SPSC) {
+        return ring_push(r, items, n);
+    }
+    size_t done = 0;
+    while (1) {
+        done += ring_push(r, (const uint8_t *)items + done * r->item_size, n - done);
+        if (done == n || !sleep_until(&r->producer_waiting, &r->producer, &timeout, has_space, r)) {
+            return done;
+        }
+    }
+}
+
+uint32_t ring_count(const ring_t *r) {
+    return atomic_load_explicit(&r->head, memory_order_relaxed) - atomic_load_explicit(&r->tail, memory_order_relaxed);
+}
+
+uint32_t ring_capacity(const ring_t *r) {
+    return r->mask + 1;
+}
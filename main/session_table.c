@@ -0,0 +1,279 @@
+#include "session_table.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+#include "esp_https_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "SESSIONS";
+
+#define SLOT_MASK (SESSION_TABLE_SLOTS - 1)
+
+// Open addressing with linear probing; an fd of -1 marks an empty slot.
+static session_info_t s_slots[SESSION_TABLE_SLOTS];
+static session_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Caller holds s_lock
+static session_info_t *find(int fd) {
+    for (unsigned i = 0, idx = fd & SLOT_MASK; i < SESSION_TABLE_SLOTS; i++, idx = (idx + 1) & SLOT_MASK) {
+        if (s_slots[idx].fd == fd) {
+            return &s_slots[idx];
+        }
+        if (s_slots[idx].fd < 0) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Removes slot idx and shifts later entries of the probe chain back so
+// lookups never stop early at the hole. Caller holds s_lock.
+static void remove_slot(unsigned idx) {
+    unsigned hole = idx;
+    for (unsigned next = (idx + 1) & SLOT_MASK; s_slots[next].fd >= 0; next = (next + 1) & SLOT_MASK) {
+        unsigned home = s_slots[next].fd & SLOT_MASK;
+        // Move the entry if its home is not cyclically within (hole, next]
+        if (((next - home) & SLOT_MASK) >= ((next - hole) & SLOT_MASK)) {
+            s_slots[hole] = s_slots[next];
+            hole = next;
+        }
+    }
+    s_slots[hole].fd = -1;
+}
+
+static void format_peer(int fd, char *ip, size_t ip_len, uint16_t *port) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    snprintf(ip, ip_len, "?");
+    *port = 0;
+    if (getpeername(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        return;
+    }
+    if (addr.ss_family == AF_INET) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+        inet_ntop(AF_INET, &in->sin_addr, ip, ip_len);
+        *port = ntohs(in->sin_port);
+    } else if (addr.ss_family == AF_INET6) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+        const uint8_t *b = (const uint8_t *)&in6->sin6_addr;
+        static const uint8_t v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        if (memcmp(b, v4_mapped, sizeof(v4_mapped)) == 0) {
+            // The server listens on IPv6, so IPv4 peers show up mapped
+            snprintf(ip, ip_len, "%u.%u.%u.%u", b[12], b[13], b[14], b[15]);
+        } else {
+            inet_ntop(AF_INET6, &in6->sin6_addr, ip, ip_len);
+        }
+        *port = ntohs(in6->sin6_port);
+    }
+}
+
+// The least recently active session other than fd that is not already
+// closing and has been idle since before idle_since_us. Caller holds s_lock.
+static session_info_t *find_lru(int fd, int64_t idle_since_us) {
+    session_info_t *lru = NULL;
+    for (int i = 0; i < SESSION_TABLE_SLOTS; i++) {
+        session_info_t *s = &s_slots[i];
+        if (s->fd < 0 || s->fd == fd || s->closing || s->last_active_us > idle_since_us) {
+            continue;
+        }
+        if (lru == NULL || s->last_active_us < lru->last_active_us) {
+            lru = s;
+        }
+    }
+    return lru;
+}
+
+// Rows not already on their way out. Caller holds s_lock.
+static size_t count_open(void) {
+    size_t n = 0;
+    for (int i = 0; i < SESSION_TABLE_SLOTS; i++) {
+        if (s_slots[i].fd >= 0 && !s_slots[i].closing) {
+            n++;
+        }
+    }
+    return n;
+}
+
+int session_table_admit(int fd, const char *cipher, size_t max_sessions, int64_t min_idle_us) {
+    if (fd < 0) {
+        return -1;
+    }
+    session_info_t info = {
+        .fd = fd,
+        .connected_us = esp_timer_get_time(),
+    };
+    info.last_active_us = info.connected_us;
+    format_peer(fd, info.ip, sizeof(info.ip), &info.port);
+    snprintf(info.cipher, sizeof(info.cipher), "%s", cipher ? cipher : "");
+
+    bool tracked = false;
+    int victim = -1;
+    taskENTER_CRITICAL(&s_lock);
+    session_info_t *row = find(fd);
+    if (row) {
+        // Missed close for a reused fd; replace the row
+        *row = info;
+        tracked = true;
+    } else {
+        for (unsigned i = 0, idx = fd & SLOT_MASK; i < SESSION_TABLE_SLOTS; i++, idx = (idx + 1) & SLOT_MASK) {
+            if (s_slots[idx].fd < 0) {
+                s_slots[idx] = info;
+                row = &s_slots[idx];
+                s_stats.active++;
+                if (s_stats.active > s_stats.peak) {
+                    s_stats.peak = s_stats.active;
+                }
+                tracked = true;
+                break;
+            }
+        }
+    }
+    if (tracked) {
+        s_stats.accepted++;
+        if (count_open() > max_sessions) {
+            session_info_t *lru = find_lru(fd, info.connected_us - min_idle_us);
+            if (lru) {
+                lru->closing = true;
+                victim = lru->fd;
+                s_stats.evicted++;
+            } else {
+                row->closing = true;
+                victim = fd;
+                s_stats.refused++;
+            }
+        }
+    } else {
+        s_stats.table_full++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (!tracked) {
+        ESP_LOGW(TAG, "Session table full, fd %d not tracked", fd);
+    }
+    return victim;
+}
+
+void session_table_close(int fd) {
+    taskENTER_CRITICAL(&s_lock);
+    session_info_t *info = find(fd);
+    if (info) {
+        remove_slot(info - s_slots);
+        s_stats.active--;
+        s_stats.closed++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void session_table_note_request(int fd) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    session_info_t *info = find(fd);
+    if (info) {
+        info->requests++;
+        info->last_active_us = now;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void session_table_note_done(int fd) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    session_info_t *info = find(fd);
+    if (info) {
+        info->last_active_us = now;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+size_t session_table_collect_idle(int64_t idle_since_us, int *fds, size_t max) {
+    size_t n = 0;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < SESSION_TABLE_SLOTS && n < max; i++) {
+        session_info_t *s = &s_slots[i];
+        if (s->fd >= 0 && !s->closing && s->last_active_us < idle_since_us) {
+            s->closing = true;
+            fds[n++] = s->fd;
+        }
+    }
+    s_stats.reaped += n;
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+int session_table_note_low_heap(int64_t min_idle_us) {
+    int64_t now = esp_timer_get_time();
+    int victim = -1;
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.low_heap_refused++;
+    session_info_t *lru = find_lru(-1, now - min_idle_us);
+    if (lru) {
+        lru->closing = true;
+        victim = lru->fd;
+        s_stats.low_heap_evicted++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return victim;
+}
+
+static void http_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    if (event_base == ESP_HTTPS_SERVER_EVENT) {
+        // Carries no fd; only counted
+        taskENTER_CRITICAL(&s_lock);
+        s_stats.tls_errors++;
+        taskEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    const esp_http_server_event_data *data = (const esp_http_server_event_data *)event_data;
+    if (data->data_len <= 0) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    session_info_t *info = find(data->fd);
+    if (info) {
+        // A long upload is one request but keeps the session busy throughout
+        info->last_active_us = now;
+        if (event_id == HTTP_SERVER_EVENT_ON_DATA) {
+            info->bytes_in += data->data_len;
+        } else {
+            info->bytes_out += data->data_len;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t session_table_init(void) {
+    for (int i = 0; i < SESSION_TABLE_SLOTS; i++) {
+        s_slots[i].fd = -1;
+    }
+    esp_err_t err = esp_event_handler_register(ESP_HTTP_SERVER_EVENT, HTTP_SERVER_EVENT_ON_DATA, &http_event_handler, NULL);
+    if (err == ESP_OK) {
+        err = esp_event_handler_register(ESP_HTTP_SERVER_EVENT, HTTP_SERVER_EVENT_SENT_DATA, &http_event_handler, NULL);
+    }
+    if (err == ESP_OK) {
+        err = esp_event_handler_register(ESP_HTTPS_SERVER_EVENT, HTTPS_SERVER_EVENT_ERROR, &http_event_handler, NULL);
+    }
+    return err;
+}
+
+size_t session_table_snapshot(session_info_t *out, size_t max) {
+    size_t n = 0;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < SESSION_TABLE_SLOTS && n < max; i++) {
+        if (s_slots[i].fd >= 0) {
+            out[n++] = s_slots[i];
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+void session_table_get_stats(session_stats_t *stats) {
+    taskENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
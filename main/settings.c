@@ -0,0 +1,390 @@
+#include "settings.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "SETTINGS";
+
+#define SETTINGS_NAMESPACE "settings"
+#define SETTINGS_KEY "values"
+#define DEFAULT_DEVICE_NAME "gateway"
+
+// The stored record: magic and version, then for each value its key length
+// and key, type, value length and value, ints as 4 bytes little-endian.
+// Values are found by key, so a record outlives settings being added or
+// dropped.
+#define RECORD_MAGIC 0x31544553u   // "SET1"
+#define RECORD_HDR_SIZE 8
+#define RECORD_KEY_MAX 15
+#define RECORD_MAX (RECORD_HDR_SIZE + SETTING_COUNT * (3 + RECORD_KEY_MAX + SETTINGS_STR_MAX))
+
+static const setting_desc_t s_desc[SETTING_COUNT] = {
+    [SETTING_WIFI_SSID] = {"wifi_ssid", SETTING_TYPE_STR, 1, 32},
+    [SETTING_WIFI_PASSWORD] = {"wifi_password", SETTING_TYPE_STR, 0, 64, .secret = true},
+    [SETTING_WIFI_MAX_RETRY] = {"wifi_max_retry", SETTING_TYPE_INT, 1, 1000},
+    [SETTING_DEVICE_NAME] = {"device_name", SETTING_TYPE_STR, 1, 32},
+    [SETTING_LED_GPIO] = {"led_gpio", SETTING_TYPE_INT, CONFIG_ENV_GPIO_RANGE_MIN, CONFIG_ENV_GPIO_OUT_RANGE_MAX,
+                          .restart = true},
+    [SETTING_LED_BLINK_MS] = {"led_blink_ms", SETTING_TYPE_INT, 10, 3600000},
+};
+
+typedef struct {
+    uint32_t version;
+    int32_t ints[SETTING_COUNT];
+    char strs[SETTING_COUNT][SETTINGS_STR_MAX + 1];
+} values_t;
+
+#define DEFAULT_VALUES                                          \
+    {                                                           \
+        .ints = {                                               \
+            [SETTING_WIFI_MAX_RETRY] = CONFIG_ESP_MAXIMUM_RETRY, \
+            [SETTING_LED_GPIO] = CONFIG_BLINK_GPIO,             \
+            [SETTING_LED_BLINK_MS] = CONFIG_BLINK_PERIOD,       \
+        },                                                      \
+        .strs = {                                               \
+            [SETTING_WIFI_SSID] = CONFIG_ESP_WIFI_SSID,         \
+            [SETTING_WIFI_PASSWORD] = CONFIG_ESP_WIFI_PASSWORD, \
+            [SETTING_DEVICE_NAME] = DEFAULT_DEVICE_NAME,        \
+        },                                                      \
+    }
+
+static const values_t s_defaults = DEFAULT_VALUES;
+
+// Readers use s_values[s_seq & 1]. A commit fills in the other copy and then
+// bumps s_seq, so readers never see a half-written copy; one copying a
+// string only has to retry if s_seq moved meanwhile, and never waits on a
+// writer.
+static values_t s_values[2] = {DEFAULT_VALUES};
+static atomic_uint s_seq;
+
+static SemaphoreHandle_t s_commit_lock;
+static uint8_t s_record[RECORD_MAX];   // Only used under s_commit_lock
+
+static portMUX_TYPE s_sub_lock = portMUX_INITIALIZER_UNLOCKED;
+typedef struct {
+    settings_cb_t cb;
+    void *ctx;
+} settings_subscriber_t;
+static settings_subscriber_t s_subs[SETTINGS_MAX_SUBSCRIBERS];
+
+const setting_desc_t *settings_desc(setting_id_t id) {
+    return (unsigned)id < SETTING_COUNT ? &s_desc[id] : NULL;
+}
+
+int settings_find(const char *key) {
+    for (int id = 0; id < SETTING_COUNT; id++) {
+        if (strcmp(s_desc[id].key, key) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+int32_t settings_get_int(setting_id_t id) {
+    unsigned seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+    return __atomic_load_n(&s_values[seq & 1].ints[id], __ATOMIC_RELAXED);
+}
+
+void settings_get_str(setting_id_t id, char *buf, size_t len) {
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+        snprintf(buf, len, "%s", s_values[seq & 1].strs[id]);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&s_seq, memory_order_relaxed) != seq);
+}
+
+uint32_t settings_version(void) {
+    unsigned seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+    return __atomic_load_n(&s_values[seq & 1].version, __ATOMIC_RELAXED);
+}
+
+void settings_batch_init(settings_batch_t *batch) {
+    memset(batch, 0, sizeof(*batch));
+}
+
+esp_err_t settings_batch_set_int(settings_batch_t *batch, setting_id_t id, int32_t value) {
+    const setting_desc_t *desc = settings_desc(id);
+    if (desc == NULL || desc->type != SETTING_TYPE_INT || value < desc->min || value > desc->max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    batch->ints[id] = value;
+    batch->set |= SETTING_BIT(id);
+    return ESP_OK;
+}
+
+esp_err_t settings_batch_set_str(settings_batch_t *batch, setting_id_t id, const char *value) {
+    const setting_desc_t *desc = settings_desc(id);
+    if (desc == NULL || desc->type != SETTING_TYPE_STR || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len = strlen(value);
+    if (len < (size_t)desc->min || len > (size_t)desc->max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(batch->strs[id], value, len + 1);
+    batch->set |= SETTING_BIT(id);
+    return ESP_OK;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static size_t encode_record(const values_t *v, uint8_t *buf) {
+    put_u32(buf, RECORD_MAGIC);
+    put_u32(buf + 4, v->version);
+    size_t pos = RECORD_HDR_SIZE;
+    for (int id = 0; id < SETTING_COUNT; id++) {
+        size_t key_len = strlen(s_desc[id].key);
+        buf[pos++] = (uint8_t)key_len;
+        memcpy(buf + pos, s_desc[id].key, key_len);
+        pos += key_len;
+        buf[pos++] = (uint8_t)s_desc[id].type;
+        if (s_desc[id].type == SETTING_TYPE_INT) {
+            buf[pos++] = 4;
+            put_u32(buf + pos, (uint32_t)v->ints[id]);
+            pos += 4;
+        } else {
+            size_t len = strlen(v->strs[id]);
+            buf[pos++] = (uint8_t)len;
+            memcpy(buf + pos, v->strs[id], len);
+            pos += len;
+        }
+    }
+    return pos;
+}
+
+static int find_key(const uint8_t *key, size_t len) {
+    for (int id = 0; id < SETTING_COUNT; id++) {
+        if (strlen(s_desc[id].key) == len && memcmp(s_desc[id].key, key, len) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Overlays the values in a stored record on v. Returns the number taken,
+// or -1 if the record is not one of ours or is cut short.
+static int decode_record(const uint8_t *buf, size_t len, values_t *v) {
+    if (len < RECORD_HDR_SIZE || get_u32(buf) != RECORD_MAGIC) {
+        return -1;
+    }
+    v->version = get_u32(buf + 4);
+    int taken = 0;
+    size_t pos = RECORD_HDR_SIZE;
+    while (pos < len) {
+        size_t key_len = buf[pos++];
+        if (pos + key_len + 2 > len) {
+            return -1;
+        }
+        const uint8_t *key = buf + pos;
+        pos += key_len;
+        uint8_t type = buf[pos++];
+        size_t value_len = buf[pos++];
+        if (pos + value_len > len) {
+            return -1;
+        }
+        const uint8_t *value = buf + pos;
+        pos += value_len;
+
+        int id = find_key(key, key_len);
+        if (id < 0 || type != s_desc[id].type) {
+            continue;
+        }
+        if (type == SETTING_TYPE_INT && value_len == 4) {
+            int32_t n = (int32_t)get_u32(value);
+            if (n >= s_desc[id].min && n <= s_desc[id].max) {
+                v->ints[id] = n;
+                taken++;
+            }
+        } else if (type == SETTING_TYPE_STR && value_len >= (size_t)s_desc[id].min &&
+                   value_len <= (size_t)s_desc[id].max) {
+            memcpy(v->strs[id], value, value_len);
+            v->strs[id][value_len] = '\0';
+            taken++;
+        }
+    }
+    return taken;
+}
+
+// All values go in one blob: NVS writes a new blob in full before it drops
+// the old one, so after a power cut either the old or the new batch is read
+// back, never a mix of the two.
+static esp_err_t store(const values_t *v) {
+    size_t len = encode_record(v, s_record);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, SETTINGS_KEY, s_record, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+// Switches readers to the copy that was not current at seq. Caller holds
+// s_commit_lock.
+static void publish(unsigned seq) {
+    atomic_store_explicit(&s_seq, seq + 1, memory_order_release);
+}
+
+esp_err_t settings_init(void) {
+    if (s_commit_lock == NULL) {
+        s_commit_lock = xSemaphoreCreateMutex();
+        if (s_commit_lock == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xSemaphoreTake(s_commit_lock, portMAX_DELAY);
+    unsigned seq = atomic_load_explicit(&s_seq, memory_order_relaxed);
+    values_t *next = &s_values[(seq + 1) & 1];
+    *next = s_defaults;
+
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_record);
+    esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, SETTINGS_KEY, s_record, &len);
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK) {
+        int taken = decode_record(s_record, len, next);
+        if (taken < 0) {
+            ESP_LOGW(TAG, "Stored settings unreadable, using defaults");
+            *next = s_defaults;
+        } else {
+            ESP_LOGI(TAG, "Loaded version %" PRIu32 ", %d of %d values", next->version, taken, SETTING_COUNT);
+        }
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "Nothing stored yet, using defaults");
+    } else {
+        ESP_LOGW(TAG, "Failed to read stored settings, using defaults: %s", esp_err_to_name(err));
+    }
+    publish(seq);
+    xSemaphoreGive(s_commit_lock);
+    return ESP_OK;
+}
+
+// Writes the batch's values into v and returns the bits of those that differ
+static uint32_t apply_batch(const settings_batch_t *batch, values_t *v) {
+    uint32_t changed = 0;
+    for (int id = 0; id < SETTING_COUNT; id++) {
+        if (!(batch->set & SETTING_BIT(id))) {
+            continue;
+        }
+        if (s_desc[id].type == SETTING_TYPE_INT) {
+            if (v->ints[id] != batch->ints[id]) {
+                v->ints[id] = batch->ints[id];
+                changed |= SETTING_BIT(id);
+            }
+        } else if (strcmp(v->strs[id], batch->strs[id]) != 0) {
+            memcpy(v->strs[id], batch->strs[id], sizeof(v->strs[id]));
+            changed |= SETTING_BIT(id);
+        }
+    }
+    return changed;
+}
+
+// Notifies subscribers outside the lock
+static void notify(uint32_t changed) {
+    settings_subscriber_t subs[SETTINGS_MAX_SUBSCRIBERS];
+    taskENTER_CRITICAL(&s_sub_lock);
+    memcpy(subs, s_subs, sizeof(subs));
+    taskEXIT_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < SETTINGS_MAX_SUBSCRIBERS; i++) {
+        if (subs[i].cb) {
+            subs[i].cb(changed, subs[i].ctx);
+        }
+    }
+}
+
+esp_err_t settings_commit(const settings_batch_t *batch, uint32_t expected_version, uint32_t *version) {
+    if (s_commit_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_commit_lock, portMAX_DELAY);
+    unsigned seq = atomic_load_explicit(&s_seq, memory_order_relaxed);
+    const values_t *cur = &s_values[seq & 1];
+    values_t *next = &s_values[(seq + 1) & 1];
+    esp_err_t err = ESP_OK;
+    uint32_t changed = 0;
+    if (expected_version != SETTINGS_ANY_VERSION && expected_version != cur->version) {
+        err = ESP_ERR_INVALID_VERSION;
+    } else {
+        // next may still be the copy a slow reader is in; the fence keeps
+        // the writes below from showing before the s_seq that sends it back
+        atomic_thread_fence(memory_order_release);
+        *next = *cur;
+        changed = apply_batch(batch, next);
+        if (changed) {
+            next->version = cur->version + 1;
+            err = store(next);
+            if (err == ESP_OK) {
+                publish(seq);
+            }
+        }
+    }
+    uint32_t now = s_values[atomic_load_explicit(&s_seq, memory_order_relaxed) & 1].version;
+    xSemaphoreGive(s_commit_lock);
+
+    if (version) {
+        *version = now;
+    }
+    if (err != ESP_OK && err != ESP_ERR_INVALID_VERSION) {
+        ESP_LOGE(TAG, "Failed to store settings: %s", esp_err_to_name(err));
+    }
+    if (err == ESP_OK && changed) {
+        ESP_LOGI(TAG, "Committed version %" PRIu32 ", changed 0x%" PRIx32, now, changed);
+        notify(changed);
+    }
+    return err;
+}
+
+esp_err_t settings_subscribe(settings_cb_t cb, void *ctx) {
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    taskENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < SETTINGS_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[i].cb == NULL) {
+            s_subs[i].cb = cb;
+            s_subs[i].ctx = ctx;
+            err = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_sub_lock);
+    return err;
+}
+
+esp_err_t settings_unsubscribe(settings_cb_t cb, void *ctx) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < SETTINGS_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[i].cb == cb && s_subs[i].ctx == ctx) {
+            s_subs[i].cb = NULL;
+            s_subs[i].ctx = NULL;
+            err = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_sub_lock);
+    return err;
+}
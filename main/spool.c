@@ -0,0 +1,298 @@
+#include "spool.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "SPOOL";
+
+#define ITEM_MAGIC 0x5153 // "SQ"
+#define PATH_LEN 64
+
+// Same framing as log_store: crc covers len and the payload
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;
+} item_hdr_t;
+
+struct spool {
+    char dir[PATH_LEN - 16];
+    uint32_t segment_size;
+    uint32_t max_segments;
+    uint32_t head_seg;        // Segment being read
+    uint32_t head_off;
+    uint32_t tail_seg;        // Segment being appended to
+    uint32_t tail_len;
+    FILE *tail_file;
+    uint32_t peeked_len;      // Payload length of the last peek, 0 if none
+    uint32_t *seg_items;      // Items left per live segment, by seg % ring
+    uint32_t *seg_bytes;
+    uint32_t ring;
+    spool_stats_t stats;
+};
+
+static void segment_path(const spool_t *s, char *path, uint32_t seg) {
+    snprintf(path, PATH_LEN, "%s/%08" PRIx32 ".q", s->dir, seg);
+}
+
+static uint32_t item_crc(const item_hdr_t *hdr, const void *data) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->len, sizeof(hdr->len));
+    return esp_rom_crc32_le(crc, data, hdr->len);
+}
+
+// Forgets whatever is left in the head segment and moves past it
+static void drop_head(spool_t *s) {
+    uint32_t slot = s->head_seg % s->ring;
+    s->stats.items -= s->seg_items[slot];
+    s->stats.bytes -= s->seg_bytes[slot];
+    s->seg_items[slot] = 0;
+    s->seg_bytes[slot] = 0;
+    char path[PATH_LEN];
+    segment_path(s, path, s->head_seg);
+    remove(path);
+    s->head_seg++;
+    s->head_off = 0;
+    s->peeked_len = 0;
+}
+
+// On failure the tail is left closed, and the next push tries the next
+// segment again
+static esp_err_t open_tail(spool_t *s, uint32_t seg) {
+    if (s->tail_file) {
+        fclose(s->tail_file);
+    }
+    char path[PATH_LEN];
+    segment_path(s, path, seg);
+    s->tail_file = fopen(path, "ab");
+    if (s->tail_file == NULL) {
+        s->tail_len = 0;
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    s->tail_seg = seg;
+    s->tail_len = 0;
+    s->seg_items[seg % s->ring] = 0;
+    s->seg_bytes[seg % s->ring] = 0;
+    return ESP_OK;
+}
+
+// Counts the intact items of a segment left from a previous run
+static void count_segment(spool_t *s, uint32_t seg) {
+    char path[PATH_LEN];
+    segment_path(s, path, seg);
+    FILE *f = fopen(path, "rb");
+    uint32_t slot = seg % s->ring;
+    s->seg_items[slot] = 0;
+    s->seg_bytes[slot] = 0;
+    if (f == NULL) {
+        return;
+    }
+    item_hdr_t hdr;
+    static uint8_t buf[SPOOL_MAX_ITEM_SIZE];
+    while (fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == ITEM_MAGIC && hdr.len > 0 &&
+           fread(buf, 1, hdr.len, f) == hdr.len && item_crc(&hdr, buf) == hdr.crc) {
+        s->seg_items[slot]++;
+        s->seg_bytes[slot] += hdr.len;
+    }
+    fclose(f);
+    s->stats.items += s->seg_items[slot];
+    s->stats.bytes += s->seg_bytes[slot];
+}
+
+esp_err_t spool_open(const char *dir, uint32_t segment_size, uint32_t max_segments, spool_t **out) {
+    if (strlen(dir) >= sizeof(((spool_t *)0)->dir) || max_segments < 2 ||
+        segment_size < sizeof(item_hdr_t) + SPOOL_MAX_ITEM_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Failed to create %s", dir);
+        return ESP_FAIL;
+    }
+    spool_t *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->ring = max_segments + 1;
+    s->seg_items = calloc(s->ring, sizeof(uint32_t));
+    s->seg_bytes = calloc(s->ring, sizeof(uint32_t));
+    if (s->seg_items == NULL || s->seg_bytes == NULL) {
+        free(s->seg_items);
+        free(s->seg_bytes);
+        free(s);
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(s->dir, sizeof(s->dir), "%s", dir);
+    s->segment_size = segment_size;
+    s->max_segments = max_segments;
+
+    bool found = false;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        char *end;
+        unsigned long seg = strtoul(entry->d_name, &end, 16);
+        if (end == entry->d_name || strcmp(end, ".q") != 0) {
+            continue;
+        }
+        if (!found || seg < first) {
+            first = seg;
+        }
+        if (!found || seg > last) {
+            last = seg;
+        }
+        found = true;
+    }
+    if (d) {
+        closedir(d);
+    }
+
+    // Always append to a fresh segment so a torn tail is never extended
+    esp_err_t err;
+    if (found) {
+        s->head_seg = first;
+        while (last - s->head_seg + 1 >= max_segments) {
+            drop_head(s);
+        }
+        for (uint32_t seg = s->head_seg; seg <= last; seg++) {
+            count_segment(s, seg);
+        }
+        err = open_tail(s, last + 1);
+    } else {
+        err = open_tail(s, 0);
+    }
+    if (err != ESP_OK) {
+        free(s->seg_items);
+        free(s->seg_bytes);
+        free(s);
+        return err;
+    }
+    if (s->stats.items) {
+        ESP_LOGI(TAG, "%s: %" PRIu32 " items (%" PRIu32 " bytes) left from before", dir, s->stats.items,
+                 s->stats.bytes);
+    }
+    *out = s;
+    return ESP_OK;
+}
+
+esp_err_t spool_push(spool_t *s, const void *data, size_t len) {
+    if (data == NULL || len == 0 || len > SPOOL_MAX_ITEM_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    item_hdr_t hdr = {
+        .magic = ITEM_MAGIC,
+        .len = (uint16_t)len,
+    };
+    hdr.crc = item_crc(&hdr, data);
+
+    if (s->tail_file == NULL || s->tail_len + sizeof(hdr) + len > s->segment_size) {
+        if (open_tail(s, s->tail_seg + 1) != ESP_OK) {
+            s->stats.write_errors++;
+            return ESP_FAIL;
+        }
+        while (s->tail_seg - s->head_seg + 1 > s->max_segments) {
+            s->stats.dropped += s->seg_items[s->head_seg % s->ring];
+            drop_head(s);
+        }
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, s->tail_file) != 1 || fwrite(data, 1, len, s->tail_file) != len ||
+        fflush(s->tail_file) != 0 || fsync(fileno(s->tail_file)) != 0) {
+        // Start over in a new segment rather than append after a torn item
+        s->stats.write_errors++;
+        if (open_tail(s, s->tail_seg + 1) != ESP_OK) {
+            s->stats.write_errors++;
+        }
+        return ESP_FAIL;
+    }
+    uint32_t slot = s->tail_seg % s->ring;
+    s->tail_len += sizeof(hdr) + len;
+    s->seg_items[slot]++;
+    s->seg_bytes[slot] += len;
+    s->stats.items++;
+    s->stats.bytes += len;
+    s->stats.pushed++;
+    return ESP_OK;
+}
+
+esp_err_t spool_peek(spool_t *s, void *buf, size_t size, size_t *len) {
+    s->peeked_len = 0;
+    while (s->stats.items > 0) {
+        uint32_t slot = s->head_seg % s->ring;
+        if (s->seg_items[slot] == 0) {
+            if (s->head_seg == s->tail_seg) {
+                break;
+            }
+            drop_head(s);
+            continue;
+        }
+        char path[PATH_LEN];
+        segment_path(s, path, s->head_seg);
+        FILE *f = fopen(path, "rb");
+        item_hdr_t hdr;
+        bool ok = f && fseek(f, s->head_off, SEEK_SET) == 0 && fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  hdr.magic == ITEM_MAGIC && hdr.len > 0 && hdr.len <= SPOOL_MAX_ITEM_SIZE;
+        if (ok && hdr.len > size) {
+            fclose(f);
+            *len = hdr.len;
+            s->peeked_len = hdr.len;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        ok = ok && fread(buf, 1, hdr.len, f) == hdr.len && item_crc(&hdr, buf) == hdr.crc;
+        if (f) {
+            fclose(f);
+        }
+        if (!ok) {
+            // The rest of a damaged segment cannot be trusted
+            s->stats.read_errors++;
+            if (s->head_seg == s->tail_seg) {
+                s->stats.items -= s->seg_items[slot];
+                s->stats.bytes -= s->seg_bytes[slot];
+                s->seg_items[slot] = 0;
+                s->seg_bytes[slot] = 0;
+                if (open_tail(s, s->tail_seg + 1) != ESP_OK) {
+                    s->stats.write_errors++;
+                }
+            }
+            drop_head(s);
+            continue;
+        }
+        *len = hdr.len;
+        s->peeked_len = hdr.len;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+void spool_pop(spool_t *s) {
+    if (s->peeked_len == 0) {
+        return;
+    }
+    uint32_t slot = s->head_seg % s->ring;
+    s->head_off += sizeof(item_hdr_t) + s->peeked_len;
+    s->seg_items[slot]--;
+    s->seg_bytes[slot] -= s->peeked_len;
+    s->stats.items--;
+    s->stats.bytes -= s->peeked_len;
+    s->stats.popped++;
+    s->peeked_len = 0;
+    if (s->seg_items[slot] == 0) {
+        // Drained: start the writer on a fresh file when it was this one
+        if (s->head_seg == s->tail_seg && open_tail(s, s->tail_seg + 1) != ESP_OK) {
+            s->stats.write_errors++;
+        }
+        drop_head(s);
+    }
+}
+
+void spool_get_stats(const spool_t *s, spool_stats_t *stats) {
+    *stats = s->stats;
+    stats->segments = s->tail_seg - s->head_seg + 1;
+}
@@ -0,0 +1,302 @@
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY || !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#error "task_profiler needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS"
+#endif
+
+// IDF 5 can widen the counters to 64 bits; the profiler only uses deltas
+// between samples, so the low 32 bits are enough either way.
+#ifndef configRUN_TIME_COUNTER_TYPE
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
+static const char *TAG = "TASK_PROF";
+
+#define MAX_TASKS CONFIG_TASK_PROFILER_MAX_TASKS
+#define WINDOW CONFIG_TASK_PROFILER_WINDOW
+#define RING (WINDOW + 1)   // Samples kept, so a full window has both ends
+#define MIN_STACK_MARGIN 512
+#define STACK_ROUND 256
+
+typedef struct {
+    uint32_t number;          // 0 for a free slot
+    char name[configMAX_TASK_NAME_LEN];
+    uint8_t priority;
+    uint8_t state;
+    uint32_t first_sample;
+    uint32_t last_sample;
+    uint32_t stack_free;
+    uint32_t stack_free_min;
+    uint32_t runtime[RING];   // Indexed like s_total
+} slot_t;
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t size;
+} declared_t;
+
+static const char *const state_names[] = {
+    [eRunning] = "running",
+    [eReady] = "ready",
+    [eBlocked] = "blocked",
+    [eSuspended] = "suspended",
+    [eDeleted] = "deleted",
+    [eInvalid] = "invalid",
+};
+
+static SemaphoreHandle_t s_lock;
+static slot_t s_slots[MAX_TASKS];
+static uint32_t s_total[RING];
+static uint32_t s_samples;
+static uint32_t s_overflow;
+// Room for a few tasks past the limit so uxTaskGetSystemState() still
+// succeeds and the extra ones can be counted
+static TaskStatus_t s_status[MAX_TASKS + 8];
+
+static portMUX_TYPE s_declared_lock = portMUX_INITIALIZER_UNLOCKED;
+static declared_t s_declared[MAX_TASKS];
+
+void task_profiler_declare_stack(const char *name, uint32_t stack_size) {
+    taskENTER_CRITICAL(&s_declared_lock);
+    declared_t *free_entry = NULL;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        declared_t *d = &s_declared[i];
+        if (d->size && strncmp(d->name, name, sizeof(d->name) - 1) == 0) {
+            d->size = stack_size;
+            taskEXIT_CRITICAL(&s_declared_lock);
+            return;
+        }
+        if (d->size == 0 && free_entry == NULL) {
+            free_entry = d;
+        }
+    }
+    if (free_entry) {
+        snprintf(free_entry->name, sizeof(free_entry->name), "%s", name);
+        free_entry->size = stack_size;
+    }
+    taskEXIT_CRITICAL(&s_declared_lock);
+}
+
+static uint32_t declared_stack(const char *name) {
+    uint32_t size = 0;
+    taskENTER_CRITICAL(&s_declared_lock);
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (s_declared[i].size && strncmp(s_declared[i].name, name, sizeof(s_declared[i].name) - 1) == 0) {
+            size = s_declared[i].size;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_declared_lock);
+    return size;
+}
+
+static uint32_t recommend_stack(uint32_t size, uint32_t free_min) {
+    if (size == 0) {
+        return 0;
+    }
+    uint32_t used = size > free_min ? size - free_min : 0;
+    uint32_t margin = used * CONFIG_TASK_PROFILER_STACK_MARGIN_PCT / 100;
+    if (margin < MIN_STACK_MARGIN) {
+        margin = MIN_STACK_MARGIN;
+    }
+    return (used + margin + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+}
+
+static slot_t *find_slot(uint32_t number) {
+    slot_t *free_slot = NULL;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (s_slots[i].number == number) {
+            return &s_slots[i];
+        }
+        if (s_slots[i].number == 0 && free_slot == NULL) {
+            free_slot = &s_slots[i];
+        }
+    }
+    return free_slot;
+}
+
+static void take_sample(void) {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t n = uxTaskGetSystemState(s_status, sizeof(s_status) / sizeof(s_status[0]), &total);
+    if (n == 0) {
+        ESP_LOGW(TAG, "More than %u tasks, sample skipped", (unsigned)(sizeof(s_status) / sizeof(s_status[0])));
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t sample = s_samples;
+    size_t idx = sample % RING;
+    uint32_t overflow = 0;
+    s_total[idx] = (uint32_t)total;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *st = &s_status[i];
+        slot_t *slot = find_slot(st->xTaskNumber);
+        if (slot == NULL) {
+            overflow++;
+            continue;
+        }
+        if (slot->number == 0) {
+            slot->number = st->xTaskNumber;
+            snprintf(slot->name, sizeof(slot->name), "%s", st->pcTaskName);
+            slot->first_sample = sample;
+            slot->stack_free_min = UINT32_MAX;
+        }
+        slot->priority = st->uxCurrentPriority;
+        slot->state = st->eCurrentState;
+        slot->last_sample = sample;
+        slot->runtime[idx] = (uint32_t)st->ulRunTimeCounter;
+        slot->stack_free = st->usStackHighWaterMark;
+        if (slot->stack_free < slot->stack_free_min) {
+            slot->stack_free_min = slot->stack_free;
+        }
+    }
+    // Tasks missing from this sample have been deleted
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (s_slots[i].number != 0 && s_slots[i].last_sample != sample) {
+            s_slots[i].number = 0;
+        }
+    }
+    s_overflow = overflow;
+    s_samples = sample + 1;
+    xSemaphoreGive(s_lock);
+}
+
+// CPU share between two samples still in the ring. Caller holds s_lock.
+static float cpu_pct(const slot_t *slot, uint32_t from, uint32_t to) {
+    uint32_t dt = s_total[to % RING] - s_total[from % RING];
+    if (dt == 0) {
+        return 0.0f;
+    }
+    uint32_t run = slot->runtime[to % RING] - slot->runtime[from % RING];
+    return 100.0f * (float)run / (float)dt;
+}
+
+static int busiest_first(const void *a, const void *b) {
+    float pa = ((const task_profile_t *)a)->cpu_pct_window;
+    float pb = ((const task_profile_t *)b)->cpu_pct_window;
+    return (pa < pb) - (pa > pb);
+}
+
+size_t task_profiler_get(task_profile_t *out, size_t max, task_profiler_info_t *info) {
+    if (s_lock == NULL) {
+        if (info) {
+            memset(info, 0, sizeof(*info));
+        }
+        return 0;
+    }
+    size_t count = 0;
+    uint32_t tasks = 0;
+    uint32_t declared = 0;
+    uint32_t reclaimable = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t samples = s_samples;
+    uint32_t latest = samples - 1;
+    uint32_t oldest = samples > RING ? samples - RING : 0;
+    for (int i = 0; i < MAX_TASKS && samples > 0; i++) {
+        const slot_t *slot = &s_slots[i];
+        if (slot->number == 0) {
+            continue;
+        }
+        tasks++;
+        uint32_t size = declared_stack(slot->name);
+        uint32_t recommended = recommend_stack(size, slot->stack_free_min);
+        declared += size;
+        if (recommended < size) {
+            reclaimable += size - recommended;
+        }
+        if (count >= max) {
+            continue;
+        }
+        uint32_t from = slot->first_sample > oldest ? slot->first_sample : oldest;
+        task_profile_t *p = &out[count++];
+        snprintf(p->name, sizeof(p->name), "%s", slot->name);
+        p->number = slot->number;
+        p->priority = slot->priority;
+        p->state = slot->state;
+        p->cpu_pct = slot->first_sample < latest ? cpu_pct(slot, latest - 1, latest) : -1.0f;
+        p->cpu_pct_window = from < latest ? cpu_pct(slot, from, latest) : -1.0f;
+        p->stack_size = size;
+        p->stack_free = slot->stack_free;
+        p->stack_free_min = slot->stack_free_min;
+        p->stack_recommended = recommended;
+    }
+    if (info) {
+        info->samples = samples;
+        info->interval_ms = CONFIG_TASK_PROFILER_INTERVAL_MS;
+        info->window_ms = (samples > 1 ? latest - oldest : 0) * CONFIG_TASK_PROFILER_INTERVAL_MS;
+        info->tasks = tasks;
+        info->overflow = s_overflow;
+        info->stack_declared = declared;
+        info->stack_reclaimable = reclaimable;
+    }
+    xSemaphoreGive(s_lock);
+    qsort(out, count, sizeof(*out), busiest_first);
+    return count;
+}
+
+void task_profiler_log_report(void) {
+    static task_profile_t profiles[MAX_TASKS];
+    task_profiler_info_t info;
+    size_t n = task_profiler_get(profiles, MAX_TASKS, &info);
+    ESP_LOGI(TAG, "Stack report: %" PRIu32 " tasks, %" PRIu32 " bytes declared, %" PRIu32 " reclaimable",
+             info.tasks, info.stack_declared, info.stack_reclaimable);
+    for (size_t i = 0; i < n; i++) {
+        const task_profile_t *p = &profiles[i];
+        if (p->stack_size) {
+            ESP_LOGI(TAG, "  %-16s size %6" PRIu32 "  min free %6" PRIu32 "  recommended %6" PRIu32,
+                     p->name, p->stack_size, p->stack_free_min, p->stack_recommended);
+        } else {
+            ESP_LOGI(TAG, "  %-16s size      ?  min free %6" PRIu32, p->name, p->stack_free_min);
+        }
+    }
+}
+
+const char *task_profiler_state_name(uint8_t state) {
+    return state < sizeof(state_names) / sizeof(state_names[0]) ? state_names[state] : "?";
+}
+
+static void task_profiler_task(void *arg) {
+    const uint32_t report_every =
+        (uint32_t)CONFIG_TASK_PROFILER_REPORT_INTERVAL_S * 1000 / CONFIG_TASK_PROFILER_INTERVAL_MS;
+    TickType_t wake = xTaskGetTickCount();
+    while (1) {
+        take_sample();
+        if (report_every && s_samples % report_every == 0) {
+            task_profiler_log_report();
+        }
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_TASK_PROFILER_INTERVAL_MS));
+    }
+}
+
+esp_err_t task_profiler_init(void) {
+    // Tasks IDF creates itself
+    task_profiler_declare_stack("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+    task_profiler_declare_stack("IDLE", CONFIG_FREERTOS_IDLE_TASK_STACKSIZE);
+    task_profiler_declare_stack("esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE);
+    task_profiler_declare_stack("sys_evt", CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE);
+#ifdef CONFIG_LWIP_TCPIP_TASK_STACK_SIZE
+    task_profiler_declare_stack("tiT", CONFIG_LWIP_TCPIP_TASK_STACK_SIZE);
+#endif
+#ifdef CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH
+    task_profiler_declare_stack("Tmr Svc", CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH);
+#endif
+    task_profiler_declare_stack("task_prof", 3072);
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(task_profiler_task, "task_prof", 3072, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,496 @@
+#include "tsdb.h"
+#include "heap_monitor.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "TSDB";
+
+#define CHUNK_MAGIC 0x5354 // "TS"
+#define CHUNK_VERSION 1
+#define CHUNKS_PER_SECTOR (SPI_FLASH_SEC_SIZE / TSDB_CHUNK_SIZE)
+#define INDEX_EMPTY 0xff
+#define WINDOW_NONE 0xff
+
+// Worst case for one sample: '1111' + 32-bit dod, '11' + 5 + 5 + 32-bit xor
+#define MAX_SAMPLE_BITS 80
+
+// On-flash chunk header; crc covers the header up to crc and the payload
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t series;
+    uint8_t version;
+    uint16_t count;
+    uint16_t bits;     // Payload bits used
+    uint32_t seq;      // Increases with every chunk written
+    int64_t t_first;
+    int64_t t_last;
+    uint32_t crc;
+} chunk_hdr_t;
+
+#define PAYLOAD_SIZE (TSDB_CHUNK_SIZE - sizeof(chunk_hdr_t))
+
+typedef struct __attribute__((packed)) {
+    chunk_hdr_t hdr;
+    uint8_t payload[PAYLOAD_SIZE];
+} chunk_t;
+
+// Encoder state for a series' open chunk
+typedef struct {
+    chunk_t chunk;
+    int64_t last_ts;     // Survives sealing, for the ordering check
+    int64_t prev_delta;
+    uint32_t prev_val;
+    uint8_t lead;        // XOR window of the previous value
+    uint8_t trail;
+} series_t;
+
+// Time bounds are whole seconds (rounded outwards) to keep an entry at 12
+// bytes; a query may read a chunk that turns out to miss by under a second.
+typedef struct {
+    uint32_t t_lo;
+    uint32_t t_hi;
+    uint16_t count;
+    uint8_t series;     // INDEX_EMPTY when the slot holds no live chunk
+} index_entry_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint32_t pos;
+    uint32_t end;
+} bit_reader_t;
+
+static SemaphoreHandle_t s_lock;
+static const esp_partition_t *s_part;
+static index_entry_t *s_index;
+static uint32_t s_slots;
+static uint32_t s_head;     // Next slot to write
+static uint32_t s_seq;
+static series_t s_series[CONFIG_TSDB_MAX_SERIES];
+static tsdb_stats_t s_stats;
+
+static void put_bits(chunk_t *c, uint32_t value, int n) {
+    while (n > 0) {
+        int free = 8 - (c->hdr.bits & 7);
+        int take = n < free ? n : free;
+        uint8_t part = (value >> (n - take)) & ((1u << take) - 1);
+        c->payload[c->hdr.bits >> 3] |= part << (free - take);
+        c->hdr.bits += take;
+        n -= take;
+    }
+}
+
+static uint32_t get_bits(bit_reader_t *r, int n) {
+    uint32_t value = 0;
+    while (n > 0) {
+        int avail = 8 - (r->pos & 7);
+        int take = n < avail ? n : avail;
+        uint8_t byte = r->buf[r->pos >> 3];
+        value = (value << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+        r->pos += take;
+        n -= take;
+    }
+    return value;
+}
+
+static int64_t sign_extend(uint32_t value, int n) {
+    return n == 32 ? (int64_t)(int32_t)value : (int64_t)((int32_t)(value << (32 - n)) >> (32 - n));
+}
+
+static uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t chunk_crc(const chunk_t *c) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&c->hdr, offsetof(chunk_hdr_t, crc));
+    return esp_rom_crc32_le(crc, c->payload, (c->hdr.bits + 7) / 8);
+}
+
+static bool chunk_valid(const chunk_t *c) {
+    return c->hdr.magic == CHUNK_MAGIC && c->hdr.version == CHUNK_VERSION && c->hdr.count > 0 &&
+           c->hdr.bits <= PAYLOAD_SIZE * 8 && c->hdr.series < CONFIG_TSDB_MAX_SERIES &&
+           chunk_crc(c) == c->hdr.crc;
+}
+
+static void reset_chunk(series_t *s, uint8_t series) {
+    memset(&s->chunk, 0, sizeof(s->chunk));
+    s->chunk.hdr.magic = CHUNK_MAGIC;
+    s->chunk.hdr.series = series;
+    s->chunk.hdr.version = CHUNK_VERSION;
+    s->prev_delta = 0;
+    s->lead = WINDOW_NONE;
+}
+
+static uint32_t to_sec_floor(int64_t ms) {
+    return ms / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(ms / 1000);
+}
+
+static uint32_t to_sec_ceil(int64_t ms) {
+    return (ms + 999) / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)((ms + 999) / 1000);
+}
+
+static void index_chunk(uint32_t slot, const chunk_hdr_t *hdr) {
+    s_index[slot] = (index_entry_t){
+        .t_lo = to_sec_floor(hdr->t_first),
+        .t_hi = to_sec_ceil(hdr->t_last),
+        .count = hdr->count,
+        .series = hdr->series,
+    };
+    s_stats.live_chunks++;
+}
+
+// Writes the open chunk of s at the head, erasing the head's sector first
+// when entering it. Caller holds s_lock.
+static esp_err_t seal_locked(series_t *s) {
+    chunk_t *c = &s->chunk;
+    if (c->hdr.count == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    if (s_head % CHUNKS_PER_SECTOR == 0) {
+        for (uint32_t i = s_head; i < s_head + CHUNKS_PER_SECTOR && i < s_slots; i++) {
+            if (s_index[i].series != INDEX_EMPTY) {
+                s_index[i].series = INDEX_EMPTY;
+                s_stats.live_chunks--;
+                s_stats.dropped_chunks++;
+            }
+        }
+        err = esp_partition_erase_range(s_part, (size_t)s_head * TSDB_CHUNK_SIZE, SPI_FLASH_SEC_SIZE);
+        s_stats.erased_sectors++;
+    }
+    if (err == ESP_OK) {
+        c->hdr.seq = s_seq++;
+        c->hdr.crc = chunk_crc(c);
+        err = esp_partition_write(s_part, (size_t)s_head * TSDB_CHUNK_SIZE, c, sizeof(*c));
+    }
+    if (err == ESP_OK) {
+        index_chunk(s_head, &c->hdr);
+        s_stats.sealed_chunks++;
+        s_stats.sealed_samples += c->hdr.count;
+        s_stats.sealed_bits += c->hdr.bits;
+    } else {
+        s_stats.write_errors++;
+        ESP_LOGE(TAG, "Chunk write to slot %" PRIu32 " failed (%s)", s_head, esp_err_to_name(err));
+    }
+    // A failed slot is left behind; its CRC keeps it out of the next scan
+    s_head = (s_head + 1) % s_slots;
+    reset_chunk(s, c->hdr.series);
+    return err;
+}
+
+static void encode_value(series_t *s, uint32_t value) {
+    chunk_t *c = &s->chunk;
+    uint32_t x = value ^ s->prev_val;
+    s->prev_val = value;
+    if (x == 0) {
+        put_bits(c, 0, 1);
+        return;
+    }
+    int lead = __builtin_clz(x);
+    int trail = __builtin_ctz(x);
+    if (lead > 31) {
+        lead = 31;
+    }
+    if (s->lead != WINDOW_NONE && lead >= s->lead && trail >= s->trail) {
+        // Meaningful bits fit the previous window
+        put_bits(c, 0x2, 2);
+        put_bits(c, x >> s->trail, 32 - s->lead - s->trail);
+        return;
+    }
+    int len = 32 - lead - trail;
+    put_bits(c, 0x3, 2);
+    put_bits(c, lead, 5);
+    put_bits(c, len - 1, 5);
+    put_bits(c, x >> trail, len);
+    s->lead = lead;
+    s->trail = trail;
+}
+
+// Encodes the delta-of-delta in the smallest bucket that holds it. Returns
+// false if it does not fit 32 bits, in which case the chunk is untouched.
+static bool encode_timestamp(series_t *s, int64_t ts) {
+    chunk_t *c = &s->chunk;
+    int64_t delta = ts - c->hdr.t_last;
+    int64_t dod = delta - s->prev_delta;
+    if (dod == 0) {
+        put_bits(c, 0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        put_bits(c, 0x2, 2);
+        put_bits(c, (uint32_t)dod & 0x7f, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        put_bits(c, 0x6, 3);
+        put_bits(c, (uint32_t)dod & 0x1ff, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        put_bits(c, 0xe, 4);
+        put_bits(c, (uint32_t)dod & 0xfff, 12);
+    } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+        put_bits(c, 0xf, 4);
+        put_bits(c, (uint32_t)dod, 32);
+    } else {
+        return false;
+    }
+    s->prev_delta = delta;
+    return true;
+}
+
+esp_err_t tsdb_append(uint8_t series, int64_t ts_ms, float value) {
+    if (series >= CONFIG_TSDB_MAX_SERIES || ts_ms < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    series_t *s = &s_series[series];
+    if (ts_ms < s->last_ts) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    chunk_t *c = &s->chunk;
+    if (c->hdr.count > 0 &&
+        (c->hdr.bits + MAX_SAMPLE_BITS > PAYLOAD_SIZE * 8 || !encode_timestamp(s, ts_ms))) {
+        err = seal_locked(s);
+    }
+    if (c->hdr.count == 0) {
+        // First sample: timestamp in the header, value stored raw
+        c->hdr.t_first = ts_ms;
+        s->prev_val = float_bits(value);
+        put_bits(c, s->prev_val, 32);
+    } else {
+        encode_value(s, float_bits(value));
+    }
+    c->hdr.t_last = ts_ms;
+    c->hdr.count++;
+    s->last_ts = ts_ms;
+    s_stats.samples++;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t tsdb_flush(void) {
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        esp_err_t e = seal_locked(&s_series[i]);
+        if (e != ESP_OK) {
+            err = e;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+// Replays a chunk through cb. Returns false once cb asks to stop.
+static bool decode_chunk(const chunk_t *c, int64_t from_ms, int64_t to_ms, tsdb_visit_cb_t cb, void *ctx) {
+    bit_reader_t r = {.buf = c->payload, .end = c->hdr.bits};
+    int64_t ts = c->hdr.t_first;
+    int64_t delta = 0;
+    uint32_t value = get_bits(&r, 32);
+    int lead = 0;
+    int trail = 0;
+    for (uint16_t i = 0; i < c->hdr.count; i++) {
+        if (i > 0) {
+            int64_t dod;
+            if (get_bits(&r, 1) == 0) {
+                dod = 0;
+            } else if (get_bits(&r, 1) == 0) {
+                dod = sign_extend(get_bits(&r, 7), 7);
+            } else if (get_bits(&r, 1) == 0) {
+                dod = sign_extend(get_bits(&r, 9), 9);
+            } else if (get_bits(&r, 1) == 0) {
+                dod = sign_extend(get_bits(&r, 12), 12);
+            } else {
+                dod = sign_extend(get_bits(&r, 32), 32);
+            }
+            delta += dod;
+            ts += delta;
+            if (get_bits(&r, 1) == 1) {
+                if (get_bits(&r, 1) == 1) {
+                    lead = get_bits(&r, 5);
+                    trail = 32 - lead - ((int)get_bits(&r, 5) + 1);
+                }
+                value ^= get_bits(&r, 32 - lead - trail) << trail;
+            }
+        }
+        if (r.pos > r.end || ts > to_ms) {
+            break;
+        }
+        if (ts >= from_ms && !cb(c->hdr.series, ts, bits_float(value), ctx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t tsdb_query(uint8_t series, int64_t from_ms, int64_t to_ms, tsdb_visit_cb_t cb, void *ctx) {
+    if (series >= CONFIG_TSDB_MAX_SERIES || from_ms > to_ms || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    chunk_t *buf = heap_monitor_malloc(HEAP_TAG_STORAGE, sizeof(*buf));
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t start = s_head;
+    xSemaphoreGive(s_lock);
+
+    // Oldest slot first; within a series the ring is in time order. The
+    // chunk is copied under the lock so the ring cannot erase it mid-read,
+    // and decoded outside it.
+    bool more = true;
+    for (uint32_t i = 0; i < s_slots && more; i++) {
+        uint32_t slot = (start + i) % s_slots;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        const index_entry_t *entry = &s_index[slot];
+        if (entry->series != series) {
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+        if ((int64_t)entry->t_hi * 1000 < from_ms || (int64_t)entry->t_lo * 1000 > to_ms) {
+            s_stats.chunks_skipped++;
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+        esp_err_t err = esp_partition_read(s_part, (size_t)slot * TSDB_CHUNK_SIZE, buf, sizeof(*buf));
+        s_stats.chunks_read++;
+        xSemaphoreGive(s_lock);
+        if (err == ESP_OK && chunk_valid(buf) && buf->hdr.series == series) {
+            more = decode_chunk(buf, from_ms, to_ms, cb, ctx);
+        }
+    }
+
+    if (more) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        const chunk_t *open = &s_series[series].chunk;
+        bool have = open->hdr.count > 0 && open->hdr.t_last >= from_ms && open->hdr.t_first <= to_ms;
+        if (have) {
+            memcpy(buf, open, sizeof(*buf));
+        }
+        xSemaphoreGive(s_lock);
+        if (have) {
+            decode_chunk(buf, from_ms, to_ms, cb, ctx);
+        }
+    }
+    heap_monitor_free(HEAP_TAG_STORAGE, buf);
+    return ESP_OK;
+}
+
+void tsdb_get_stats(tsdb_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+int64_t tsdb_last_ts(void) {
+    int64_t last = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        if (s_series[i].last_ts > last) {
+            last = s_series[i].last_ts;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return last;
+}
+
+static bool slot_blank(uint32_t slot, chunk_t *buf) {
+    if (esp_partition_read(s_part, (size_t)slot * TSDB_CHUNK_SIZE, buf, sizeof(*buf)) != ESP_OK) {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)buf;
+    for (size_t i = 0; i < sizeof(*buf); i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads every chunk header back, so a reboot only loses the open chunks.
+// Calling it again rescans the partition and discards open chunks.
+esp_err_t tsdb_init(void) {
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TSDB_PARTITION);
+    if (s_part == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition", TSDB_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        if (s_lock == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    chunk_t *buf = heap_monitor_malloc(HEAP_TAG_STORAGE, sizeof(*buf));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    heap_monitor_free(HEAP_TAG_STORAGE, s_index);
+    s_slots = s_part->size / SPI_FLASH_SEC_SIZE * CHUNKS_PER_SECTOR;
+    s_index = heap_monitor_malloc(HEAP_TAG_STORAGE, s_slots * sizeof(*s_index));
+    if (buf == NULL || s_index == NULL) {
+        xSemaphoreGive(s_lock);
+        heap_monitor_free(HEAP_TAG_STORAGE, buf);
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.total_chunks = s_slots;
+    for (int i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        reset_chunk(&s_series[i], i);
+        s_series[i].last_ts = 0;
+    }
+
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t slot = 0; slot < s_slots; slot++) {
+        s_index[slot].series = INDEX_EMPTY;
+        if (esp_partition_read(s_part, (size_t)slot * TSDB_CHUNK_SIZE, buf, sizeof(*buf)) != ESP_OK ||
+            buf->hdr.magic == 0xffff) {
+            continue;
+        }
+        if (!chunk_valid(buf)) {
+            s_stats.bad_chunks++;
+            continue;
+        }
+        index_chunk(slot, &buf->hdr);
+        series_t *s = &s_series[buf->hdr.series];
+        if (buf->hdr.t_last > s->last_ts) {
+            s->last_ts = buf->hdr.t_last;
+        }
+        if (!found || buf->hdr.seq > s_seq) {
+            s_seq = buf->hdr.seq;
+            newest = slot;
+        }
+        found = true;
+    }
+    s_head = 0;
+    if (found) {
+        s_seq++;
+        s_head = (newest + 1) % s_slots;
+        // The rest of the head's sector must still be erased; if a write was
+        // torn there, move on to the next sector
+        for (uint32_t slot = s_head; slot % CHUNKS_PER_SECTOR != 0; slot++) {
+            if (!slot_blank(slot, buf)) {
+                s_head = (s_head / CHUNKS_PER_SECTOR + 1) * CHUNKS_PER_SECTOR % s_slots;
+                break;
+            }
+        }
+    } else {
+        s_seq = 0;
+    }
+    xSemaphoreGive(s_lock);
+    heap_monitor_free(HEAP_TAG_STORAGE, buf);
+
+    ESP_LOGI(TAG, "%" PRIu32 "/%" PRIu32 " chunks live, %" PRIu32 " bad, head at %" PRIu32,
+             s_stats.live_chunks, s_slots, s_stats.bad_chunks, s_head);
+    return ESP_OK;
+}
@@ -0,0 +1,495 @@
+#include "uplink.h"
+#include "ingest.h"
+#include "spool.h"
+#include "task_profiler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "mqtt_client.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+static const char *TAG = "UPLINK";
+
+// The spool shares the record log's LittleFS partition
+#ifndef LOG_STORE_BASE_PATH
+#define LOG_STORE_BASE_PATH "/data"
+#endif
+#define SPOOL_DIR LOG_STORE_BASE_PATH "/uplink"
+
+#define UPLINK_TASK_STACK_SIZE 4096
+#define TICK_MS 100
+#define BATCH_CAPACITY ((CONFIG_UPLINK_BATCH_MAX_BYTES - UPLINK_BATCH_HDR_SIZE) / UPLINK_RECORD_SIZE)
+#define READY_SLOTS 4
+#define EVENT_QUEUE_LEN (CONFIG_UPLINK_MAX_INFLIGHT + 8)
+#define TOPIC_LEN 96
+
+_Static_assert(CONFIG_UPLINK_BATCH_MAX_BYTES <= SPOOL_MAX_ITEM_SIZE, "a batch must fit in one spool item");
+
+typedef struct {
+    uint16_t count;
+    int64_t base_ms;          // Wall time of the first reading
+    int64_t opened_us;        // esp_timer_get_time() at the first reading
+    uint8_t data[CONFIG_UPLINK_BATCH_MAX_BYTES];
+} batch_t;
+
+typedef struct {
+    int msg_id;               // 0 for a free slot
+    int64_t sent_us;
+    size_t len;
+    uint8_t data[CONFIG_UPLINK_BATCH_MAX_BYTES];
+} inflight_t;
+
+typedef enum {
+    EV_CONNECTED,
+    EV_DISCONNECTED,
+    EV_PUBLISHED,
+    EV_BATCH,
+} uplink_event_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    int msg_id;
+} uplink_event_t;
+
+// Shared with the ingest dispatcher: the ready ring and the stats. The
+// batch being filled is s_ready[s_ready_tail % READY_SLOTS], sealed ones
+// run from s_ready_head up to it.
+static SemaphoreHandle_t s_lock;
+static batch_t s_ready[READY_SLOTS];
+static uint32_t s_ready_head;
+static uint32_t s_ready_tail;
+static uint32_t s_batch_seq;
+static uplink_stats_t s_stats;
+static uint64_t s_latency_sum_ms;
+
+// Owned by the uplink task
+static QueueHandle_t s_events;
+static esp_mqtt_client_handle_t s_client;
+static spool_t *s_spool;
+static inflight_t s_inflight[CONFIG_UPLINK_MAX_INFLIGHT];
+static bool s_connected;
+static uint8_t s_scratch[CONFIG_UPLINK_BATCH_MAX_BYTES];
+static char s_client_id[24];
+static char s_topic_sensors[TOPIC_LEN];
+static char s_topic_status[TOPIC_LEN];
+
+static int64_t now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static int64_t get_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = v << 8 | p[i];
+    }
+    return (int64_t)v;
+}
+
+static size_t batch_len(const batch_t *b) {
+    return UPLINK_BATCH_HDR_SIZE + (size_t)b->count * UPLINK_RECORD_SIZE;
+}
+
+static void notify(uint8_t kind, int msg_id) {
+    uplink_event_t ev = {.kind = kind, .msg_id = msg_id};
+    xQueueSend(s_events, &ev, 0);
+}
+
+// Closes the open batch if there is room for another. Caller holds s_lock.
+static bool seal_locked(void) {
+    if (s_ready_tail - s_ready_head >= READY_SLOTS - 1) {
+        return false;
+    }
+    batch_t *b = &s_ready[s_ready_tail % READY_SLOTS];
+    uint64_t base = (uint64_t)b->base_ms;
+    b->data[0] = UPLINK_BATCH_VERSION;
+    b->data[1] = 0;
+    put_le16(b->data + 2, b->count);
+    put_le32(b->data + 4, s_batch_seq++);
+    put_le32(b->data + 8, (uint32_t)base);
+    put_le32(b->data + 12, (uint32_t)(base >> 32));
+    s_ready_tail++;
+    s_ready[s_ready_tail % READY_SLOTS].count = 0;
+    s_stats.batches++;
+    return true;
+}
+
+// Ingest consumer: packs readings into the open batch. Runs on the ingest
+// dispatcher, so it never touches the network or flash.
+static size_t uplink_consume(const ingest_record_t *records, size_t count, void *ctx) {
+    size_t accepted = 0;
+    bool sealed = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (; accepted < count; accepted++) {
+        const ingest_record_t *r = &records[accepted];
+        batch_t *b = &s_ready[s_ready_tail % READY_SLOTS];
+        if (b->count == BATCH_CAPACITY || (b->count && r->ts_ms < b->base_ms)) {
+            if (!seal_locked()) {
+                break;
+            }
+            sealed = true;
+            b = &s_ready[s_ready_tail % READY_SLOTS];
+        }
+        if (b->count == 0) {
+            b->base_ms = r->ts_ms;
+            b->opened_us = esp_timer_get_time();
+        }
+        uint8_t *p = b->data + batch_len(b);
+        int64_t offset = r->ts_ms - b->base_ms;
+        uint32_t value;
+        memcpy(&value, &r->value, sizeof(value));
+        put_le32(p, r->sensor_id);
+        put_le32(p + 4, offset > UINT32_MAX ? UINT32_MAX : (uint32_t)offset);
+        put_le32(p + 8, value);
+        put_le16(p + 12, r->seq);
+        p[14] = r->kind;
+        p[15] = r->source;
+        b->count++;
+    }
+    s_stats.records += accepted;
+    s_stats.records_dropped += count - accepted;
+    xSemaphoreGive(s_lock);
+    if (sealed) {
+        notify(EV_BATCH, 0);
+    }
+    return accepted;
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+    switch (event_id) {
+    case MQTT_EVENT_CONNECTED:
+        notify(EV_CONNECTED, 0);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        notify(EV_DISCONNECTED, 0);
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        notify(EV_PUBLISHED, event->msg_id);
+        break;
+    default:
+        break;
+    }
+}
+
+static void spool_batch(const uint8_t *data, size_t len) {
+    esp_err_t err = spool_push(s_spool, data, len);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (err == ESP_OK) {
+        s_stats.spooled++;
+    } else {
+        s_stats.spool_errors++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static inflight_t *free_slot(void) {
+    for (int i = 0; i < CONFIG_UPLINK_MAX_INFLIGHT; i++) {
+        if (s_inflight[i].msg_id == 0) {
+            return &s_inflight[i];
+        }
+    }
+    return NULL;
+}
+
+// Publishes with QoS 1 and keeps a copy until the PUBACK. Returns false if
+// the batch was not handed over.
+static bool publish(const uint8_t *data, size_t len) {
+    inflight_t *slot = free_slot();
+    if (!s_connected || slot == NULL) {
+        return false;
+    }
+    memcpy(slot->data, data, len);
+    int msg_id = esp_mqtt_client_publish(s_client, s_topic_sensors, (const char *)slot->data, (int)len, 1, 0);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (msg_id > 0) {
+        s_stats.published++;
+    } else {
+        s_stats.publish_errors++;
+    }
+    xSemaphoreGive(s_lock);
+    if (msg_id <= 0) {
+        return false;
+    }
+    slot->msg_id = msg_id;
+    slot->sent_us = esp_timer_get_time();
+    slot->len = len;
+    return true;
+}
+
+// Spools every unacknowledged batch again so it is resent later
+static void respool_inflight(int64_t older_than_us) {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < CONFIG_UPLINK_MAX_INFLIGHT; i++) {
+        inflight_t *slot = &s_inflight[i];
+        if (slot->msg_id && now - slot->sent_us >= older_than_us) {
+            spool_batch(slot->data, slot->len);
+            slot->msg_id = 0;
+        }
+    }
+}
+
+static void acked(int msg_id) {
+    for (int i = 0; i < CONFIG_UPLINK_MAX_INFLIGHT; i++) {
+        inflight_t *slot = &s_inflight[i];
+        if (slot->msg_id != msg_id) {
+            continue;
+        }
+        int64_t latency = now_ms() - get_le64(slot->data + 8);
+        uint32_t ms = latency < 0 ? 0 : latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+        slot->msg_id = 0;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.acked++;
+        s_stats.latency_ms_last = ms;
+        s_latency_sum_ms += ms;
+        s_stats.latency_ms_avg = (uint32_t)(s_latency_sum_ms / s_stats.acked);
+        if (ms > s_stats.latency_ms_max) {
+            s_stats.latency_ms_max = ms;
+        }
+        xSemaphoreGive(s_lock);
+        return;
+    }
+}
+
+static void publish_status(void) {
+    uplink_stats_t up;
+    uplink_get_stats(&up);
+    ingest_stats_t in;
+    ingest_get_stats(&in);
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "uptime_s", (double)(esp_timer_get_time() / 1000000));
+    cJSON_AddNumberToObject(root, "heap_free", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(root, "heap_min_free", esp_get_minimum_free_heap_size());
+    cJSON_AddNumberToObject(root, "ingest_per_s", in.in_per_s);
+    cJSON_AddNumberToObject(root, "spool_items", up.spool_items);
+    cJSON_AddNumberToObject(root, "acked", up.acked);
+    cJSON_AddNumberToObject(root, "latency_ms_avg", up.latency_ms_avg);
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (json) {
+        esp_mqtt_client_publish(s_client, s_topic_status, json, 0, 0, 0);
+        cJSON_free(json);
+    }
+}
+
+static void handle_event(const uplink_event_t *ev) {
+    switch (ev->kind) {
+    case EV_CONNECTED:
+        s_connected = true;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.connects++;
+        xSemaphoreGive(s_lock);
+        publish_status();
+        break;
+    case EV_DISCONNECTED:
+        if (s_connected) {
+            s_connected = false;
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_stats.disconnects++;
+            xSemaphoreGive(s_lock);
+        }
+        respool_inflight(0);
+        break;
+    case EV_PUBLISHED:
+        acked(ev->msg_id);
+        break;
+    default:
+        break;
+    }
+}
+
+// Sends sealed batches straight out when nothing older is waiting, and to
+// the spool otherwise. The head slot is not touched by the consumer until
+// s_ready_head moves past it.
+static void forward_ready(void) {
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool empty = s_ready_head == s_ready_tail;
+        xSemaphoreGive(s_lock);
+        if (empty) {
+            return;
+        }
+        batch_t *b = &s_ready[s_ready_head % READY_SLOTS];
+        spool_stats_t sp;
+        spool_get_stats(s_spool, &sp);
+        if (sp.items > 0 || !publish(b->data, batch_len(b))) {
+            spool_batch(b->data, batch_len(b));
+        }
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_ready_head++;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+// Token bucket: up to CONFIG_UPLINK_DRAIN_PER_S batches a second, with at
+// most one second's worth saved up
+static void drain_spool(float *tokens, int64_t elapsed_us) {
+    *tokens += (float)elapsed_us * CONFIG_UPLINK_DRAIN_PER_S / 1e6f;
+    if (*tokens > CONFIG_UPLINK_DRAIN_PER_S) {
+        *tokens = CONFIG_UPLINK_DRAIN_PER_S;
+    }
+    while (s_connected && *tokens >= 1.0f && free_slot() != NULL) {
+        size_t len;
+        esp_err_t err = spool_peek(s_spool, s_scratch, sizeof(s_scratch), &len);
+        if (err == ESP_ERR_INVALID_SIZE) {
+            spool_pop(s_spool);   // Written by a build with bigger batches
+            continue;
+        }
+        if (err != ESP_OK) {
+            return;
+        }
+        if (!publish(s_scratch, len)) {
+            return;
+        }
+        spool_pop(s_spool);
+        *tokens -= 1.0f;
+    }
+}
+
+static void uplink_task(void *arg) {
+    int64_t last_us = esp_timer_get_time();
+    int64_t last_status_us = last_us;
+    float tokens = 0;
+
+    while (1) {
+        uplink_event_t ev;
+        if (xQueueReceive(s_events, &ev, pdMS_TO_TICKS(TICK_MS)) == pdTRUE) {
+            do {
+                handle_event(&ev);
+            } while (xQueueReceive(s_events, &ev, 0) == pdTRUE);
+        }
+        int64_t now = esp_timer_get_time();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        const batch_t *open = &s_ready[s_ready_tail % READY_SLOTS];
+        if (open->count && now - open->opened_us >= (int64_t)CONFIG_UPLINK_BATCH_MAX_MS * 1000) {
+            seal_locked();
+        }
+        xSemaphoreGive(s_lock);
+
+        forward_ready();
+        respool_inflight((int64_t)CONFIG_UPLINK_ACK_TIMEOUT_MS * 1000);
+        drain_spool(&tokens, now - last_us);
+        last_us = now;
+
+        if (s_connected && now - last_status_us >= (int64_t)CONFIG_UPLINK_STATUS_INTERVAL_S * 1000000) {
+            publish_status();
+            last_status_us = now;
+        }
+
+        spool_stats_t sp;
+        spool_get_stats(s_spool, &sp);
+        uint32_t inflight = 0;
+        for (int i = 0; i < CONFIG_UPLINK_MAX_INFLIGHT; i++) {
+            inflight += s_inflight[i].msg_id != 0;
+        }
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.connected = s_connected;
+        s_stats.inflight = inflight;
+        s_stats.spool_items = sp.items;
+        s_stats.spool_bytes = sp.bytes;
+        s_stats.spool_dropped = sp.dropped;
+        s_stats.spool_errors = sp.write_errors + sp.read_errors;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+void uplink_get_stats(uplink_stats_t *stats) {
+    if (s_lock == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    stats->open_records = s_ready[s_ready_tail % READY_SLOTS].count;
+    stats->ready = s_ready_tail - s_ready_head;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t uplink_start(const char *broker_uri) {
+    if (s_client != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_events = xQueueCreate(EVENT_QUEUE_LEN, sizeof(uplink_event_t));
+    if (s_lock == NULL || s_events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = spool_open(SPOOL_DIR, CONFIG_UPLINK_SPOOL_SEGMENT_SIZE, CONFIG_UPLINK_SPOOL_MAX_SEGMENTS, &s_spool);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open the spool: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    uint8_t mac[6] = {0};
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    snprintf(s_client_id, sizeof(s_client_id), "gw-%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    snprintf(s_topic_sensors, sizeof(s_topic_sensors), "%s/%s/sensors", CONFIG_UPLINK_TOPIC_PREFIX, s_client_id);
+    snprintf(s_topic_status, sizeof(s_topic_status), "%s/%s/status", CONFIG_UPLINK_TOPIC_PREFIX, s_client_id);
+
+    esp_mqtt_client_config_t cfg = {
+        .broker.address.uri = broker_uri,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+        .broker.verification.crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+        .credentials.client_id = s_client_id,
+        .credentials.username = CONFIG_UPLINK_USERNAME[0] ? CONFIG_UPLINK_USERNAME : NULL,
+        .credentials.authentication.password = CONFIG_UPLINK_PASSWORD[0] ? CONFIG_UPLINK_PASSWORD : NULL,
+        .session.keepalive = 60,
+        .network.reconnect_timeout_ms = CONFIG_UPLINK_RECONNECT_MS,
+        .buffer.size = CONFIG_UPLINK_BATCH_MAX_BYTES + TOPIC_LEN + 16,
+    };
+    s_client = esp_mqtt_client_init(&cfg);
+    if (s_client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+
+    err = ingest_add_consumer("uplink", uplink_consume, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    task_profiler_declare_stack("uplink", UPLINK_TASK_STACK_SIZE);
+    if (xTaskCreate(uplink_task, "uplink", UPLINK_TASK_STACK_SIZE, NULL, 5, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = esp_mqtt_client_start(s_client);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Publishing to %s as %s, batches of up to %d readings", broker_uri, s_client_id,
+                 (int)BATCH_CAPACITY);
+    }
+    return err;
+}
+
+esp_err_t uplink_init(void) {
+    if (CONFIG_UPLINK_BROKER_URI[0] == '\0') {
+        ESP_LOGI(TAG, "No broker configured, uplink disabled");
+        return ESP_OK;
+    }
+    return uplink_start(CONFIG_UPLINK_BROKER_URI);
+}
@@ -0,0 +1,89 @@
+#include "wifi_cache.h"
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "WIFI_CACHE";
+
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+#define WIFI_CACHE_KEY "link"
+// Bump when wifi_cache_record_t changes so old blobs are ignored.
+#define WIFI_CACHE_VERSION 1
+
+typedef struct {
+    uint8_t version;
+    uint32_t ssid_hash;
+    wifi_cache_t entry;
+} wifi_cache_record_t;
+
+// FNV-1a; only used to notice that the configured SSID changed.
+static uint32_t ssid_hash(const char *ssid) {
+    uint32_t hash = 2166136261u;
+    for (const char *p = ssid; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static esp_err_t read_record(wifi_cache_record_t *record) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) {
+        return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+    }
+    size_t len = sizeof(*record);
+    err = nvs_get_blob(nvs, WIFI_CACHE_KEY, record, &len);
+    nvs_close(nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (err == ESP_OK && (len != sizeof(*record) || record->version != WIFI_CACHE_VERSION)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return err;
+}
+
+esp_err_t wifi_cache_load(const char *ssid, wifi_cache_t *entry) {
+    wifi_cache_record_t record;
+    esp_err_t err = read_record(&record);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (record.ssid_hash != ssid_hash(ssid) || record.entry.channel == 0) {
+        ESP_LOGI(TAG, "Cached link is for another network, ignoring it");
+        return ESP_ERR_NOT_FOUND;
+    }
+    *entry = record.entry;
+    return ESP_OK;
+}
+
+esp_err_t wifi_cache_store(const char *ssid, const wifi_cache_t *entry) {
+    wifi_cache_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.version = WIFI_CACHE_VERSION;
+    record.ssid_hash = ssid_hash(ssid);
+    record.entry = *entry;
+
+    wifi_cache_record_t current;
+    if (read_record(&current) == ESP_OK && memcmp(&current, &record, sizeof(record)) == 0) {
+        return ESP_OK;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs, WIFI_CACHE_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store cached link: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Cached link: channel %d, IP " IPSTR, entry->channel, IP2STR(&entry->ip_info.ip));
+    }
+    return err;
+}
@@ -1,18 +1,52 @@
 #include "wifi_setup.h"
 #include "led_control.h"
+#include "wifi_cache.h"
+#include "settings.h"
+#include "boot.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
 
-// Event group for Wi-Fi events
-static EventGroupHandle_t s_wifi_event_group;
-// Event group bits
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
-
-#define EXAMPLE_ESP_WIFI_SSID CONFIG_ESP_WIFI_SSID
-#define EXAMPLE_ESP_WIFI_PASS CONFIG_ESP_WIFI_PASSWORD
-#define EXAMPLE_ESP_MAXIMUM_RETRY CONFIG_ESP_MAXIMUM_RETRY
+// Lets the reply to the request that changed the credentials go out before
+// the link drops
+#define RECONFIGURE_DELAY_MS 500
 
 static const char *TAG = "WIFI_SETUP";
-static int s_retry_num = 0;
+static int s_retry_num = 0;       // Consecutive failed attempts
+static esp_timer_handle_t s_retry_timer;
+
+static esp_netif_t *s_sta_netif;
+static wifi_config_t s_wifi_config;
+static char s_ssid[SETTINGS_STR_MAX + 1];
+static atomic_bool s_reconfigure;  // New credentials to pick up at the next attempt
+static esp_timer_handle_t s_reconfigure_timer;
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+static wifi_cache_t s_cache;
+static bool s_cache_valid;
+#endif
+static bool s_directed_attempt;   // Current attempt targets the cached BSSID/channel
+#if CONFIG_ESP_WIFI_REUSE_LEASE
+static bool s_lease_reused;       // Current attempt runs on the cached lease
+static bool s_lease_confirming;   // Up on it, waiting for DHCP to confirm or replace it
+#endif
+static bool s_got_ip;
+static int64_t s_connect_start_us; // Start of the current connect cycle, 0 if none
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_connect_stats_t s_stats = {
+    .time_to_ip_ms = -1,
+    .boot_time_to_ip_ms = -1,
+};
+
+static volatile wifi_state_t s_state = WIFI_STATE_IDLE;
+static portMUX_TYPE s_sub_lock = portMUX_INITIALIZER_UNLOCKED;
+typedef struct {
+    wifi_state_cb_t cb;
+    void *ctx;
+} wifi_subscriber_t;
+static wifi_subscriber_t s_subs[WIFI_MAX_STATE_SUBSCRIBERS];
 
 /* Update LED State */
 static void wifi_update_led_state(led_state_t state) {
@@ -70,44 +104,392 @@ static void disconnect_handler(void *arg, esp_event_base_t event_base,
     esp_wifi_connect();
 }
 */
+static const char *const s_state_names[] = {
+    [WIFI_STATE_IDLE] = "idle",
+    [WIFI_STATE_CONNECTING] = "connecting",
+    [WIFI_STATE_CONNECTED] = "connected",
+    [WIFI_STATE_GOT_IP] = "got_ip",
+    [WIFI_STATE_BACKOFF] = "backoff",
+};
+
+const char *wifi_state_to_str(wifi_state_t state) {
+    if ((unsigned)state >= sizeof(s_state_names) / sizeof(s_state_names[0])) {
+        return "unknown";
+    }
+    return s_state_names[state];
+}
+
+wifi_state_t wifi_get_state(void) {
+    return s_state;
+}
+
+esp_err_t wifi_subscribe_state(wifi_state_cb_t cb, void *ctx) {
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    taskENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < WIFI_MAX_STATE_SUBSCRIBERS; i++) {
+        if (s_subs[i].cb == NULL) {
+            s_subs[i].cb = cb;
+            s_subs[i].ctx = ctx;
+            err = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_sub_lock);
+    if (err == ESP_OK) {
+        cb(s_state, ctx);
+    }
+    return err;
+}
+
+esp_err_t wifi_unsubscribe_state(wifi_state_cb_t cb, void *ctx) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < WIFI_MAX_STATE_SUBSCRIBERS; i++) {
+        if (s_subs[i].cb == cb && s_subs[i].ctx == ctx) {
+            s_subs[i].cb = NULL;
+            s_subs[i].ctx = NULL;
+            err = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_sub_lock);
+    return err;
+}
+
+// Records the new state and notifies subscribers outside the lock.
+static void set_state(wifi_state_t state) {
+    if (s_state == state) {
+        return;
+    }
+    s_state = state;
+    ESP_LOGD(TAG, "State -> %s", wifi_state_to_str(state));
+    wifi_subscriber_t subs[WIFI_MAX_STATE_SUBSCRIBERS];
+    taskENTER_CRITICAL(&s_sub_lock);
+    memcpy(subs, s_subs, sizeof(subs));
+    taskEXIT_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < WIFI_MAX_STATE_SUBSCRIBERS; i++) {
+        if (subs[i].cb) {
+            subs[i].cb(state, subs[i].ctx);
+        }
+    }
+}
+
+void wifi_get_connect_stats(wifi_connect_stats_t *stats) {
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Configures the interface with a fixed address; DHCP stays off until
+// esp_netif_dhcpc_start() is called again.
+static void apply_fixed_ip(const esp_netif_ip_info_t *ip_info, esp_ip4_addr_t dns) {
+    esp_err_t err = esp_netif_dhcpc_stop(s_sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_LOGE(TAG, "Failed to stop DHCP client: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_set_ip_info(s_sta_netif, ip_info));
+    if (dns.addr != 0) {
+        esp_netif_dns_info_t dns_info = {
+            .ip.u_addr.ip4 = dns,
+            .ip.type = ESP_IPADDR_TYPE_V4,
+        };
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns_info));
+    }
+}
+
+#if CONFIG_ESP_WIFI_STATIC_IP
+static void apply_static_ip(void) {
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = esp_ip4addr_aton(CONFIG_ESP_WIFI_STATIC_IP_ADDR),
+        .netmask.addr = esp_ip4addr_aton(CONFIG_ESP_WIFI_STATIC_NETMASK),
+        .gw.addr = esp_ip4addr_aton(CONFIG_ESP_WIFI_STATIC_GATEWAY),
+    };
+    esp_ip4_addr_t dns = { .addr = esp_ip4addr_aton(CONFIG_ESP_WIFI_STATIC_DNS) };
+    ESP_LOGI(TAG, "Using static IP " IPSTR, IP2STR(&ip_info.ip));
+    apply_fixed_ip(&ip_info, dns);
+}
+#endif
+
+// Sets up the next esp_wifi_connect(): a directed connect to the cached
+// BSSID on its channel, or a scan of all channels for the strongest AP.
+static void prepare_connect(bool directed) {
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+    directed = directed && s_cache_valid;
+#else
+    directed = false;
+#endif
+#if CONFIG_ESP_WIFI_REUSE_LEASE
+    if (s_lease_reused && !directed) {
+        // The cached lease may be stale on whatever AP the scan finds
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_dhcpc_start(s_sta_netif));
+    }
+    s_lease_reused = false;
+    s_lease_confirming = false;
+#endif
+    s_directed_attempt = directed;
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+    if (directed) {
+        s_wifi_config.sta.bssid_set = true;
+        memcpy(s_wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        s_wifi_config.sta.channel = s_cache.channel;
+        s_wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        ESP_LOGI(TAG, "Directed connect to %02x:%02x:%02x:%02x:%02x:%02x on channel %d",
+                 s_cache.bssid[0], s_cache.bssid[1], s_cache.bssid[2],
+                 s_cache.bssid[3], s_cache.bssid[4], s_cache.bssid[5], s_cache.channel);
+#if CONFIG_ESP_WIFI_REUSE_LEASE
+        if (s_cache.ip_info.ip.addr != 0) {
+            ESP_LOGI(TAG, "Reusing cached lease " IPSTR, IP2STR(&s_cache.ip_info.ip));
+            apply_fixed_ip(&s_cache.ip_info, s_cache.dns);
+            s_lease_reused = true;
+        }
+#endif
+    } else
+#endif
+    {
+        s_wifi_config.sta.bssid_set = false;
+        s_wifi_config.sta.channel = 0;
+        s_wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        s_wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config));
+}
+
+// Copies the credentials from the settings into s_wifi_config, and loads
+// the cached AP for that network
+static void load_credentials(void) {
+    char password[SETTINGS_STR_MAX + 1];
+    settings_get_str(SETTING_WIFI_SSID, s_ssid, sizeof(s_ssid));
+    settings_get_str(SETTING_WIFI_PASSWORD, password, sizeof(password));
+    size_t ssid_len = strlen(s_ssid);
+    size_t password_len = strlen(password);
+    memset(s_wifi_config.sta.ssid, 0, sizeof(s_wifi_config.sta.ssid));
+    memcpy(s_wifi_config.sta.ssid, s_ssid,
+           ssid_len < sizeof(s_wifi_config.sta.ssid) ? ssid_len : sizeof(s_wifi_config.sta.ssid));
+    memset(s_wifi_config.sta.password, 0, sizeof(s_wifi_config.sta.password));
+    memcpy(s_wifi_config.sta.password, password,
+           password_len < sizeof(s_wifi_config.sta.password) ? password_len : sizeof(s_wifi_config.sta.password));
+    // An open network has no password and would never meet a WPA2 threshold
+    s_wifi_config.sta.threshold.authmode = password_len ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+    s_cache_valid = wifi_cache_load(s_ssid, &s_cache) == ESP_OK;
+#endif
+    ESP_LOGI(TAG, "Using network \"%s\"", s_ssid);
+}
+
+// Picks up credentials changed since the last attempt; true if there were any
+static bool take_reconfigure(void) {
+    if (!atomic_exchange(&s_reconfigure, false)) {
+        return false;
+    }
+    load_credentials();
+    s_retry_num = 0;
+    return true;
+}
+
+// Drops the current attempt or link so the event handler reconnects with the
+// new credentials; a pending retry is brought forward instead
+static void reconfigure_timer_cb(void *arg) {
+    if (!atomic_load(&s_reconfigure)) {
+        return;
+    }
+    wifi_state_t state = s_state;
+    if (state == WIFI_STATE_BACKOFF) {
+        esp_timer_stop(s_retry_timer);
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(s_retry_timer, 0));
+    } else if (state != WIFI_STATE_IDLE) {
+        ESP_LOGI(TAG, "Credentials changed, reconnecting");
+        esp_wifi_disconnect();
+    }
+}
+
+static void settings_changed(uint32_t changed, void *ctx) {
+    if (!(changed & (SETTING_BIT(SETTING_WIFI_SSID) | SETTING_BIT(SETTING_WIFI_PASSWORD)))) {
+        return;
+    }
+    atomic_store(&s_reconfigure, true);
+    esp_timer_stop(s_reconfigure_timer);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(s_reconfigure_timer, RECONFIGURE_DELAY_MS * 1000));
+}
+
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+// Records the AP and lease we just got so the next connect can go direct.
+static void update_cache(const ip_event_got_ip_t *event) {
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    wifi_cache_t entry = {
+        .channel = ap_info.primary,
+        .ip_info = event->ip_info,
+    };
+    memcpy(entry.bssid, ap_info.bssid, sizeof(entry.bssid));
+    esp_netif_dns_info_t dns_info;
+    if (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK) {
+        entry.dns = dns_info.ip.u_addr.ip4;
+    }
+    if (wifi_cache_store(s_ssid, &entry) == ESP_OK) {
+        s_cache = entry;
+        s_cache_valid = true;
+    }
+}
+#endif
+
+// Delay before retry n (1-based): base * 2^(n-1) capped at the maximum,
+// with the upper half jittered so a fleet that lost the same AP does not
+// come back in lockstep.
+static uint32_t backoff_delay_ms(int attempt) {
+    uint32_t delay = CONFIG_ESP_WIFI_BACKOFF_BASE_MS;
+    for (int i = 1; i < attempt && delay < CONFIG_ESP_WIFI_BACKOFF_MAX_MS; i++) {
+        delay *= 2;
+    }
+    if (delay > CONFIG_ESP_WIFI_BACKOFF_MAX_MS) {
+        delay = CONFIG_ESP_WIFI_BACKOFF_MAX_MS;
+    }
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+static void retry_timer_cb(void *arg) {
+    ESP_LOGI(TAG, "Reconnect attempt %d", s_retry_num + 1);
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.next_retry_ms = 0;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    if (take_reconfigure()) {
+        prepare_connect(true);
+    }
+    set_state(WIFI_STATE_CONNECTING);
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+    }
+}
+
+// Schedules the next attempt after a failure. There is no retry limit: past
+// the wifi_max_retry setting the LED reports the failure but attempts
+// continue at the capped interval.
+static void schedule_retry(uint8_t reason) {
+    int max_retry = settings_get_int(SETTING_WIFI_MAX_RETRY);
+    s_retry_num++;
+    uint32_t delay_ms = backoff_delay_ms(s_retry_num);
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.failed_attempts = s_retry_num;
+    s_stats.next_retry_ms = delay_ms;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    if (s_retry_num == max_retry) {
+        ESP_LOGE(TAG, "Failed to connect after %d attempts, still retrying", s_retry_num);
+    }
+    ESP_LOGI(TAG, "Connect failed (reason %d), retry %d in %" PRIu32 " ms", reason, s_retry_num, delay_ms);
+    set_led_state(s_retry_num >= max_retry ? LED_STATE_FAILED : LED_STATE_CONNECTING);
+    // Each attempt tries the cached AP first and falls back to a scan
+    prepare_connect(true);
+    set_state(WIFI_STATE_BACKOFF);
+    esp_timer_stop(s_retry_timer);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000));
+}
+
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         ESP_LOGI(TAG, "Connecting to AP...");
+        s_connect_start_us = esp_timer_get_time();
+        set_state(WIFI_STATE_CONNECTING);
         esp_wifi_connect();
         set_led_state(LED_STATE_CONNECTING); // Slow blinking (yellow)
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retrying to connect to the AP... (%d/%d)", s_retry_num, CONFIG_ESP_MAXIMUM_RETRY);
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        if (take_reconfigure()) {
+            s_got_ip = false;
+            s_connect_start_us = esp_timer_get_time();
+            prepare_connect(true);
+            set_state(WIFI_STATE_CONNECTING);
+            esp_wifi_connect();
+            set_led_state(LED_STATE_CONNECTING);
+        } else if (s_got_ip) {
+            // Link lost: reconnect straight away, back off only if that fails
+            ESP_LOGW(TAG, "Link lost (reason %d), reconnecting", event->reason);
+            s_got_ip = false;
+            s_connect_start_us = esp_timer_get_time();
+            prepare_connect(true);
+            set_state(WIFI_STATE_CONNECTING);
+            esp_wifi_connect();
+            set_led_state(LED_STATE_CONNECTING);
+        } else if (s_directed_attempt) {
+            ESP_LOGW(TAG, "Directed connect failed (reason %d), falling back to full scan", event->reason);
+            taskENTER_CRITICAL(&s_stats_lock);
+            s_stats.scan_fallbacks++;
+            taskEXIT_CRITICAL(&s_stats_lock);
+            prepare_connect(false);
             esp_wifi_connect();
-            set_led_state(LED_STATE_CONNECTING); // Continue blinking (yellow)
         } else {
-            ESP_LOGE(TAG, "Failed to connect after maximum retries.");
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-            set_led_state(LED_STATE_FAILED); // Blinking red
+            schedule_retry(event->reason);
         }
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
         ESP_LOGI(TAG, "Wi-Fi connected to AP, waiting for IP...");
+        set_state(WIFI_STATE_CONNECTED);
         set_led_state(LED_STATE_CONNECTED_NO_IP); // Blinking cyan
+#if CONFIG_ESP_WIFI_REUSE_LEASE
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP && s_lease_confirming) {
+        // DHCP's answer for the cached lease the link came up on
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "Cached lease %s by DHCP: " IPSTR, event->ip_changed ? "replaced" : "confirmed",
+                 IP2STR(&event->ip_info.ip));
+        s_lease_confirming = false;
+        update_cache(event);
+#endif
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        int64_t now_us = esp_timer_get_time();
+        int64_t time_to_ip_ms = s_connect_start_us ? (now_us - s_connect_start_us) / 1000 : -1;
+        ESP_LOGI(TAG, "Got IP: " IPSTR " in %lld ms (%s)", IP2STR(&event->ip_info.ip),
+                 (long long)time_to_ip_ms, s_directed_attempt ? "directed" : "full scan");
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_stats.time_to_ip_ms = time_to_ip_ms;
+        s_stats.fast_connect = s_directed_attempt;
+        s_stats.failed_attempts = 0;
+        s_stats.next_retry_ms = 0;
+        if (s_stats.boot_time_to_ip_ms < 0) {
+            s_stats.boot_time_to_ip_ms = now_us / 1000;
+        }
+        taskEXIT_CRITICAL(&s_stats_lock);
+        boot_mark("wifi_got_ip");
+        s_got_ip = true;
+        s_connect_start_us = 0;
         s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#if CONFIG_ESP_WIFI_REUSE_LEASE
+        if (s_lease_reused) {
+            // Up on the cached lease; have the DHCP server confirm or renew
+            // it, so an expired or reassigned address is not kept
+            s_lease_reused = false;
+            s_lease_confirming = true;
+            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_dhcpc_start(s_sta_netif));
+        }
+#endif
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+        update_cache(event);
+#endif
+        set_state(WIFI_STATE_GOT_IP);
         set_led_state(LED_STATE_CONNECTED); // Steady green
     }
 }
 
 void wifi_init_sta(void) {
   ESP_LOGI(TAG, "Initializing Wi-Fi...");
-  s_wifi_event_group = xEventGroupCreate();
-
-  ESP_ERROR_CHECK(esp_netif_init());
-  ESP_ERROR_CHECK(esp_event_loop_create_default());
-  esp_netif_create_default_wifi_sta();
+  s_sta_netif = esp_netif_create_default_wifi_sta();
 
   wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
   ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+  const esp_timer_create_args_t retry_timer_args = {
+      .callback = retry_timer_cb,
+      .name = "wifi_retry",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
+  const esp_timer_create_args_t reconfigure_timer_args = {
+      .callback = reconfigure_timer_cb,
+      .name = "wifi_reconf",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&reconfigure_timer_args, &s_reconfigure_timer));
   esp_event_handler_instance_t instance_any_id;
   esp_event_handler_instance_t instance_got_ip;
   ESP_ERROR_CHECK(esp_event_handler_instance_register(
@@ -133,32 +515,16 @@ void wifi_init_sta(void) {
                     NULL));
 
                     */
-  wifi_config_t wifi_config = {
-      .sta =
-          {
-              .ssid = CONFIG_ESP_WIFI_SSID,
-              .password = CONFIG_ESP_WIFI_PASSWORD,
-              .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-          },
-  };
+  load_credentials();
+  ESP_ERROR_CHECK_WITHOUT_ABORT(settings_subscribe(settings_changed, NULL));
+
+#if CONFIG_ESP_WIFI_STATIC_IP
+  apply_static_ip();
+#endif
 
   ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+  prepare_connect(true);
   ESP_ERROR_CHECK(esp_wifi_start());
 
-  ESP_LOGI(TAG, "Wi-Fi initialization complete.");
-
-  EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                         pdFALSE, pdFALSE, portMAX_DELAY);
-
-  if (bits & WIFI_CONNECTED_BIT) {
-    ESP_LOGI(TAG, "Connected to AP SSID:%s ", CONFIG_ESP_WIFI_SSID);
-  } else if (bits & WIFI_FAIL_BIT) {
-    ESP_LOGI(TAG, "Failed to connect to SSID:%s ", CONFIG_ESP_WIFI_SSID);
-  } else {
-    ESP_LOGE(TAG, "Unexpected event occurred.");
-  }
-  // Clean up the event group
-  vEventGroupDelete(s_wifi_event_group);
+  ESP_LOGI(TAG, "Wi-Fi started, connecting in the background.");
 }
@@ -0,0 +1,363 @@
+#include "www_bundle.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "ota_update.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = "WWW_BUNDLE";
+
+#define SLOT_COUNT 2
+#define READER_DRAIN_MS 2000
+
+static const esp_partition_t *s_part;
+static const uint8_t *s_map;       // Whole partition, both slots
+static esp_partition_mmap_handle_t s_map_handle;
+static uint32_t s_slot_size;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int s_active = -1;
+static uint32_t s_readers[SLOT_COUNT]; // Assets open per slot
+static www_bundle_info_t s_info;
+
+// Upload in progress; the header is held back and written last so a torn
+// upload never looks valid
+static bool s_updating;
+static int s_upd_slot;
+static size_t s_upd_size;
+static size_t s_upd_received;
+static size_t s_upd_erased;   // Bytes of the slot erased so far, from its start
+static int64_t s_upd_start_us;
+static www_bundle_hdr_t s_upd_hdr;
+static mbedtls_sha256_context s_upd_sha;   // Of the image as uploaded
+
+static const struct {
+    const char *ext;
+    const char *type;
+} content_types[] = {
+    {".html", "text/html"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".json", "application/json"},
+    {".svg", "image/svg+xml"},
+    {".png", "image/png"},
+    {".ico", "image/x-icon"},
+};
+
+static const char *content_type(const char *path) {
+    const char *dot = strrchr(path, '.');
+    for (size_t i = 0; dot && i < sizeof(content_types) / sizeof(content_types[0]); i++) {
+        if (strcmp(dot, content_types[i].ext) == 0) {
+            return content_types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+static const www_bundle_hdr_t *slot_hdr(int slot) {
+    return (const www_bundle_hdr_t *)(s_map + (size_t)slot * s_slot_size);
+}
+
+static const www_bundle_entry_t *slot_index(int slot) {
+    return (const www_bundle_entry_t *)(s_map + (size_t)slot * s_slot_size + sizeof(www_bundle_hdr_t));
+}
+
+// Full check of the image in a slot: header, CRC, and every index entry
+static bool slot_valid(int slot) {
+    const www_bundle_hdr_t *hdr = slot_hdr(slot);
+    if (hdr->magic != WWW_BUNDLE_MAGIC || hdr->version != WWW_BUNDLE_VERSION ||
+        hdr->size > s_slot_size ||
+        hdr->size < sizeof(*hdr) + (size_t)hdr->count * sizeof(www_bundle_entry_t)) {
+        return false;
+    }
+    const uint8_t *base = (const uint8_t *)hdr;
+    uint32_t crc = esp_rom_crc32_le(0, base, offsetof(www_bundle_hdr_t, crc));
+    crc = esp_rom_crc32_le(crc, base + sizeof(*hdr), hdr->size - sizeof(*hdr));
+    if (crc != hdr->crc) {
+        return false;
+    }
+    const www_bundle_entry_t *index = slot_index(slot);
+    for (uint16_t i = 0; i < hdr->count; i++) {
+        const www_bundle_entry_t *e = &index[i];
+        if (memchr(e->path, '\0', sizeof(e->path)) == NULL || e->path[0] != '/' ||
+            e->offset > hdr->size || e->size > hdr->size - e->offset ||
+            (i > 0 && strcmp(index[i - 1].path, e->path) >= 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Caller holds s_lock
+static void activate_locked(int slot) {
+    const www_bundle_hdr_t *hdr = slot_hdr(slot);
+    s_active = slot;
+    s_info.slot = slot;
+    s_info.seq = hdr->seq;
+    s_info.files = hdr->count;
+    s_info.size = hdr->size;
+    s_info.crc = hdr->crc;
+}
+
+esp_err_t www_bundle_open(const char *path, size_t len, www_asset_t *asset) {
+    taskENTER_CRITICAL(&s_lock);
+    int slot = s_active;
+    if (slot >= 0) {
+        s_readers[slot]++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (slot < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Binary search the sorted index in place
+    const www_bundle_hdr_t *hdr = slot_hdr(slot);
+    const www_bundle_entry_t *index = slot_index(slot);
+    int lo = 0;
+    int hi = (int)hdr->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const char *name = index[mid].path;
+        int cmp = strncmp(name, path, len);
+        if (cmp == 0 && name[len] != '\0') {
+            cmp = 1;
+        }
+        if (cmp == 0) {
+            asset->data = (const uint8_t *)hdr + index[mid].offset;
+            asset->size = index[mid].size;
+            asset->type = content_type(name);
+            asset->etag = hdr->crc;
+            asset->slot = slot;
+            taskENTER_CRITICAL(&s_lock);
+            s_info.served++;
+            taskEXIT_CRITICAL(&s_lock);
+            return ESP_OK;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    taskENTER_CRITICAL(&s_lock);
+    s_readers[slot]--;
+    taskEXIT_CRITICAL(&s_lock);
+    return ESP_ERR_NOT_FOUND;
+}
+
+void www_bundle_close(www_asset_t *asset) {
+    taskENTER_CRITICAL(&s_lock);
+    s_readers[asset->slot]--;
+    taskEXIT_CRITICAL(&s_lock);
+    asset->data = NULL;
+}
+
+void www_bundle_get_info(www_bundle_info_t *info) {
+    taskENTER_CRITICAL(&s_lock);
+    *info = s_info;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t www_bundle_update_begin(size_t image_size) {
+    if (s_map == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (image_size < sizeof(www_bundle_hdr_t) || image_size > s_slot_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    bool busy = s_updating;
+    s_updating = true;
+    int slot = s_active == 0 ? 1 : 0;
+    taskEXIT_CRITICAL(&s_lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mbedtls_sha256_init(&s_upd_sha);
+    mbedtls_sha256_starts(&s_upd_sha, 0);
+
+    // Responses still streaming from the previous bundle hold the slot
+    for (int waited = 0;; waited += 10) {
+        taskENTER_CRITICAL(&s_lock);
+        uint32_t readers = s_readers[slot];
+        taskEXIT_CRITICAL(&s_lock);
+        if (readers == 0) {
+            break;
+        }
+        if (waited >= READER_DRAIN_MS) {
+            www_bundle_update_abort();
+            return ESP_ERR_INVALID_STATE;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // Sectors are erased as the data reaches them, so no single call holds
+    // the flash for long
+    s_upd_slot = slot;
+    s_upd_size = image_size;
+    s_upd_received = 0;
+    s_upd_erased = 0;
+    s_upd_start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Receiving %u byte bundle into slot %d", (unsigned)image_size, slot);
+    return ESP_OK;
+}
+
+// Erases whole sectors of the update slot until its first end bytes are
+// covered
+static esp_err_t erase_to(size_t end) {
+    while (s_upd_erased < end) {
+        esp_err_t err = esp_partition_erase_range(s_part, (size_t)s_upd_slot * s_slot_size + s_upd_erased,
+                                                  SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Erasing slot %d at %u failed (%s)", s_upd_slot, (unsigned)s_upd_erased,
+                     esp_err_to_name(err));
+            return err;
+        }
+        s_upd_erased += SPI_FLASH_SEC_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t www_bundle_update_write(const void *data, size_t len) {
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > s_upd_size - s_upd_received) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mbedtls_sha256_update(&s_upd_sha, data, len);
+    const uint8_t *p = data;
+    if (s_upd_received < sizeof(s_upd_hdr)) {
+        size_t n = sizeof(s_upd_hdr) - s_upd_received;
+        if (n > len) {
+            n = len;
+        }
+        memcpy((uint8_t *)&s_upd_hdr + s_upd_received, p, n);
+        s_upd_received += n;
+        p += n;
+        len -= n;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = erase_to(s_upd_received + len);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, (size_t)s_upd_slot * s_slot_size + s_upd_received, p, len);
+    }
+    if (err == ESP_OK) {
+        s_upd_received += len;
+    }
+    return err;
+}
+
+esp_err_t www_bundle_update_end(const uint8_t *sig, size_t sig_len) {
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&s_upd_sha, sha256);
+    mbedtls_sha256_free(&s_upd_sha);
+    esp_err_t err = ESP_OK;
+    if (s_upd_received != s_upd_size || s_upd_hdr.size != s_upd_size) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    // Checked before the header goes out, so an unsigned image never
+    // becomes valid in flash
+    if (err == ESP_OK) {
+        err = ota_update_verify_signature(sha256, sig, sig_len);
+    }
+    if (err == ESP_OK) {
+        taskENTER_CRITICAL(&s_lock);
+        s_upd_hdr.seq = s_active >= 0 ? slot_hdr(s_active)->seq + 1 : 0;
+        taskEXIT_CRITICAL(&s_lock);
+        // A header-only image never reached write's erase
+        err = erase_to(sizeof(s_upd_hdr));
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, (size_t)s_upd_slot * s_slot_size, &s_upd_hdr, sizeof(s_upd_hdr));
+    }
+    if (err == ESP_OK && !slot_valid(s_upd_slot)) {
+        err = ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - s_upd_start_us;
+    uint32_t ms = (uint32_t)(elapsed_us / 1000);
+    taskENTER_CRITICAL(&s_lock);
+    if (err == ESP_OK) {
+        activate_locked(s_upd_slot);
+        s_info.updates++;
+        s_info.last_update_ms = ms;
+        s_info.last_update_kbps = elapsed_us > 0 ? (uint32_t)((int64_t)s_upd_size * 8000 / elapsed_us) : 0;
+    } else {
+        s_info.update_failures++;
+    }
+    s_updating = false;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Bundle %08" PRIx32 " (%u files) active in slot %d after %" PRIu32 " ms",
+                 s_info.crc, (unsigned)s_upd_hdr.count, s_upd_slot, ms);
+    } else {
+        ESP_LOGW(TAG, "Rejected bundle upload (%s)", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void www_bundle_update_abort(void) {
+    if (!s_updating) {
+        return;
+    }
+    mbedtls_sha256_free(&s_upd_sha);
+    taskENTER_CRITICAL(&s_lock);
+    s_info.update_failures++;
+    s_updating = false;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t www_bundle_init(void) {
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WWW_BUNDLE_PARTITION);
+    if (s_part == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition", WWW_BUNDLE_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    const void *map;
+    esp_err_t err = esp_partition_mmap(s_part, 0, s_part->size, ESP_PARTITION_MMAP_DATA, &map, &s_map_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mapping \"%s\" failed (%s)", WWW_BUNDLE_PARTITION, esp_err_to_name(err));
+        return err;
+    }
+    s_map = map;
+    s_slot_size = s_part->size / SLOT_COUNT / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+
+    int best = -1;
+    for (int slot = 0; slot < SLOT_COUNT; slot++) {
+        if (!slot_valid(slot)) {
+            continue;
+        }
+        if (best < 0 || (int32_t)(slot_hdr(slot)->seq - slot_hdr(best)->seq) > 0) {
+            best = slot;
+        }
+    }
+    taskENTER_CRITICAL(&s_lock);
+    s_info.slot = -1;
+    s_info.slot_size = s_slot_size;
+    if (best >= 0) {
+        activate_locked(best);
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (best < 0) {
+        ESP_LOGW(TAG, "No valid web bundle; upload one to /api/www");
+    } else {
+        ESP_LOGI(TAG, "Serving bundle %08" PRIx32 " from slot %d: %" PRIu32 " files, %" PRIu32 " bytes",
+                 s_info.crc, best, s_info.files, s_info.size);
+    }
+    return ESP_OK;
+}
@@ -1,28 +1,115 @@
 #!/bin/bash
+#
+# Smoke test for the gateway web UI and JSON APIs.
+#
+#   ./test_web_apis.sh [host[:port]]
+#
+# The target defaults to $GW_HOST, then to the host build on 127.0.0.1:8443
+# (see host/CMakeLists.txt). Pass the board's address to test real hardware.
+# Exits non-zero if any endpoint returns an unexpected status code.
 
-ESP32_IP="192.168.0.109"
+GW_TARGET="${1:-${GW_HOST:-127.0.0.1:8443}}"
+BASE_URL="https://$GW_TARGET"
+FAILURES=0
 
-echo "Testing Home Page..."
-curl -k https://$ESP32_IP/ -o index.html
+# check <description> <method> <uri> <expected status> [json body]
+check() {
+    local desc="$1" method="$2" uri="$3" expected="$4" body="$5"
+    local args=(-sk -o /dev/null -w "%{http_code}" --max-time 10 -X "$method")
+    if [ -n "$body" ]; then
+        args+=(-H "Content-Type: application/json" -d "$body")
+    fi
+    local status
+    status=$(curl "${args[@]}" "$BASE_URL$uri")
+    if [ "$status" = "$expected" ]; then
+        echo "PASS $desc ($method $uri -> $status)"
+    else
+        echo "FAIL $desc ($method $uri -> $status, expected $expected)"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
 
-echo "Testing Status Page..."
-curl -k https://$ESP32_IP/status -o status.html
+# check_cbor <description> <method> <uri> <expected status> [printf-escaped CBOR body] [reply type]
+# Asks for CBOR and, on a 200, also checks the reply type (CBOR by default;
+# the LED endpoints answer in plain text).
+check_cbor() {
+    local desc="$1" method="$2" uri="$3" expected="$4" body="$5" want_type="${6:-application/cbor}"
+    local args=(-sk -o /dev/null -w "%{http_code} %{content_type}" --max-time 10 -X "$method"
+                -H "Accept: application/cbor")
+    if [ -n "$body" ]; then
+        args+=(-H "Content-Type: application/cbor" --data-binary @-)
+    fi
+    local result status type
+    result=$(printf "$body" | curl "${args[@]}" "$BASE_URL$uri")
+    status="${result%% *}"
+    type="${result#* }"
+    if [ "$status" = "$expected" ] && { [ "$status" != 200 ] || [ "$type" = "$want_type" ]; }; then
+        echo "PASS $desc ($method $uri -> $status)"
+    else
+        echo "FAIL $desc ($method $uri -> $result, expected $expected)"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
 
-echo "Testing Clients Page..."
-curl -k https://$ESP32_IP/clients -o clients.html
+echo "Testing $BASE_URL"
 
-echo "Testing Settings Page..."
-curl -k https://$ESP32_IP/settings -o settings.html
+check "Home page" GET / 200
+check "Status page" GET /status.html 200
+check "Clients page" GET /clients.html 200
+check "Settings page" GET /settings.html 200
+check "LED control page" GET /led_control.html 200
+check "Stylesheet" GET /css/styles.css 200
+check "Script" GET /js/app.js 200
+check "Theme script" GET /js/theme.js 200
 
-echo "Testing System Info API..."
-curl -k https://$ESP32_IP/api/system_info
+check "System info API" GET /api/system_info 200
+check "Wi-Fi status API" GET /api/wifi_status 200
+check "Wi-Fi status API, 5 history points" GET "/api/wifi_status?points=5" 200
+check "Clients API" GET /api/clients 200
+check "Boot timeline API" GET /api/boot 200
+check "Heap API" GET /api/heap 200
+check "Task profiler API" GET /api/tasks 200
+check "Binary log dump" GET /api/log 200
+check "Binary log dump, later records" GET "/api/log?since=5" 200
+check "Ingest stats" GET /api/ingest 200
+check "Ingest simulator, bad body" POST /api/ingest/sim 400 '{"sensors": 2}'
+check "Ingest simulator, rate too high" POST /api/ingest/sim 400 '{"rate": 1e10}'
+check "Ingest simulator, no sensors" POST /api/ingest/sim 400 '{"rate": 10, "sensors": -1}'
+check "Ingest simulator off" POST /api/ingest/sim 200 '{"rate": 0}'
+check "Ingest report" POST /api/ingest/report 204 $'\x01\x01\x01\x01\x01\x01\x01\x01\x01AAAA'
+check "Ingest report, truncated" POST /api/ingest/report 400 $'\x01\x02\x01\x01\x01\x01\x01\x01\x01AAAA'
+check "Uplink stats" GET /api/uplink 200
+check "Web bundle API" GET /api/www 200
+check "Web bundle upload, unsigned" POST /api/www 400 'not a bundle at all, just some text'
+check "Firmware update API" GET /api/ota 200
+check "Firmware upload, unsigned" POST /api/ota 400 'not firmware, and no X-Signature'
+check "Settings" GET /api/settings 200
+check "Settings, blink period" PUT /api/settings 200 '{"settings": {"led_blink_ms": 500}}'
+check "Settings, unknown key" PUT /api/settings 400 '{"settings": {"no_such_setting": 1}}'
+check "Settings, out of range" PUT /api/settings 400 '{"settings": {"led_blink_ms": 1}}'
+check "Settings, stale version" PUT /api/settings 409 '{"version": 0, "settings": {"led_blink_ms": 1000}}'
+check "Settings, negative version" PUT /api/settings 400 '{"version": -1, "settings": {"led_blink_ms": 1000}}'
+check "Settings, fractional version" PUT /api/settings 400 '{"version": 1.5, "settings": {"led_blink_ms": 1000}}'
+check "Settings, version too large" PUT /api/settings 400 '{"version": 1e12, "settings": {"led_blink_ms": 1000}}'
+check "Settings, blink period back" PUT /api/settings 200 '{"settings": {"led_blink_ms": 1000}}'
 
-echo "Testing Wi-Fi Status API..."
-curl -k https://$ESP32_IP/api/wifi_status
+check "LED brightness" POST /api/led/brightness 200 '{"brightness":30}'
+check "LED on" POST /api/led/on 200 '{"color":"white"}'
+check "LED off" POST /api/led/off 200
+check "LED on, malformed body" POST /api/led/on 400 'not json'
 
-echo "Testing Clients API..."
-curl -k https://$ESP32_IP/api/clients
+check_cbor "Heap API as CBOR" GET /api/heap 200
+check_cbor "Task profiler API as CBOR" GET /api/tasks 200
+check_cbor "System info API as CBOR" GET /api/system_info 200
+check_cbor "Settings API as CBOR" GET /api/settings 200
+check_cbor "Ingest simulator off, CBOR body" POST /api/ingest/sim 200 '\xa1\x64rate\x00'
+check_cbor "LED brightness, CBOR body" POST /api/led/brightness 200 '\xa1\x6abrightness\x18\x1e' text/html
+check_cbor "LED on, truncated CBOR body" POST /api/led/on 400 '\xa1\x65color'
 
-echo "Testing Non-Existent URI..."
-curl -k https://$ESP32_IP/nonexistent
+check "Non-existent URI" GET /nonexistent 404
 
+if [ "$FAILURES" -ne 0 ]; then
+    echo "$FAILURES check(s) failed"
+    exit 1
+fi
+echo "All checks passed"
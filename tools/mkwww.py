@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Packs a directory into the web-asset bundle served from the "www" partition.
+
+    mkwww.py SRC_DIR OUT_FILE
+
+Layout (little-endian, see include/www_bundle.h):
+    header   magic "WWWB", version, file count, image size, crc32, seq
+    index    one entry per file, sorted by path: path[48], offset, size
+    data     file contents, each starting on a 4-byte boundary
+
+The CRC-32 covers the header up to the crc field and everything after the
+header. seq is outside the CRC; the device sets it when it accepts an image.
+Editor backups (*.old, *~) and dotfiles are skipped.
+
+The device only accepts an uploaded image with an X-Signature from the
+firmware update key, made the same way as for POST /api/ota:
+    openssl dgst -sha256 -sign ota_key.pem OUT_FILE | xxd -p | tr -d '\\n'
+"""
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = 0x42575757  # "WWWB"
+VERSION = 1
+HDR = struct.Struct('<IHHIII')
+ENTRY = struct.Struct('<48sII')
+PATH_MAX = 47
+
+
+def collect(src):
+    files = []
+    for root, dirs, names in os.walk(src):
+        dirs[:] = sorted(d for d in dirs if not d.startswith('.'))
+        for name in names:
+            if name.startswith('.') or name.endswith(('.old', '~')):
+                continue
+            full = os.path.join(root, name)
+            path = '/' + os.path.relpath(full, src).replace(os.sep, '/')
+            if len(path) > PATH_MAX:
+                sys.exit(f'{path}: path longer than {PATH_MAX} bytes')
+            files.append((path.encode(), full))
+    return sorted(files)
+
+
+def build(src):
+    files = collect(src)
+    offset = HDR.size + ENTRY.size * len(files)
+    index = b''
+    data = b''
+    for path, full in files:
+        with open(full, 'rb') as f:
+            content = f.read()
+        pad = (-(offset + len(data))) % 4
+        data += b'\0' * pad
+        index += ENTRY.pack(path, offset + len(data), len(content))
+        data += content
+    body = index + data
+    size = HDR.size + len(body)
+    fields = struct.pack('<IHHI', MAGIC, VERSION, len(files), size)
+    crc = zlib.crc32(body, zlib.crc32(fields))
+    return HDR.pack(MAGIC, VERSION, len(files), size, crc, 0) + body
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    image = build(sys.argv[1])
+    with open(sys.argv[2], 'wb') as f:
+        f.write(image)
+
+
+if __name__ == '__main__':
+    main()